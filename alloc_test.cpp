@@ -0,0 +1,266 @@
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <string>
+#include <vector>
+#include "src/btree_index/index.h"
+#include "src/factories/op_factory.h"
+#include "src/format/custom_struct.h"
+#include "fmt/format.h"
+
+/*
+    heap allocations per index operation. the global operator new of this binary counts
+    every allocation of the calling thread (background threads are not counted), each op
+    is measured alone. ops that do not change the page count (no split / merge / new root)
+    must not allocate in a memory or mmap index; the per-op figures of every mode are
+    printed, and bounded where the mode itself allocates (log records, copied pages).
+*/
+
+namespace {
+
+thread_local uint64_t thread_allocs = 0;
+
+auto CountedAlloc(std::size_t size) -> void* {
+    thread_allocs++;
+    if (auto ptr = std::malloc(size == 0 ? 1 : size); ptr != nullptr) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+auto CountedAlignedAlloc(std::size_t size, std::align_val_t align) -> void* {
+    thread_allocs++;
+    auto alignment = std::max(sizeof(void*), (std::size_t)align);
+    // aligned_alloc wants a size that is a multiple of the alignment
+    if (auto ptr = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment); ptr != nullptr) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+}
+
+void* operator new(std::size_t size) { return CountedAlloc(size); }
+void* operator new[](std::size_t size) { return CountedAlloc(size); }
+void* operator new(std::size_t size, std::align_val_t align) { return CountedAlignedAlloc(size, align); }
+void* operator new[](std::size_t size, std::align_val_t align) { return CountedAlignedAlloc(size, align); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+using namespace std;
+
+int constexpr ALLOC_TEST_NUM = 4000;
+
+enum class AllocOp : int { Insert, InsertSplit, InsertDuplicate, GetHit, GetMiss, Update, Remove, RemoveMerge };
+int constexpr ALLOC_OP_CNT = 8;
+array<const char*, ALLOC_OP_CNT> constexpr ALLOC_OP_NAMES = {
+    "insert", "insert (split)", "insert (duplicate)", "get (hit)", "get (miss)", "update", "remove", "remove (merge)",
+};
+
+struct AllocCounts {
+    array<uint64_t, ALLOC_OP_CNT> ops{};
+    array<uint64_t, ALLOC_OP_CNT> allocs{};
+
+    auto PerOp(AllocOp op) const -> double {
+        auto i = (int)op;
+        return this->ops[i] == 0 ? 0.0 : (double)this->allocs[i] / (double)this->ops[i];
+    }
+};
+
+using IndexT = Index<int, TestStructB, IntThreeWayCmper>;
+
+template<typename FnT>
+auto AllocsOf(FnT fn) -> uint64_t {
+    auto before = thread_allocs;
+    fn();
+    return thread_allocs - before;
+}
+
+auto PageCnt(IndexT& idx) -> size_t {
+    auto stats = idx.GetTreeStats();
+    return stats.leaf_pages + stats.inner_pages;
+}
+
+/*
+    1. warm up: first ops of a thread set up its latency shard
+    2. insert the even keys, then the odd ones, one op at a time
+    3. duplicate inserts, hit / miss gets, updates
+    4. remove every key
+*/
+auto CountAllocs(IndexT& idx) -> AllocCounts {
+    auto counts = AllocCounts{};
+    auto record = [&counts](AllocOp op, uint64_t allocs) {
+        counts.ops[(int)op]++;
+        counts.allocs[(int)op] += allocs;
+    };
+    auto val = TestStructB{};
+    // 1. warm up
+    idx.Insert(-1, val).Unwrap();
+    idx.Get(-1).Unwrap();
+    idx.Update(-1, val).Unwrap();
+    idx.Remove(-1).Unwrap();
+    // 2. insert
+    for (int round = 0; round < 2; round++) {
+        for (int i = round; i < 2 * ALLOC_TEST_NUM; i += 2) {
+            auto pages = PageCnt(idx);
+            val.score = i;
+            auto allocs = AllocsOf([&] { idx.Insert(i, val).Unwrap(); });
+            record(PageCnt(idx) == pages ? AllocOp::Insert : AllocOp::InsertSplit, allocs);
+        }
+    }
+    // 3. no structure change
+    for (int i = 0; i < 2 * ALLOC_TEST_NUM; i += 7) {
+        auto dup = Status{};
+        record(AllocOp::InsertDuplicate, AllocsOf([&] { dup = idx.Insert(i, val); }));
+        assert(dup.Code() == StatusCode::KeyDuplicate);
+        auto found = optional<TestStructB>{};
+        record(AllocOp::GetHit, AllocsOf([&] { found = idx.Get(i).Unwrap(); }));
+        assert(found.has_value() && found->score == i);
+        record(AllocOp::GetMiss, AllocsOf([&] { found = idx.Get(-i - 2).Unwrap(); }));
+        assert(!found.has_value());
+        val.score = -i;
+        record(AllocOp::Update, AllocsOf([&] { idx.Update(i, val).Unwrap(); }));
+    }
+    // 4. remove
+    for (int i = 0; i < 2 * ALLOC_TEST_NUM; i++) {
+        auto pages = PageCnt(idx);
+        auto allocs = AllocsOf([&] { idx.Remove(i).Unwrap(); });
+        record(PageCnt(idx) == pages ? AllocOp::Remove : AllocOp::RemoveMerge, allocs);
+    }
+    return counts;
+}
+
+void PrintCounts(const string& mode, const AllocCounts& counts) {
+    cout << fmt::format("\n\t{:<6} {:<20} {:>8} {:>8} {:>10}\n", "mode", "op", "ops", "allocs", "allocs/op");
+    for (int op = 0; op < ALLOC_OP_CNT; op++) {
+        cout << fmt::format("\t{:<6} {:<20} {:>8} {:>8} {:>10.2f}\n", mode, ALLOC_OP_NAMES[op], counts.ops[op],
+            counts.allocs[op], counts.PerOp((AllocOp)op));
+    }
+}
+
+int main() {
+    cout << "\n\n============ START CHECKING BTREE INDEX ALLOCATIONS ==================\n";
+    auto dir = filesystem::temp_directory_path();
+
+    cout << "\n\n-----Running [ALLOC MEMORY] Check On Btree Index...--------\n";
+    {
+        auto idx = IndexT::create();
+        auto counts = CountAllocs(*idx);
+        PrintCounts("memory", counts);
+        assert(counts.ops[(int)AllocOp::InsertSplit] > 0 && counts.ops[(int)AllocOp::RemoveMerge] > 0);
+        // fast paths: nothing on the heap unless a page is created
+        assert(counts.allocs[(int)AllocOp::Insert] == 0);
+        assert(counts.allocs[(int)AllocOp::InsertDuplicate] == 0);
+        assert(counts.allocs[(int)AllocOp::GetHit] == 0);
+        assert(counts.allocs[(int)AllocOp::GetMiss] == 0);
+        assert(counts.allocs[(int)AllocOp::Update] == 0);
+        assert(counts.allocs[(int)AllocOp::Remove] == 0);
+        // a split allocates its new page (or two, with a new root)
+        assert(counts.PerOp(AllocOp::InsertSplit) <= 4.0);
+    }
+    cout << "\n\n\t\t [ALLOC MEMORY] Check Passed! \n";
+
+    cout << "\n\n-----Running [ALLOC MMAP] Check On Btree Index...--------\n";
+    {
+        auto mmap_options = MmapOptions{(dir / "btree_alloc_test.mmap").string()};
+        filesystem::remove(mmap_options.path);
+        auto idx = IndexT::open(mmap_options).Unwrap();
+        auto counts = CountAllocs(*idx);
+        PrintCounts("mmap", counts);
+        assert(counts.allocs[(int)AllocOp::Insert] == 0);
+        assert(counts.allocs[(int)AllocOp::GetHit] == 0);
+        assert(counts.allocs[(int)AllocOp::GetMiss] == 0);
+        assert(counts.allocs[(int)AllocOp::Update] == 0);
+        assert(counts.allocs[(int)AllocOp::Remove] == 0);
+        idx.reset();
+        filesystem::remove(mmap_options.path);
+    }
+    cout << "\n\n\t\t [ALLOC MMAP] Check Passed! \n";
+
+    cout << "\n\n-----Running [ALLOC WAL] Check On Btree Index...--------\n";
+    {
+        auto wal_options = WalOptions{(dir / "btree_alloc_test.wal").string(), WalSyncMode::None};
+        filesystem::remove(wal_options.path);
+        auto idx = IndexT::open(wal_options).Unwrap();
+        auto counts = CountAllocs(*idx);
+        PrintCounts("wal", counts);
+        // reads never touch the log
+        assert(counts.allocs[(int)AllocOp::GetHit] == 0);
+        assert(counts.allocs[(int)AllocOp::GetMiss] == 0);
+        assert(counts.allocs[(int)AllocOp::InsertDuplicate] == 0);
+        // writes only allocate when the log buffer grows
+        assert(counts.PerOp(AllocOp::Insert) < 0.05);
+        assert(counts.PerOp(AllocOp::Update) < 0.05);
+        assert(counts.PerOp(AllocOp::Remove) < 0.05);
+        idx.reset();
+        filesystem::remove(wal_options.path);
+    }
+    cout << "\n\n\t\t [ALLOC WAL] Check Passed! \n";
+
+    cout << "\n\n-----Running [ALLOC SHADOW] Check On Btree Index...--------\n";
+    {
+        auto shadow_options = ShadowOptions{(dir / "btree_alloc_test.shadow").string(), false};
+        filesystem::remove(shadow_options.path);
+        auto idx = IndexT::open(shadow_options).Unwrap();
+        auto counts = CountAllocs(*idx);
+        PrintCounts("cow", counts);
+        // pinned versions are shared, reads copy nothing
+        assert(counts.allocs[(int)AllocOp::GetHit] == 0);
+        assert(counts.allocs[(int)AllocOp::GetMiss] == 0);
+        // a write copies its path and builds a txn, bounded by the (small) height
+        assert(counts.PerOp(AllocOp::Insert) < 32.0);
+        assert(counts.PerOp(AllocOp::Update) < 32.0);
+        assert(counts.PerOp(AllocOp::Remove) < 32.0);
+        idx.reset();
+        filesystem::remove(shadow_options.path);
+    }
+    cout << "\n\n\t\t [ALLOC SHADOW] Check Passed! \n";
+
+    cout << "\n\n-----Running [ALLOC BATCH] Check On Btree Index...--------\n";
+    {
+        auto idx = IndexT::create();
+        auto val = TestStructB{};
+        for (int i = 0; i < ALLOC_TEST_NUM; i++) {
+            idx->Insert(i, val).Unwrap();
+        }
+        auto factory = IndexOpFactory<int, TestStructB, IntThreeWayCmper>{};
+        auto batch = factory.make_batch(ALLOC_TEST_NUM);
+        auto got = vector<optional<TestStructB>>(ALLOC_TEST_NUM);
+        auto fill = [&] {
+            batch.Clear();
+            for (int i = 0; i < ALLOC_TEST_NUM; i++) {
+                auto k = (i * 7919) % ALLOC_TEST_NUM;
+                if (i % 2 == 0) {
+                    batch.Add<OPTYPE::UPDATE>(k, val);
+                } else {
+                    batch.Add<OPTYPE::GET>(k, got[i]);
+                }
+            }
+        };
+        // the first run grows the MultiGet buffers
+        fill();
+        [[maybe_unused]] auto failed = batch.Run(*idx);
+        assert(failed == 0);
+        auto allocs = AllocsOf([&] {
+            fill();
+            [[maybe_unused]] auto failed = batch.Run(*idx);
+            assert(failed == 0);
+        });
+        cout << fmt::format("\n\t{} ops, {} allocs\n", ALLOC_TEST_NUM, allocs);
+        assert(allocs == 0);
+    }
+    cout << "\n\n\t\t [ALLOC BATCH] Check Passed! \n";
+
+    cout << "\n\n =============CHECK RESULT: All Check Passed!==============\n\n" << endl;
+}
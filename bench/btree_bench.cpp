@@ -0,0 +1,455 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <latch>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "src/btree_index/index.h"
+#include "src/format/custom_struct.h"
+#include "fmt/format.h"
+#include "generators.h"
+
+/*
+    YCSB core workloads A-F against one Index.
+    load phase inserts keys [0, keys) in shuffled order, run phase spreads ops over
+    the threads. one JSON object per workload goes to stdout (an array for several),
+    progress to stderr.
+
+    usage: btree_bench [--workloads=ABCDEF] [--distribution=zipfian|uniform|latest]
+        [--keys=100000] [--ops=100000] [--threads=1] [--value-size=100] [--page-size=4096]
+        [--mode=memory|wal|cow|mmap] [--sync=perop|periodic|none] [--dir=<tmp>]
+        [--max-scan=100] [--seed=42]
+*/
+
+namespace {
+
+enum class OpKind : int { Read, Update, Insert, Scan, ReadModifyWrite };
+int constexpr OP_KIND_CNT = 5;
+std::array<const char*, OP_KIND_CNT> constexpr OP_KIND_NAMES = {"read", "update", "insert", "scan", "read_modify_write"};
+
+enum class Distribution : int { Zipfian, Uniform, Latest };
+std::array<const char*, 3> constexpr DISTRIBUTION_NAMES = {"zipfian", "uniform", "latest"};
+
+struct Workload {
+    char name;
+    // share of each OpKind, sums to 1
+    std::array<double, OP_KIND_CNT> mix;
+    Distribution distribution;
+};
+
+// the YCSB core workload definitions
+std::array<Workload, 6> constexpr WORKLOADS = {
+    // update heavy
+    Workload{'A', {0.5, 0.5, 0.0, 0.0, 0.0}, Distribution::Zipfian},
+    // read mostly
+    Workload{'B', {0.95, 0.05, 0.0, 0.0, 0.0}, Distribution::Zipfian},
+    // read only
+    Workload{'C', {1.0, 0.0, 0.0, 0.0, 0.0}, Distribution::Zipfian},
+    // read latest
+    Workload{'D', {0.95, 0.0, 0.05, 0.0, 0.0}, Distribution::Latest},
+    // short ranges
+    Workload{'E', {0.0, 0.0, 0.05, 0.95, 0.0}, Distribution::Zipfian},
+    // read-modify-write
+    Workload{'F', {0.5, 0.0, 0.0, 0.0, 0.5}, Distribution::Zipfian},
+};
+
+struct BenchOptions {
+    std::string workloads{"ABCDEF"};
+    // overrides the distribution of the workload
+    std::optional<Distribution> distribution;
+    uint64_t keys{100000};
+    uint64_t ops{100000};
+    int threads{1};
+    size_t value_size{100};
+    size_t page_size{BTREE_PAGE_SIZE};
+    std::string mode{"memory"};
+    WalSyncMode sync{WalSyncMode::Periodic};
+    std::string dir{std::filesystem::temp_directory_path().string()};
+    int max_scan{100};
+    uint64_t seed{42};
+};
+
+template<size_t Size>
+struct BenchValue {
+    std::array<char, Size> bytes;
+};
+
+struct ThreadResult {
+    std::array<std::vector<uint64_t>, OP_KIND_CNT> latencies_ns;
+    uint64_t not_found{0};
+};
+
+auto Usage() -> int {
+    std::cerr << "usage: btree_bench [--workloads=ABCDEF] [--distribution=zipfian|uniform|latest]\n"
+        "    [--keys=N] [--ops=N] [--threads=N] [--value-size=16|100|800|1000] [--page-size=4096|16384]\n"
+        "    [--mode=memory|wal|cow|mmap] [--sync=perop|periodic|none] [--dir=PATH] [--max-scan=N] [--seed=N]\n"
+        "    1000 byte values need --page-size=16384\n";
+    return 1;
+}
+
+auto ParseArgs(int argc, char** argv, BenchOptions& options) -> bool {
+    for (int i = 1; i < argc; i++) {
+        auto arg = std::string(argv[i]);
+        auto eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            return false;
+        }
+        auto name = arg.substr(2, eq - 2);
+        auto val = arg.substr(eq + 1);
+        try {
+            if (name == "workloads") {
+                options.workloads = val;
+            } else if (name == "distribution") {
+                auto res = std::find(DISTRIBUTION_NAMES.begin(), DISTRIBUTION_NAMES.end(), val);
+                if (res == DISTRIBUTION_NAMES.end()) {
+                    return false;
+                }
+                options.distribution = (Distribution)(res - DISTRIBUTION_NAMES.begin());
+            } else if (name == "keys") {
+                options.keys = std::stoull(val);
+            } else if (name == "ops") {
+                options.ops = std::stoull(val);
+            } else if (name == "threads") {
+                options.threads = std::stoi(val);
+            } else if (name == "value-size") {
+                options.value_size = std::stoull(val);
+            } else if (name == "page-size") {
+                options.page_size = std::stoull(val);
+            } else if (name == "mode") {
+                options.mode = val;
+            } else if (name == "sync") {
+                if (val == "perop") {
+                    options.sync = WalSyncMode::PerOp;
+                } else if (val == "periodic") {
+                    options.sync = WalSyncMode::Periodic;
+                } else if (val == "none") {
+                    options.sync = WalSyncMode::None;
+                } else {
+                    return false;
+                }
+            } else if (name == "dir") {
+                options.dir = val;
+            } else if (name == "max-scan") {
+                options.max_scan = std::stoi(val);
+            } else if (name == "seed") {
+                options.seed = std::stoull(val);
+            } else {
+                return false;
+            }
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    auto known_mode = options.mode == "memory" || options.mode == "wal" || options.mode == "cow" || options.mode == "mmap";
+    return known_mode && options.keys > 0 && options.keys < (uint64_t)INT32_MAX / 2 && options.threads > 0
+        && options.max_scan > 0;
+}
+
+// nearest rank
+auto Percentile(const std::vector<uint64_t>& sorted, double p) -> double {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    auto rank = (size_t)std::ceil(p * (double)sorted.size());
+    return (double)sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1] / 1000.0;
+}
+
+auto LatencyJson(std::vector<uint64_t>& latencies_ns) -> std::string {
+    std::sort(latencies_ns.begin(), latencies_ns.end());
+    auto sum = std::accumulate(latencies_ns.begin(), latencies_ns.end(), 0.0);
+    auto mean = latencies_ns.empty() ? 0.0 : sum / (double)latencies_ns.size() / 1000.0;
+    return fmt::format(R"({{"mean": {:.3f}, "p50": {:.3f}, "p90": {:.3f}, "p99": {:.3f}, "p999": {:.3f}, "max": {:.3f}}})",
+        mean, Percentile(latencies_ns, 0.5), Percentile(latencies_ns, 0.9), Percentile(latencies_ns, 0.99),
+        Percentile(latencies_ns, 0.999), Percentile(latencies_ns, 1.0));
+}
+
+template<typename IndexT>
+class BenchRunner {
+    using ValueT = typename std::remove_cvref_t<decltype(std::declval<IndexT>().Get(0).Unwrap().value())>;
+public:
+    BenchRunner(const BenchOptions& options, const Workload& workload): options(options), workload(workload),
+        distribution(options.distribution.value_or(workload.distribution)),
+        uniform(options.keys), zipfian(options.keys), latest(options.keys), next_key(options.keys),
+        newest_key(options.keys - 1) {}
+
+    auto Run() -> std::string {
+        /*
+            1. open a fresh index in the chosen mode
+            2. load: keys [0, keys) in shuffled order, split over the threads
+            3. run: ops split over the threads, each op timed on its own
+            4. report
+        */
+        // 1. open
+        auto paths = std::vector<std::string>{};
+        this->idx = Open(paths);
+        // 2. load
+        auto keys = std::vector<int>(this->options.keys);
+        std::iota(keys.begin(), keys.end(), 0);
+        std::shuffle(keys.begin(), keys.end(), std::mt19937_64(this->options.seed));
+        auto load_seconds = Parallel([this, &keys](int thread_id, ThreadResult&) {
+            for (size_t i = thread_id; i < keys.size(); i += this->options.threads) {
+                this->idx->Insert(keys[i], MakeValue(keys[i])).Unwrap();
+            }
+        }).first;
+        std::cerr << fmt::format("workload {}: loaded {} keys in {:.2f}s\n", this->workload.name, keys.size(), load_seconds);
+        // 3. run
+        auto [run_seconds, results] = Parallel([this](int thread_id, ThreadResult& result) {
+            RunOps(thread_id, result);
+        });
+        std::cerr << fmt::format("workload {}: ran {} ops in {:.2f}s\n", this->workload.name, this->options.ops, run_seconds);
+        this->idx.reset();
+        for (auto& path : paths) {
+            std::filesystem::remove(path);
+        }
+        // 4. report
+        auto op_jsons = std::vector<std::string>{};
+        uint64_t not_found = 0;
+        for (int kind = 0; kind < OP_KIND_CNT; kind++) {
+            auto merged = std::vector<uint64_t>{};
+            for (auto& result : results) {
+                merged.insert(merged.end(), result.latencies_ns[kind].begin(), result.latencies_ns[kind].end());
+            }
+            if (merged.empty()) {
+                continue;
+            }
+            op_jsons.push_back(fmt::format(R"("{}": {{"count": {}, "ops_per_sec": {:.1f}, "latency_us": {}}})",
+                OP_KIND_NAMES[kind], merged.size(), (double)merged.size() / run_seconds, LatencyJson(merged)));
+        }
+        for (auto& result : results) {
+            not_found += result.not_found;
+        }
+        return fmt::format(R"({{"workload": "{}", "distribution": "{}", "mode": "{}", "keys": {}, "ops": {}, )"
+            R"("threads": {}, "value_size": {}, "page_size": {}, )"
+            R"("load": {{"seconds": {:.3f}, "ops_per_sec": {:.1f}}}, "run": {{"seconds": {:.3f}, "ops_per_sec": {:.1f}, )"
+            R"("not_found": {}}}, "operations": {{{}}}}})",
+            this->workload.name, DISTRIBUTION_NAMES[(int)this->distribution], this->options.mode, this->options.keys,
+            this->options.ops, this->options.threads, sizeof(ValueT), this->options.page_size,
+            load_seconds, (double)this->options.keys / load_seconds, run_seconds, (double)this->options.ops / run_seconds,
+            not_found, fmt::join(op_jsons, ", "));
+    }
+
+private:
+    auto Open(std::vector<std::string>& paths) -> std::shared_ptr<IndexT> {
+        auto base = (std::filesystem::path(this->options.dir) / fmt::format("btree_bench_{}", this->workload.name)).string();
+        if (this->options.mode == "wal") {
+            auto wal_options = WalOptions{base + ".wal", this->options.sync};
+            auto ckpt_options = CheckpointOptions{base + ".pages"};
+            paths = {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt"};
+            RemoveAll(paths);
+            return IndexT::open(wal_options, ckpt_options).Unwrap();
+        }
+        if (this->options.mode == "cow") {
+            auto shadow_options = ShadowOptions{base + ".shadow", this->options.sync != WalSyncMode::None};
+            paths = {shadow_options.path};
+            RemoveAll(paths);
+            return IndexT::open(shadow_options).Unwrap();
+        }
+        if (this->options.mode == "mmap") {
+            auto mmap_options = MmapOptions{base + ".mmap"};
+            paths = {mmap_options.path};
+            RemoveAll(paths);
+            return IndexT::open(mmap_options).Unwrap();
+        }
+        return IndexT::create();
+    }
+
+    static void RemoveAll(const std::vector<std::string>& paths) {
+        for (auto& path : paths) {
+            std::filesystem::remove(path);
+        }
+    }
+
+    static auto MakeValue(uint64_t seed) -> ValueT {
+        auto val = ValueT{};
+        for (size_t i = 0; i < val.bytes.size(); i++) {
+            val.bytes[i] = (char)('a' + (seed + i) % 26);
+        }
+        return val;
+    }
+
+    // fn(thread_id, result) on every thread, wall time from the common start
+    template<typename FnT>
+    auto Parallel(FnT fn) -> std::pair<double, std::vector<ThreadResult>> {
+        auto results = std::vector<ThreadResult>(this->options.threads);
+        auto start_line = std::latch(this->options.threads + 1);
+        auto threads = std::vector<std::thread>{};
+        for (int i = 0; i < this->options.threads; i++) {
+            threads.emplace_back([&fn, &results, &start_line, i] {
+                start_line.arrive_and_wait();
+                fn(i, results[i]);
+            });
+        }
+        auto start = std::chrono::steady_clock::now();
+        start_line.arrive_and_wait();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return {std::max(seconds, 1e-9), std::move(results)};
+    }
+
+    auto NextKey(std::mt19937_64& rng) -> int {
+        switch (this->distribution) {
+            case Distribution::Zipfian:
+                return (int)this->zipfian.Next(rng);
+            case Distribution::Uniform:
+                return (int)this->uniform.Next(rng);
+            case Distribution::Latest:
+                return (int)this->latest.Next(rng, this->newest_key.load(std::memory_order_relaxed));
+        }
+        std::cout << "should not reach here!\n";
+        exit(-1);
+    }
+
+    auto PickOp(std::mt19937_64& rng) const -> OpKind {
+        auto u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        for (int kind = 0; kind < OP_KIND_CNT; kind++) {
+            if (u < this->workload.mix[kind]) {
+                return (OpKind)kind;
+            }
+            u -= this->workload.mix[kind];
+        }
+        return OpKind::Read;
+    }
+
+    void RunOps(int thread_id, ThreadResult& result) {
+        auto rng = std::mt19937_64(this->options.seed + 1 + thread_id);
+        auto op_cnt = this->options.ops / this->options.threads + (thread_id < (int)(this->options.ops % this->options.threads));
+        for (auto& latencies : result.latencies_ns) {
+            latencies.reserve(op_cnt);
+        }
+        for (uint64_t i = 0; i < op_cnt; i++) {
+            auto kind = PickOp(rng);
+            auto start = std::chrono::steady_clock::now();
+            switch (kind) {
+                case OpKind::Read: {
+                    result.not_found += !this->idx->Get(NextKey(rng)).Unwrap().has_value();
+                    break;
+                }
+                case OpKind::Update: {
+                    auto key = NextKey(rng);
+                    this->idx->Update(key, MakeValue(key + i)).Unwrap();
+                    break;
+                }
+                case OpKind::Insert: {
+                    auto key = this->next_key.fetch_add(1, std::memory_order_relaxed);
+                    this->idx->Insert((int)key, MakeValue(key)).Unwrap();
+                    // readers of the latest keys see it from now on
+                    auto newest = this->newest_key.load(std::memory_order_relaxed);
+                    while (newest < key && !this->newest_key.compare_exchange_weak(newest, key)) {}
+                    break;
+                }
+                case OpKind::Scan: {
+                    // no cursor in the index: a scan is a run of lookups of consecutive keys
+                    auto first = NextKey(rng);
+                    auto len = std::uniform_int_distribution<int>(1, this->options.max_scan)(rng);
+                    for (int key = first; key < first + len; key++) {
+                        result.not_found += !this->idx->Get(key).Unwrap().has_value();
+                    }
+                    break;
+                }
+                case OpKind::ReadModifyWrite: {
+                    auto key = NextKey(rng);
+                    auto val = this->idx->Get(key).Unwrap();
+                    if (!val.has_value()) {
+                        result.not_found++;
+                        break;
+                    }
+                    val->bytes[0] = (char)('a' + i % 26);
+                    this->idx->Update(key, *val).Unwrap();
+                    break;
+                }
+            }
+            auto latency = std::chrono::steady_clock::now() - start;
+            result.latencies_ns[(int)kind].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+        }
+    }
+
+    const BenchOptions& options;
+    const Workload& workload;
+    Distribution distribution;
+    UniformGenerator uniform;
+    ScrambledZipfianGenerator zipfian;
+    LatestGenerator latest;
+    std::shared_ptr<IndexT> idx;
+    std::atomic<uint64_t> next_key;
+    std::atomic<uint64_t> newest_key;
+};
+
+template<size_t ValueSize, size_t PageSize>
+auto RunWorkload(const BenchOptions& options, const Workload& workload) -> std::optional<std::string> {
+    using IndexT = Index<int, BenchValue<ValueSize>, IntThreeWayCmper, NoAggregate, PageSize>;
+    // too few values fit a page to split it
+    if constexpr (!IndexT::FITS_PAGE) {
+        return {};
+    } else {
+        return BenchRunner<IndexT>(options, workload).Run();
+    }
+}
+
+template<size_t ValueSize>
+auto DispatchPageSize(const BenchOptions& options, const Workload& workload) -> std::optional<std::string> {
+    switch (options.page_size) {
+        case 4096:
+            return RunWorkload<ValueSize, 4096>(options, workload);
+        case 16384:
+            return RunWorkload<ValueSize, 16384>(options, workload);
+        default:
+            return {};
+    }
+}
+
+// values and pages are compile time sizes, the supported ones are instantiated here
+auto Dispatch(const BenchOptions& options, const Workload& workload) -> std::optional<std::string> {
+    switch (options.value_size) {
+        case 16:
+            return DispatchPageSize<16>(options, workload);
+        case 100:
+            return DispatchPageSize<100>(options, workload);
+        case 800:
+            return DispatchPageSize<800>(options, workload);
+        case 1000:
+            return DispatchPageSize<1000>(options, workload);
+        default:
+            return {};
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    auto options = BenchOptions{};
+    if (!ParseArgs(argc, argv, options)) {
+        return Usage();
+    }
+    auto jsons = std::vector<std::string>{};
+    for (auto name : options.workloads) {
+        auto workload = std::find_if(WORKLOADS.begin(), WORKLOADS.end(), [name](const Workload& w) {
+            return w.name == std::toupper(name);
+        });
+        if (workload == WORKLOADS.end()) {
+            return Usage();
+        }
+        auto json = Dispatch(options, *workload);
+        if (!json.has_value()) {
+            return Usage();
+        }
+        jsons.push_back(std::move(*json));
+    }
+    if (jsons.size() == 1) {
+        std::cout << jsons[0] << "\n";
+    } else {
+        std::cout << fmt::format("[\n{}\n]\n", fmt::join(jsons, ",\n"));
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+/*
+    key choosers of the YCSB core workloads, all pick an item in [0, items).
+    one generator is shared by the threads (read only after construction),
+    each thread brings its own rng.
+*/
+
+class UniformGenerator {
+public:
+    explicit UniformGenerator(uint64_t items): items(items) {}
+    auto Next(std::mt19937_64& rng) const -> uint64_t {
+        return std::uniform_int_distribution<uint64_t>(0, this->items - 1)(rng);
+    }
+
+private:
+    uint64_t items;
+};
+
+/*
+    item i is picked with probability proportional to 1 / (i + 1)^theta, small items
+    are hot. Gray et al., "Quickly Generating Billion-Record Synthetic Databases",
+    the same computation YCSB does
+*/
+class ZipfianGenerator {
+public:
+    static double constexpr YCSB_THETA = 0.99;
+
+    explicit ZipfianGenerator(uint64_t items, double theta = YCSB_THETA):
+        items(items), theta(theta), zeta_2(Zeta(2, theta)), zeta_n(Zeta(items, theta)) {
+        this->alpha = 1.0 / (1.0 - theta);
+        this->eta = (1.0 - std::pow(2.0 / (double)items, 1.0 - theta)) / (1.0 - this->zeta_2 / this->zeta_n);
+    }
+    auto Next(std::mt19937_64& rng) const -> uint64_t {
+        auto u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        auto uz = u * this->zeta_n;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + std::pow(0.5, this->theta)) {
+            return 1;
+        }
+        auto item = (uint64_t)((double)this->items * std::pow(this->eta * u - this->eta + 1.0, this->alpha));
+        return item < this->items ? item : this->items - 1;
+    }
+
+private:
+    static auto Zeta(uint64_t n, double theta) -> double {
+        auto sum = 0.0;
+        for (uint64_t i = 1; i <= n; i++) {
+            sum += 1.0 / std::pow((double)i, theta);
+        }
+        return sum;
+    }
+
+    uint64_t items;
+    double theta;
+    double zeta_2;
+    double zeta_n;
+    double alpha;
+    double eta;
+};
+
+/*
+    zipfian popularity, hot items spread over the whole key space instead of
+    clustering at its start (FNV-1a of the zipfian item)
+*/
+class ScrambledZipfianGenerator {
+public:
+    explicit ScrambledZipfianGenerator(uint64_t items): items(items), zipf(items) {}
+    auto Next(std::mt19937_64& rng) const -> uint64_t {
+        return Fnv1a(this->zipf.Next(rng)) % this->items;
+    }
+
+private:
+    static auto Fnv1a(uint64_t val) -> uint64_t {
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        for (int i = 0; i < 8; i++) {
+            hash ^= val & 0xFF;
+            hash *= 0x100000001B3ULL;
+            val >>= 8;
+        }
+        return hash;
+    }
+
+    uint64_t items;
+    ZipfianGenerator zipf;
+};
+
+/*
+    the most recently inserted items are hot: zipfian distance back from the newest one
+*/
+class LatestGenerator {
+public:
+    explicit LatestGenerator(uint64_t items): zipf(items) {}
+    // newest: the last inserted item
+    auto Next(std::mt19937_64& rng, uint64_t newest) const -> uint64_t {
+        auto back = this->zipf.Next(rng);
+        return back > newest ? 0 : newest - back;
+    }
+
+private:
+    ZipfianGenerator zipf;
+};
@@ -0,0 +1,514 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <random>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "src/btree_index/index.h"
+#include "src/format/custom_struct.h"
+
+/*
+    microbenchmarks of the page primitives the tree runs in its inner loops.
+    page benchmarks are templated on key / value size (4 byte keys are ints,
+    wider ones compare with memcmp), lookups and in-page moves also on page
+    fill (percent of the slots). a mutating op always starts from the same
+    page state: pages are restored from a prepared image every BATCH ops with
+    the timer paused. besides ns/op every benchmark reports bytes_per_op, the
+    bytes the primitive copies (shifted slots, copied values) or scans.
+    BM_IndexGet / BM_IndexMultiGet compare lookups one by one with interleaved
+    batches on whole trees, one small enough for the cache and one larger than it.
+
+    run: ./page_bench [--benchmark_filter=Leaf] [--benchmark_format=json]
+*/
+
+namespace {
+
+int constexpr BATCH = 256;
+int constexpr KEY_POOL = 4096;
+
+// id stored big-endian at the front, memcmp order is id order
+template<size_t Size>
+struct BenchKey {
+    std::array<unsigned char, Size> bytes;
+};
+
+template<size_t Size>
+struct BenchKeyCmp {
+    auto operator()(const BenchKey<Size>& a, const BenchKey<Size>& b) -> int {
+        auto res = std::memcmp(a.bytes.data(), b.bytes.data(), Size);
+        return (res > 0) - (res < 0);
+    }
+};
+
+template<size_t Size>
+struct BenchValue {
+    std::array<char, Size> bytes;
+};
+
+template<size_t KeySize, size_t ValueSize>
+struct Layout {
+    using KeyT = std::conditional_t<KeySize == sizeof(int), int, BenchKey<KeySize>>;
+    using CmpT = std::conditional_t<KeySize == sizeof(int), IntThreeWayCmper, BenchKeyCmp<KeySize>>;
+    using ValueT = BenchValue<ValueSize>;
+    using LeafT = LeafPage<KeyT, ValueT, CmpT>;
+    using InternalT = InternalPage<KeyT, ValueT, int, CmpT>;
+    static size_t constexpr SLOT_BYTES = sizeof(KeyT) + sizeof(ValueT);
+
+    // slot counts are private to the pages, read them from an initialized one
+    static auto LeafMax() -> int {
+        auto page = Page(BTREE_PAGE_SIZE);
+        reinterpret_cast<LeafT*>(page.data())->Init();
+        return reinterpret_cast<LeafT*>(page.data())->GetMaxSize();
+    }
+    static auto InternalMax() -> int {
+        auto page = Page(BTREE_PAGE_SIZE);
+        reinterpret_cast<InternalT*>(page.data())->Init();
+        return reinterpret_cast<InternalT*>(page.data())->GetMaxSize();
+    }
+
+    static auto Key(int id) -> KeyT {
+        if constexpr (KeySize == sizeof(int)) {
+            return id;
+        } else {
+            auto key = KeyT{};
+            for (int i = 0; i < 4; i++) {
+                key.bytes[i] = (unsigned char)(id >> (8 * (3 - i)));
+            }
+            return key;
+        }
+    }
+    static auto Value(int id) -> ValueT {
+        auto val = ValueT{};
+        std::fill(val.bytes.begin(), val.bytes.end(), (char)id);
+        return val;
+    }
+};
+
+// page table bound to the benchmark thread
+struct PageEnv {
+    PageStore store{PoolOptions{}};
+    RawPageMgr::Scope scope{&store, false};
+};
+
+auto FillCnt(int max_size, int64_t fill_pct) -> int {
+    // below max_size - 1: one more insert never splits
+    return std::clamp((int)(max_size * fill_pct / 100), 2, max_size - 2);
+}
+
+auto KeyIds(int lo, int hi, uint64_t seed) -> std::vector<int> {
+    auto rng = std::mt19937_64(seed);
+    auto ids = std::vector<int>(KEY_POOL);
+    for (auto& id : ids) {
+        id = std::uniform_int_distribution<int>(lo, hi)(rng);
+    }
+    return ids;
+}
+
+auto BTreePageOf(const std::shared_ptr<Page>& page) -> int {
+    return reinterpret_cast<const BTreePage*>(page->data())->GetPageId();
+}
+
+// leaf holding the even ids 0, 2, .. 2 * (cnt - 1)
+template<typename L>
+auto BuildLeaf(int cnt, int first_id = 0) -> std::shared_ptr<Page> {
+    auto page = RawPageMgr::create();
+    auto& leaf = *reinterpret_cast<typename L::LeafT*>(page->data());
+    leaf.Init();
+    auto split_info = SplitInfo<typename L::KeyT, typename L::ValueT>{};
+    for (int i = 0; i < cnt; i++) {
+        leaf.Insert(L::Key(first_id + 2 * i), L::Value(i), split_info).Unwrap();
+    }
+    return page;
+}
+
+// inner page with cnt children (empty leaves), separator ids 2, 4, .. 2 * (cnt - 1)
+template<typename L>
+auto BuildInternal(int cnt) -> std::shared_ptr<Page> {
+    auto children = std::vector<int>{};
+    for (int i = 0; i < cnt; i++) {
+        children.push_back(BTreePageOf(BuildLeaf<L>(0)));
+    }
+    auto page = RawPageMgr::create();
+    auto& inner = *reinterpret_cast<typename L::InternalT*>(page->data());
+    inner.Init();
+    inner.SetInitialState({L::Key(2), L::Value(2)}, children[0], children[1]);
+    auto split_info = SplitInfo<typename L::KeyT, typename L::ValueT>{};
+    for (int i = 2; i < cnt; i++) {
+        inner.Insert(L::Key(2 * i), L::Value(2 * i), children[i], split_info).Unwrap();
+    }
+    return page;
+}
+
+// copies of a page image, restored every BATCH ops with the timer paused
+class PageCopies {
+public:
+    explicit PageCopies(const Page& image): image(image), copies(BATCH, image) {}
+    template<typename PageT>
+    auto Next(benchmark::State& state) -> PageT& {
+        if (this->used == BATCH) {
+            state.PauseTiming();
+            for (auto& copy : this->copies) {
+                std::memcpy(copy.data(), this->image.data(), this->image.size());
+            }
+            this->used = 0;
+            state.ResumeTiming();
+        }
+        return *reinterpret_cast<PageT*>(this->copies[this->used++].data());
+    }
+
+private:
+    const Page& image;
+    std::vector<Page> copies;
+    int used{0};
+};
+
+void ReportBytes(benchmark::State& state, double bytes) {
+    state.SetBytesProcessed((int64_t)bytes);
+    state.counters["bytes_per_op"] = benchmark::Counter(bytes, benchmark::Counter::kAvgIterations);
+}
+
+template<size_t KeySize, size_t ValueSize>
+void BM_LeafGet(benchmark::State& state) {
+    using L = Layout<KeySize, ValueSize>;
+    auto env = PageEnv{};
+    auto page = BuildLeaf<L>(FillCnt(L::LeafMax(), state.range(0)));
+    auto& leaf = *reinterpret_cast<typename L::LeafT*>(page->data());
+    auto ids = KeyIds(0, leaf.GetSize() - 1, 1);
+    auto result = typename L::ValueT{};
+    size_t i = 0;
+    for (auto _ : state) {
+        auto res = leaf.Get(L::Key(2 * ids[i++ % KEY_POOL]), result);
+        benchmark::DoNotOptimize(res);
+        benchmark::DoNotOptimize(result);
+    }
+    ReportBytes(state, (double)state.iterations() * sizeof(typename L::ValueT));
+}
+
+template<size_t KeySize, size_t ValueSize>
+void BM_LeafInsert(benchmark::State& state) {
+    using L = Layout<KeySize, ValueSize>;
+    auto env = PageEnv{};
+    auto image = BuildLeaf<L>(FillCnt(L::LeafMax(), state.range(0)));
+    auto size = reinterpret_cast<typename L::LeafT*>(image->data())->GetSize();
+    // odd ids fall between the stored ones, id 2k+1 lands at slot k + 1
+    auto ids = KeyIds(0, size - 1, 2);
+    auto copies = PageCopies(*image);
+    auto split_info = SplitInfo<typename L::KeyT, typename L::ValueT>{};
+    double bytes = 0;
+    size_t i = 0;
+    for (auto _ : state) {
+        auto id = ids[i++ % KEY_POOL];
+        auto res = copies.template Next<typename L::LeafT>(state).Insert(L::Key(2 * id + 1), L::Value(id), split_info);
+        benchmark::DoNotOptimize(res);
+        bytes += (double)(size - id) * L::SLOT_BYTES;
+    }
+    ReportBytes(state, bytes);
+}
+
+template<size_t KeySize, size_t ValueSize>
+void BM_LeafRemove(benchmark::State& state) {
+    using L = Layout<KeySize, ValueSize>;
+    auto env = PageEnv{};
+    auto image = BuildLeaf<L>(FillCnt(L::LeafMax(), state.range(0)));
+    auto size = reinterpret_cast<typename L::LeafT*>(image->data())->GetSize();
+    auto ids = KeyIds(0, size - 1, 3);
+    auto copies = PageCopies(*image);
+    auto no_parent = std::shared_ptr<Page>{};
+    auto merged_key = typename L::KeyT{};
+    double bytes = 0;
+    size_t i = 0;
+    for (auto _ : state) {
+        auto id = ids[i++ % KEY_POOL];
+        // as root: no underflow handling, the in-page remove only
+        auto res = copies.template Next<typename L::LeafT>(state).Remove(L::Key(2 * id), no_parent, merged_key, true);
+        benchmark::DoNotOptimize(res);
+        bytes += (double)(size - id - 1) * L::SLOT_BYTES;
+    }
+    ReportBytes(state, bytes);
+}
+
+template<size_t KeySize, size_t ValueSize>
+void BM_LeafSplit(benchmark::State& state) {
+    using L = Layout<KeySize, ValueSize>;
+    auto env = PageEnv{};
+    auto max_size = L::LeafMax();
+    // one insert short of max_size: the next one splits
+    auto image = BuildLeaf<L>(max_size - 1);
+    auto copies = PageCopies(*image);
+    auto split_info = SplitInfo<typename L::KeyT, typename L::ValueT>{};
+    auto new_pids = std::vector<int>{};
+    auto ids = KeyIds(0, max_size - 2, 4);
+    size_t i = 0;
+    for (auto _ : state) {
+        auto id = ids[i++ % KEY_POOL];
+        auto res = copies.template Next<typename L::LeafT>(state).Insert(L::Key(2 * id + 1), L::Value(id), split_info);
+        benchmark::DoNotOptimize(res);
+        new_pids.push_back(split_info.new_page_id);
+        if (new_pids.size() == BATCH) {
+            state.PauseTiming();
+            for (auto pid : new_pids) {
+                RawPageMgr::remove(pid);
+            }
+            new_pids.clear();
+            state.ResumeTiming();
+        }
+    }
+    // the upper half moves to the new page, the middle one goes up
+    ReportBytes(state, (double)state.iterations() * (max_size - (max_size - 1) / 2) * L::SLOT_BYTES);
+}
+
+// parent with two leaves, the left one just fell below min size, the right one holds right_cnt
+template<typename L>
+struct Underflow {
+    std::shared_ptr<Page> parent;
+    std::shared_ptr<Page> left;
+    std::shared_ptr<Page> right;
+
+    static auto Build(int right_cnt) -> Underflow {
+        auto max_size = L::LeafMax();
+        auto min_size = (max_size - 1) / 2;
+        auto underflow = Underflow{};
+        underflow.left = BuildLeaf<L>(min_size - 1);
+        auto separator = 2 * max_size;
+        underflow.right = BuildLeaf<L>(right_cnt, separator + 2);
+        underflow.parent = RawPageMgr::create();
+        auto& parent = *reinterpret_cast<typename L::InternalT*>(underflow.parent->data());
+        parent.Init();
+        parent.SetInitialState({L::Key(separator), L::Value(separator)}, BTreePageOf(underflow.left),
+            BTreePageOf(underflow.right));
+        return underflow;
+    }
+    void Remove() {
+        for (auto page : {this->parent, this->left, this->right}) {
+            RawPageMgr::remove(BTreePageOf(page));
+        }
+    }
+};
+
+// right_extra: simbling above min size (borrow) or at it (merge)
+template<typename L>
+void UnderflowBench(benchmark::State& state, int right_extra) {
+    auto env = PageEnv{};
+    auto max_size = L::LeafMax();
+    auto min_size = (max_size - 1) / 2;
+    auto batch = std::vector<Underflow<L>>{};
+    size_t used = 0;
+    for (auto _ : state) {
+        if (used == batch.size()) {
+            state.PauseTiming();
+            for (auto& underflow : batch) {
+                underflow.Remove();
+            }
+            batch.clear();
+            for (int i = 0; i < BATCH; i++) {
+                batch.push_back(Underflow<L>::Build(min_size + right_extra));
+            }
+            used = 0;
+            state.ResumeTiming();
+        }
+        auto& underflow = batch[used++];
+        auto res = reinterpret_cast<typename L::LeafT*>(underflow.left->data())->CheckOrBorrowOrMerge(underflow.parent);
+        benchmark::DoNotOptimize(res);
+    }
+    // borrow: the simbling shifts down one slot; merge: the simbling moves over
+    auto moved = right_extra > 0 ? min_size + right_extra : min_size + 1;
+    ReportBytes(state, (double)state.iterations() * moved * L::SLOT_BYTES);
+}
+
+template<size_t KeySize, size_t ValueSize>
+void BM_LeafBorrow(benchmark::State& state) {
+    UnderflowBench<Layout<KeySize, ValueSize>>(state, 1);
+}
+
+template<size_t KeySize, size_t ValueSize>
+void BM_LeafMerge(benchmark::State& state) {
+    UnderflowBench<Layout<KeySize, ValueSize>>(state, 0);
+}
+
+template<size_t KeySize, size_t ValueSize>
+void BM_InternalGetChildPidOrValue(benchmark::State& state) {
+    using L = Layout<KeySize, ValueSize>;
+    auto env = PageEnv{};
+    auto page = BuildInternal<L>(FillCnt(L::InternalMax(), state.range(0)));
+    auto& inner = *reinterpret_cast<typename L::InternalT*>(page->data());
+    // even ids hit a separator (value copy), odd ones descend (pid)
+    auto ids = KeyIds(1, 2 * inner.GetSize() - 1, 5);
+    auto result = std::variant<typename L::ValueT, int>{};
+    double bytes = 0;
+    size_t i = 0;
+    for (auto _ : state) {
+        auto res = inner.GetChildPidOrValue(L::Key(ids[i++ % KEY_POOL]), result);
+        benchmark::DoNotOptimize(res);
+        benchmark::DoNotOptimize(result);
+        bytes += result.index() == 0 ? sizeof(typename L::ValueT) : sizeof(int);
+    }
+    ReportBytes(state, bytes);
+}
+
+template<size_t KeySize, size_t ValueSize>
+void BM_InternalGetIdxByPid(benchmark::State& state) {
+    using L = Layout<KeySize, ValueSize>;
+    auto env = PageEnv{};
+    auto page = BuildInternal<L>(FillCnt(L::InternalMax(), state.range(0)));
+    auto& inner = *reinterpret_cast<typename L::InternalT*>(page->data());
+    auto idxs = KeyIds(0, inner.GetSize() - 1, 6);
+    double bytes = 0;
+    size_t i = 0;
+    for (auto _ : state) {
+        auto idx = idxs[i++ % KEY_POOL];
+        auto res = inner.GetIdxByPid(inner.PidAt(idx));
+        benchmark::DoNotOptimize(res);
+        // linear scan up to the match
+        bytes += (double)(idx + 1) * sizeof(int);
+    }
+    ReportBytes(state, bytes);
+}
+
+template<size_t KeySize, size_t ValueSize>
+void BM_InternalSplit(benchmark::State& state) {
+    using L = Layout<KeySize, ValueSize>;
+    auto env = PageEnv{};
+    auto max_size = L::InternalMax();
+    auto image = BuildInternal<L>(max_size - 1);
+    auto& proto = *reinterpret_cast<typename L::InternalT*>(image->data());
+    // the new child is an existing one, the insert reads its subtree count
+    auto child_pid = proto.PidAt(0);
+    auto copies = PageCopies(*image);
+    auto split_info = SplitInfo<typename L::KeyT, typename L::ValueT>{};
+    auto new_pids = std::vector<int>{};
+    auto ids = KeyIds(1, max_size - 2, 7);
+    size_t i = 0;
+    for (auto _ : state) {
+        auto id = ids[i++ % KEY_POOL];
+        auto& inner = copies.template Next<typename L::InternalT>(state);
+        auto res = inner.Insert(L::Key(2 * id + 1), L::Value(id), child_pid, split_info);
+        benchmark::DoNotOptimize(res);
+        new_pids.push_back(split_info.new_page_id);
+        if (new_pids.size() == BATCH) {
+            state.PauseTiming();
+            for (auto pid : new_pids) {
+                RawPageMgr::remove(pid);
+            }
+            new_pids.clear();
+            state.ResumeTiming();
+        }
+    }
+    auto slot_bytes = L::SLOT_BYTES + sizeof(int) * 2;
+    ReportBytes(state, (double)state.iterations() * (max_size - (max_size - 1) / 2) * slot_bytes);
+}
+
+void BM_RawPageMgrCreate(benchmark::State& state) {
+    auto env = PageEnv{};
+    auto page_size = (int)state.range(0);
+    auto pids = std::vector<int>{};
+    for (auto _ : state) {
+        auto page = RawPageMgr::create(page_size);
+        benchmark::DoNotOptimize(page);
+        pids.push_back(BTreePageOf(page));
+        if (pids.size() == BATCH) {
+            state.PauseTiming();
+            for (auto pid : pids) {
+                RawPageMgr::remove(pid);
+            }
+            pids.clear();
+            state.ResumeTiming();
+        }
+    }
+    // a new page is zeroed
+    ReportBytes(state, (double)state.iterations() * page_size);
+}
+
+void BM_RawPageMgrGetPage(benchmark::State& state) {
+    auto env = PageEnv{};
+    auto page_cnt = (int)state.range(0);
+    for (int i = 0; i < page_cnt; i++) {
+        RawPageMgr::create();
+    }
+    auto pids = KeyIds(0, page_cnt - 1, 8);
+    size_t i = 0;
+    for (auto _ : state) {
+        auto page = RawPageMgr::get_page(pids[i++ % KEY_POOL]);
+        benchmark::DoNotOptimize(page);
+    }
+    ReportBytes(state, 0);
+}
+
+int constexpr LOOKUP_BATCH = 64;
+
+using LookupIndexT = Index<int, BenchValue<8>, IntThreeWayCmper>;
+
+// keys [0, key_cnt), built once per size and kept for the run
+auto LookupIndex(int key_cnt) -> LookupIndexT& {
+    static auto indexes = std::map<int, std::shared_ptr<LookupIndexT>>{};
+    auto& idx = indexes[key_cnt];
+    if (idx == nullptr) {
+        idx = LookupIndexT::create();
+        for (int i = 0; i < key_cnt; i++) {
+            idx->Insert(i, BenchValue<8>{}).Unwrap();
+        }
+    }
+    return *idx;
+}
+
+void BM_IndexGet(benchmark::State& state) {
+    auto& idx = LookupIndex((int)state.range(0));
+    auto ids = KeyIds(0, (int)state.range(0) - 1, 9);
+    size_t i = 0;
+    for (auto _ : state) {
+        for (int k = 0; k < LOOKUP_BATCH; k++) {
+            auto res = idx.Get(ids[i++ % KEY_POOL]);
+            benchmark::DoNotOptimize(res);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * LOOKUP_BATCH);
+}
+
+void BM_IndexMultiGet(benchmark::State& state) {
+    auto& idx = LookupIndex((int)state.range(0));
+    auto ids = KeyIds(0, (int)state.range(0) - 1, 9);
+    auto results = std::vector<std::optional<BenchValue<8>>>(LOOKUP_BATCH);
+    size_t i = 0;
+    for (auto _ : state) {
+        auto keys = std::span<const int>(ids).subspan(i, LOOKUP_BATCH);
+        idx.MultiGet(keys, results, (size_t)state.range(1)).Unwrap();
+        benchmark::DoNotOptimize(results.data());
+        i = (i + LOOKUP_BATCH) % (KEY_POOL - LOOKUP_BATCH);
+    }
+    state.SetItemsProcessed(state.iterations() * LOOKUP_BATCH);
+}
+
+void FillArgs(benchmark::internal::Benchmark* bench) {
+    bench->ArgName("fill_pct")->Arg(25)->Arg(50)->Arg(90);
+}
+
+}
+
+// key size, value size: int keys with small / medium / wide values, wide keys
+#define PAGE_BENCHMARK(fn, ...) \
+    BENCHMARK_TEMPLATE(fn, 4, 8)__VA_ARGS__; \
+    BENCHMARK_TEMPLATE(fn, 4, 100)__VA_ARGS__; \
+    BENCHMARK_TEMPLATE(fn, 16, 100)__VA_ARGS__; \
+    BENCHMARK_TEMPLATE(fn, 4, 800)__VA_ARGS__; \
+    BENCHMARK_TEMPLATE(fn, 64, 800)__VA_ARGS__
+
+PAGE_BENCHMARK(BM_LeafGet, ->Apply(FillArgs));
+PAGE_BENCHMARK(BM_LeafInsert, ->Apply(FillArgs));
+PAGE_BENCHMARK(BM_LeafRemove, ->Apply(FillArgs));
+PAGE_BENCHMARK(BM_LeafSplit);
+PAGE_BENCHMARK(BM_LeafBorrow);
+PAGE_BENCHMARK(BM_LeafMerge);
+PAGE_BENCHMARK(BM_InternalGetChildPidOrValue, ->Apply(FillArgs));
+PAGE_BENCHMARK(BM_InternalGetIdxByPid, ->Apply(FillArgs));
+PAGE_BENCHMARK(BM_InternalSplit);
+BENCHMARK(BM_RawPageMgrCreate)->ArgName("page_size")->Arg(4096)->Arg(16384)->Arg(65536);
+BENCHMARK(BM_RawPageMgrGetPage)->ArgName("pages")->Arg(1 << 10)->Arg(1 << 16);
+BENCHMARK(BM_IndexGet)->ArgName("keys")->Arg(1 << 16)->Arg(1 << 22);
+BENCHMARK(BM_IndexMultiGet)->ArgNames({"keys", "group"})->ArgsProduct({{1 << 16, 1 << 22}, {1, 4, 8, 16, 32}});
+
+BENCHMARK_MAIN();
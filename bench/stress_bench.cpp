@@ -0,0 +1,401 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <latch>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "src/btree_index/index.h"
+#include "src/format/custom_struct.h"
+#include "fmt/format.h"
+
+/*
+    scalability stress: threads issue a mix of Insert / Get / Update / Remove against one
+    Index, once per thread count of the sweep (1, 2, 4, ... up to --max-threads, default
+    all cores), each point on a fresh index. the same number of ops is split over the
+    threads, so perfect scaling is a speedup equal to the thread count.
+
+    checking under concurrency: key k belongs to thread k % threads, only its owner
+    mutates it, so every thread keeps an exact reference model of its keys and checks
+    each mutation's status against it. keys of one leaf belong to different threads, the
+    writers still contend on every page. reads pick any key and check a found value
+    was written for that key. after the run every key is read back and compared with
+    the merged reference models, Count() and GetTreeStats() must agree with them too.
+
+    one JSON array with a point per thread count goes to stdout, a throughput chart to
+    stderr, --csv writes (threads, ops/sec, speedup) for plotting. the exit code is 1 if
+    any check failed.
+
+    usage: stress_bench [--max-threads=<cores>] [--keys=100000] [--ops=400000]
+        [--mix=25:50:15:10 (insert:get:update:remove)] [--mode=memory|wal|cow|mmap]
+        [--dir=<tmp>] [--csv=PATH] [--seed=42]
+*/
+
+namespace {
+
+enum class StressOp : int { Insert, Get, Update, Remove };
+int constexpr STRESS_OP_CNT = 4;
+std::array<const char*, STRESS_OP_CNT> constexpr STRESS_OP_NAMES = {"insert", "get", "update", "remove"};
+
+struct StressOptions {
+    int max_threads{std::max(1, (int)std::thread::hardware_concurrency())};
+    uint64_t keys{100000};
+    uint64_t ops{400000};
+    // share of each StressOp in percent
+    std::array<int, STRESS_OP_CNT> mix{25, 50, 15, 10};
+    std::string mode{"memory"};
+    std::string dir{std::filesystem::temp_directory_path().string()};
+    std::string csv;
+    uint64_t seed{42};
+};
+
+// a value names the key it was written for and the owner's write count of that key
+struct StressValue {
+    int64_t key;
+    int64_t version;
+};
+
+struct ThreadResult {
+    std::array<uint64_t, STRESS_OP_CNT> op_cnts{};
+    // statuses / values that disagree with the reference model
+    uint64_t mismatches{0};
+};
+
+struct PointResult {
+    int threads;
+    double seconds;
+    std::array<uint64_t, STRESS_OP_CNT> op_cnts{};
+    uint64_t mismatches{0};
+    // final contents disagree with the merged reference models
+    uint64_t verify_errors{0};
+    size_t final_keys{0};
+};
+
+using IndexT = Index<int, StressValue, IntThreeWayCmper>;
+
+auto Usage() -> int {
+    std::cerr << "usage: stress_bench [--max-threads=N] [--keys=N] [--ops=N] [--mix=INSERT:GET:UPDATE:REMOVE]\n"
+        "    [--mode=memory|wal|cow|mmap] [--dir=PATH] [--csv=PATH] [--seed=N]\n";
+    return 1;
+}
+
+auto ParseMix(const std::string& val, std::array<int, STRESS_OP_CNT>& mix) -> bool {
+    size_t pos = 0;
+    for (int i = 0; i < STRESS_OP_CNT; i++) {
+        auto end = val.find(':', pos);
+        if ((end == std::string::npos) != (i == STRESS_OP_CNT - 1)) {
+            return false;
+        }
+        mix[i] = std::stoi(val.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return std::all_of(mix.begin(), mix.end(), [](int share) { return share >= 0; })
+        && std::accumulate(mix.begin(), mix.end(), 0) > 0;
+}
+
+auto ParseArgs(int argc, char** argv, StressOptions& options) -> bool {
+    for (int i = 1; i < argc; i++) {
+        auto arg = std::string(argv[i]);
+        auto eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            return false;
+        }
+        auto name = arg.substr(2, eq - 2);
+        auto val = arg.substr(eq + 1);
+        try {
+            if (name == "max-threads") {
+                options.max_threads = std::stoi(val);
+            } else if (name == "keys") {
+                options.keys = std::stoull(val);
+            } else if (name == "ops") {
+                options.ops = std::stoull(val);
+            } else if (name == "mix") {
+                if (!ParseMix(val, options.mix)) {
+                    return false;
+                }
+            } else if (name == "mode") {
+                options.mode = val;
+            } else if (name == "dir") {
+                options.dir = val;
+            } else if (name == "csv") {
+                options.csv = val;
+            } else if (name == "seed") {
+                options.seed = std::stoull(val);
+            } else {
+                return false;
+            }
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    auto known_mode = options.mode == "memory" || options.mode == "wal" || options.mode == "cow" || options.mode == "mmap";
+    return known_mode && options.keys > 0 && options.keys < (uint64_t)INT32_MAX / 2 && options.max_threads > 0;
+}
+
+// 1, 2, 4, ... below max_threads, then max_threads
+auto ThreadSweep(int max_threads) -> std::vector<int> {
+    auto sweep = std::vector<int>{};
+    for (int threads = 1; threads < max_threads; threads *= 2) {
+        sweep.push_back(threads);
+    }
+    sweep.push_back(max_threads);
+    return sweep;
+}
+
+class StressRunner {
+public:
+    StressRunner(const StressOptions& options, int threads): options(options), threads(threads) {}
+
+    auto Run() -> PointResult {
+        /*
+            1. open a fresh index, preload the even keys (not timed)
+            2. run: ops split over the threads, each checks its own keys' outcomes
+            3. verify the final contents against the merged reference models
+        */
+        auto point = PointResult{this->threads};
+        // 1. open + preload
+        auto paths = std::vector<std::string>{};
+        this->idx = Open(paths);
+        // versions[key]: owner's write count, -1 while absent. only the owner touches its keys
+        this->versions.assign(this->options.keys, -1);
+        auto keys = std::vector<int>{};
+        for (int key = 0; key < (int)this->options.keys; key += 2) {
+            keys.push_back(key);
+        }
+        std::shuffle(keys.begin(), keys.end(), std::mt19937_64(this->options.seed));
+        for (auto key : keys) {
+            this->idx->Insert(key, StressValue{key, 0}).Unwrap();
+            this->versions[key] = 0;
+        }
+        // 2. run
+        auto results = std::vector<ThreadResult>(this->threads);
+        auto start_line = std::latch(this->threads + 1);
+        auto workers = std::vector<std::thread>{};
+        for (int i = 0; i < this->threads; i++) {
+            workers.emplace_back([this, &results, &start_line, i] {
+                start_line.arrive_and_wait();
+                RunOps(i, results[i]);
+            });
+        }
+        auto start = std::chrono::steady_clock::now();
+        start_line.arrive_and_wait();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        point.seconds = std::max(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), 1e-9);
+        for (auto& result : results) {
+            for (int op = 0; op < STRESS_OP_CNT; op++) {
+                point.op_cnts[op] += result.op_cnts[op];
+            }
+            point.mismatches += result.mismatches;
+        }
+        // 3. verify
+        point.verify_errors = Verify(point.final_keys);
+        this->idx.reset();
+        for (auto& path : paths) {
+            std::filesystem::remove(path);
+        }
+        return point;
+    }
+
+private:
+    auto Open(std::vector<std::string>& paths) -> std::shared_ptr<IndexT> {
+        auto base = (std::filesystem::path(this->options.dir) / fmt::format("stress_bench_{}", this->threads)).string();
+        if (this->options.mode == "wal") {
+            // the log is what writers serialize on, not the disk
+            auto wal_options = WalOptions{base + ".wal", WalSyncMode::None};
+            auto ckpt_options = CheckpointOptions{base + ".pages"};
+            paths = {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt"};
+            RemoveAll(paths);
+            return IndexT::open(wal_options, ckpt_options).Unwrap();
+        }
+        if (this->options.mode == "cow") {
+            auto shadow_options = ShadowOptions{base + ".shadow", false};
+            paths = {shadow_options.path};
+            RemoveAll(paths);
+            return IndexT::open(shadow_options).Unwrap();
+        }
+        if (this->options.mode == "mmap") {
+            auto mmap_options = MmapOptions{base + ".mmap"};
+            paths = {mmap_options.path};
+            RemoveAll(paths);
+            return IndexT::open(mmap_options).Unwrap();
+        }
+        return IndexT::create();
+    }
+
+    static void RemoveAll(const std::vector<std::string>& paths) {
+        for (auto& path : paths) {
+            std::filesystem::remove(path);
+        }
+    }
+
+    auto PickOp(std::mt19937_64& rng) const -> StressOp {
+        auto total = std::accumulate(this->options.mix.begin(), this->options.mix.end(), 0);
+        auto u = std::uniform_int_distribution<int>(0, total - 1)(rng);
+        for (int op = 0; op < STRESS_OP_CNT; op++) {
+            if (u < this->options.mix[op]) {
+                return (StressOp)op;
+            }
+            u -= this->options.mix[op];
+        }
+        return StressOp::Get;
+    }
+
+    void RunOps(int thread_id, ThreadResult& result) {
+        auto rng = std::mt19937_64(this->options.seed + 1 + thread_id);
+        auto op_cnt = this->options.ops / this->threads + (thread_id < (int)(this->options.ops % this->threads));
+        // keys thread_id, thread_id + threads, ... are owned by this thread
+        auto owned_cnt = (this->options.keys - thread_id + this->threads - 1) / this->threads;
+        auto any_key = std::uniform_int_distribution<int>(0, (int)this->options.keys - 1);
+        auto owned_key = std::uniform_int_distribution<int>(0, (int)std::max<uint64_t>(owned_cnt, 1) - 1);
+        for (uint64_t i = 0; i < op_cnt; i++) {
+            auto op = PickOp(rng);
+            result.op_cnts[(int)op]++;
+            if (op == StressOp::Get) {
+                // others may be changing it, a found value only has to belong to the key
+                auto key = any_key(rng);
+                auto val = this->idx->Get(key);
+                result.mismatches += !val.Ok() || (val.Unwrap().has_value() && val.Unwrap()->key != key);
+                continue;
+            }
+            if (owned_cnt == 0) {
+                continue;
+            }
+            auto key = owned_key(rng) * this->threads + thread_id;
+            auto& version = this->versions[key];
+            switch (op) {
+                case StressOp::Insert: {
+                    auto res = this->idx->Insert(key, StressValue{key, version + 1});
+                    if (version < 0) {
+                        result.mismatches += !res.Ok();
+                        version = res.Ok() ? version + 1 : version;
+                    } else {
+                        result.mismatches += res.Code() != StatusCode::KeyDuplicate;
+                    }
+                    break;
+                }
+                case StressOp::Update: {
+                    // updating a missing key is a no-op
+                    auto res = this->idx->Update(key, StressValue{key, version + 1});
+                    result.mismatches += !res.Ok();
+                    version = (res.Ok() && version >= 0) ? version + 1 : version;
+                    break;
+                }
+                case StressOp::Remove: {
+                    // removing a missing key is a no-op
+                    auto res = this->idx->Remove(key);
+                    result.mismatches += !res.Ok();
+                    version = res.Ok() ? -1 : version;
+                    break;
+                }
+                case StressOp::Get:
+                    break;
+            }
+        }
+    }
+
+    // number of keys whose final state differs from the reference, plus count disagreements
+    auto Verify(size_t& final_keys) -> uint64_t {
+        uint64_t errors = 0;
+        final_keys = 0;
+        for (int key = 0; key < (int)this->options.keys; key++) {
+            auto val = this->idx->Get(key);
+            auto version = this->versions[key];
+            if (!val.Ok()) {
+                errors++;
+                continue;
+            }
+            auto found = val.Unwrap();
+            if (version < 0) {
+                errors += found.has_value();
+                continue;
+            }
+            final_keys++;
+            errors += !found.has_value() || found->key != key || found->version != version;
+        }
+        auto count = this->idx->Count(0, (int)this->options.keys);
+        errors += !count.Ok() || count.Unwrap() != final_keys;
+        errors += this->idx->GetTreeStats(true).keys != final_keys;
+        return errors;
+    }
+
+    const StressOptions& options;
+    int threads;
+    std::shared_ptr<IndexT> idx;
+    std::vector<int64_t> versions;
+};
+
+auto OpsPerSec(const PointResult& point) -> double {
+    return (double)std::accumulate(point.op_cnts.begin(), point.op_cnts.end(), (uint64_t)0) / point.seconds;
+}
+
+auto PointJson(const PointResult& point, double base_ops_per_sec) -> std::string {
+    auto ops_per_sec = OpsPerSec(point);
+    auto speedup = ops_per_sec / base_ops_per_sec;
+    auto op_jsons = std::vector<std::string>{};
+    for (int op = 0; op < STRESS_OP_CNT; op++) {
+        op_jsons.push_back(fmt::format(R"("{}": {})", STRESS_OP_NAMES[op], point.op_cnts[op]));
+    }
+    return fmt::format(R"({{"threads": {}, "seconds": {:.3f}, "ops_per_sec": {:.1f}, "speedup": {:.2f}, )"
+        R"("efficiency": {:.2f}, "ops": {{{}}}, "final_keys": {}, "mismatches": {}, "verify_errors": {}, "verified": {}}})",
+        point.threads, point.seconds, ops_per_sec, speedup, speedup / point.threads, fmt::join(op_jsons, ", "),
+        point.final_keys, point.mismatches, point.verify_errors, point.mismatches == 0 && point.verify_errors == 0);
+}
+
+// one bar per thread count, scaled to the best throughput
+void PrintChart(const std::vector<PointResult>& points) {
+    auto ops_per_sec = std::vector<double>{};
+    for (auto& point : points) {
+        ops_per_sec.push_back(OpsPerSec(point));
+    }
+    auto best = *std::max_element(ops_per_sec.begin(), ops_per_sec.end());
+    int constexpr BAR_WIDTH = 50;
+    std::cerr << "threads | ops/sec\n";
+    for (size_t i = 0; i < points.size(); i++) {
+        auto bar = std::string((size_t)std::lround(BAR_WIDTH * ops_per_sec[i] / best), '#');
+        std::cerr << fmt::format("{:>7} | {:<{}} {:.0f}\n", points[i].threads, bar, BAR_WIDTH, ops_per_sec[i]);
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    auto options = StressOptions{};
+    if (!ParseArgs(argc, argv, options)) {
+        return Usage();
+    }
+    auto points = std::vector<PointResult>{};
+    for (auto threads : ThreadSweep(options.max_threads)) {
+        points.push_back(StressRunner(options, threads).Run());
+        auto& point = points.back();
+        std::cerr << fmt::format("{} threads: {:.2f}s, {} mismatches, {} verify errors\n",
+            threads, point.seconds, point.mismatches, point.verify_errors);
+    }
+    auto base_ops_per_sec = OpsPerSec(points[0]);
+    auto jsons = std::vector<std::string>{};
+    for (auto& point : points) {
+        jsons.push_back(PointJson(point, base_ops_per_sec));
+    }
+    std::cout << fmt::format("[\n{}\n]\n", fmt::join(jsons, ",\n"));
+    PrintChart(points);
+    if (!options.csv.empty()) {
+        auto csv = std::ofstream(options.csv);
+        csv << "threads,ops_per_sec,speedup\n";
+        for (auto& point : points) {
+            csv << fmt::format("{},{:.1f},{:.3f}\n", point.threads, OpsPerSec(point), OpsPerSec(point) / base_ops_per_sec);
+        }
+    }
+    auto failed = std::any_of(points.begin(), points.end(), [](const PointResult& point) {
+        return point.mismatches != 0 || point.verify_errors != 0;
+    });
+    return failed ? 1 : 0;
+}
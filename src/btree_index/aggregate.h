@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+/*
+    Aggregate policy of an Index.
+    InternalPage keeps one SummaryT per child, so a range aggregate only
+    combines stored summaries plus the two boundary paths.
+
+    A policy provides:
+        SummaryT
+        static auto Identity() -> SummaryT;
+        static auto FromValue(const ValueT& v) -> SummaryT;
+        static auto Combine(const SummaryT& a, const SummaryT& b) -> SummaryT;
+*/
+
+// default policy: no summary is stored in inner pages
+struct NoAggregate {
+    struct SummaryT {};
+
+    template<typename ValueT>
+    static auto FromValue(const ValueT&) -> SummaryT {
+        return {};
+    }
+    static auto Identity() -> SummaryT {
+        return {};
+    }
+    static auto Combine(const SummaryT&, const SummaryT&) -> SummaryT {
+        return {};
+    }
+};
+
+template<typename AggregateT>
+bool constexpr HAS_SUMMARY = !std::is_empty_v<typename AggregateT::SummaryT>;
+
+// sum / min / max of the numeric field FieldExtractorT{}(value)
+template<typename ValueT, typename FieldExtractorT>
+struct SumMinMaxAggregate {
+    using FieldT = std::decay_t<std::invoke_result_t<FieldExtractorT, const ValueT&>>;
+    static_assert(std::is_arithmetic_v<FieldT>);
+
+    struct SummaryT {
+        FieldT sum;
+        FieldT min;
+        FieldT max;
+    };
+
+    static auto Identity() -> SummaryT {
+        return {FieldT{}, std::numeric_limits<FieldT>::max(), std::numeric_limits<FieldT>::lowest()};
+    }
+    static auto FromValue(const ValueT& v) -> SummaryT {
+        auto field = FieldExtractorT{}(v);
+        return {field, field, field};
+    }
+    static auto Combine(const SummaryT& a, const SummaryT& b) -> SummaryT {
+        return {a.sum + b.sum, std::min(a.min, b.min), std::max(a.max, b.max)};
+    }
+};
@@ -0,0 +1,59 @@
+#include "batch_lookup.h"
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace {
+
+// freed frames kept per thread, a group never holds more at once
+size_t constexpr FRAME_CACHE_CNT = BATCH_GROUP_MAX;
+
+// a frame is preceded by its capacity, so a cached one is only reused when it fits.
+// the header is max aligned, so is the frame right after it
+struct alignas(std::max_align_t) FrameHeader {
+    size_t capacity;
+
+    auto Frame() -> void* {
+        return reinterpret_cast<char*>(this) + sizeof(FrameHeader);
+    }
+    static auto Of(void* frame) -> FrameHeader* {
+        return reinterpret_cast<FrameHeader*>(static_cast<char*>(frame) - sizeof(FrameHeader));
+    }
+};
+
+struct FrameCache {
+    std::vector<FrameHeader*> frames;
+
+    ~FrameCache() {
+        for (auto header : this->frames) {
+            ::operator delete(header);
+        }
+    }
+};
+
+thread_local FrameCache frame_cache;
+
+}
+
+auto LookupTask::promise_type::operator new(size_t size) -> void* {
+    auto& frames = frame_cache.frames;
+    if (!frames.empty() && frames.back()->capacity >= size) {
+        auto header = frames.back();
+        frames.pop_back();
+        return header->Frame();
+    }
+    auto header = static_cast<FrameHeader*>(::operator new(sizeof(FrameHeader) + size));
+    header->capacity = size;
+    return header->Frame();
+}
+
+void LookupTask::promise_type::operator delete(void* frame, size_t) {
+    auto header = FrameHeader::Of(frame);
+    auto& frames = frame_cache.frames;
+    if (frames.size() < FRAME_CACHE_CNT) {
+        frames.push_back(header);
+        return;
+    }
+    ::operator delete(header);
+}
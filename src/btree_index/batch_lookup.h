@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <iostream>
+#include <utility>
+
+/*
+    interleaved lookups: each lookup of a batch is a coroutine that prefetches the
+    page it reads next and suspends, RunInterleaved resumes the others meanwhile, so
+    up to a group of page misses are in flight instead of one. frames come from a
+    per-thread cache, a batch allocates only when it runs more lookups at once than
+    the thread ever did.
+*/
+
+// lookups interleaved at most, more in flight only thrash the fill buffers
+size_t constexpr BATCH_GROUP_MAX = 32;
+size_t constexpr BATCH_GROUP_DEFAULT = 8;
+
+class LookupTask {
+public:
+    struct promise_type {
+        auto get_return_object() -> LookupTask {
+            return LookupTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        // created suspended: the scheduler decides when a lookup touches its first page
+        auto initial_suspend() noexcept -> std::suspend_always { return {}; }
+        // stays suspended at the end, so the scheduler can see done() before destroying it
+        auto final_suspend() noexcept -> std::suspend_always { return {}; }
+        void return_void() {}
+        void unhandled_exception() {
+            std::cout << "should not reach here!\n";
+            exit(-1);
+        }
+        static auto operator new(size_t size) -> void*;
+        static void operator delete(void* frame, size_t size);
+    };
+
+    LookupTask() = default;
+    LookupTask(const LookupTask&) = delete;
+    LookupTask(LookupTask&& other) noexcept: handle(std::exchange(other.handle, {})) {}
+    auto operator=(LookupTask&& other) noexcept -> LookupTask& {
+        if (this != &other) {
+            Reset();
+            this->handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    ~LookupTask() {
+        Reset();
+    }
+    // no lookup, or the lookup finished
+    auto Done() const -> bool {
+        return !this->handle || this->handle.done();
+    }
+    // run to the next prefetch (or the end)
+    void Resume() {
+        this->handle.resume();
+    }
+
+private:
+    explicit LookupTask(std::coroutine_handle<promise_type> handle): handle(handle) {}
+    void Reset() {
+        if (this->handle) {
+            this->handle.destroy();
+            this->handle = {};
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+/*
+    make_task(i) for i in [0, cnt), group_size of them in flight: resumed round robin,
+    a finished one is replaced by the next, so the group stays full until the tail
+*/
+template<typename MakeTaskT>
+void RunInterleaved(size_t cnt, size_t group_size, MakeTaskT make_task) {
+    std::array<LookupTask, BATCH_GROUP_MAX> tasks;
+    group_size = std::clamp<size_t>(group_size, 1, BATCH_GROUP_MAX);
+    size_t next = 0;
+    size_t live = 0;
+    for (size_t slot = 0; slot < group_size && next < cnt; slot++, live++) {
+        tasks[slot] = make_task(next++);
+    }
+    while (live > 0) {
+        for (size_t slot = 0; slot < group_size; slot++) {
+            if (tasks[slot].Done()) {
+                continue;
+            }
+            tasks[slot].Resume();
+            if (!tasks[slot].Done()) {
+                continue;
+            }
+            if (next < cnt) {
+                tasks[slot] = make_task(next++);
+            } else {
+                tasks[slot] = LookupTask{};
+                live--;
+            }
+        }
+    }
+}
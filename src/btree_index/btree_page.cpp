@@ -1,26 +1,41 @@
 #include "btree_page.h"
 
-std::unordered_map<int, std::shared_ptr<Page>> RawPageMgr::pages_map = {};
-int RawPageMgr::next_page_id = 0;
+thread_local PageBackend* RawPageMgr::cur_store = nullptr;
+thread_local bool RawPageMgr::cur_for_write = false;
 
 auto RawPageMgr::create(int page_size) -> std::shared_ptr<Page> {
-    int page_id = next_page_id++;
-    auto page = std::make_shared<Page>(std::vector<char>(page_size));
+    assert(cur_store != nullptr);
+    return cur_store->create(page_size);
+}
 
-    auto& btree_page = *reinterpret_cast<BTreePage*>(page->data());
-    btree_page.SetPageId(page_id);
+auto RawPageMgr::get_page(int pid) -> std::shared_ptr<Page> {
+    assert(cur_store != nullptr);
+    return cur_store->get_page(pid, cur_for_write);
+}
 
-    pages_map.insert({page_id, page});
+void RawPageMgr::remove(int pid) {
+    assert(cur_store != nullptr);
+    cur_store->remove(pid);
+}
 
-    return page;
+auto RawPageMgr::Reserve(size_t page_cnt) -> Status {
+    assert(cur_store != nullptr);
+    return cur_store->Reserve(page_cnt);
 }
 
-auto RawPageMgr::get_page(int pid) -> std::shared_ptr<Page> {
-    auto res = pages_map.find(pid);
-    if (res == pages_map.end()) {
-        return {};
-    }
-    return res->second;
+void RawPageMgr::prefetch(const std::vector<int>& pids) {
+    assert(cur_store != nullptr);
+    cur_store->prefetch(pids);
+}
+
+RawPageMgr::Scope::Scope(PageBackend* store, bool for_write): prev_store(cur_store), prev_for_write(cur_for_write) {
+    cur_store = store;
+    cur_for_write = for_write;
+}
+
+RawPageMgr::Scope::~Scope() {
+    cur_store = this->prev_store;
+    cur_for_write = this->prev_for_write;
 }
 
 void BTreePage::Init(BTreePageType t, int _m_size) noexcept {
@@ -41,6 +56,10 @@ auto BTreePage::IsLeafPage() const -> bool {
     return this->page_type == BTreePageType::LEAF_PAGE;
 }
 
+auto BTreePage::IsInternalPage() const -> bool {
+    return this->page_type == BTreePageType::INTERNAL_PAGE;
+}
+
 void BTreePage::SetPageType(BTreePageType page_type) {
     this->page_type = page_type;
 }
@@ -1,25 +1,47 @@
 #pragma once
 
 #include <vector>
-#include <unordered_map>
+#include <cassert>
 #include "common.h"
+#include "aggregate.h"
+#include "page_store.h"
 
-INTERNAL_TEMPLATE_ARGUMENTS
+template<typename KeyT, typename ValueT, typename PidT, typename KeyComparatorT, typename AggregateT = NoAggregate, 
+    size_t PageSize = BTREE_PAGE_SIZE>
 class InternalPage;
 
-LEAF_TEMPLATE_ARGUMENTS
+template<typename KeyT, typename ValueT, typename KeyComparatorT, typename AggregateT = NoAggregate, 
+    size_t PageSize = BTREE_PAGE_SIZE>
 class LeafPage;
 
 
-using Page = std::vector<char>;
-
+/*
+    page access of the tree code.
+    calls go to the PageBackend bound to the current thread by a Scope,
+    so every index keeps its own page table without passing it around.
+*/
 struct RawPageMgr {
 public: 
     static auto create(int page_size = BTREE_PAGE_SIZE) -> std::shared_ptr<Page>;
     static auto get_page(int pid) -> std::shared_ptr<Page>;
+    static void remove(int pid);
+    static auto Reserve(size_t page_cnt) -> Status;
+    // start reading pids ahead of their get_page
+    static void prefetch(const std::vector<int>& pids);
+
+    // binds store to this thread until destroyed, pages fetched for_write are marked dirty
+    class Scope {
+    public:
+        Scope(PageBackend* store, bool for_write);
+        Scope(const Scope&) = delete;
+        ~Scope();
+    private:
+        PageBackend* prev_store;
+        bool prev_for_write;
+    };
 private:
-    static std::unordered_map<int, std::shared_ptr<Page>> pages_map;
-    static int next_page_id;
+    static thread_local PageBackend* cur_store;
+    static thread_local bool cur_for_write;
 };
 
 
@@ -37,6 +59,7 @@ public:
     auto GetPageId() const -> int;
 
     auto IsLeafPage() const -> bool;
+    auto IsInternalPage() const -> bool;
     void SetPageType(BTreePageType page_type);
   
     auto GetSize() const -> int;
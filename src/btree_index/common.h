@@ -4,11 +4,16 @@
 #include <utility>
 #include <memory>
 
+// default page size, every Index picks its own (PageSize template argument)
 const size_t BTREE_PAGE_SIZE = 4096;
 const size_t LEAF_PAGE_HEADER_SIZE = 16;
+// page buffers start at this alignment, O_DIRECT io needs buffers aligned to the device block size
+const size_t PAGE_IO_ALIGN = 4096;
+// bound of root-to-leaf path length, every page holds at least 2 children
+int constexpr MAX_TREE_HEIGHT = 64;
 
-template<int keysize, int val_size>
-int constexpr PAGE_SLOT_CNT_CALC = (BTREE_PAGE_SIZE - LEAF_PAGE_HEADER_SIZE) / (keysize + val_size);
+template<int keysize, int val_size, size_t page_size = BTREE_PAGE_SIZE>
+int constexpr PAGE_SLOT_CNT_CALC = (page_size - LEAF_PAGE_HEADER_SIZE) / (keysize + val_size);
 
 template <typename KeyT, typename ValueT>
 struct SplitInfo {
@@ -18,7 +23,7 @@ public:
     std::pair<KeyT, ValueT> mid_elem;
 };
 
-#define LEAF_TEMPLATE_ARGUMENTS template<typename KeyT, typename ValueT, typename KeyComparatorT>
-#define INTERNAL_TEMPLATE_ARGUMENTS template<typename KeyT, typename ValueT, typename PidT, typename KeyComparatorT>
-#define INDEX_TEMPLATE_ARGUMENTS template<typename KeyT, typename ValueT, typename KeyComparatorT>
+#define LEAF_TEMPLATE_ARGUMENTS template<typename KeyT, typename ValueT, typename KeyComparatorT, typename AggregateT, size_t PageSize>
+#define INTERNAL_TEMPLATE_ARGUMENTS template<typename KeyT, typename ValueT, typename PidT, typename KeyComparatorT, typename AggregateT, size_t PageSize>
+#define INDEX_TEMPLATE_ARGUMENTS template<typename KeyT, typename ValueT, typename KeyComparatorT, typename AggregateT, size_t PageSize>
 
@@ -3,576 +3,1759 @@
 #include "common.h"
 #include "inner_page.h"
 #include "../status/status.h"
+#include "fmt/core.h"
 #include "btree_page.h"
 #include "leaf_page.h"
+#include "shadow_store.h"
+#include "mmap_store.h"
+#include "../wal/wal.h"
+#include "../wal/checkpoint.h"
+#include "latency_stats.h"
+#include "batch_lookup.h"
+#include "../graphviz/graphviz.h"
 
+#include <algorithm>
+#include <array>
 #include <cstddef>
+#include <cstring>
 #include <iostream>
 #include <optional>
 #include <sstream>
 #include <memory>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <type_traits>
 #include <variant>
+#include <vector>
 #include <shared_mutex>
+#include <span>
+#include <mutex>
+#include <string>
+#include <thread>
 
-enum class IndexCase: int {
-    Ok,
-    ChildInsertPageSplit,
-    KeyNotFound,
-    ChildRemoveDidMerge,
+struct WritebackOptions {
+    // the checkpoint thread also runs once dirty pages pass this share of the page table, 0: off
+    double dirty_target{0.0};
+    // writers wait for one checkpoint round while dirty pages pass this share, 0: never
+    double dirty_limit{0.0};
+    // how often the checkpoint thread looks at the dirty share
+    int poll_interval_ms{10};
 };
 
-template<typename KeyT, typename ValueT, typename KeyComparatorT>
+struct WarmupOptions {
+    // keep a list of the resident pages, hottest first, beside the page file (path + ".hot");
+    // open prefetches them in the background while the index already serves
+    bool enabled{false};
+    // pages in the list, 0: the pool capacity, every resident page when unbounded
+    size_t max_pages{0};
+};
+
+// one level of the tree, TreeStats::levels[0] are the leaves
+struct LevelStats {
+    size_t pages{0};
+    // keys on a leaf level, children on an inner level
+    size_t slots{0};
+    // slots per slot capacity of the level's pages. min / max only come from a scan
+    double avg_fill{0.0};
+    double min_fill{0.0};
+    double max_fill{0.0};
+};
+
+struct TreeStats {
+    int height{0};
+    size_t keys{0};
+    size_t leaf_pages{0};
+    size_t inner_pages{0};
+    std::vector<LevelStats> levels;
+    // page headers and used slots of the tree's pages
+    size_t bytes_used{0};
+    // pages the page table / file holds for the index, times the page size
+    size_t bytes_allocated{0};
+    // held by the store, unreachable from the root: page file slots of removed pages
+    // (the page table does not reuse pids), or leaked pages
+    size_t orphaned_pages{0};
+    // pages were walked: min / max fill are known, counters were recounted
+    bool scanned{false};
+};
+
+struct GraphvizOptions {
+    // levels below the root to draw, deeper subtrees become one box with their key count. -1: all
+    int max_depth{-1};
+    // children drawn per inner page, spread evenly (first and last included), 0: all
+    int sample_children{0};
+    // a leaf is one box with its key count and fill instead of its keys
+    bool summarize_leaves{false};
+};
+
+struct CheckpointOptions {
+    // page file, empty: no page file, the whole log is replayed on open
+    // the checkpoint record lives next to it as <path>.ckpt
+    std::string path;
+    // period of background checkpoints, 0: only explicit Checkpoint()
+    int interval_ms{1000};
+    // page reads on a miss, read-ahead and checkpoint writes go through this engine
+    IoOptions io;
+    // bound of the page table and its replacement policy, pages come back from the page file
+    PoolOptions pool;
+    // background writeback and writer throttling by dirty share
+    WritebackOptions writeback;
+    // page table warm-up after a restart
+    WarmupOptions warmup;
+};
+
+/*
+    PageSize: bytes of every page of this index, so slot counts (fanout) follow from it.
+    indexes of one process may differ; a file is reopened with the page size it was made with
+*/
+template<typename KeyT, typename ValueT, typename KeyComparatorT, typename AggregateT = NoAggregate, 
+    size_t PageSize = BTREE_PAGE_SIZE>
 class Index {
-    using SelfT = Index<KeyT, ValueT, KeyComparatorT>;
-    using LeafT = LeafPage<KeyT, ValueT, KeyComparatorT>;
-    using InternalT = InternalPage<KeyT, ValueT, int, KeyComparatorT>;
+    // page files are read / written (O_DIRECT too) in whole aligned blocks
+    static_assert(PageSize >= PAGE_IO_ALIGN && PageSize % PAGE_IO_ALIGN == 0, 
+        "page size must be a multiple of PAGE_IO_ALIGN");
+    using SelfT = Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>;
+    using LeafT = LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>;
+    using InternalT = InternalPage<KeyT, ValueT, int, KeyComparatorT, AggregateT, PageSize>;
     using PidT = int;
     using LeafSplitInfoT = SplitInfo<KeyT, ValueT>;
     using InternalSplitInfoT = SplitInfo<KeyT, ValueT>;
 public:
+    // false: KeyT + ValueT too big for PageSize, inserting does not compile
+    static bool constexpr FITS_PAGE = InternalT::FITS_PAGE;
+
     Index() = default;
+    ~Index();
     static auto create() -> std::shared_ptr<SelfT>;
+    // durable index: every mutation is logged before it returns. state is rebuilt
+    // from the last checkpoint (if ckpt_options.path is set) plus the log after it.
+    // IOError from a write: the log failed, the op is applied in memory but may be lost.
+    // the index then refuses every write and checkpoint, reopen to recover
+    static auto open(const WalOptions& options, const CheckpointOptions& ckpt_options = {}) -> StatusOr<std::shared_ptr<SelfT>>;
+    // copy-on-write index: pages are never modified in place, every mutation publishes
+    // a new version once it is durable. reads run on a pinned version without locks
+    static auto open(const ShadowOptions& options) -> StatusOr<std::shared_ptr<SelfT>>;
+    // index in a memory-mapped file, pages are used in place. changes are durable
+    // after Checkpoint() (msync), a file left unflushed by a crash is repaired on open
+    // (see MmapStore), or rejected unless options.repair
+    static auto open(const MmapOptions& options) -> StatusOr<std::shared_ptr<SelfT>>;
+    // write pages dirtied since the last checkpoint, then drop the log they cover
+    auto Checkpoint() -> Status;
+    // save the hot page list for the next open to warm up from, done on every periodic
+    // checkpoint and on close. no-op unless CheckpointOptions::warmup is enabled
+    auto SaveHotPages() -> Status;
+    // page table hits / misses / evictions, zeros in copy-on-write and mmap mode
+    auto GetPoolStats() const -> PoolStats;
+    // latency histograms of Insert / Get / Update / Remove since open: whole call, lock wait,
+    // descent, split / merge. summed over the threads' shards on each call
+    auto Stats() const -> IndexStats;
+    // tree shape from counters the writers keep per level, O(height) page reads.
+    // scan (or the first call after open): walk every page header for min / max fill
+    auto GetTreeStats(bool scan = false) -> TreeStats;
     auto Insert(const KeyT& key, const ValueT& val) -> Status;
     auto Update(const KeyT& key, const ValueT& new_val) -> Status;
     auto Get(const KeyT& key) -> StatusOr<std::optional<ValueT>>;
+    // Get of keys[i] into results[i], under one lock (or pinned version). group_size lookups
+    // run interleaved: each prefetches the page it reads next and yields to the others, so
+    // their cache misses overlap. not counted in Stats(). OutOfSpace: results too short
+    auto MultiGet(std::span<const KeyT> keys, std::span<std::optional<ValueT>> results, 
+        size_t group_size = BATCH_GROUP_DEFAULT) -> Status;
     auto Remove(const KeyT& key) -> Status;
+    // number of keys in [lo, hi)
+    auto Count(const KeyT& lo, const KeyT& hi) -> StatusOr<size_t>;
+    // number of keys < key
+    auto Rank(const KeyT& key) -> StatusOr<size_t>;
+    // k-th (0 based) smallest key
+    auto Select(size_t k) -> StatusOr<std::optional<KeyT>>;
+    // remove keys in [lo, hi), returns number of removed keys
+    auto DeleteRange(const KeyT& lo, const KeyT& hi) -> StatusOr<size_t>;
+    // AggregateT summary of values whose key in [lo, hi)
+    auto Aggregate(const KeyT& lo, const KeyT& hi) -> StatusOr<typename AggregateT::SummaryT>;
     auto dump_struct() const -> std::string;
     auto DumpGraphviz() -> std::string;
+    // dot document of the tree written while it is walked. the index is locked per subtree
+    // (an inner page, or a bottom inner page with its leaves), writers run in between, so
+    // outside copy-on-write mode (one pinned version) pages drawn late may be newer
+    auto WriteGraphviz(std::ostream& out, const GraphvizOptions& options = {}) -> Status;
+    auto WriteGraphviz(int fd, const GraphvizOptions& options = {}) -> Status;
 
 private:
-    static auto InsertFromInternal(std::shared_ptr<Page>& cur_page, const KeyT& key, 
-        const ValueT& value, std::shared_ptr<InternalSplitInfoT>& split_info) -> StatusOr<IndexCase>;
-    static auto UpdateFromInternal(std::shared_ptr<Page>& cur_page, const KeyT& key, 
-        const ValueT& value) -> StatusOr<IndexCase>;
-    static auto GetFromInternal(std::shared_ptr<Page>& cur_page, const KeyT& key, ValueT& result) -> StatusOr<IndexCase>;
-    static auto RemoveFromInternal(std::shared_ptr<Page>& cur_page, 
-        std::shared_ptr<Page> parent_page, 
-        const KeyT& key,
-        KeyT& parent_merged_key
-    ) -> StatusOr<IndexCase>;
+    // root-to-leaf pages of one descent, pages[0] is root
+    struct PathT {
+        std::array<std::shared_ptr<Page>, MAX_TREE_HEIGHT> pages;
+        // child_idxs[level] is the idx of pages[level + 1] in pages[level]
+        std::array<int, MAX_TREE_HEIGHT> child_idxs;
+        int depth{0};
+
+        void Push(std::shared_ptr<Page> page) {
+            assert(depth < MAX_TREE_HEIGHT);
+            pages[depth++] = std::move(page);
+        }
+        auto Back() -> std::shared_ptr<Page>& {
+            return pages[depth - 1];
+        }
+    };
+
+    // what a read op works on: shared index lock, or a pinned version in copy-on-write mode
+    struct ReadViewT {
+        std::shared_lock<std::shared_mutex> guard;
+        std::shared_ptr<ShadowSnapshot> snapshot;
+        std::shared_ptr<Page> root;
+        RawPageMgr::Scope scope;
+    };
+
+    auto InsertFromRoot(const KeyT& key, const ValueT& val, OpTimer& timer) -> Status;
+    auto UpdateFromRoot(const KeyT& key, const ValueT& new_val) -> Status;
+    auto DeleteRangeFromRoot(const KeyT& lo, const KeyT& hi) -> StatusOr<size_t>;
+    template<typename... FieldTs>
+    auto LogRecord(WalRecordType type, const FieldTs&... fields) -> uint64_t;
+    void ApplyRecord(const WalRecord& record);
+    // make the applied mutation durable: publish the txn, or log it; guard may be released
+    template<typename... FieldTs>
+    auto CommitOp(std::unique_lock<std::shared_mutex>& guard, WalRecordType type, const FieldTs&... fields) -> Status;
+    // the log failed a write: nothing may change the tree or reach the page file after it
+    auto LogFailed() const -> bool;
+    void CheckpointLoop(int interval_ms);
+    // dirty share over the limit: wait until the checkpoint thread ran a round
+    void ThrottleWriter();
+    auto OverDirtyShare(double share) const -> bool;
+    // binds page_store to this thread for one operation
+    auto ReadScope() const -> RawPageMgr::Scope;
+    auto ReadView() const -> ReadViewT;
+    // pages touched in a write scope are marked dirty, root included.
+    // copy-on-write mode: starts a txn, root and touched pages are private copies
+    auto WriteScope() -> RawPageMgr::Scope;
+    static auto AggregateFromPage(std::shared_ptr<Page>& cur_page, const KeyT* lo, const KeyT* hi) -> typename AggregateT::SummaryT;
+    static auto RankFromRoot(std::shared_ptr<Page> cur_page, const KeyT& key) -> size_t;
+    // one lookup of MultiGet, suspends after prefetching each page below the root
+    static auto LookupFromRoot(std::shared_ptr<Page> cur_page, int height, const KeyT& key, 
+        std::optional<ValueT>& result) -> LookupTask;
+    auto RemoveFromRoot(const KeyT& key, OpTimer& timer) -> Status;
+    void TrimRange(std::shared_ptr<Page>& cur_page, const KeyT* lo, const KeyT* hi, std::optional<KeyT>& sentinel);
+    // returns the level of pid, counted from the leaves
+    auto DropSubtree(PidT pid) -> int;
+    // mmap repair: checks the pages under raw_page and recounts child metas bottom up,
+    // marks them in live. IOError if they do not form a tree
+    static auto RepairSubtree(std::shared_ptr<Page> raw_page, PidT pid, int depth, int& leaf_depth,
+        std::vector<bool>& live) -> Status;
+    // pages, slots and fill of every level, leaves first, one header read per page
+    static auto ScanLevels(std::shared_ptr<Page>& root) -> std::vector<LevelStats>;
+    auto FixUnderflowOnPath(const KeyT& key) -> bool;
     static auto GetLeaf(std::shared_ptr<Page>& ptr) -> LeafT&;
     static auto GetInner(std::shared_ptr<Page>& ptr) -> InternalT&;
-    static auto DoBorrowOrMerge(std::shared_ptr<Page>& me, std::shared_ptr<Page>& parent, KeyT& del_key_in_parent) -> StatusOr<IndexCase>;
+    // copy-on-write mode: root of the running txn, readers use their version's root
     std::shared_ptr<Page> root;
-    std::shared_mutex rw_lock;
+    // copy-on-write mode: serializes writers only
+    mutable std::shared_mutex rw_lock;
+    std::shared_ptr<PageStore> page_store;
+    // nullptr unless copy-on-write mode
+    std::shared_ptr<ShadowStore> shadow_store;
+    std::unique_ptr<ShadowTxn> txn;
+    // nullptr unless mmap mode, replaces page_store
+    std::shared_ptr<MmapStore> mmap_store;
+    // nullptr for an in-memory index
+    std::shared_ptr<Wal> wal;
+    // nullptr without checkpoints
+    std::shared_ptr<PageFile> page_file;
+    std::string checkpoint_path;
+    // hot page list, empty: warm-up off
+    std::string hot_pages_path;
+    size_t hot_pages_max{0};
+    // right simblings of a leaf Get lands on to read ahead, IoOptions::leaf_readahead
+    int leaf_readahead{0};
+    uint64_t checkpoint_lsn{0};
+    // one checkpoint at a time
+    std::mutex checkpoint_mu;
+    std::thread checkpoint_thread;
+    std::mutex stop_mu;
+    std::condition_variable stop_cv;
+    bool stopping{false};
+    WritebackOptions writeback_options;
+    // guarded by stop_mu. a throttled writer asks for a round, then waits for the round count to move
+    bool writeback_requested{false};
+    uint64_t writeback_rounds{0};
+    std::condition_variable writeback_cv;
+    // per-thread latency histograms of the point ops
+    mutable LatencyRecorder latency;
+    // pages per level counted from the leaves, adjusted by writers under rw_lock on
+    // every split / merge / root change. valid once known, a scan recounts them
+    std::array<int64_t, MAX_TREE_HEIGHT> level_pages{};
+    bool level_pages_known{false};
+    // one GetTreeStats at a time, it may recount level_pages
+    std::mutex tree_stats_mu;
 };
 
 INDEX_TEMPLATE_ARGUMENTS
-auto Index<KeyT, ValueT, KeyComparatorT>::GetLeaf(std::shared_ptr<Page>& ptr) -> LeafT& {
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::GetLeaf(std::shared_ptr<Page>& ptr) -> LeafT& {
     return *reinterpret_cast<LeafT*>(ptr->data());
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-auto Index<KeyT, ValueT, KeyComparatorT>::GetInner(std::shared_ptr<Page>& ptr) -> InternalT& {
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::GetInner(std::shared_ptr<Page>& ptr) -> InternalT& {
     return *reinterpret_cast<InternalT*>(ptr->data());
 }
 
 
 INDEX_TEMPLATE_ARGUMENTS
-auto Index<KeyT, ValueT, KeyComparatorT>::Insert(const KeyT& key, const ValueT& val) -> Status {
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Insert(const KeyT& key, const ValueT& val) -> Status {
+    auto timer = OpTimer(this->latency, LatencyOp::Insert);
+    ThrottleWriter();
     std::unique_lock guard(this->rw_lock);
-    // std::cout << "root addr: " << (void *)this->root.get() << std::endl;
-    if (CheckIsLeafPage(this->root)) {
-        auto& leaf_root = GetLeaf(this->root);
-        auto leaf_split_info = std::make_shared<LeafSplitInfoT>();
-        auto leaf_insert_res = leaf_root.Insert(key, val, leaf_split_info);
-        if (leaf_insert_res.Ok()) {
-            auto leaf_case = leaf_insert_res.Unwrap();
-            if (leaf_case == LeafCase::OK) {
-                // std::cout << "leaf insert ok\n";
-            } else if (leaf_case == LeafCase::SplitPage) {
-                // split
-                assert(leaf_split_info.get() != nullptr);
-                auto new_root_page = RawPageMgr::create();
-                auto& inner_new_root = GetInner(new_root_page);
-                inner_new_root.Init();
-                // std::cout << "leaf_page?" << inner_new_root.IsLeafPage() << "  |  " << CheckIsLeafPage(new_root_page)<< std::endl;
-                inner_new_root.SetInitialState(leaf_split_info->mid_elem, leaf_root.GetPageId(), leaf_split_info->new_page_id);
-                this->root = new_root_page;
-                // std::cout << "new root addr: " << (void *)this->root.get() << std::endl;
-            }
-        } else {
-            std::cout << "leaf insert error!\n";
-            leaf_insert_res.Unwrap();
+    timer.Mark(LatencyPhase::LockWait);
+    if (LogFailed()) {
+        return {StatusCode::IOError};
+    }
+    auto scope = WriteScope();
+    auto insert_res = InsertFromRoot(key, val, timer);
+    if (!insert_res.Ok()) {
+        return insert_res;
+    }
+    return CommitOp(guard, WalRecordType::Insert, key, val);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::InsertFromRoot(const KeyT& key, const ValueT& val, OpTimer& timer) -> Status {
+    /*
+        1. descend to leaf, record the path
+        2. insert into leaf
+        3. bottom-up: count the new key in child, or insert the elem split out of child
+        4. grow a new root if root split
+    */
+    static_assert(FITS_PAGE, "inner page holds too few elems to split, use a bigger PageSize");
+    // 1. descend
+    PathT path{};
+    path.Push(this->root);
+    while (!CheckIsLeafPage(path.Back())) {
+        auto& cur_inner = GetInner(path.Back());
+        std::variant<ValueT, PidT> get_result;
+        auto get_pid_case = cur_inner.GetChildPidOrValue(key, get_result).Unwrap();
+        if (get_pid_case == InternalCase::GetValue) {
+            // key is duplicate
+            return {StatusCode::KeyDuplicate};
+        } else if (get_pid_case != InternalCase::GetChildPageId) {
+            std::cout << "should not reach here!\n";
             exit(-1);
         }
-        return {};
-    } else {
-        // root is internal
-        /*
-            1. find leaf
-            2. insert
-            3. do split if happen
-        */
-        auto old_root_split_info = std::make_shared<InternalSplitInfoT>();
-        auto internal_insert_res = InsertFromInternal(this->root, key, val, old_root_split_info);
-        if (internal_insert_res.Ok()) {
-            auto iicase =internal_insert_res.Unwrap();
-            if (iicase == IndexCase::Ok) {
-                // std::cout << "insert ok in internal insert\n";
-                return {};
-            } else if (iicase == IndexCase::ChildInsertPageSplit) {
-                assert(old_root_split_info.get() != nullptr);
-                auto new_root_page = RawPageMgr::create();
-                auto& inner_new_root = GetInner(new_root_page);
-                inner_new_root.Init();
-                auto& inner_old_root = GetInner(this->root);
-                auto old_root_pid = inner_old_root.GetPageId();
-                inner_new_root.SetInitialState(old_root_split_info->mid_elem, old_root_pid, old_root_split_info->new_page_id);
-                this->root = new_root_page;
-                // std::cout << "new root addr: " << (void *)this->root.get() << std::endl;
+        auto child_pid = std::get<PidT>(get_result);
+        path.child_idxs[path.depth - 1] = cur_inner.GetIdxByPid(child_pid);
+        path.Push(RawPageMgr::get_page(child_pid));
+    }
+    timer.Mark(LatencyPhase::Descent);
+    // every level may split and the root grow: fail here, before any page changes
+    auto reserve_res = RawPageMgr::Reserve(path.depth + 1);
+    if (!reserve_res.Ok()) {
+        return reserve_res;
+    }
+
+    // 2. insert into leaf
+    // filled in by a split only, on the stack: the common insert allocates nothing
+    auto split_info = LeafSplitInfoT{};
+    auto leaf_insert_res = GetLeaf(path.Back()).Insert(key, val, split_info);
+    if (!leaf_insert_res.Ok()) {
+        // key is duplicate
+        return {StatusCode::KeyDuplicate};
+    }
+    auto leaf_did_split = leaf_insert_res.Unwrap() == LeafCase::SplitPage;
+    auto did_split = leaf_did_split;
+    if (leaf_did_split) {
+        this->level_pages[0]++;
+    }
+
+    // 3. bottom-up
+    for (int level = path.depth - 2; level >= 0; level--) {
+        auto& cur_inner = GetInner(path.pages[level]);
+        auto child_idx = path.child_idxs[level];
+        if (!did_split) {
+            cur_inner.ChangeCountAt(child_idx, 1);
+            // a new value only widens the child summary
+            if constexpr (HAS_SUMMARY<AggregateT>) {
+                cur_inner.CombineSummaryAt(child_idx, AggregateT::FromValue(val));
             }
+            continue;
+        }
+        // Insert refreshes metas of the split child and its new simbling
+        auto mid_elem = split_info.mid_elem; // pair<key, value>
+        auto new_pid = split_info.new_page_id;
+        auto inner_insert_case = cur_inner.Insert(mid_elem.first, mid_elem.second, new_pid, split_info).Unwrap();
+        did_split = inner_insert_case == InternalCase::InsertSplit;
+        if (did_split) {
+            this->level_pages[path.depth - 1 - level]++;
         }
-        return {};
     }
+
+    // 4. grow root
+    if (did_split) {
+        auto new_root_page = RawPageMgr::create(PageSize);
+        auto& inner_new_root = GetInner(new_root_page);
+        inner_new_root.Init();
+        auto old_root_pid = reinterpret_cast<BTreePage*>(this->root->data())->GetPageId();
+        inner_new_root.SetInitialState(split_info.mid_elem, old_root_pid, split_info.new_page_id);
+        this->root = new_root_page;
+        this->level_pages[path.depth]++;
+        if (this->mmap_store != nullptr) {
+            // a repair from the old root would lose the half split off it
+            this->mmap_store->SetRootPid(inner_new_root.GetPageId());
+        }
+    }
+    if (leaf_did_split) {
+        timer.Mark(LatencyPhase::SplitMerge);
+    }
+    return {};
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-auto Index<KeyT, ValueT, KeyComparatorT>::dump_struct() const -> std::string {
-    std::shared_lock guard(this->rw_lock);
-    if (CheckIsLeafPage(this->root)) {
-        auto btree_page = reinterpret_cast<LeafT*>(this->root->data());
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::dump_struct() const -> std::string {
+    auto view = ReadView();
+    if (CheckIsLeafPage(view.root)) {
+        auto btree_page = reinterpret_cast<LeafT*>(view.root->data());
         return btree_page->dump_struct();
     } else {
-        auto btree_page = reinterpret_cast<InternalT*>(this->root->data());
+        auto btree_page = reinterpret_cast<InternalT*>(view.root->data());
         return btree_page->dump_struct();
     }
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-auto Index<KeyT, ValueT, KeyComparatorT>::create() -> std::shared_ptr<SelfT> {
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::create() -> std::shared_ptr<SelfT> {
     auto idx = std::make_shared<SelfT>();
-    idx->root = RawPageMgr::create();
+    idx->page_store = std::make_shared<PageStore>();
+    auto scope = idx->WriteScope();
+    idx->root = RawPageMgr::create(PageSize);
     auto& root_leaf = GetLeaf(idx->root);
     root_leaf.Init();
+    idx->level_pages[0] = 1;
+    idx->level_pages_known = true;
     return idx;
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-auto Index<KeyT, ValueT, KeyComparatorT>::InsertFromInternal(std::shared_ptr<Page>& cur_page, const KeyT& key, 
-    const ValueT& value, std::shared_ptr<InternalSplitInfoT>& cur_split_info) -> StatusOr<IndexCase> {
-    if (CheckIsLeafPage(cur_page)) {
-        // insert in leaf
-        auto& cur_leaf = GetLeaf(cur_page);
-        auto leaf_split_info = std::make_shared<LeafSplitInfoT>();
-        auto leaf_insert_res = cur_leaf.Insert(key, value, leaf_split_info);
-        auto leaf_case = leaf_insert_res.Unwrap();
-        if (leaf_case == LeafCase::OK) {
-            return {IndexCase::Ok};
-        } else if (leaf_case == LeafCase::SplitPage) {
-            assert(leaf_split_info.get() != nullptr);
-            auto elem = leaf_split_info->mid_elem; // pair<key, value>
-            auto new_pid = leaf_split_info->new_page_id;
-            // insert mid key, mid value, new pid into cur page
-            cur_split_info->mid_elem = elem;
-            cur_split_info->new_page_id = new_pid;
-            return {IndexCase::ChildInsertPageSplit};
+Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::~Index() {
+    if (this->checkpoint_thread.joinable()) {
+        {
+            std::unique_lock lk(this->stop_mu);
+            this->stopping = true;
         }
-    } else {
-        // internal page
-        auto& cur_inner = GetInner(cur_page);
-        std::variant<ValueT, PidT> get_result;
-        auto get_pid_res = cur_inner.GetChildPidOrValue(key, get_result);
-        auto get_pid_case = get_pid_res.Unwrap();
-        if (get_pid_case == InternalCase::GetValue) {
-            // key is duplicate
-            return {make_exception<KeyDuplicateException>()};
-        } else if (get_pid_case != InternalCase::GetChildPageId) {
-            std::cout << "should not reach here!\n";
-            exit(-1);
+        this->stop_cv.notify_all();
+        this->checkpoint_thread.join();
+    }
+    // clean shutdown, next open replays nothing
+    if (this->page_file != nullptr || this->mmap_store != nullptr) {
+        Checkpoint();
+        SaveHotPages();
+    }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::ReadScope() const -> RawPageMgr::Scope {
+    if (this->mmap_store != nullptr) {
+        return RawPageMgr::Scope(this->mmap_store.get(), false);
+    }
+    return RawPageMgr::Scope(this->page_store.get(), false);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::ReadView() const -> ReadViewT {
+    if (this->shadow_store != nullptr) {
+        // no lock: the pinned version stays as it is while writers publish new ones
+        auto snapshot = this->shadow_store->Acquire();
+        auto root_page = snapshot->get_page(snapshot->root_pid, false);
+        auto backend = snapshot.get();
+        return ReadViewT{{}, std::move(snapshot), std::move(root_page), RawPageMgr::Scope(backend, false)};
+    }
+    std::shared_lock guard(this->rw_lock);
+    auto root_page = this->root;
+    return ReadViewT{std::move(guard), {}, std::move(root_page), ReadScope()};
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::WriteScope() -> RawPageMgr::Scope {
+    if (this->shadow_store != nullptr) {
+        // a txn left by a failed op is dropped here
+        this->txn = this->shadow_store->Begin();
+        auto root_pid = this->txn->BaseRootPid();
+        this->root = (root_pid < 0)? std::shared_ptr<Page>{} : this->txn->get_page(root_pid, true);
+        return RawPageMgr::Scope(this->txn.get(), true);
+    }
+    if (this->mmap_store != nullptr) {
+        // file is marked unflushed before the first page changes
+        this->mmap_store->BeginWrite().Unwrap();
+        return RawPageMgr::Scope(this->mmap_store.get(), true);
+    }
+    // root is held directly, not fetched through the store
+    if (this->root != nullptr) {
+        this->page_store->MarkDirty(reinterpret_cast<BTreePage*>(this->root->data())->GetPageId());
+    }
+    return RawPageMgr::Scope(this->page_store.get(), true);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+template<typename... FieldTs>
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::CommitOp(std::unique_lock<std::shared_mutex>& guard, 
+    WalRecordType type, const FieldTs&... fields) -> Status {
+    if (this->shadow_store != nullptr) {
+        auto root_pid = reinterpret_cast<BTreePage*>(this->root->data())->GetPageId();
+        auto commit_res = this->shadow_store->Commit(*this->txn, root_pid);
+        this->txn.reset();
+        if (!commit_res.Ok()) {
+            // level counters moved with the dropped txn
+            this->level_pages_known = false;
         }
-        auto child_pid = std::get<PidT>(get_result);
-        auto child_page = RawPageMgr::get_page(child_pid);
-        auto child_insert_res = InsertFromInternal(child_page, key, value, cur_split_info);
-        auto child_insert_case = child_insert_res.Unwrap();
-        if (child_insert_case == IndexCase::Ok) {
-            return {IndexCase::Ok};
-        } else if (child_insert_case == IndexCase::ChildInsertPageSplit) {
-            auto cur_insert_elem = cur_split_info->mid_elem; // pair<key, value>
-            auto cur_insert_pid = cur_split_info->new_page_id;
-            auto child_split_info = std::make_shared<InternalSplitInfoT>();
-            auto inner_insert_res = cur_inner.Insert(cur_insert_elem.first, cur_insert_elem.second, cur_insert_pid, child_split_info);
-            auto inner_insert_case = inner_insert_res.Unwrap();
-            if (inner_insert_case == InternalCase::OK) {
-                return {IndexCase::Ok};
-            } else {
-                assert(child_split_info.get() != nullptr);
-                auto elem = child_split_info->mid_elem; // pair<key, value>
-                auto new_pid = child_split_info->new_page_id;
-                // insert mid key, mid value, new pid into cur page
-                // TODO
-                cur_split_info->mid_elem = elem;
-                cur_split_info->new_page_id = new_pid;
-                return {IndexCase::ChildInsertPageSplit};
+        return commit_res;
+    }
+    if (this->mmap_store != nullptr) {
+        // where a repair starts after a crash
+        this->mmap_store->SetRootPid(reinterpret_cast<BTreePage*>(this->root->data())->GetPageId());
+        return {};
+    }
+    if (this->wal == nullptr) {
+        return {};
+    }
+    auto lsn = LogRecord(type, fields...);
+    // group commit, wait without holding the index lock
+    guard.unlock();
+    return this->wal->Commit(lsn);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::LogFailed() const -> bool {
+    return this->wal != nullptr && this->wal->Failed();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::open(const ShadowOptions& options) -> StatusOr<std::shared_ptr<SelfT>> {
+    /*
+        1. load the last committed version
+        2. empty file: commit a version holding an empty root leaf
+        nothing to redo or undo, a crash leaves the last committed version intact
+    */
+    auto idx = std::make_shared<SelfT>();
+    // 1. load
+    auto store_res = ShadowStore::open(options, PageSize);
+    if (!store_res.Ok()) {
+        return {store_res.Code()};
+    }
+    idx->shadow_store = store_res.Unwrap();
+    // 2. first version
+    if (idx->shadow_store->Acquire()->root_pid < 0) {
+        auto scope = idx->WriteScope();
+        idx->root = RawPageMgr::create(PageSize);
+        GetLeaf(idx->root).Init();
+        auto commit_res = idx->shadow_store->Commit(*idx->txn, reinterpret_cast<BTreePage*>(idx->root->data())->GetPageId());
+        idx->txn.reset();
+        if (!commit_res.Ok()) {
+            return {commit_res.Code()};
+        }
+    }
+    return {idx};
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::open(const WalOptions& options, 
+    const CheckpointOptions& ckpt_options) -> StatusOr<std::shared_ptr<SelfT>> {
+    /*
+        1. load the last checkpoint, write its page images into the page file again
+        2. open log, lsn continues after the checkpoint
+        3. redo the log records after the checkpoint
+        4. attach log, start background checkpoints
+        5. warm up: prefetch the pages hot at the last close, reads go on beside the caller
+        no undo pass: only mutations that were applied are logged, each one as a whole
+    */
+    static_assert(std::is_trivially_copyable_v<KeyT> && std::is_trivially_copyable_v<ValueT>, 
+        "log records copy raw key / value bytes");
+    auto idx = std::make_shared<SelfT>();
+    idx->page_store = std::make_shared<PageStore>(ckpt_options.pool);
+    uint64_t start_lsn = 0;
+    // 1. checkpoint
+    if (!ckpt_options.path.empty()) {
+        auto file_res = PageFile::open(ckpt_options.path, IoEngine::create(ckpt_options.io), ckpt_options.io.direct, PageSize);
+        if (!file_res.Ok()) {
+            return {file_res.Code()};
+        }
+        idx->page_file = file_res.Unwrap();
+        idx->checkpoint_path = ckpt_options.path + ".ckpt";
+        auto ckpt_res = LoadCheckpoint(idx->checkpoint_path);
+        if (!ckpt_res.Ok()) {
+            return {ckpt_res.Code()};
+        }
+        auto ckpt = ckpt_res.Unwrap();
+        auto next_pid = 0;
+        if (ckpt.has_value()) {
+            // made by an index of another page size
+            if (ckpt->page_size != PageSize) {
+                return {StatusCode::IOError};
             }
+            // crash may have hit while the images were written last time
+            auto write_res = idx->page_file->WriteBatch(ckpt->images);
+            if (!write_res.Ok()) {
+                return {write_res.Code()};
+            }
+            auto sync_res = idx->page_file->Sync();
+            if (!sync_res.Ok()) {
+                return {sync_res.Code()};
+            }
+            next_pid = ckpt->next_pid;
+            start_lsn = ckpt->lsn;
+        }
+        // pages are read from the page file on first access
+        idx->page_store->AttachFile(idx->page_file, next_pid);
+        idx->leaf_readahead = ckpt_options.io.leaf_readahead;
+        if (ckpt.has_value()) {
+            auto scope = idx->ReadScope();
+            idx->root = RawPageMgr::get_page(ckpt->root_pid);
         }
     }
-    return {IndexCase::Ok};
+    idx->checkpoint_lsn = start_lsn;
+    if (idx->root == nullptr) {
+        auto scope = idx->WriteScope();
+        idx->root = RawPageMgr::create(PageSize);
+        GetLeaf(idx->root).Init();
+    }
+    // 2. open log
+    auto wal_res = Wal::open(options, start_lsn);
+    if (!wal_res.Ok()) {
+        return {wal_res.Code()};
+    }
+    auto wal = wal_res.Unwrap();
+    // 3. redo
+    {
+        auto scope = idx->WriteScope();
+        auto replay_res = wal->Replay(start_lsn, [&idx](const WalRecord& record) {
+            idx->ApplyRecord(record);
+        });
+        if (!replay_res.Ok()) {
+            return {replay_res.Code()};
+        }
+    }
+    // 4. attach
+    idx->wal = wal;
+    idx->writeback_options = ckpt_options.writeback;
+    if (idx->page_file != nullptr && (ckpt_options.interval_ms > 0 || ckpt_options.writeback.dirty_target > 0)) {
+        idx->checkpoint_thread = std::thread([raw = idx.get(), interval_ms = ckpt_options.interval_ms] {
+            raw->CheckpointLoop(interval_ms);
+        });
+    }
+    // 5. warm up
+    if (idx->page_file != nullptr && ckpt_options.warmup.enabled) {
+        idx->hot_pages_path = ckpt_options.path + ".hot";
+        idx->hot_pages_max = ckpt_options.warmup.max_pages > 0 ? ckpt_options.warmup.max_pages : ckpt_options.pool.capacity;
+        auto hot_res = LoadHotPages(idx->hot_pages_path);
+        // a missing or broken list only means a cold start
+        if (hot_res.Ok()) {
+            auto pids = hot_res.Unwrap();
+            if (idx->hot_pages_max > 0 && pids.size() > idx->hot_pages_max) {
+                pids.resize(idx->hot_pages_max);
+            }
+            idx->page_store->prefetch(pids);
+        }
+    }
+    return {idx};
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-auto Index<KeyT, ValueT, KeyComparatorT>::Update(const KeyT& key, const ValueT& new_val) -> Status {
-    // std::cout << "root addr: " << (void *)this->root.get() << std::endl;
-    std::unique_lock guard(this->rw_lock);
-    if (CheckIsLeafPage(this->root)) {
-        auto& leaf_root = GetLeaf(this->root);
-        auto leaf_split_info = std::make_shared<LeafSplitInfoT>();
-        auto leaf_insert_res = leaf_root.Update(key, new_val);
-        if (leaf_insert_res.Ok()) {
-            auto leaf_case = leaf_insert_res.Unwrap();
-            if (leaf_case == LeafCase::OK) {
-                std::cout << "root is leaf! update ok\n";
-            } else if (leaf_case == LeafCase::KeyNotFound) {
-                std::cout << fmt::format("root is leaf! KeyNotFound\n");
-            } else {
-                std::cout << "should not reach here\n";
-                exit(-1);
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::open(const MmapOptions& options) -> StatusOr<std::shared_ptr<SelfT>> {
+    /*
+        1. map the file, nothing is read up front
+        2. unflushed file: walk the tree, free what it does not reach
+        3. new file: empty root leaf
+        4. start background flushes
+    */
+    auto idx = std::make_shared<SelfT>();
+    // 1. map
+    auto store_res = MmapStore::open(options, PageSize);
+    if (!store_res.Ok()) {
+        return {store_res.Code()};
+    }
+    idx->mmap_store = store_res.Unwrap();
+    auto root_pid = idx->mmap_store->RootPid();
+    // 2. repair
+    if (idx->mmap_store->NeedsRepair()) {
+        auto scope = idx->WriteScope();
+        auto live = std::vector<bool>{};
+        if (root_pid >= 0) {
+            auto leaf_depth = -1;
+            auto repair_res = RepairSubtree(RawPageMgr::get_page(root_pid), root_pid, 0, leaf_depth, live);
+            if (!repair_res.Ok()) {
+                return {repair_res.Code()};
             }
-        } else {
-            std::cout << "root is leaf! update error!\n";
-            leaf_insert_res.Unwrap();
-            exit(-1);
         }
+        auto finish_res = idx->mmap_store->FinishRepair(root_pid, live);
+        if (!finish_res.Ok()) {
+            return {finish_res.Code()};
+        }
+    }
+    // 3. root
+    if (root_pid >= 0) {
+        auto scope = idx->ReadScope();
+        idx->root = RawPageMgr::get_page(root_pid);
+    } else {
+        auto scope = idx->WriteScope();
+        auto reserve_res = RawPageMgr::Reserve(1);
+        if (!reserve_res.Ok()) {
+            return {reserve_res.Code()};
+        }
+        idx->root = RawPageMgr::create(PageSize);
+        GetLeaf(idx->root).Init();
+        idx->mmap_store->SetRootPid(reinterpret_cast<BTreePage*>(idx->root->data())->GetPageId());
+    }
+    // 4. background flush
+    if (options.flush_interval_ms > 0) {
+        idx->checkpoint_thread = std::thread([raw = idx.get(), interval_ms = options.flush_interval_ms] {
+            raw->CheckpointLoop(interval_ms);
+        });
+    }
+    return {idx};
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Checkpoint() -> Status {
+    /*
+        fuzzy checkpoint: writers wait only while dirty pages are copied, io runs beside them
+        1. under shared lock: copy dirty pages, root pid and the lsn of the last applied record,
+           then sync the log: no op whose record failed to reach it gets into the page file
+        2. save the checkpoint record, from now on recovery starts from it
+        3. write the images into the page file
+        4. drop the log records the checkpoint covers
+        a failed step marks the pages dirty again, the next checkpoint retries them
+    */
+    if (this->mmap_store != nullptr) {
+        // mmap mode: the kernel holds the dirty pages, flush them and mark the file clean
+        std::unique_lock checkpoint_guard(this->checkpoint_mu);
+        std::shared_lock guard(this->rw_lock);
+        if (this->root == nullptr) {
+            // open failed before the root was known, the file stays as it was
+            return {};
+        }
+        return this->mmap_store->Flush(reinterpret_cast<BTreePage*>(this->root->data())->GetPageId());
+    }
+    if (this->page_file == nullptr || this->wal == nullptr) {
         return {};
+    }
+    // the tree may hold ops whose records never made it to the log
+    if (LogFailed()) {
+        return {StatusCode::IOError};
+    }
+    std::unique_lock checkpoint_guard(this->checkpoint_mu);
+    // 1. snapshot
+    auto record = CheckpointRecord{};
+    {
+        std::shared_lock guard(this->rw_lock);
+        record.lsn = this->wal->LastLsn();
+        if (record.lsn == this->checkpoint_lsn) {
+            // nothing applied since the last checkpoint
+            return {};
+        }
+        record.root_pid = reinterpret_cast<BTreePage*>(this->root->data())->GetPageId();
+        record.next_pid = this->page_store->NextPageId();
+        record.page_size = PageSize;
+        record.images = this->page_store->TakeDirtyImages();
+    }
+    auto redirty = [this, &record] {
+        for (auto& [pid, image] : record.images) {
+            this->page_store->MarkDirty(pid);
+        }
+    };
+    auto log_res = this->wal->Sync();
+    if (!log_res.Ok()) {
+        redirty();
+        return log_res;
+    }
+    // 2. save record
+    auto save_res = SaveCheckpoint(this->checkpoint_path, record);
+    if (!save_res.Ok()) {
+        redirty();
+        return save_res;
+    }
+    // 3. write images, submitted as one batch
+    auto write_res = this->page_file->WriteBatch(record.images);
+    if (!write_res.Ok()) {
+        redirty();
+        return write_res;
+    }
+    auto sync_res = this->page_file->Sync();
+    if (!sync_res.Ok()) {
+        redirty();
+        return sync_res;
+    }
+    this->page_store->FinishWriteback(record.images);
+    // 4. drop covered log
+    this->checkpoint_lsn = record.lsn;
+    return this->wal->Truncate(record.lsn);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::SaveHotPages() -> Status {
+    if (this->hot_pages_path.empty()) {
+        return {};
+    }
+    std::unique_lock checkpoint_guard(this->checkpoint_mu);
+    return ::SaveHotPages(this->hot_pages_path, this->page_store->HotPages(this->hot_pages_max));
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::GetPoolStats() const -> PoolStats {
+    if (this->page_store == nullptr) {
+        return {};
+    }
+    return this->page_store->Stats();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Stats() const -> IndexStats {
+    return this->latency.Collect();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::GetTreeStats(bool scan) -> TreeStats {
+    /*
+        1. keep writers out (copy-on-write readers lock nothing otherwise), pin the view
+        2. leftmost descent: height, slot capacity of leaves / inner pages
+        3. pages per level: counters, or a walk when asked or not known yet
+        4. fill, bytes and orphans from the slots per level
+    */
+    // 1. lock
+    auto writer_guard = std::shared_lock(this->rw_lock, std::defer_lock);
+    if (this->shadow_store != nullptr) {
+        writer_guard.lock();
+    }
+    auto view = ReadView();
+    std::lock_guard stats_guard(this->tree_stats_mu);
+    auto stats = TreeStats{};
+    stats.keys = (size_t)InternalT::SubtreeCount(view.root);
+
+    // 2. descent
+    auto leaf_max = 0;
+    auto inner_max = 0;
+    auto cur_page = view.root;
+    while (!CheckIsLeafPage(cur_page)) {
+        inner_max = GetInner(cur_page).GetMaxSize();
+        stats.height++;
+        cur_page = RawPageMgr::get_page(GetInner(cur_page).PidAt(0));
+    }
+    leaf_max = GetLeaf(cur_page).GetMaxSize();
+    stats.height++;
+
+    // 3. pages per level
+    if (scan || !this->level_pages_known) {
+        stats.levels = ScanLevels(view.root);
+        stats.scanned = true;
+        this->level_pages.fill(0);
+        for (size_t level = 0; level < stats.levels.size(); level++) {
+            this->level_pages[level] = (int64_t)stats.levels[level].pages;
+        }
+        this->level_pages_known = true;
     } else {
-        // root is internal
-        /*
-            1. find leaf
-            2. insert
-            3. do split if happen
-        */
-        auto old_root_split_info = std::make_shared<InternalSplitInfoT>();
-        auto internal_update_res = UpdateFromInternal(this->root, key, new_val);
-        if (internal_update_res.Ok()) {
-            auto iucase =internal_update_res.Unwrap();
-            if (iucase == IndexCase::Ok) {
-                // std::cout << "root is internal! update ok\n";
-            } else if (iucase == IndexCase::KeyNotFound) {
-            } else {
-                std::cout << "should not reach here\n";
-                exit(-1);
+        stats.levels.resize(stats.height);
+        for (int level = 0; level < stats.height; level++) {
+            stats.levels[level].pages = (size_t)this->level_pages[level];
+        }
+        // an inner page of c children holds c - 1 keys, every page but the root is a child
+        stats.levels[0].slots = stats.keys - (stats.levels[0].pages - 1);
+        for (int level = 1; level < stats.height; level++) {
+            stats.levels[level].slots = stats.levels[level - 1].pages;
+        }
+    }
+
+    // 4. fill, bytes
+    auto leaf_slot_bytes = (sizeof(LeafT) - sizeof(BTreePage)) / leaf_max;
+    auto inner_slot_bytes = inner_max == 0 ? 0 : (sizeof(InternalT) - sizeof(BTreePage)) / inner_max;
+    for (size_t level = 0; level < stats.levels.size(); level++) {
+        auto& level_stats = stats.levels[level];
+        auto slot_max = level == 0 ? leaf_max : inner_max;
+        level_stats.avg_fill = (double)level_stats.slots / (double)(level_stats.pages * slot_max);
+        (level == 0 ? stats.leaf_pages : stats.inner_pages) += level_stats.pages;
+        stats.bytes_used += level_stats.pages * sizeof(BTreePage) 
+            + level_stats.slots * (level == 0 ? leaf_slot_bytes : inner_slot_bytes);
+    }
+    auto live_pages = size_t{0};
+    if (view.snapshot != nullptr) {
+        live_pages = view.snapshot->LivePages();
+    } else if (this->mmap_store != nullptr) {
+        live_pages = this->mmap_store->LivePages();
+    } else {
+        live_pages = this->page_store->LivePages();
+    }
+    stats.bytes_allocated = live_pages * PageSize;
+    auto tree_pages = stats.leaf_pages + stats.inner_pages;
+    stats.orphaned_pages = live_pages > tree_pages ? live_pages - tree_pages : 0;
+    return stats;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::RepairSubtree(std::shared_ptr<Page> raw_page, PidT pid, 
+    int depth, int& leaf_depth, std::vector<bool>& live) -> Status {
+    /*
+        1. the page: readable, reached once, stamped with its pid, of a known type and fill
+        2. leaf: all leaves on one level
+        3. inner: repair the children, then recount their metas; an op cut short may
+           have counted its key on the way down without reaching the leaf
+    */
+    // 1. page
+    if (raw_page == nullptr || depth >= MAX_TREE_HEIGHT || ((size_t)pid < live.size() && live[pid])) {
+        return {StatusCode::IOError};
+    }
+    if (live.size() <= (size_t)pid) {
+        live.resize(pid + 1);
+    }
+    live[pid] = true;
+    // max sizes Init writes
+    static auto const leaf_max = [] {
+        auto page = Page(PageSize);
+        reinterpret_cast<LeafT*>(page.data())->Init();
+        return reinterpret_cast<BTreePage*>(page.data())->GetMaxSize();
+    }();
+    static auto const inner_max = [] {
+        auto page = Page(PageSize);
+        reinterpret_cast<InternalT*>(page.data())->Init();
+        return reinterpret_cast<BTreePage*>(page.data())->GetMaxSize();
+    }();
+    auto& btree_page = *reinterpret_cast<BTreePage*>(raw_page->data());
+    if (!btree_page.IsLeafPage() && !btree_page.IsInternalPage()) {
+        return {StatusCode::IOError};
+    }
+    if (btree_page.GetPageId() != pid || btree_page.GetMaxSize() != (btree_page.IsLeafPage() ? leaf_max : inner_max)
+        || btree_page.GetSize() < 0 || btree_page.GetSize() > btree_page.GetMaxSize()) {
+        return {StatusCode::IOError};
+    }
+    // 2. leaf
+    if (btree_page.IsLeafPage()) {
+        if (leaf_depth < 0) {
+            leaf_depth = depth;
+        }
+        return leaf_depth == depth ? Status{} : Status{StatusCode::IOError};
+    }
+    // 3. inner
+    auto& inner = GetInner(raw_page);
+    if (inner.GetSize() < 1) {
+        return {StatusCode::IOError};
+    }
+    for (int i = 0; i < inner.GetSize(); i++) {
+        auto child_pid = inner.PidAt(i);
+        auto child_res = RepairSubtree(RawPageMgr::get_page(child_pid), child_pid, depth + 1, leaf_depth, live);
+        if (!child_res.Ok()) {
+            return child_res;
+        }
+        inner.RefreshMetaAt(i);
+    }
+    return {};
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::ScanLevels(std::shared_ptr<Page>& root) -> std::vector<LevelStats> {
+    // breadth first, only sizes and child pids are read, a level's pids are held at a time
+    auto levels = std::vector<LevelStats>{};
+    auto cur_pids = std::vector<PidT>{reinterpret_cast<BTreePage*>(root->data())->GetPageId()};
+    while (!cur_pids.empty()) {
+        auto level_stats = LevelStats{};
+        level_stats.min_fill = 1.0;
+        size_t capacity = 0;
+        auto next_pids = std::vector<PidT>{};
+        for (auto pid : cur_pids) {
+            auto raw_page = RawPageMgr::get_page(pid);
+            auto& btree_page = *reinterpret_cast<BTreePage*>(raw_page->data());
+            auto fill = (double)btree_page.GetSize() / (double)btree_page.GetMaxSize();
+            level_stats.pages++;
+            level_stats.slots += btree_page.GetSize();
+            level_stats.min_fill = std::min(level_stats.min_fill, fill);
+            level_stats.max_fill = std::max(level_stats.max_fill, fill);
+            capacity += btree_page.GetMaxSize();
+            if (!btree_page.IsLeafPage()) {
+                auto& inner = GetInner(raw_page);
+                for (int i = 0; i < inner.GetSize(); i++) {
+                    next_pids.push_back(inner.PidAt(i));
+                }
             }
+        }
+        level_stats.avg_fill = (double)level_stats.slots / (double)capacity;
+        levels.push_back(level_stats);
+        cur_pids.swap(next_pids);
+    }
+    std::reverse(levels.begin(), levels.end());
+    return levels;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::CheckpointLoop(int interval_ms) {
+    /*
+        checkpoint every interval_ms (0: no periodic checkpoint). with a dirty target the
+        thread also wakes every poll interval, or when a throttled writer asks, and checkpoints
+        as soon as dirty pages pass the target, so writers rarely find the page table dirty
+    */
+    auto poll_ms = this->writeback_options.dirty_target > 0 ? this->writeback_options.poll_interval_ms : 0;
+    auto wait_ms = interval_ms > 0 && poll_ms > 0 ? std::min(interval_ms, poll_ms) : std::max(interval_ms, poll_ms);
+    auto last_checkpoint = std::chrono::steady_clock::now();
+    std::unique_lock lk(this->stop_mu);
+    while (!this->stopping) {
+        this->stop_cv.wait_for(lk, std::chrono::milliseconds(wait_ms), [this] {
+            return this->stopping || this->writeback_requested;
+        });
+        if (this->stopping) {
+            break;
+        }
+        auto now = std::chrono::steady_clock::now();
+        auto due = interval_ms > 0 && now - last_checkpoint >= std::chrono::milliseconds(interval_ms);
+        auto dirty = this->writeback_requested || (poll_ms > 0 && OverDirtyShare(this->writeback_options.dirty_target));
+        this->writeback_requested = false;
+        if (due || dirty) {
+            lk.unlock();
+            // failure keeps the pages dirty, next round retries
+            Checkpoint();
+            if (due) {
+                SaveHotPages();
+            }
+            lk.lock();
+            last_checkpoint = now;
+        }
+        this->writeback_rounds++;
+        this->writeback_cv.notify_all();
+    }
+    // writers must not wait for a round that never comes
+    this->writeback_cv.notify_all();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::OverDirtyShare(double share) const -> bool {
+    return this->page_store != nullptr && this->page_store->DirtyRatio() > share;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::ThrottleWriter() {
+    if (this->writeback_options.dirty_limit <= 0 || !this->checkpoint_thread.joinable()
+        || !OverDirtyShare(this->writeback_options.dirty_limit)) {
+        return;
+    }
+    std::unique_lock lk(this->stop_mu);
+    auto seen_rounds = this->writeback_rounds;
+    this->writeback_requested = true;
+    this->stop_cv.notify_all();
+    this->writeback_cv.wait(lk, [this, seen_rounds] {
+        return this->stopping || this->writeback_rounds != seen_rounds;
+    });
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+template<typename... FieldTs>
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::LogRecord(WalRecordType type, const FieldTs&... fields) -> uint64_t {
+    // payload is the raw bytes of fields, back to back
+    char payload[(sizeof(FieldTs) + ...)];
+    size_t offset = 0;
+    ((std::memcpy(payload + offset, &fields, sizeof(FieldTs)), offset += sizeof(FieldTs)), ...);
+    return this->wal->Append(type, payload, sizeof(payload));
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::ApplyRecord(const WalRecord& record) {
+    // only applied mutations are logged, a replayed one can not fail
+    KeyT key{};
+    std::memcpy(&key, record.payload, sizeof(KeyT));
+    auto rest = record.payload + sizeof(KeyT);
+    // replay is not an op of this process, nothing timed
+    auto no_timer = OpTimer{};
+    if (record.type == WalRecordType::Insert || record.type == WalRecordType::Update) {
+        assert(record.size == sizeof(KeyT) + sizeof(ValueT));
+        ValueT val{};
+        std::memcpy(&val, rest, sizeof(ValueT));
+        if (record.type == WalRecordType::Insert) {
+            InsertFromRoot(key, val, no_timer);
         } else {
-            std::cout << "root is internal! update error!\n";
-            internal_update_res.Unwrap();
-            exit(-1);
+            UpdateFromRoot(key, val);
         }
+    } else if (record.type == WalRecordType::Remove) {
+        assert(record.size == sizeof(KeyT));
+        RemoveFromRoot(key, no_timer);
+    } else if (record.type == WalRecordType::DeleteRange) {
+        assert(record.size == 2 * sizeof(KeyT));
+        KeyT hi{};
+        std::memcpy(&hi, rest, sizeof(KeyT));
+        DeleteRangeFromRoot(key, hi);
+    } else {
+        std::cout << "should not reach here!\n";
+        exit(-1);
+    }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Update(const KeyT& key, const ValueT& new_val) -> Status {
+    auto timer = OpTimer(this->latency, LatencyOp::Update);
+    ThrottleWriter();
+    std::unique_lock guard(this->rw_lock);
+    timer.Mark(LatencyPhase::LockWait);
+    if (LogFailed()) {
+        return {StatusCode::IOError};
+    }
+    auto scope = WriteScope();
+    auto update_res = UpdateFromRoot(key, new_val);
+    timer.Mark(LatencyPhase::Descent);
+    // updating a missing key is a no-op, nothing to log
+    if (!update_res.Ok()) {
         return {};
     }
+    return CommitOp(guard, WalRecordType::Update, key, new_val);
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-auto Index<KeyT, ValueT, KeyComparatorT>::UpdateFromInternal(std::shared_ptr<Page>& cur_page, const KeyT& key, 
-                                                                 const ValueT& new_val) -> StatusOr<IndexCase> {
-    if (CheckIsLeafPage(cur_page)) {
-        // Update in leaf
-        auto& cur_leaf = GetLeaf(cur_page);
-        auto leaf_split_info = std::make_shared<LeafSplitInfoT>();
-        auto leaf_insert_res = cur_leaf.Update(key, new_val);
-        auto leaf_case = leaf_insert_res.Unwrap();
-        if (leaf_case == LeafCase::OK) {
-            return {IndexCase::Ok};
-        } else if (leaf_case == LeafCase::KeyNotFound) {
-            return {IndexCase::KeyNotFound};
-        } else {
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::UpdateFromRoot(const KeyT& key, const ValueT& new_val) -> Status {
+    /*
+        1. descend, record the path, update in place where key is found
+        2. bottom-up: old value may be the child min / max, rebuild summaries on the path
+    */
+    // 1. descend
+    PathT path{};
+    path.Push(this->root);
+    auto found = false;
+    while (!CheckIsLeafPage(path.Back())) {
+        auto& cur_inner = GetInner(path.Back());
+        PidT child_pid{};
+        auto cur_update_get_case = cur_inner.DoUpdateOrGetChild(key, new_val, child_pid).Unwrap();
+        if (cur_update_get_case == InternalCase::OK) {
+            found = true;
+            break;
+        } else if (cur_update_get_case != InternalCase::GetChildPageId) {
             std::cout << "should not reach here!\n";
             exit(-1);
         }
-    } else {
-        // internal page
-        auto& cur_inner = GetInner(cur_page);
-        PidT get_pid{};
-        auto cur_inner_get_res = cur_inner.DoUpdateOrGetChild(key, new_val, get_pid);
-        auto cur_update_get_case = cur_inner_get_res.Unwrap();
-        if (cur_update_get_case == InternalCase::OK) {
-            return {IndexCase::Ok};
-        } else if (cur_update_get_case == InternalCase::GetChildPageId) {
-            auto child_pid = get_pid;
-            auto child_page = RawPageMgr::get_page(child_pid);
-            auto child_insert_res = UpdateFromInternal(child_page, key, new_val);
-            auto child_insert_case = child_insert_res.Unwrap();
-            if (child_insert_case == IndexCase::Ok || child_insert_case == IndexCase::KeyNotFound) {
-                return {child_insert_case};
-            } else {
-                std::cout << "should not reach here!\n";
-                exit(-1);
-            }
-        } else {
+        path.child_idxs[path.depth - 1] = cur_inner.GetIdxByPid(child_pid);
+        path.Push(RawPageMgr::get_page(child_pid));
+    }
+    if (!found) {
+        auto leaf_case = GetLeaf(path.Back()).Update(key, new_val).Unwrap();
+        if (leaf_case == LeafCase::OK) {
+            found = true;
+        } else if (leaf_case != LeafCase::KeyNotFound) {
             std::cout << "should not reach here!\n";
             exit(-1);
         }
-        
     }
-    return {IndexCase::Ok};
+
+    // 2. bottom-up
+    if constexpr (HAS_SUMMARY<AggregateT>) {
+        if (found) {
+            for (int level = path.depth - 2; level >= 0; level--) {
+                GetInner(path.pages[level]).RefreshSummaryAt(path.child_idxs[level]);
+            }
+        }
+    }
+    if (!found) {
+        return {StatusCode::KeyNotFound};
+    }
+    return {};
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-auto Index<KeyT, ValueT, KeyComparatorT>::Get(const KeyT& key) -> StatusOr<std::optional<ValueT>> {
-    std::shared_lock guard(this->rw_lock);
-    if (CheckIsLeafPage(this->root)) {
-        auto& leaf_root = GetLeaf(this->root);
-        ValueT value{};
-        auto leaf_get_res = leaf_root.Get(key, value);
-        if (leaf_get_res.Ok()) {
-            auto leaf_case = leaf_get_res.Unwrap();
-            if (leaf_case == LeafCase::OK) {
-                // std::cout << "leaf get ok\n";
-                return {std::make_optional(value)};
-            } else if (leaf_case == LeafCase::KeyNotFound) {
-                return {std::optional<ValueT>{}};
-            } else {
-                std::cout << "should not reach here!\n";
-                exit(-1);
-            }
-        } else {
-            std::cout << "leaf insert error!\n";
-            leaf_get_res.Unwrap();
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Get(const KeyT& key) -> StatusOr<std::optional<ValueT>> {
+    auto timer = OpTimer(this->latency, LatencyOp::Get);
+    auto view = ReadView();
+    timer.Mark(LatencyPhase::LockWait);
+    // read only, no path needed
+    auto cur_page = view.root;
+    while (!CheckIsLeafPage(cur_page)) {
+        auto& cur_inner = GetInner(cur_page);
+        std::variant<ValueT, PidT> get_res;
+        auto cur_get_case = cur_inner.GetChildPidOrValue(key, get_res).Unwrap();
+        if (cur_get_case == InternalCase::GetValue) {
+            timer.Mark(LatencyPhase::Descent);
+            return {std::make_optional(std::get<ValueT>(get_res))};
+        } else if (cur_get_case != InternalCase::GetChildPageId) {
+            std::cout << "should not reach here!\n";
             exit(-1);
         }
-        return {std::optional<ValueT>{}};
-    } else {
-        // root is internal
-        /*
-            1. find leaf
-            2. insert
-            3. do split if happen
-        */
-        ValueT result{};
-        auto internal_get_res = GetFromInternal(this->root, key, result);
-        auto iicase =internal_get_res.Unwrap();
-        if (iicase == IndexCase::Ok) {
-            // std::cout << "insert ok in internal insert\n";
-            return {std::make_optional<ValueT>(result)};
-        } else if (iicase == IndexCase::KeyNotFound) {
-            return {std::optional<ValueT>{}};
+        auto child_page = RawPageMgr::get_page(std::get<PidT>(get_res));
+        if (this->leaf_readahead > 0 && CheckIsLeafPage(child_page)) {
+            // next lookups / scans are likely to land on the right simblings
+            auto child_idx = cur_inner.ChildIdxOf(key);
+            auto last_idx = std::min(cur_inner.GetSize(), child_idx + 1 + this->leaf_readahead);
+            auto pids = std::vector<int>{};
+            for (int i = child_idx + 1; i < last_idx; i++) {
+                pids.push_back(cur_inner.PidAt(i));
+            }
+            RawPageMgr::prefetch(pids);
         }
-        std::cout << "should not reach here!\n";
-        exit(-1);
+        // cur_inner lives in cur_page, a bounded page table may evict it once unpinned
+        cur_page = std::move(child_page);
+    }
+    ValueT value{};
+    auto leaf_case = GetLeaf(cur_page).Get(key, value).Unwrap();
+    timer.Mark(LatencyPhase::Descent);
+    if (leaf_case == LeafCase::OK) {
+        return {std::make_optional(value)};
+    } else if (leaf_case == LeafCase::KeyNotFound) {
         return {std::optional<ValueT>{}};
     }
+    std::cout << "should not reach here!\n";
+    exit(-1);
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-auto Index<KeyT, ValueT, KeyComparatorT>::GetFromInternal(std::shared_ptr<Page>& cur_page, const KeyT& key, ValueT& result) -> StatusOr<IndexCase> {
-    if (CheckIsLeafPage(cur_page)) {
-        // insert in leaf
-        auto& cur_leaf = GetLeaf(cur_page);
-        ValueT val{};
-        auto leaf_get_res = cur_leaf.Get(key, val);
-        auto leaf_case = leaf_get_res.Unwrap();
-        if (leaf_case == LeafCase::OK) {
-            result = val;
-            return {IndexCase::Ok};
-        } else if (leaf_case == LeafCase::KeyNotFound) {
-            return {IndexCase::KeyNotFound};
-        }
-    } else {
-        // internal page
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::MultiGet(std::span<const KeyT> keys, 
+    std::span<std::optional<ValueT>> results, size_t group_size) -> Status {
+    if (results.size() < keys.size()) {
+        return {StatusCode::OutOfSpace};
+    }
+    auto view = ReadView();
+    // leaves are all this deep, the height tells a lookup which kind of page it prefetches
+    auto height = 1;
+    for (auto page = view.root; !CheckIsLeafPage(page); page = RawPageMgr::get_page(GetInner(page).PidAt(0))) {
+        height++;
+    }
+    RunInterleaved(keys.size(), group_size, [&view, height, &keys, &results](size_t i) {
+        return LookupFromRoot(view.root, height, keys[i], results[i]);
+    });
+    return {};
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::LookupFromRoot(std::shared_ptr<Page> cur_page, 
+    int height, const KeyT& key, std::optional<ValueT>& result) -> LookupTask {
+    // the root is hot: shared by the whole batch
+    auto level = 0;
+    while (!CheckIsLeafPage(cur_page)) {
         auto& cur_inner = GetInner(cur_page);
         std::variant<ValueT, PidT> get_res;
-        auto cur_get_res = cur_inner.GetChildPidOrValue(key, get_res);
-        auto cur_get_case = cur_get_res.Unwrap();
+        auto cur_get_case = cur_inner.GetChildPidOrValue(key, get_res).Unwrap();
         if (cur_get_case == InternalCase::GetValue) {
             result = std::get<ValueT>(get_res);
-            return {IndexCase::Ok};
-        } else if (cur_get_case == InternalCase::GetChildPageId) {
-            auto child_pid = std::get<PidT>(get_res);
-            auto child_page = RawPageMgr::get_page(child_pid);
-
-            auto child_get_res = GetFromInternal(child_page, key, result);
-            auto child_insert_case = child_get_res.Unwrap();
-            if (child_insert_case == IndexCase::Ok || child_insert_case == IndexCase::KeyNotFound) {
-                return {child_insert_case};
-            } else {
-                std::cout << "should not reach here!\n";
-                exit(-1);
-            }
-        } else {
+            co_return;
+        } else if (cur_get_case != InternalCase::GetChildPageId) {
             std::cout << "should not reach here!\n";
             exit(-1);
         }
+        cur_page = RawPageMgr::get_page(std::get<PidT>(get_res));
+        level++;
+        if (level == height - 1) {
+            LeafT::Prefetch(cur_page);
+        } else {
+            InternalT::Prefetch(cur_page);
+        }
+        // the child loads while the other lookups of the group run
+        co_await std::suspend_always{};
+    }
+    ValueT value{};
+    auto leaf_case = GetLeaf(cur_page).Get(key, value).Unwrap();
+    if (leaf_case == LeafCase::OK) {
+        result = value;
+        co_return;
+    } else if (leaf_case == LeafCase::KeyNotFound) {
+        result.reset();
+        co_return;
     }
-    return {IndexCase::Ok};
+    std::cout << "should not reach here!\n";
+    exit(-1);
 }
 
+
 INDEX_TEMPLATE_ARGUMENTS
-auto Index<KeyT, ValueT, KeyComparatorT>::Remove(const KeyT& key) -> Status {
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Remove(const KeyT& key) -> Status {
+    auto timer = OpTimer(this->latency, LatencyOp::Remove);
+    ThrottleWriter();
     std::unique_lock guard(this->rw_lock);
-    if (CheckIsLeafPage(this->root)) {
-        auto& leaf_root = GetLeaf(this->root);
-        auto fake_parent = std::shared_ptr<Page>{};
-        KeyT fake_key{};
-        auto leaf_get_res = leaf_root.Remove(key, fake_parent, fake_key, true);
-        if (leaf_get_res.Ok()) {
-            auto leaf_case = leaf_get_res.Unwrap();
-            if (leaf_case == LeafCase::OK) {
-                // std::cout << "root is leaf! remove ok\n";
-                return {};
-            } else if (leaf_case == LeafCase::KeyNotFound) {
-                // std::cout << "root is leaf! key not found\n";
-                return {};
-            } else {
-                std::cout << "should not reach here!\n";
-                exit(-1);
-            }
-        }
-        std::cout << "leaf remove error!\n";
-        leaf_get_res.Unwrap();
-        exit(-1);
-    } else {
-        // root is internal
-        /*
-            1. find leaf
-            2. insert
-            3. do split if happen
-        */
-        auto& inner_root = GetInner(this->root);
+    timer.Mark(LatencyPhase::LockWait);
+    if (LogFailed()) {
+        return {StatusCode::IOError};
+    }
+    auto scope = WriteScope();
+    auto remove_res = RemoveFromRoot(key, timer);
+    // removing a missing key is a no-op, nothing to log
+    if (!remove_res.Ok()) {
+        return {};
+    }
+    return CommitOp(guard, WalRecordType::Remove, key);
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::RemoveFromRoot(const KeyT& key, OpTimer& timer) -> Status {
+    /*
+        1. descend, record the path, uncount the key in each child on the way;
+           key found in an inner page is replaced by its successor, which is removed instead
+        2. remove in leaf, leaf borrows / merges with its parent itself
+        3. key not found: restore the counts
+        4. bottom-up: refresh summaries, inner page whose child merged borrows / merges
+        5. shrink root with single child
+    */
+    // 1. descend
+    PathT path{};
+    path.Push(this->root);
+    auto removed_key = key;
+    while (!CheckIsLeafPage(path.Back())) {
+        auto& cur_inner = GetInner(path.Back());
         KeyT child_removed_key{};
         PidT child_pid{};
-        auto get_pid_res = inner_root.DowncastRemoveOrGetChildPid(key, child_removed_key, child_pid);
-        auto get_pid_case = get_pid_res.Unwrap();
-
-        std::shared_ptr<Page> child_raw_page;
-        KeyT cur_merged_key{};
-        KeyT new_removed_key{};
-
-
+        auto get_pid_case = cur_inner.DowncastRemoveOrGetChildPid(removed_key, child_removed_key, child_pid).Unwrap();
         if (get_pid_case == InternalCase::RemoveFound) {
             // downcast effect
-            child_raw_page = RawPageMgr::get_page(child_pid);
-            new_removed_key = child_removed_key;
-        } else if (get_pid_case == InternalCase::GetChildPageId) {
-            // get child pid
-            child_raw_page = RawPageMgr::get_page(child_pid);
-            new_removed_key = key;
-        } else {
+            removed_key = child_removed_key;
+        } else if (get_pid_case != InternalCase::GetChildPageId) {
             std::cout << "should not reach here!\n";
             exit(-1);
-        } 
-        
-
-        auto internal_remove_result = RemoveFromInternal(child_raw_page, this->root,
-            new_removed_key, cur_merged_key);
-        auto internal_remove_case = internal_remove_result.Unwrap();
-        if (internal_remove_case == IndexCase::Ok) {
-            // remove does not upcast effect
-            // std::cout << "root is inner! remove ok! \n";
-            return {};
-        } else if (internal_remove_case == IndexCase::ChildRemoveDidMerge) {
-            // check merge
-            if (inner_root.GetSize() == 1) {
-                // root is empty, change root.
-                // std::cout << "root is inner! change to new root!\n";
-                this->root = child_raw_page;
-            }
-            return {};
-        } else if (internal_remove_case == IndexCase::KeyNotFound) {
-            // std::cout << "root is inner! key not found\n";
-            return {};
         }
+        auto child_idx = cur_inner.GetIdxByPid(child_pid);
+        cur_inner.ChangeCountAt(child_idx, -1);
+        path.child_idxs[path.depth - 1] = child_idx;
+        path.Push(RawPageMgr::get_page(child_pid));
+    }
+    timer.Mark(LatencyPhase::Descent);
+
+    // 2. remove in leaf
+    auto is_root = path.depth == 1;
+    auto parent_page = is_root? std::shared_ptr<Page>{} : path.pages[path.depth - 2];
+    KeyT parent_merged_key{};
+    auto leaf_case = GetLeaf(path.Back()).Remove(removed_key, parent_page, parent_merged_key, is_root).Unwrap();
+
+    // 3. key not found
+    if (leaf_case == LeafCase::KeyNotFound) {
+        for (int level = 0; level < path.depth - 1; level++) {
+            GetInner(path.pages[level]).ChangeCountAt(path.child_idxs[level], 1);
+        }
+        return {StatusCode::KeyNotFound};
+    } else if (leaf_case != LeafCase::OK && leaf_case != LeafCase::DidBorrow && leaf_case != LeafCase::DidMerge) {
         std::cout << "should not reach here!\n";
         exit(-1);
     }
+
+    // 4. bottom-up
+    auto child_did_merge = leaf_case == LeafCase::DidMerge;
+    if (child_did_merge) {
+        this->level_pages[0]--;
+    }
+    for (int level = path.depth - 2; level >= 0; level--) {
+        auto& cur_inner = GetInner(path.pages[level]);
+        // child and its simbling may have changed, before cur borrows / merges
+        cur_inner.RefreshSummariesAround(path.child_idxs[level]);
+        if (!child_did_merge || level == 0) {
+            continue;
+        }
+        auto check_after_remove_case = cur_inner.CheckOrBorrowOrMerge(path.pages[level - 1]).Unwrap();
+        child_did_merge = check_after_remove_case == InternalCase::RemoveDidMerge;
+        if (child_did_merge) {
+            this->level_pages[path.depth - 1 - level]--;
+        }
+    }
+
+    // 5. shrink root
+    if (child_did_merge && GetInner(this->root).GetSize() == 1) {
+        // root is empty, its only child becomes new root.
+        auto old_root_pid = GetInner(this->root).GetPageId();
+        this->root = RawPageMgr::get_page(GetInner(this->root).PidAt(0));
+        RawPageMgr::remove(old_root_pid);
+        this->level_pages[path.depth - 1]--;
+    }
+    if (leaf_case != LeafCase::OK) {
+        timer.Mark(LatencyPhase::SplitMerge);
+    }
+    return {};
+}
+
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Count(const KeyT& lo, const KeyT& hi) -> StatusOr<size_t> {
+    auto view = ReadView();
+    if (KeyComparatorT{}(lo, hi) >= 0) {
+        return {size_t{0}};
+    }
+    return {RankFromRoot(view.root, hi) - RankFromRoot(view.root, lo)};
 }
 
 INDEX_TEMPLATE_ARGUMENTS
-auto Index<KeyT, ValueT, KeyComparatorT>::RemoveFromInternal(
-    std::shared_ptr<Page>& cur_page, 
-    std::shared_ptr<Page> parent_page, 
-    const KeyT& removed_key,
-    KeyT& parent_merged_key
-) -> StatusOr<IndexCase> {
-    auto cur_page_id = reinterpret_cast<BTreePage*>(cur_page->data())->GetPageId();
-    
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Rank(const KeyT& key) -> StatusOr<size_t> {
+    auto view = ReadView();
+    return {RankFromRoot(view.root, key)};
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::RankFromRoot(std::shared_ptr<Page> cur_page, const KeyT& key) -> size_t {
+    /*
+        descend towards key, summing subtree counts on the left
+        1. at inner page, add children and elems left of key
+        2. stop when key is an elem of inner page
+        3. at leaf, add keys < key
+    */
+    int64_t rank = 0;
+    while (!CheckIsLeafPage(cur_page)) {
+        auto& cur_inner = GetInner(cur_page);
+        PidT child_pid{};
+        auto rank_res = cur_inner.RankOrGetChild(key, rank, child_pid);
+        if (rank_res.Unwrap() == InternalCase::KeyFound) {
+            return (size_t)rank;
+        }
+        cur_page = RawPageMgr::get_page(child_pid);
+    }
+    return (size_t)(rank + GetLeaf(cur_page).Rank(key));
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Select(size_t k) -> StatusOr<std::optional<KeyT>> {
+    auto view = ReadView();
+    auto cur_page = view.root;
+    if (k >= (size_t)InternalT::SubtreeCount(cur_page)) {
+        return {std::optional<KeyT>{}};
+    }
+    auto remain = (int64_t)k;
+    while (!CheckIsLeafPage(cur_page)) {
+        auto& cur_inner = GetInner(cur_page);
+        KeyT result{};
+        PidT child_pid{};
+        auto select_res = cur_inner.SelectOrGetChild(remain, result, child_pid);
+        if (select_res.Unwrap() == InternalCase::KeyFound) {
+            return {std::make_optional(result)};
+        }
+        cur_page = RawPageMgr::get_page(child_pid);
+    }
+    // what remains is an index into the leaf
+    return {std::make_optional(GetLeaf(cur_page).KeyAt((int)remain))};
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::DeleteRange(const KeyT& lo, const KeyT& hi) -> StatusOr<size_t> {
+    ThrottleWriter();
+    std::unique_lock guard(this->rw_lock);
+    if (LogFailed()) {
+        return {StatusCode::IOError};
+    }
+    auto scope = WriteScope();
+    auto removed = DeleteRangeFromRoot(lo, hi).Unwrap();
+    if (removed == 0) {
+        return {removed};
+    }
+    auto commit_res = CommitOp(guard, WalRecordType::DeleteRange, lo, hi);
+    if (!commit_res.Ok()) {
+        return {commit_res.Code()};
+    }
+    return {removed};
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::DeleteRangeFromRoot(const KeyT& lo, const KeyT& hi) -> StatusOr<size_t> {
+    /*
+        1. trim: detach fully covered subtrees, cut the two boundary paths,
+           keep one in-range elem at the fork page as separator (sentinel)
+        2. rebalance the pages on the two boundary paths once
+        3. remove the sentinel as a normal single key
+    */
+    if (KeyComparatorT{}(lo, hi) >= 0) {
+        return {size_t{0}};
+    }
+    auto removed = RankFromRoot(this->root, hi) - RankFromRoot(this->root, lo);
+    if (removed == 0) {
+        return {size_t{0}};
+    }
+
+    // 1. trim
+    std::optional<KeyT> sentinel{};
+    TrimRange(this->root, &lo, &hi, sentinel);
+
+    // 2. rebalance
+    while (FixUnderflowOnPath(lo) || FixUnderflowOnPath(hi)) {}
+
+    // 3. remove sentinel
+    if (sentinel.has_value()) {
+        auto no_timer = OpTimer{};
+        RemoveFromRoot(sentinel.value(), no_timer).Unwrap();
+    }
+    return {removed};
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+void Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::TrimRange(std::shared_ptr<Page>& cur_page, 
+    const KeyT* lo, const KeyT* hi, std::optional<KeyT>& sentinel) {
+    /*
+        remove keys in [lo, hi) below cur page without rebalancing, nullptr bound is unbounded
+        1. leaf: cut the range
+        2. lo and hi in the same child: descend
+        3. fork: drop children in between, keep elem before hi child as sentinel
+        4. left boundary (no hi): drop every child right of lo child
+        5. right boundary (no lo): drop every child left of hi child
+    */
+    // 1. leaf
     if (CheckIsLeafPage(cur_page)) {
-        // std::cout << "[RemoveFromInternal] (LEAF) on page id : " << cur_page_id << std::endl;
-        auto& parent_inner = GetInner(parent_page);
-        auto cur_idx_in_parent = parent_inner.GetIdxByPid(cur_page_id);
-        assert(cur_idx_in_parent != -1);
-        PidT simbling_pid{};
-        if (cur_idx_in_parent == parent_inner.GetSize() - 1) {
-            simbling_pid = parent_inner.PidAt(cur_idx_in_parent - 1);
-        } else {
-            simbling_pid = parent_inner.PidAt(cur_idx_in_parent + 1);
+        GetLeaf(cur_page).RemoveRange(lo, hi);
+        return;
+    }
+    auto& cur_inner = GetInner(cur_page);
+    auto lo_idx = (lo == nullptr)? 0 : cur_inner.ChildIdxOf(*lo);
+    auto hi_idx = (hi == nullptr)? cur_inner.GetSize() - 1 : cur_inner.ChildIdxOf(*hi);
+
+    // 2. same child
+    if (lo_idx == hi_idx) {
+        auto child_page = RawPageMgr::get_page(cur_inner.PidAt(lo_idx));
+        TrimRange(child_page, lo, hi, sentinel);
+        cur_inner.RefreshMetaAt(lo_idx);
+        return;
+    }
+
+    if (lo != nullptr && hi != nullptr) {
+        // 3. fork
+        sentinel = cur_inner.ElemAt(hi_idx).first;
+        for (int i = lo_idx + 1; i < hi_idx; i++) {
+            DropSubtree(cur_inner.PidAt(i));
         }
-        auto simbling_page = RawPageMgr::get_page(simbling_pid);
-        // delete in leaf
-        auto& cur_leaf = GetLeaf(cur_page);
-        auto leaf_remove_res = cur_leaf.Remove(removed_key, parent_page, parent_merged_key, false);
-        auto leaf_case = leaf_remove_res.Unwrap();
-        if (leaf_case == LeafCase::OK) {
-            return {IndexCase::Ok};
-        } else if (leaf_case == LeafCase::DidMerge) {
-            return {IndexCase::ChildRemoveDidMerge};
-        } else if (leaf_case == LeafCase::DidBorrow) {
-            return {IndexCase::Ok};
-        } else if (leaf_case == LeafCase::KeyNotFound) {
-            return {IndexCase::KeyNotFound};
+        cur_inner.RemoveElemsAndPidsIn(lo_idx + 1, hi_idx);
+        auto left_page = RawPageMgr::get_page(cur_inner.PidAt(lo_idx));
+        auto right_page = RawPageMgr::get_page(cur_inner.PidAt(lo_idx + 1));
+        TrimRange(left_page, lo, nullptr, sentinel);
+        TrimRange(right_page, nullptr, hi, sentinel);
+        cur_inner.RefreshMetaAt(lo_idx);
+        cur_inner.RefreshMetaAt(lo_idx + 1);
+    } else if (hi == nullptr) {
+        // 4. left boundary
+        for (int i = lo_idx + 1; i < cur_inner.GetSize(); i++) {
+            DropSubtree(cur_inner.PidAt(i));
         }
-        std::cout << "should not reach here!\n";
-        exit(-1);
+        cur_inner.RemoveElemsAndPidsIn(lo_idx + 1, cur_inner.GetSize());
+        auto child_page = RawPageMgr::get_page(cur_inner.PidAt(lo_idx));
+        TrimRange(child_page, lo, nullptr, sentinel);
+        cur_inner.RefreshMetaAt(lo_idx);
     } else {
-        // std::cout << "[RemoveFromInternal] (INNER) on page id : " << cur_page_id << std::endl;
-        // internal page
-        auto& cur_inner = GetInner(cur_page);
-        KeyT child_removed_key{};
-        PidT child_pid{};
-        auto get_pid_res = cur_inner.DowncastRemoveOrGetChildPid(removed_key, child_removed_key, child_pid);
-        auto get_pid_case = get_pid_res.Unwrap();
-        std::shared_ptr<Page> child_raw_page{};
-        KeyT cur_merged_key{};
-        KeyT new_removed_key{};
-        if (get_pid_case == InternalCase::RemoveFound) {
-            // downcast effect
-            child_raw_page = RawPageMgr::get_page(child_pid);
-            new_removed_key = child_removed_key;
-        } else if (get_pid_case == InternalCase::GetChildPageId) {
-            // get child pid
-            child_raw_page = RawPageMgr::get_page(child_pid);
-            new_removed_key = removed_key;
-        } else {
-            std::cout << "should not reach here!\n";
-            exit(-1);
+        // 5. right boundary
+        for (int i = 0; i < hi_idx; i++) {
+            DropSubtree(cur_inner.PidAt(i));
+        }
+        cur_inner.RemoveFrontPids(hi_idx);
+        auto child_page = RawPageMgr::get_page(cur_inner.PidAt(0));
+        TrimRange(child_page, nullptr, hi, sentinel);
+        cur_inner.RefreshMetaAt(0);
+    }
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::DropSubtree(PidT pid) -> int {
+    auto raw_page = RawPageMgr::get_page(pid);
+    auto level = 0;
+    if (!CheckIsLeafPage(raw_page)) {
+        auto& inner = GetInner(raw_page);
+        // read all children in one batch instead of one miss after another
+        auto pids = std::vector<int>{};
+        for (int i = 0; i < inner.GetSize(); i++) {
+            pids.push_back(inner.PidAt(i));
+        }
+        RawPageMgr::prefetch(pids);
+        for (int i = 0; i < inner.GetSize(); i++) {
+            level = DropSubtree(inner.PidAt(i)) + 1;
+        }
+    }
+    RawPageMgr::remove(pid);
+    this->level_pages[level]--;
+    return level;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::FixUnderflowOnPath(const KeyT& key) -> bool {
+    /*
+        after TrimRange only pages on the lo / hi paths can be under min size
+        1. collect root-to-leaf path next to key
+        2. bottom-up, borrow until the page is full enough, or merge
+        3. a merge changes the path, let caller walk it again
+        4. shrink root with single child
+        returns whether anything changed
+    */
+    // 1. collect path
+    PathT path{};
+    path.Push(this->root);
+    while (!CheckIsLeafPage(path.Back())) {
+        auto& inner = GetInner(path.Back());
+        auto child_idx = inner.ChildIdxOf(key);
+        path.child_idxs[path.depth - 1] = child_idx;
+        path.Push(RawPageMgr::get_page(inner.PidAt(child_idx)));
+    }
+
+    // 2. bottom-up
+    auto changed = false;
+    for (int level = path.depth - 1; level >= 1; level--) {
+        auto& parent_inner = GetInner(path.pages[level - 1]);
+        if (parent_inner.GetSize() < 2) {
+            // no simbling yet, revisit once parent is fixed
+            continue;
         }
-        auto internal_remove_result = RemoveFromInternal(child_raw_page, cur_page, new_removed_key, cur_merged_key);
-        auto internal_remove_case = internal_remove_result.Unwrap();
-        if (internal_remove_case == IndexCase::Ok) {
-            // remove does not upcast effect
-            return {IndexCase::Ok};
-        } else if (internal_remove_case == IndexCase::ChildRemoveDidMerge) {
-            // check merge
-            auto check_after_remove_res = cur_inner.CheckOrBorrowOrMerge(parent_page);
-            auto check_after_remove_case = check_after_remove_res.Unwrap();
-            if (check_after_remove_case == InternalCase::RemoveDidMerge) {
-                // did merge in cur page
-                return {IndexCase::ChildRemoveDidMerge};
+        auto& cur_page = path.pages[level];
+        auto my_idx = path.child_idxs[level - 1];
+        if (CheckIsLeafPage(cur_page)) {
+            auto& cur_leaf = GetLeaf(cur_page);
+            while (cur_leaf.GetSize() < cur_leaf.GetMinSize()) {
+                auto fix_case = cur_leaf.CheckOrBorrowOrMerge(path.pages[level - 1]).Unwrap();
+                parent_inner.RefreshSummariesAround(my_idx);
+                changed = true;
+                // 3. path changed
+                if (fix_case == LeafCase::DidMerge) {
+                    this->level_pages[0]--;
+                    return true;
+                }
+            }
+        } else {
+            auto& cur_inner = GetInner(cur_page);
+            while (cur_inner.GetSize() < cur_inner.GetMinSize()) {
+                auto fix_case = cur_inner.CheckOrBorrowOrMerge(path.pages[level - 1]).Unwrap();
+                parent_inner.RefreshSummariesAround(my_idx);
+                changed = true;
+                // 3. path changed
+                if (fix_case == InternalCase::RemoveDidMerge) {
+                    this->level_pages[path.depth - 1 - level]--;
+                    return true;
+                }
             }
-            // cur size is safe or did borrow
-            return {IndexCase::Ok};
         }
-        std::cout << "should not reach here!\n";
-        exit(-1);
     }
-    return {IndexCase::Ok};
+
+    // 4. shrink root
+    if (!CheckIsLeafPage(this->root) && GetInner(this->root).GetSize() == 1) {
+        auto old_root_pid = GetInner(this->root).GetPageId();
+        this->root = RawPageMgr::get_page(GetInner(this->root).PidAt(0));
+        RawPageMgr::remove(old_root_pid);
+        this->level_pages[path.depth - 1]--;
+        return true;
+    }
+    return changed;
 }
 
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Aggregate(const KeyT& lo, const KeyT& hi) -> StatusOr<typename AggregateT::SummaryT> {
+    static_assert(HAS_SUMMARY<AggregateT>, "Index is created without aggregate policy");
+    auto view = ReadView();
+    if (KeyComparatorT{}(lo, hi) >= 0) {
+        return {AggregateT::Identity()};
+    }
+    return {AggregateFromPage(view.root, &lo, &hi)};
+}
 
 INDEX_TEMPLATE_ARGUMENTS
-auto Index<KeyT, ValueT, KeyComparatorT>::DumpGraphviz() -> std::string {
-    std::shared_lock guard(this->rw_lock);
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::AggregateFromPage(std::shared_ptr<Page>& cur_page, 
+    const KeyT* lo, const KeyT* hi) -> typename AggregateT::SummaryT {
+    /*
+        aggregate keys in [lo, hi), nullptr bound is already satisfied by the whole page
+        1. leaf: scan the keys in range
+        2. inner: child fully in range -> use stored summary
+        3. inner: child crosses lo or hi -> descend (only two boundary paths)
+    */
+    if (CheckIsLeafPage(cur_page)) {
+        return GetLeaf(cur_page).RangeSummary(lo, hi);
+    }
+    auto& cur_inner = GetInner(cur_page);
+    auto cmp = KeyComparatorT{};
+    auto total = AggregateT::Identity();
+    for (int i = 0; i < cur_inner.GetSize(); i++) {
+        // child i holds keys in (elem[i], elem[i + 1])
+        auto has_left = i > 0;
+        auto has_right = i + 1 < cur_inner.GetSize();
+        auto left_elem = has_left? cur_inner.ElemAt(i) : std::pair<KeyT, ValueT>{};
+        auto right_key = has_right? cur_inner.ElemAt(i + 1).first : KeyT{};
+        if (has_left && hi != nullptr && cmp(left_elem.first, *hi) >= 0) {
+            break;
+        }
+        if (has_left && (lo == nullptr || cmp(*lo, left_elem.first) <= 0)) {
+            total = AggregateT::Combine(total, AggregateT::FromValue(left_elem.second));
+        }
+        if (has_right && lo != nullptr && cmp(right_key, *lo) <= 0) {
+            continue;
+        }
+        auto lo_covered = lo == nullptr || (has_left && cmp(*lo, left_elem.first) <= 0);
+        auto hi_covered = hi == nullptr || (has_right && cmp(right_key, *hi) <= 0);
+        if (lo_covered && hi_covered) {
+            total = AggregateT::Combine(total, cur_inner.SummaryAt(i));
+        } else {
+            auto child_page = RawPageMgr::get_page(cur_inner.PidAt(i));
+            auto child_total = AggregateFromPage(child_page, lo_covered? nullptr : lo, hi_covered? nullptr : hi);
+            total = AggregateT::Combine(total, child_total);
+        }
+    }
+    return total;
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::DumpGraphviz() -> std::string {
     std::stringstream out;
+    WriteGraphviz(out);
+    return out.str();
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::WriteGraphviz(std::ostream& out, 
+    const GraphvizOptions& options) -> Status {
+    /*
+        depth first over an explicit stack of (pid, depth), one lock per step:
+        1. lock, or use the version pinned for the whole walk in copy-on-write mode
+        2. draw the page, a pid removed since its parent was drawn becomes a dashed box
+        3. inner page: draw the sampled children's edges; children past max_depth become
+           a count box, leaf children are drawn right away, inner ones are pushed
+    */
+    auto pinned = this->shadow_store == nullptr ? nullptr : this->shadow_store->Acquire();
+    auto lock_step = [this, &pinned]() -> ReadViewT {
+        if (pinned == nullptr) {
+            return ReadView();
+        }
+        auto root_page = pinned->get_page(pinned->root_pid, false);
+        return ReadViewT{{}, pinned, std::move(root_page), RawPageMgr::Scope(pinned.get(), false)};
+    };
+    auto max_depth = options.max_depth < 0 ? MAX_TREE_HEIGHT : std::min(options.max_depth, MAX_TREE_HEIGHT);
+    auto draw_leaf = [&out, &options](LeafT& leaf) {
+        if (!options.summarize_leaves) {
+            out << leaf.DumpNodeGraphviz();
+            return;
+        }
+        out << "  node" << leaf.GetPageId() << " [label=\"" << leaf.GetSize() << " keys|"
+            << 100 * leaf.GetSize() / leaf.GetMaxSize() << "% full\"];\n";
+    };
+    auto stack = std::vector<std::pair<PidT, int>>{};
     out << "digraph BTree {\n";
     out << "  node [shape=record];\n";
-
-    if (CheckIsLeafPage(this->root)) {
-        auto& leaf = GetLeaf(this->root);
-        out << leaf.DumpNodeGraphviz();
-    } else {
-        auto& inner = GetInner(this->root);
+    {
+        auto view = lock_step();
+        stack.emplace_back(reinterpret_cast<BTreePage*>(view.root->data())->GetPageId(), 0);
+    }
+    while (!stack.empty() && out) {
+        auto [pid, depth] = stack.back();
+        stack.pop_back();
+        // 1. lock
+        auto view = lock_step();
+        // 2. draw page
+        auto raw_page = RawPageMgr::get_page(pid);
+        if (raw_page == nullptr || reinterpret_cast<BTreePage*>(raw_page->data())->GetPageId() != pid) {
+            out << "  node" << pid << " [label=\"removed\", style=dashed];\n";
+            continue;
+        }
+        if (CheckIsLeafPage(raw_page)) {
+            draw_leaf(GetLeaf(raw_page));
+            continue;
+        }
+        auto& inner = GetInner(raw_page);
         out << inner.DumpNodeGraphviz();
+        // 3. children
+        auto child_cnt = inner.GetSize();
+        auto drawn_cnt = (options.sample_children > 0) ? std::min(options.sample_children, child_cnt) : child_cnt;
+        auto pushed = std::vector<std::pair<PidT, int>>{};
+        for (int k = 0; k < drawn_cnt; k++) {
+            auto i = (drawn_cnt == child_cnt || drawn_cnt == 1) ? k : k * (child_cnt - 1) / (drawn_cnt - 1);
+            auto child_pid = inner.PidAt(i);
+            out << "  node" << pid << ":f" << i << " -> node" << child_pid << ";\n";
+            if (depth + 1 >= max_depth) {
+                out << "  node" << child_pid << " [label=\"subtree|" << inner.CountAt(i) << " keys\", style=dashed];\n";
+                continue;
+            }
+            auto child_page = RawPageMgr::get_page(child_pid);
+            if (child_page != nullptr && CheckIsLeafPage(child_page)) {
+                draw_leaf(GetLeaf(child_page));
+            } else {
+                pushed.emplace_back(child_pid, depth + 1);
+            }
+        }
+        if (drawn_cnt < child_cnt) {
+            out << "  node" << pid << "_more [label=\"" << child_cnt - drawn_cnt << " more children\", shape=plaintext];\n";
+            out << "  node" << pid << " -> node" << pid << "_more [style=dotted];\n";
+        }
+        // leftmost child on top
+        stack.insert(stack.end(), pushed.rbegin(), pushed.rend());
     }
-
     out << "}\n";
-    return out.str();
+    out.flush();
+    if (!out) {
+        return {StatusCode::IOError};
+    }
+    return {};
+}
+
+INDEX_TEMPLATE_ARGUMENTS
+auto Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::WriteGraphviz(int fd, 
+    const GraphvizOptions& options) -> Status {
+    auto buf = FdOutBuf(fd);
+    auto out = std::ostream(&buf);
+    auto write_res = WriteGraphviz(out, options);
+    if (!write_res.Ok() || buf.Failed()) {
+        return {StatusCode::IOError};
+    }
+    return {};
 }
@@ -12,6 +12,7 @@
 #include "common.h"
 #include "btree_page.h"
 #include "../status/status.h"
+#include "fmt/core.h"
 #include "index.h"
 
 
@@ -28,11 +29,18 @@ enum class InternalCase: int {
 
 INTERNAL_TEMPLATE_ARGUMENTS
 class InternalPage: public BTreePage {
-    static size_t constexpr SLOT_CNT = PAGE_SLOT_CNT_CALC<sizeof(KeyT) + sizeof(ValueT), sizeof(PidT)>;
-    using LeafT = LeafPage<KeyT, ValueT, KeyComparatorT>;
-    using SelfT = InternalPage<KeyT, ValueT, PidT, KeyComparatorT>;
+    using SummaryT = typename AggregateT::SummaryT;
+    struct ChildMeta {
+        // number of elements in the subtree, 64 bit: a tree may hold more than 2^31
+        int64_t count;
+        // aggregate of the subtree, takes no space under NoAggregate
+        [[no_unique_address]] SummaryT summary;
+    };
+    static size_t constexpr SLOT_CNT = PAGE_SLOT_CNT_CALC<sizeof(std::pair<KeyT, ValueT>), sizeof(PidT) + sizeof(ChildMeta), PageSize>;
+    using LeafT = LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>;
+    using SelfT = InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>;
     using PairT = std::pair<KeyT, ValueT>;
-    using KVPidT = std::tuple<KeyT, ValueT, PidT>;
+    using KVPidT = std::tuple<KeyT, ValueT, PidT, ChildMeta>;
     using InternalSplitInfoT = SplitInfo<KeyT, ValueT>;
 
 
@@ -60,6 +68,9 @@ class InternalPage: public BTreePage {
     using PairLowerBoundCmpT = PairComparatorLowerBound;
     using PairThreeWayCmpT = PairComparator;
 public:
+    // a split leaves both halves a key only from 5 slots on, a tree needs that many
+    static bool constexpr FITS_PAGE = SLOT_CNT >= 5;
+
     struct RemoveInfo {
     public:
         RemoveInfo() = default;
@@ -74,7 +85,7 @@ public:
 
     void SetInitialState(PairT first_kv, PidT pid1, PidT pid2) noexcept;
 
-    auto Insert(const KeyT& key, const ValueT& value, const PidT& pid, std::shared_ptr<InternalSplitInfoT>& split_info) -> StatusOr<InternalCase>;
+    auto Insert(const KeyT& key, const ValueT& value, const PidT& pid, InternalSplitInfoT& split_info) -> StatusOr<InternalCase>;
 
     auto NoExceptGet(const KeyT& key, ValueT& res, PidT& child_pid) const -> StatusOr<InternalCase>;
 
@@ -94,6 +105,10 @@ public:
 
     auto GetPidMatchElem(const PairT& elem, PidT& result) const -> StatusOr<InternalCase>;
 
+    auto RankOrGetChild(const KeyT& key, int64_t& rank, PidT& child_pid) const -> StatusOr<InternalCase>;
+
+    auto SelectOrGetChild(int64_t& k, KeyT& result, PidT& child_pid) const -> StatusOr<InternalCase>;
+
     auto dump_struct() const -> std::string;
 
     auto RemoveFirst() -> std::pair<PairT, PidT>;
@@ -108,10 +123,41 @@ public:
 
     void RemoveElemAndPidAt(int idx);
 
+    void RemoveElemsAndPidsIn(int first, int last);
+
+    void RemoveFrontPids(int cnt);
+
+    auto ChildIdxOf(const KeyT& key) const -> int;
+
+    void RefreshMetaAt(int idx);
+
     void SetElemPairAt(int idx, PairT p);
 
     auto GetFirstElem() const -> PairT;
 
+    auto CountAt(int idx) const -> int64_t;
+
+    void ChangeCountAt(int idx, int64_t amount);
+
+    auto TotalCount() const -> int64_t;
+
+    static auto SubtreeCount(const std::shared_ptr<Page>& raw_page) -> int64_t;
+
+    auto SummaryAt(int idx) const -> SummaryT;
+
+    void CombineSummaryAt(int idx, const SummaryT& summary);
+
+    void RefreshSummaryAt(int idx);
+
+    void RefreshSummariesAround(int idx);
+
+    auto TotalSummary() const -> SummaryT;
+
+    static auto SubtreeSummary(const std::shared_ptr<Page>& raw_page) -> SummaryT;
+
+    // start loading what GetChildPidOrValue reads first, without waiting for it
+    static void Prefetch(const std::shared_ptr<Page>& raw_page);
+
     auto DumpNodeGraphviz() const -> std::string;
 
 private:
@@ -127,18 +173,21 @@ private:
     // [pid0] [pid1]
     std::array<PairT, SLOT_CNT> pairs;
     std::array<PidT, SLOT_CNT> pids;
+    // count / summary of the subtree of pids[i]
+    std::array<ChildMeta, SLOT_CNT> metas;
 };
 
 
 
 
 INTERNAL_TEMPLATE_ARGUMENTS
-void InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::Init() noexcept {
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::Init() noexcept {
+    static_assert(sizeof(InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>) <= PageSize);
     BTreePage::Init(BTreePageType::INTERNAL_PAGE, (int)SLOT_CNT);
 }
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::Insert(const KeyT& key, const ValueT& value, const PidT& pid, std::shared_ptr<InternalSplitInfoT>& split_info) -> StatusOr<InternalCase> {
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::Insert(const KeyT& key, const ValueT& value, const PidT& pid, InternalSplitInfoT& split_info) -> StatusOr<InternalCase> {
     /*
         insert kv into page
         1. find position to insert
@@ -164,25 +213,33 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::Insert(const KeyT& key, c
         std::begin(this->pids) + GetSize(),
         std::begin(this->pids) + GetSize() + 1
     );
+    std::copy_backward(
+        std::begin(this->metas) + new_idx,
+        std::begin(this->metas) + GetSize(),
+        std::begin(this->metas) + GetSize() + 1
+    );
     // insert
     this->pairs[new_idx] = new_pair;
     this->pids[new_idx] = pid;
+    // the split child and its new right simbling share the old subtree
+    RefreshMetaAt(new_idx - 1);
+    RefreshMetaAt(new_idx);
     // 3. check whethre reaching max
     ChangeSizeBy(1);
     if (GetSize() < GetMaxSize()) {
         return {InternalCase::OK};        
     }
 
-    auto new_page = RawPageMgr::create();
+    auto new_page = RawPageMgr::create(PageSize);
     auto& new_inner_page = *reinterpret_cast<SelfT*>(new_page->data());
     new_inner_page.Init();
-    assert(split_info.get() != nullptr);
-    split_info->new_page_id = new_inner_page.GetPageId();
+    split_info.new_page_id = new_inner_page.GetPageId();
     auto mid_pos = GetMinSize();
-    split_info->mid_elem = this->pairs[mid_pos];
+    split_info.mid_elem = this->pairs[mid_pos];
 
     auto& new_pairs = new_inner_page.pairs;
     auto& new_pids = new_inner_page.pids;
+    auto& new_metas = new_inner_page.metas;
     std::copy(
         std::begin(this->pairs) + mid_pos + 1, 
         std::begin(this->pairs) + GetSize(), 
@@ -193,6 +250,11 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::Insert(const KeyT& key, c
         std::begin(this->pids) + GetSize(), 
         std::begin(new_pids)
     );
+    std::copy(
+        std::begin(this->metas) + mid_pos, 
+        std::begin(this->metas) + GetSize(), 
+        std::begin(new_metas)
+    );
     new_inner_page.SetSize(GetSize() - GetMinSize());
     this->SetSize(GetMinSize());
     return {InternalCase::InsertSplit};
@@ -200,7 +262,7 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::Insert(const KeyT& key, c
 
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::NoExceptGet(const KeyT& key, ValueT& res, PidT& child_pid) const -> StatusOr<InternalCase>{
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::NoExceptGet(const KeyT& key, ValueT& res, PidT& child_pid) const -> StatusOr<InternalCase>{
     /*
         get value of given key in page
         1. find pos of key
@@ -242,15 +304,17 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::NoExceptGet(const KeyT& k
 }
 
 INTERNAL_TEMPLATE_ARGUMENTS
-void InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::SetInitialState(PairT first_kv, PidT pid1, PidT pid2) noexcept {
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::SetInitialState(PairT first_kv, PidT pid1, PidT pid2) noexcept {
     this->pairs[1] = first_kv;
     this->pids[0] = pid1;
     this->pids[1] = pid2;
     SetSize(2);
+    RefreshMetaAt(0);
+    RefreshMetaAt(1);
 }
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::dump_struct() const -> std::string {
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::dump_struct() const -> std::string {
     std::string ret{};
     ret += fmt::format("------------------- [INNER] page pid: {} -----------------\n", GetPageId());
     ret += "children pid: ";
@@ -258,6 +322,11 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::dump_struct() const -> st
         ret += fmt::format("{}, ", this->pids[i]);
     }
     ret += "\n";
+    ret += "children count: ";
+    for (int i = 0; i < GetSize(); i++) {
+        ret += fmt::format("{}, ", this->metas[i].count);
+    }
+    ret += "\n";
     ret += "values: ";
     for (int i = 0; i < GetSize(); i++) {
         ret += fmt::format("{}, ", this->pairs[i].second.dump_struct());
@@ -283,7 +352,7 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::dump_struct() const -> st
 }
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::GetChildPidOrValue(const KeyT& key, std::variant<ValueT, PidT>& result) const -> StatusOr<InternalCase> {
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::GetChildPidOrValue(const KeyT& key, std::variant<ValueT, PidT>& result) const -> StatusOr<InternalCase> {
     /*
         assert key not exist in elements in this->pairs
         1. find slot whose key >= search_key
@@ -321,7 +390,7 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::GetChildPidOrValue(const
 }
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::GetPidMatchElem(const PairT& elem, PidT& result) const -> StatusOr<InternalCase> {
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::GetPidMatchElem(const PairT& elem, PidT& result) const -> StatusOr<InternalCase> {
     /*
         assert key not exist in elements in this->pairs
         1. find slot whose key >= search_key
@@ -352,7 +421,7 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::GetPidMatchElem(const Pai
 
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::DoUpdateOrGetChild(const KeyT& key, const ValueT& new_val, PidT& child_pid) -> StatusOr<InternalCase> {
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::DoUpdateOrGetChild(const KeyT& key, const ValueT& new_val, PidT& child_pid) -> StatusOr<InternalCase> {
     /*
         get value of given key in page
         1. find pos of key
@@ -396,7 +465,7 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::DoUpdateOrGetChild(const
 
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::DowncastRemoveOrGetChildPid(
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::DowncastRemoveOrGetChildPid(
         const KeyT& key, 
         KeyT& child_removed_key,
         PidT& child_pid
@@ -445,24 +514,25 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::DowncastRemoveOrGetChildP
 }
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::RemoveFirst() -> std::pair<PairT, PidT> {
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::RemoveFirst() -> std::pair<PairT, PidT> {
     return this->pairs[1];
 }
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::GetRawPageFirstElem(const std::shared_ptr<Page>& raw_page) -> PairT {
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::GetRawPageFirstElem(const std::shared_ptr<Page>& raw_page) -> PairT {
     if (CheckIsLeafPage(raw_page)) {
         auto& leaf = *reinterpret_cast<LeafT*>(raw_page->data());
         return leaf.GetFirstElem();
     } else {
+        // smallest elem of the subtree lives in the leftmost leaf
         auto& inner = *reinterpret_cast<SelfT*>(raw_page->data());
-        return inner.GetFirstElem();
+        return GetRawPageFirstElem(RawPageMgr::get_page(inner.PidAt(0)));
     }
 }
 
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::CheckOrBorrowOrMerge(
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::CheckOrBorrowOrMerge(
     std::shared_ptr<Page>& parent
 ) -> StatusOr<InternalCase> {
     if (GetSize() < GetMinSize()) {
@@ -488,10 +558,15 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::CheckOrBorrowOrMerge(
                 auto k_v_pid_tuple = std::make_tuple(
                     replace_or_merge_pair.first, 
                     replace_or_merge_pair.second, 
-                    std::get<2>(sim_front_tuple)
+                    std::get<2>(sim_front_tuple),
+                    std::get<3>(sim_front_tuple)
                 );
 
                 PushBack(k_v_pid_tuple);
+                // parent elem and borrowed child subtree move from simbling to me
+                auto moved_cnt = 1 + std::get<3>(sim_front_tuple).count;
+                parent_inner.ChangeCountAt(my_pid_idx, moved_cnt);
+                parent_inner.ChangeCountAt(simbling_pid_idx, -moved_cnt);
 
                 parent_inner.SetPairAt(
                     replace_or_merge_pair_idx_in_parent, 
@@ -506,9 +581,13 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::CheckOrBorrowOrMerge(
                 auto k_v_pid_tuple = std::make_tuple(
                     replace_or_merge_pair.first, 
                     replace_or_merge_pair.second, 
-                    std::get<2>(sim_back_tuple)
+                    std::get<2>(sim_back_tuple),
+                    std::get<3>(sim_back_tuple)
                 );
                 PushFront(k_v_pid_tuple);
+                auto moved_cnt = 1 + std::get<3>(sim_back_tuple).count;
+                parent_inner.ChangeCountAt(my_pid_idx, moved_cnt);
+                parent_inner.ChangeCountAt(simbling_pid_idx, -moved_cnt);
                 parent_inner.SetPairAt(
                     replace_or_merge_pair_idx_in_parent, 
                     std::make_pair(
@@ -533,8 +612,9 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::CheckOrBorrowOrMerge(
             auto& mergee_inner = *reinterpret_cast<SelfT*>(mergee_inner_ptr);
             // copy parent borrow elem to merger
             auto mergee_first_pid = mergee_inner.PidAt(0);
-            auto kvp_tp = std::make_tuple(replace_or_merge_pair.first, replace_or_merge_pair.second, mergee_first_pid);
+            auto kvp_tp = std::make_tuple(replace_or_merge_pair.first, replace_or_merge_pair.second, mergee_first_pid, mergee_inner.metas[0]);
             merger_inner.PushBack(kvp_tp);
+            parent_inner.ChangeCountAt(merger_idx, 1 + parent_inner.CountAt(merger_idx + 1));
             parent_inner.RemoveElemAndPidAt(replace_or_merge_pair_idx_in_parent);
             // copy mergee to merger
             std::copy(
@@ -547,7 +627,14 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::CheckOrBorrowOrMerge(
                 std::begin(mergee_inner.pids) + mergee_inner.GetSize(),
                 std::begin(merger_inner.pids) + merger_inner.GetSize()
             );
-            ChangeSizeBy(mergee_inner.GetSize() - 1);
+            std::copy(
+                std::begin(mergee_inner.metas) + 1,
+                std::begin(mergee_inner.metas) + mergee_inner.GetSize(),
+                std::begin(merger_inner.metas) + merger_inner.GetSize()
+            );
+            merger_inner.ChangeSizeBy(mergee_inner.GetSize() - 1);
+            // mergee is unreachable now, caller may still hold its page
+            RawPageMgr::remove(mergee_inner.GetPageId());
             return {InternalCase::RemoveDidMerge};
         }
     }
@@ -557,7 +644,7 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::CheckOrBorrowOrMerge(
 
 
 INTERNAL_TEMPLATE_ARGUMENTS
-void InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::RemoveElemAndPidAt(int idx) {
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::RemoveElemAndPidAt(int idx) {
     if (idx + 1 != GetSize()) {
         std::copy(
             std::begin(pairs) + idx + 1,
@@ -569,33 +656,91 @@ void InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::RemoveElemAndPidAt(int id
             std::begin(pids) + GetSize(),
             std::begin(pids) + idx
         );
+        std::copy(
+            std::begin(metas) + idx + 1,
+            std::begin(metas) + GetSize(),
+            std::begin(metas) + idx
+        );
     }
     ChangeSizeBy(-1);
 }
 
 
 INTERNAL_TEMPLATE_ARGUMENTS
-void InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::SetElemPairAt(int idx, PairT p) {
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::RemoveElemsAndPidsIn(int first, int last) {
+    // remove elems [first, last) with their right children pids [first, last)
+    std::copy(
+        std::begin(pairs) + last,
+        std::begin(pairs) + GetSize(),
+        std::begin(pairs) + first
+    );
+    std::copy(
+        std::begin(pids) + last,
+        std::begin(pids) + GetSize(),
+        std::begin(pids) + first
+    );
+    std::copy(
+        std::begin(metas) + last,
+        std::begin(metas) + GetSize(),
+        std::begin(metas) + first
+    );
+    ChangeSizeBy(first - last);
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::RemoveFrontPids(int cnt) {
+    // remove children pids [0, cnt) with elems [1, cnt], pid[cnt] becomes first child
+    std::copy(
+        std::begin(pairs) + cnt + 1,
+        std::begin(pairs) + GetSize(),
+        std::begin(pairs) + 1
+    );
+    std::copy(
+        std::begin(pids) + cnt,
+        std::begin(pids) + GetSize(),
+        std::begin(pids)
+    );
+    std::copy(
+        std::begin(metas) + cnt,
+        std::begin(metas) + GetSize(),
+        std::begin(metas)
+    );
+    ChangeSizeBy(-cnt);
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::ChildIdxOf(const KeyT& key) const -> int {
+    // child whose range is next to key from the left: number of elems < key
+    auto const end_ite = std::begin(pairs) + GetSize();
+    auto const start_ite = std::begin(pairs);  // first is begin() + 1
+    auto search_pair = std::pair<KeyT, ValueT>{key, ValueT{}};
+    auto ge_ite = std::lower_bound(start_ite + 1, end_ite, search_pair, PairLowerBoundCmpT{});
+    return std::distance(start_ite, ge_ite) - 1;
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::SetElemPairAt(int idx, PairT p) {
     this->pairs[idx] = p;
 }
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::GetFirstElem() const -> PairT {
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::GetFirstElem() const -> PairT {
     return this->pairs[1];
 }
 
 INTERNAL_TEMPLATE_ARGUMENTS
-void InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::PushBack(KVPidT elem) {
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::PushBack(KVPidT elem) {
     this->pairs[GetSize()] = std::make_pair(
         std::get<0>(elem),
         std::get<1>(elem)
     );
     this->pids[GetSize()] = std::get<2>(elem);
+    this->metas[GetSize()] = std::get<3>(elem);
     ChangeSizeBy(1);
 }
 
 INTERNAL_TEMPLATE_ARGUMENTS
-void InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::PushFront(KVPidT elem) {
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::PushFront(KVPidT elem) {
     std::copy_backward(
         std::begin(pairs) + 1,
         std::begin(pairs) + GetSize(),
@@ -606,22 +751,29 @@ void InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::PushFront(KVPidT elem) {
         std::begin(pids) + GetSize(),
         std::begin(pids) + GetSize() + 1
     );
+    std::copy_backward(
+        std::begin(metas),
+        std::begin(metas) + GetSize(),
+        std::begin(metas) + GetSize() + 1
+    );
 
     this->pairs[1] = std::make_pair(
         std::get<0>(elem),
         std::get<1>(elem)
     );
     this->pids[0] = std::get<2>(elem);
+    this->metas[0] = std::get<3>(elem);
     ChangeSizeBy(1);
 }
 
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::PopBack() -> KVPidT {
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::PopBack() -> KVPidT {
     auto ret = std::make_tuple(
         this->pairs[GetSize() - 1].first,
         this->pairs[GetSize() - 1].second,
-        this->pids[GetSize() - 1]
+        this->pids[GetSize() - 1],
+        this->metas[GetSize() - 1]
     );
     ChangeSizeBy(-1);
     return ret;
@@ -629,11 +781,12 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::PopBack() -> KVPidT {
 
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::PopFront() -> KVPidT {
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::PopFront() -> KVPidT {
     auto ret = std::make_tuple(
         this->pairs[1].first,
         this->pairs[1].second,
-        this->pids[0]
+        this->pids[0],
+        this->metas[0]
     );
     this->pairs[1] = std::make_pair(KeyT{}, ValueT{});
     std::copy(
@@ -646,23 +799,28 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::PopFront() -> KVPidT {
         std::begin(pids) + GetSize(),
         std::begin(pids)
     );
+    std::copy(
+        std::begin(metas) + 1,
+        std::begin(metas) + GetSize(),
+        std::begin(metas)
+    );
 
     ChangeSizeBy(-1);
     return ret;
 }
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::ElemAt(int idx) const -> PairT {
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::ElemAt(int idx) const -> PairT {
     return this->pairs[idx];
 }
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::PidAt(int idx) const -> PidT {
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::PidAt(int idx) const -> PidT {
     return this->pids[idx];
 }
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::GetIdxByPid(PidT pid) const -> int {
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::GetIdxByPid(PidT pid) const -> int {
     for (int i = 0; i < GetSize(); i++) {
         if (this->pids[i] == pid) {
             return i;
@@ -672,14 +830,164 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::GetIdxByPid(PidT pid) con
 }
 
 INTERNAL_TEMPLATE_ARGUMENTS
-void InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::SetPairAt(int idx, PairT new_elem) {
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::SetPairAt(int idx, PairT new_elem) {
     this->pairs[idx] = new_elem;
 }
 
+INTERNAL_TEMPLATE_ARGUMENTS
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::CountAt(int idx) const -> int64_t {
+    return this->metas[idx].count;
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::ChangeCountAt(int idx, int64_t amount) {
+    this->metas[idx].count += amount;
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::TotalCount() const -> int64_t {
+    // children subtrees + (size - 1) elems stored in this page
+    int64_t total = GetSize() - 1;
+    for (int i = 0; i < GetSize(); i++) {
+        total += this->metas[i].count;
+    }
+    return total;
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::SubtreeCount(const std::shared_ptr<Page>& raw_page) -> int64_t {
+    if (CheckIsLeafPage(raw_page)) {
+        return reinterpret_cast<LeafT*>(raw_page->data())->GetSize();
+    }
+    return reinterpret_cast<SelfT*>(raw_page->data())->TotalCount();
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::SummaryAt(int idx) const -> SummaryT {
+    return this->metas[idx].summary;
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::CombineSummaryAt(int idx, const SummaryT& summary) {
+    this->metas[idx].summary = AggregateT::Combine(this->metas[idx].summary, summary);
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::RefreshSummaryAt(int idx) {
+    if constexpr (HAS_SUMMARY<AggregateT>) {
+        this->metas[idx].summary = SubtreeSummary(RawPageMgr::get_page(this->pids[idx]));
+    }
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::RefreshSummariesAround(int idx) {
+    // a child op may borrow from / merge with its direct simbling only
+    auto lo = std::max(idx - 1, 0);
+    auto hi = std::min(idx + 1, GetSize() - 1);
+    for (int i = lo; i <= hi; i++) {
+        RefreshSummaryAt(i);
+    }
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::TotalSummary() const -> SummaryT {
+    auto total = this->metas[0].summary;
+    for (int i = 1; i < GetSize(); i++) {
+        total = AggregateT::Combine(total, AggregateT::FromValue(this->pairs[i].second));
+        total = AggregateT::Combine(total, this->metas[i].summary);
+    }
+    return total;
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::SubtreeSummary(const std::shared_ptr<Page>& raw_page) -> SummaryT {
+    if (CheckIsLeafPage(raw_page)) {
+        return reinterpret_cast<LeafT*>(raw_page->data())->Summary();
+    }
+    return reinterpret_cast<SelfT*>(raw_page->data())->TotalSummary();
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::Prefetch(const std::shared_ptr<Page>& raw_page) {
+    // the header, and the keys the first probes of the binary search land on
+    // for a page filled between half and full
+    auto inner = reinterpret_cast<const SelfT*>(raw_page->data());
+    __builtin_prefetch(inner);
+    __builtin_prefetch(&inner->pairs[SLOT_CNT / 4].first);
+    __builtin_prefetch(&inner->pairs[SLOT_CNT * 3 / 8].first);
+    __builtin_prefetch(&inner->pairs[SLOT_CNT / 2].first);
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+void InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::RefreshMetaAt(int idx) {
+    this->metas[idx].count = SubtreeCount(RawPageMgr::get_page(this->pids[idx]));
+    RefreshSummaryAt(idx);
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::RankOrGetChild(const KeyT& key, int64_t& rank, PidT& child_pid) const -> StatusOr<InternalCase> {
+    /*
+        count elems < key in this page and the children left of key
+        1. find slot whose key >= search_key
+        2. add every child subtree and elem on the left
+        3. if equal, the child before the slot is fully counted, stop
+        4. else descend into pid[pos-1]
+    */
+    // 1. find slot whose key >= search_key
+    auto const end_ite = std::begin(pairs) + GetSize();
+    auto const start_ite = std::begin(pairs);  // first is begin() + 1
+
+    auto search_pair = std::pair<KeyT, ValueT>{key, ValueT{}};
+    auto ge_ite = std::lower_bound(start_ite + 1, end_ite, search_pair, PairLowerBoundCmpT{});
+    auto new_idx = std::distance(start_ite, ge_ite);
+
+    // 2. add every child subtree and elem on the left
+    for (int i = 0; i < new_idx - 1; i++) {
+        rank += this->metas[i].count + 1;
+    }
+
+    // 3. if equal, stop
+    if (ge_ite != end_ite && PairThreeWayCmpT{}(*ge_ite, search_pair) == 0) {
+        rank += this->metas[new_idx - 1].count;
+        return {InternalCase::KeyFound};
+    }
+
+    // 4. descend into pid[pos-1]
+    child_pid = this->pids[new_idx - 1];
+    return {InternalCase::GetChildPageId};
+}
+
+INTERNAL_TEMPLATE_ARGUMENTS
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::SelectOrGetChild(int64_t& k, KeyT& result, PidT& child_pid) const -> StatusOr<InternalCase> {
+    /*
+        find the k-th (0 based) elem in this subtree
+        1. skip children subtrees and elems before k
+        2. if k falls in a child subtree, descend with the remaining k
+        3. if k hits an elem in this page, return it
+    */
+    for (int i = 0; i < GetSize(); i++) {
+        if (k < this->metas[i].count) {
+            child_pid = this->pids[i];
+            return {InternalCase::GetChildPageId};
+        }
+        k -= this->metas[i].count;
+        if (i + 1 < GetSize()) {
+            if (k == 0) {
+                result = this->pairs[i + 1].first;
+                return {InternalCase::KeyFound};
+            }
+            k -= 1;
+        }
+    }
+    // caller checks k < TotalCount()
+    std::cout << "should not reach here!\n";
+    exit(-1);
+}
+
 
 
 INTERNAL_TEMPLATE_ARGUMENTS
-auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::DumpNodeGraphviz() const -> std::string {
+auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT, AggregateT, PageSize>::DumpNodeGraphviz() const -> std::string {
     std::stringstream out;
     out << "  node" << GetPageId() << " [label=\"";
     for (int i = 0; i < GetSize(); ++i) {
@@ -692,19 +1000,6 @@ auto InternalPage<KeyT, ValueT, PidT, KeyComparatorT>::DumpNodeGraphviz() const
         }
     }
     out << "\"];\n";
-
-    for (int i = 0; i < GetSize(); ++i) {
-        int child_id = pids[i];
-        auto raw_page = RawPageMgr::get_page(child_id);
-        if (CheckIsLeafPage(raw_page)) {
-            auto& leaf = *reinterpret_cast<LeafT*>(raw_page->data());
-            out << leaf.DumpNodeGraphviz();
-        } else {
-            auto& inner = *reinterpret_cast<SelfT*>(raw_page->data());
-            out << inner.DumpNodeGraphviz();
-        }
-        out << "  node" << GetPageId() << ":f" << i << " -> node" << child_id << ";\n";
-    }
-
+    // children and edges are written by the caller, which picks the ones to draw
     return out.str();
 }
\ No newline at end of file
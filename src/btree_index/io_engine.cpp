@@ -0,0 +1,334 @@
+#include "io_engine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// finish req from done bytes on with plain pread / pwrite
+auto FinishSync(const IoRequest& req, uint32_t done) -> bool {
+    while (done < req.len) {
+        auto n = req.is_write
+            ? ::pwrite(req.fd, req.buf + done, req.len - done, req.offset + done)
+            : ::pread(req.fd, req.buf + done, req.len - done, req.offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        // a read past the end of file is a failure too
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+auto RingSetup(uint32_t entries, io_uring_params& params) -> int {
+    return (int)::syscall(__NR_io_uring_setup, entries, &params);
+}
+
+auto RingEnter(int ring_fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) -> int {
+    return (int)::syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+template<typename T>
+auto RingField(void* ring, uint32_t offset) -> T* {
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+}
+
+auto IoEngine::create(const IoOptions& options) -> std::unique_ptr<IoEngine> {
+    if (options.engine != IoEngineKind::ThreadPool) {
+        auto ring = IoUringEngine::create(options.queue_depth);
+        if (ring != nullptr) {
+            return ring;
+        }
+    }
+    return std::make_unique<ThreadPoolIoEngine>(options.pool_threads);
+}
+
+auto IoEngine::RunBatch(std::vector<IoRequest> reqs) -> Status {
+    std::mutex mu;
+    std::condition_variable cv;
+    auto remaining = reqs.size();
+    auto all_ok = true;
+    for (auto& req : reqs) {
+        req.done = [&](bool ok) {
+            std::lock_guard lk(mu);
+            all_ok = all_ok && ok;
+            remaining--;
+            // notify under the lock, the waiter owns cv
+            cv.notify_one();
+        };
+    }
+    Submit(std::move(reqs));
+    std::unique_lock lk(mu);
+    cv.wait(lk, [&remaining] { return remaining == 0; });
+    if (!all_ok) {
+        return {StatusCode::IOError};
+    }
+    return {};
+}
+
+ThreadPoolIoEngine::ThreadPoolIoEngine(int thread_cnt) {
+    for (int i = 0; i < std::max(thread_cnt, 1); i++) {
+        this->workers.emplace_back([this] {
+            WorkerLoop();
+        });
+    }
+}
+
+ThreadPoolIoEngine::~ThreadPoolIoEngine() {
+    {
+        std::lock_guard lk(this->mu);
+        this->stopping = true;
+    }
+    this->queued_cv.notify_all();
+    for (auto& worker : this->workers) {
+        worker.join();
+    }
+}
+
+void ThreadPoolIoEngine::Submit(std::vector<IoRequest> reqs) {
+    {
+        std::lock_guard lk(this->mu);
+        for (auto& req : reqs) {
+            this->queue.push_back(std::move(req));
+        }
+    }
+    this->queued_cv.notify_all();
+}
+
+auto ThreadPoolIoEngine::Kind() const -> IoEngineKind {
+    return IoEngineKind::ThreadPool;
+}
+
+void ThreadPoolIoEngine::WorkerLoop() {
+    std::unique_lock lk(this->mu);
+    while (true) {
+        this->queued_cv.wait(lk, [this] {
+            return this->stopping || !this->queue.empty();
+        });
+        // queued requests are drained before stopping
+        if (this->queue.empty()) {
+            return;
+        }
+        auto req = std::move(this->queue.front());
+        this->queue.pop_front();
+        lk.unlock();
+        auto ok = FinishSync(req, 0);
+        if (req.done) {
+            req.done(ok);
+        }
+        lk.lock();
+    }
+}
+
+auto IoUringEngine::create(int queue_depth) -> std::unique_ptr<IoUringEngine> {
+    /*
+        1. io_uring_setup, refused by old kernels / seccomp / io_uring_disabled
+        2. map submission ring, completion ring (one mapping if the kernel allows) and sqes
+        3. start the reaper
+    */
+    auto engine = std::unique_ptr<IoUringEngine>(new IoUringEngine());
+    // 1. setup
+    auto params = io_uring_params{};
+    engine->ring_fd = RingSetup((uint32_t)std::max(queue_depth, 1), params);
+    if (engine->ring_fd < 0) {
+        return {};
+    }
+    // 2. map
+    engine->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    engine->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    auto single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        engine->sq_ring_size = std::max(engine->sq_ring_size, engine->cq_ring_size);
+        engine->cq_ring_size = engine->sq_ring_size;
+    }
+    auto map_ring = [&engine](size_t size, off_t offset) -> void* {
+        auto addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, engine->ring_fd, offset);
+        return addr == MAP_FAILED ? nullptr : addr;
+    };
+    engine->sq_ring = map_ring(engine->sq_ring_size, IORING_OFF_SQ_RING);
+    if (engine->sq_ring == nullptr) {
+        return {};
+    }
+    engine->cq_ring = single_mmap ? engine->sq_ring : map_ring(engine->cq_ring_size, IORING_OFF_CQ_RING);
+    if (engine->cq_ring == nullptr) {
+        return {};
+    }
+    engine->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    engine->sqes = map_ring(engine->sqes_size, IORING_OFF_SQES);
+    if (engine->sqes == nullptr) {
+        return {};
+    }
+    engine->sq_tail = RingField<uint32_t>(engine->sq_ring, params.sq_off.tail);
+    engine->sq_mask = *RingField<uint32_t>(engine->sq_ring, params.sq_off.ring_mask);
+    engine->sq_array = RingField<uint32_t>(engine->sq_ring, params.sq_off.array);
+    engine->cq_head = RingField<uint32_t>(engine->cq_ring, params.cq_off.head);
+    engine->cq_tail = RingField<uint32_t>(engine->cq_ring, params.cq_off.tail);
+    engine->cq_mask = *RingField<uint32_t>(engine->cq_ring, params.cq_off.ring_mask);
+    engine->cqes = RingField<void>(engine->cq_ring, params.cq_off.cqes);
+    // cq holds at least sq_entries, capping in flight at sq_entries keeps it from overflowing
+    engine->entries = params.sq_entries;
+    // 3. reaper
+    engine->reaper = std::thread([raw = engine.get()] {
+        raw->ReapLoop();
+    });
+    return engine;
+}
+
+IoUringEngine::~IoUringEngine() {
+    if (this->reaper.joinable()) {
+        // a nop with user_data 0 wakes the reaper, it stops once nothing is in flight
+        std::unique_lock lk(this->mu);
+        this->slot_cv.wait(lk, [this] {
+            return this->in_flight < this->entries;
+        });
+        auto tail = *this->sq_tail;
+        auto idx = tail & this->sq_mask;
+        auto& sqe = static_cast<io_uring_sqe*>(this->sqes)[idx];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_NOP;
+        sqe.user_data = 0;
+        this->sq_array[idx] = idx;
+        __atomic_store_n(this->sq_tail, tail + 1, __ATOMIC_RELEASE);
+        this->in_flight++;
+        this->stopping = true;
+        EnterLocked(1);
+        lk.unlock();
+        this->reaper.join();
+    }
+    if (this->sqes != nullptr) {
+        ::munmap(this->sqes, this->sqes_size);
+    }
+    if (this->cq_ring != nullptr && this->cq_ring != this->sq_ring) {
+        ::munmap(this->cq_ring, this->cq_ring_size);
+    }
+    if (this->sq_ring != nullptr) {
+        ::munmap(this->sq_ring, this->sq_ring_size);
+    }
+    if (this->ring_fd >= 0) {
+        ::close(this->ring_fd);
+    }
+}
+
+void IoUringEngine::Submit(std::vector<IoRequest> reqs) {
+    /*
+        fill one sqe per request, enter the kernel once for the whole batch.
+        a full ring enters what is queued so far and waits for the reaper to free slots
+    */
+    std::unique_lock lk(this->mu);
+    uint32_t queued = 0;
+    for (auto& req : reqs) {
+        if (this->in_flight == this->entries) {
+            EnterLocked(queued);
+            queued = 0;
+            this->slot_cv.wait(lk, [this] {
+                return this->in_flight < this->entries;
+            });
+        }
+        auto owned = new IoRequest(std::move(req));
+        auto tail = *this->sq_tail;
+        auto idx = tail & this->sq_mask;
+        auto& sqe = static_cast<io_uring_sqe*>(this->sqes)[idx];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = owned->is_write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe.fd = owned->fd;
+        sqe.addr = reinterpret_cast<uint64_t>(owned->buf);
+        sqe.len = owned->len;
+        sqe.off = owned->offset;
+        sqe.user_data = reinterpret_cast<uint64_t>(owned);
+        this->sq_array[idx] = idx;
+        // kernel reads the sqe after it sees the new tail
+        __atomic_store_n(this->sq_tail, tail + 1, __ATOMIC_RELEASE);
+        this->in_flight++;
+        queued++;
+    }
+    EnterLocked(queued);
+}
+
+auto IoUringEngine::Kind() const -> IoEngineKind {
+    return IoEngineKind::IoUring;
+}
+
+void IoUringEngine::EnterLocked(uint32_t to_submit) {
+    while (to_submit > 0) {
+        auto ret = RingEnter(this->ring_fd, to_submit, 0, 0);
+        if (ret < 0) {
+            // EAGAIN / EBUSY: kernel is short of resources until completions are reaped
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            std::cout << "should not reach here!\n";
+            exit(-1);
+        }
+        to_submit -= ret;
+    }
+}
+
+void IoUringEngine::ReapLoop() {
+    /*
+        1. wait for at least one completion
+        2. take all completions, free their cq entries and in flight slots
+        3. run callbacks without the lock, a callback may submit again.
+           a short or failed transfer is finished synchronously, it also
+           covers kernels without IORING_OP_READ / WRITE (-EINVAL)
+    */
+    auto finished = std::vector<std::pair<IoRequest*, int>>{};
+    while (true) {
+        // 1. wait
+        auto head = *this->cq_head;
+        if (head == __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE)) {
+            auto ret = RingEnter(this->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+            if (ret < 0 && errno != EINTR) {
+                std::cout << "should not reach here!\n";
+                exit(-1);
+            }
+            continue;
+        }
+        // 2. take
+        finished.clear();
+        auto tail = __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            auto& cqe = static_cast<io_uring_cqe*>(this->cqes)[head & this->cq_mask];
+            finished.emplace_back(reinterpret_cast<IoRequest*>(cqe.user_data), cqe.res);
+        }
+        __atomic_store_n(this->cq_head, head, __ATOMIC_RELEASE);
+        bool stop{};
+        {
+            std::lock_guard lk(this->mu);
+            this->in_flight -= finished.size();
+            stop = this->stopping && this->in_flight == 0;
+        }
+        this->slot_cv.notify_all();
+        // 3. callbacks
+        for (auto [req, res] : finished) {
+            // stop sentinel
+            if (req == nullptr) {
+                continue;
+            }
+            auto ok = false;
+            if (res >= 0) {
+                ok = FinishSync(*req, (uint32_t)res);
+            } else if (res == -EINTR || res == -EAGAIN || res == -EINVAL || res == -EOPNOTSUPP) {
+                ok = FinishSync(*req, 0);
+            }
+            if (req->done) {
+                req->done(ok);
+            }
+            delete req;
+        }
+        if (stop) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../status/status.h"
+
+/*
+    asynchronous page io.
+    io_uring (raw syscalls, no liburing) keeps many reads / writes in flight with one
+    syscall per batch; where the kernel refuses io_uring a small thread pool runs
+    pread / pwrite instead. completions run on an engine thread.
+*/
+
+enum class IoEngineKind : uint8_t {
+    // io_uring if the kernel allows it, else the thread pool
+    Auto,
+    IoUring,
+    ThreadPool,
+};
+
+struct IoOptions {
+    IoEngineKind engine{IoEngineKind::Auto};
+    // io_uring submission queue entries, bounds the requests in flight
+    int queue_depth{64};
+    // workers of the thread pool engine
+    int pool_threads{4};
+    // Get reads ahead this many right simblings of the leaf it lands on, 0: off
+    int leaf_readahead{0};
+    // page file bypasses the kernel page cache (O_DIRECT), pages are cached once in the page table.
+    // falls back to buffered io where the filesystem refuses O_DIRECT
+    bool direct{false};
+};
+
+struct IoRequest {
+    bool is_write;
+    int fd;
+    char* buf;
+    uint32_t len;
+    uint64_t offset;
+    // runs on an engine thread once all len bytes are done, or on failure
+    std::function<void(bool ok)> done;
+};
+
+class IoEngine {
+public:
+    virtual ~IoEngine() = default;
+    // IoUring falls back to the thread pool when io_uring_setup fails
+    static auto create(const IoOptions& options) -> std::unique_ptr<IoEngine>;
+    // queue reqs, they are submitted together. never call with a lock a done callback takes
+    virtual void Submit(std::vector<IoRequest> reqs) = 0;
+    virtual auto Kind() const -> IoEngineKind = 0;
+    // submit reqs and wait for all of them, done callbacks are ignored
+    auto RunBatch(std::vector<IoRequest> reqs) -> Status;
+};
+
+class ThreadPoolIoEngine : public IoEngine {
+public:
+    explicit ThreadPoolIoEngine(int thread_cnt);
+    ~ThreadPoolIoEngine() override;
+    void Submit(std::vector<IoRequest> reqs) override;
+    auto Kind() const -> IoEngineKind override;
+
+private:
+    void WorkerLoop();
+
+    std::mutex mu;
+    std::condition_variable queued_cv;
+    std::deque<IoRequest> queue;
+    bool stopping{false};
+    std::vector<std::thread> workers;
+};
+
+class IoUringEngine : public IoEngine {
+public:
+    IoUringEngine(const IoUringEngine&) = delete;
+    ~IoUringEngine() override;
+    // nullptr when the kernel refuses io_uring
+    static auto create(int queue_depth) -> std::unique_ptr<IoUringEngine>;
+    void Submit(std::vector<IoRequest> reqs) override;
+    auto Kind() const -> IoEngineKind override;
+
+private:
+    IoUringEngine() = default;
+    void ReapLoop();
+    // enter the kernel until to_submit sqes are taken
+    void EnterLocked(uint32_t to_submit);
+
+    int ring_fd{-1};
+    // submission ring
+    void* sq_ring{nullptr};
+    size_t sq_ring_size{0};
+    uint32_t* sq_tail{nullptr};
+    uint32_t sq_mask{0};
+    uint32_t* sq_array{nullptr};
+    void* sqes{nullptr};
+    size_t sqes_size{0};
+    // completion ring, may share the mapping of the submission ring
+    void* cq_ring{nullptr};
+    size_t cq_ring_size{0};
+    uint32_t* cq_head{nullptr};
+    uint32_t* cq_tail{nullptr};
+    uint32_t cq_mask{0};
+    void* cqes{nullptr};
+
+    uint32_t entries{0};
+    std::mutex mu;
+    std::condition_variable slot_cv;
+    // submitted, not reaped yet. kept <= entries so the completion ring never overflows
+    uint32_t in_flight{0};
+    bool stopping{false};
+    std::thread reaper;
+};
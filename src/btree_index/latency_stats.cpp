@@ -0,0 +1,218 @@
+#include "latency_stats.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+std::atomic<uint64_t> next_recorder_id{1};
+
+// recorders a thread has used: (recorder id, its shard), at most this many kept
+size_t constexpr THREAD_CACHE_CNT = 64;
+
+}
+
+auto LatencySnapshot::BucketOf(uint64_t ns) -> size_t {
+    if (ns < (uint64_t)SUB_CNT) {
+        return (size_t)ns;
+    }
+    auto top_bit = 63 - std::countl_zero(ns);
+    if (top_bit >= MAX_BITS) {
+        return BUCKET_CNT - 1;
+    }
+    // top SUB_BITS bits below the leading one pick the sub bucket
+    auto shift = top_bit - SUB_BITS;
+    return (size_t)(shift + 1) * SUB_CNT + (size_t)((ns >> shift) & (SUB_CNT - 1));
+}
+
+auto LatencySnapshot::BucketTop(size_t idx) -> uint64_t {
+    if (idx < (size_t)SUB_CNT) {
+        return idx;
+    }
+    auto shift = idx / SUB_CNT - 1;
+    auto low = ((uint64_t)SUB_CNT + idx % SUB_CNT) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+auto LatencySnapshot::Percentile(double q) const -> uint64_t {
+    if (this->count == 0) {
+        return 0;
+    }
+    auto rank = std::max<uint64_t>(1, (uint64_t)std::ceil(std::clamp(q, 0.0, 1.0) * (double)this->count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_CNT; i++) {
+        seen += this->buckets[i];
+        if (seen >= rank) {
+            // the bucket top may overshoot the slowest op actually seen
+            return std::min(BucketTop(i), this->max_ns);
+        }
+    }
+    return this->max_ns;
+}
+
+auto LatencySnapshot::MeanNs() const -> double {
+    return this->count == 0 ? 0.0 : (double)this->sum_ns / (double)this->count;
+}
+
+auto OpLatency::Phase(LatencyPhase phase) -> LatencySnapshot& {
+    switch (phase) {
+        case LatencyPhase::Total:
+            return this->total;
+        case LatencyPhase::LockWait:
+            return this->lock_wait;
+        case LatencyPhase::Descent:
+            return this->descent;
+        case LatencyPhase::SplitMerge:
+            return this->split_merge;
+    }
+    std::cout << "should not reach here!\n";
+    exit(-1);
+}
+
+auto IndexStats::Op(LatencyOp op) -> OpLatency& {
+    switch (op) {
+        case LatencyOp::Insert:
+            return this->insert;
+        case LatencyOp::Get:
+            return this->get;
+        case LatencyOp::Update:
+            return this->update;
+        case LatencyOp::Remove:
+            return this->remove;
+    }
+    std::cout << "should not reach here!\n";
+    exit(-1);
+}
+
+struct LatencyRecorder::ThreadCache {
+    struct Entry {
+        uint64_t recorder_id;
+        std::weak_ptr<State> state;
+        Shard* shard;
+    };
+
+    ~ThreadCache() {
+        Clear();
+    }
+    // the shards go back to their recorders, the counts in them stay
+    void Clear() {
+        for (auto& entry : this->entries) {
+            if (auto state = entry.state.lock()) {
+                std::lock_guard lk(state->mu);
+                state->free_shards.push_back(entry.shard);
+            }
+        }
+        this->entries.clear();
+    }
+
+    std::vector<Entry> entries;
+};
+
+LatencyRecorder::LatencyRecorder()
+    : id(next_recorder_id.fetch_add(1, std::memory_order_relaxed)), state(std::make_shared<State>()) {}
+
+auto LatencyRecorder::LocalShard() -> Shard& {
+    thread_local ThreadCache cache;
+    for (auto& entry : cache.entries) {
+        if (entry.recorder_id == this->id) {
+            return *entry.shard;
+        }
+    }
+    // entries of dead recorders pile up in long lived threads, start over. a live
+    // recorder seen again takes a free shard back below
+    if (cache.entries.size() == THREAD_CACHE_CNT) {
+        cache.Clear();
+    }
+    Shard* shard{};
+    {
+        std::lock_guard lk(this->state->mu);
+        if (!this->state->free_shards.empty()) {
+            shard = this->state->free_shards.back();
+            this->state->free_shards.pop_back();
+        } else {
+            this->state->shards.push_back(std::make_unique<Shard>());
+            shard = this->state->shards.back().get();
+        }
+    }
+    cache.entries.push_back(ThreadCache::Entry{this->id, this->state, shard});
+    return *shard;
+}
+
+auto LatencyRecorder::ShardCnt() const -> size_t {
+    std::lock_guard lk(this->state->mu);
+    return this->state->shards.size();
+}
+
+void LatencyRecorder::Record(LatencyOp op, LatencyPhase phase, uint64_t ns) {
+    auto& histogram = LocalShard().histograms[(size_t)op * LATENCY_PHASE_CNT + (size_t)phase];
+    // single writer: load + store, no read-modify-write
+    auto& bucket = histogram.buckets[LatencySnapshot::BucketOf(ns)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    histogram.sum_ns.store(histogram.sum_ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    if (ns > histogram.max_ns.load(std::memory_order_relaxed)) {
+        histogram.max_ns.store(ns, std::memory_order_relaxed);
+    }
+}
+
+auto LatencyRecorder::Collect() const -> IndexStats {
+    /*
+        1. sum every shard into the snapshot of its op phase
+        2. fill in count and percentiles
+    */
+    auto stats = IndexStats{};
+    // 1. sum shards, their threads keep recording meanwhile
+    {
+        std::lock_guard lk(this->state->mu);
+        for (auto& shard : this->state->shards) {
+            for (size_t op = 0; op < LATENCY_OP_CNT; op++) {
+                for (size_t phase = 0; phase < LATENCY_PHASE_CNT; phase++) {
+                    auto& histogram = shard->histograms[op * LATENCY_PHASE_CNT + phase];
+                    auto& snapshot = stats.Op((LatencyOp)op).Phase((LatencyPhase)phase);
+                    for (size_t i = 0; i < LatencySnapshot::BUCKET_CNT; i++) {
+                        snapshot.buckets[i] += histogram.buckets[i].load(std::memory_order_relaxed);
+                    }
+                    snapshot.sum_ns += histogram.sum_ns.load(std::memory_order_relaxed);
+                    snapshot.max_ns = std::max(snapshot.max_ns, histogram.max_ns.load(std::memory_order_relaxed));
+                }
+            }
+        }
+    }
+    // 2. percentiles
+    for (size_t op = 0; op < LATENCY_OP_CNT; op++) {
+        for (size_t phase = 0; phase < LATENCY_PHASE_CNT; phase++) {
+            auto& snapshot = stats.Op((LatencyOp)op).Phase((LatencyPhase)phase);
+            for (auto bucket_cnt : snapshot.buckets) {
+                snapshot.count += bucket_cnt;
+            }
+            snapshot.p50_ns = snapshot.Percentile(0.5);
+            snapshot.p99_ns = snapshot.Percentile(0.99);
+            snapshot.p999_ns = snapshot.Percentile(0.999);
+        }
+    }
+    return stats;
+}
+
+OpTimer::OpTimer(LatencyRecorder& recorder, LatencyOp op): recorder(&recorder), op(op), start(ClockT::now()) {
+    this->last = this->start;
+}
+
+OpTimer::~OpTimer() {
+    if (this->recorder == nullptr) {
+        return;
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(ClockT::now() - this->start).count();
+    this->recorder->Record(this->op, LatencyPhase::Total, (uint64_t)ns);
+}
+
+void OpTimer::Mark(LatencyPhase phase) {
+    if (this->recorder == nullptr) {
+        return;
+    }
+    auto now = ClockT::now();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - this->last).count();
+    this->recorder->Record(this->op, phase, (uint64_t)ns);
+    this->last = now;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+    per-operation latency histograms of an index.
+    every thread records into its own shard (one histogram per op type and phase),
+    a shard is written by its thread only, with relaxed atomics, so recording
+    takes no lock and shares no cache line with other threads. Stats() sums the
+    shards on demand. a thread gives its shards back when it exits, the next new
+    thread records on into one of them: shards stay as many as threads recording
+    at the same time, however many come and go. buckets are log-linear (HDR style): 16 per power of two,
+    a reported percentile is at most ~6% above the recorded latency.
+*/
+
+enum class LatencyOp : uint8_t { Insert = 0, Get, Update, Remove };
+enum class LatencyPhase : uint8_t {
+    // whole call, writer throttling and the log commit included
+    Total = 0,
+    // waiting for rw_lock (writers: throttling too), readers of copy-on-write mode pin a version
+    LockWait,
+    // root to the leaf, leaf op of reads and updates included
+    Descent,
+    // leaf op to the end of rebalancing, only ops that split / borrowed / merged
+    SplitMerge,
+};
+
+size_t constexpr LATENCY_OP_CNT = 4;
+size_t constexpr LATENCY_PHASE_CNT = 4;
+
+// merged histogram of one op phase
+struct LatencySnapshot {
+    static int constexpr SUB_BITS = 4;
+    static int constexpr SUB_CNT = 1 << SUB_BITS;
+    // latencies from 2^40 ns (~18 min) on land in the last bucket
+    static int constexpr MAX_BITS = 40;
+    static size_t constexpr BUCKET_CNT = (MAX_BITS - SUB_BITS + 1) * SUB_CNT;
+
+    uint64_t count{0};
+    uint64_t sum_ns{0};
+    uint64_t max_ns{0};
+    uint64_t p50_ns{0};
+    uint64_t p99_ns{0};
+    uint64_t p999_ns{0};
+    std::array<uint64_t, BUCKET_CNT> buckets{};
+
+    static auto BucketOf(uint64_t ns) -> size_t;
+    // highest latency counted in bucket idx
+    static auto BucketTop(size_t idx) -> uint64_t;
+    // q in [0, 1], 0 if nothing recorded
+    auto Percentile(double q) const -> uint64_t;
+    auto MeanNs() const -> double;
+};
+
+struct OpLatency {
+    LatencySnapshot total;
+    LatencySnapshot lock_wait;
+    LatencySnapshot descent;
+    LatencySnapshot split_merge;
+
+    auto Phase(LatencyPhase phase) -> LatencySnapshot&;
+};
+
+struct IndexStats {
+    OpLatency insert;
+    OpLatency get;
+    OpLatency update;
+    OpLatency remove;
+
+    auto Op(LatencyOp op) -> OpLatency&;
+};
+
+class LatencyRecorder {
+public:
+    LatencyRecorder();
+    LatencyRecorder(const LatencyRecorder&) = delete;
+    void Record(LatencyOp op, LatencyPhase phase, uint64_t ns);
+    auto Collect() const -> IndexStats;
+    // shards allocated so far, in use or free
+    auto ShardCnt() const -> size_t;
+
+private:
+    // one thread's histograms, padded so neighbouring shards share no cache line
+    struct alignas(64) Histogram {
+        std::array<std::atomic<uint64_t>, LatencySnapshot::BUCKET_CNT> buckets{};
+        std::atomic<uint64_t> sum_ns{0};
+        std::atomic<uint64_t> max_ns{0};
+    };
+    struct Shard {
+        std::array<Histogram, LATENCY_OP_CNT * LATENCY_PHASE_CNT> histograms;
+    };
+    // outlives the recorder while a thread still holds one of its shards
+    struct State {
+        std::mutex mu;
+        std::vector<std::unique_ptr<Shard>> shards;
+        // given back by their threads, recorded into by the next thread that asks
+        std::vector<Shard*> free_shards;
+    };
+    // recorders a thread has used, gives their shards back when the thread exits
+    struct ThreadCache;
+    auto LocalShard() -> Shard&;
+
+    // unique per recorder, thread caches never mistake a new recorder for a dead one
+    uint64_t id;
+    std::shared_ptr<State> state;
+};
+
+/*
+    times one op: Mark(phase) records the time since the previous mark into phase,
+    the total is recorded on destruction. a default constructed timer records nothing
+*/
+class OpTimer {
+public:
+    using ClockT = std::chrono::steady_clock;
+
+    OpTimer() = default;
+    OpTimer(LatencyRecorder& recorder, LatencyOp op);
+    OpTimer(const OpTimer&) = delete;
+    ~OpTimer();
+    void Mark(LatencyPhase phase);
+
+private:
+    LatencyRecorder* recorder{nullptr};
+    LatencyOp op{LatencyOp::Insert};
+    ClockT::time_point start;
+    ClockT::time_point last;
+};
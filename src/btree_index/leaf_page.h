@@ -12,6 +12,7 @@
 
 #include "common.h"
 #include "../status/status.h"
+#include "fmt/core.h"
 #include "btree_page.h"
 
 
@@ -25,12 +26,12 @@ enum class LeafCase: int {
     DidBorrow
 };
 
-template <typename KeyT, typename ValueT, typename KeyComparatorT>
+LEAF_TEMPLATE_ARGUMENTS
 class LeafPage: public BTreePage {
-    static size_t constexpr SLOT_CNT = PAGE_SLOT_CNT_CALC<sizeof(KeyT), sizeof(ValueT)>;
-    using SelfT = LeafPage<KeyT, ValueT, KeyComparatorT>;
+    static size_t constexpr SLOT_CNT = PAGE_SLOT_CNT_CALC<sizeof(KeyT), sizeof(ValueT), PageSize>;
+    using SelfT = LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>;
     using PairT = std::pair<KeyT, ValueT>;
-    using InternalT = InternalPage<KeyT, ValueT, int, KeyComparatorT>;
+    using InternalT = InternalPage<KeyT, ValueT, int, KeyComparatorT, AggregateT, PageSize>;
     using LeafSplitInfo = SplitInfo<KeyT, ValueT>;
     struct KeyLowerBoundComparator {
         auto operator()(const KeyT& a, const KeyT& b) -> bool {
@@ -54,7 +55,7 @@ public:
 
     void Init() noexcept;
 
-    auto Insert(const KeyT& key, const ValueT& value, std::shared_ptr<LeafSplitInfo>& split_info) -> StatusOr<LeafCase>;
+    auto Insert(const KeyT& key, const ValueT& value, LeafSplitInfo& split_info) -> StatusOr<LeafCase>;
     auto Update(const KeyT& key, const ValueT& value) -> StatusOr<LeafCase>;
     auto Get(const KeyT& key, ValueT& result) const -> StatusOr<LeafCase>;
     auto Remove(
@@ -63,27 +64,35 @@ public:
         KeyT& parent_merged_key,
         bool is_root
     ) -> StatusOr<LeafCase>;
+    auto CheckOrBorrowOrMerge(std::shared_ptr<Page>& parent) -> StatusOr<LeafCase>;
+    auto RemoveRange(const KeyT* lo, const KeyT* hi) -> int;
     auto dump_struct() const -> std::string;
     auto GetFirstElem() const -> PairT;
+    auto Rank(const KeyT& key) const -> int;
+    auto KeyAt(int idx) const -> KeyT;
+    auto Summary() const -> typename AggregateT::SummaryT;
+    auto RangeSummary(const KeyT* lo, const KeyT* hi) const -> typename AggregateT::SummaryT;
     auto DumpNodeGraphviz() const -> std::string;
+    // start loading what Get reads first, without waiting for it
+    static void Prefetch(const std::shared_ptr<Page>& raw_page);
 };
 
 
 auto IsLeafPage(std::shared_ptr<Page>& ptr) -> bool;
 
 LEAF_TEMPLATE_ARGUMENTS
-void LeafPage<KeyT, ValueT, KeyComparatorT>::Init() noexcept {
-    static_assert(sizeof(LeafPage<KeyT, ValueT, KeyComparatorT>) <= BTREE_PAGE_SIZE);
+void LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Init() noexcept {
+    static_assert(sizeof(LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>) <= PageSize);
     BTreePage::Init(BTreePageType::LEAF_PAGE, (int)SLOT_CNT);
 }
 
 
 
 LEAF_TEMPLATE_ARGUMENTS
-auto LeafPage<KeyT, ValueT, KeyComparatorT>::Insert(const KeyT& key, const ValueT& value, std::shared_ptr<LeafSplitInfo>& split_info) -> StatusOr<LeafCase> {
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Insert(const KeyT& key, const ValueT& value, LeafSplitInfo& split_info) -> StatusOr<LeafCase> {
     /*
         insert kv into page
-        1. find position to insert
+        1. find position to insert (reject duplicate)
         2. memorymove
         3. check whether reaching max size
         4. if max split
@@ -94,6 +103,9 @@ auto LeafPage<KeyT, ValueT, KeyComparatorT>::Insert(const KeyT& key, const Value
     auto const start_ite = std::begin(keys);
     auto const ge_ite = std::lower_bound(start_ite, end_ite, key, KeyLowerBoundCmpT{});
     auto new_idx = std::distance(start_ite, ge_ite);
+    if (ge_ite != end_ite && KeyThreeWayCmpT{}(*ge_ite, key) == 0) {
+        return {StatusCode::KeyDuplicate};
+    }
 
     // 2. memmove
     std::copy_backward(
@@ -117,14 +129,13 @@ auto LeafPage<KeyT, ValueT, KeyComparatorT>::Insert(const KeyT& key, const Value
 
 
     // 4. SPLIT
-    auto new_page = RawPageMgr::create();
+    auto new_page = RawPageMgr::create(PageSize);
     auto& new_leaf_page = *reinterpret_cast<SelfT*>(new_page->data());
     new_leaf_page.Init();
 
-    assert(split_info.get() != nullptr);
-    split_info->new_page_id = new_leaf_page.GetPageId();
+    split_info.new_page_id = new_leaf_page.GetPageId();
     auto mid_pos = GetMinSize();
-    split_info->mid_elem = std::pair<KeyT, ValueT> {
+    split_info.mid_elem = std::pair<KeyT, ValueT> {
         this->keys[mid_pos],
         this->vals[mid_pos]
     };
@@ -141,7 +152,7 @@ auto LeafPage<KeyT, ValueT, KeyComparatorT>::Insert(const KeyT& key, const Value
 
 
 LEAF_TEMPLATE_ARGUMENTS
-auto LeafPage<KeyT, ValueT, KeyComparatorT>::Update(const KeyT& key, const ValueT& value) -> StatusOr<LeafCase> {
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Update(const KeyT& key, const ValueT& value) -> StatusOr<LeafCase> {
     /*
         update kv in page
         1. find position to update
@@ -170,7 +181,7 @@ auto LeafPage<KeyT, ValueT, KeyComparatorT>::Update(const KeyT& key, const Value
 }
 
 LEAF_TEMPLATE_ARGUMENTS
-auto LeafPage<KeyT, ValueT, KeyComparatorT>::Get(const KeyT& key, ValueT& result) const -> StatusOr<LeafCase> {
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Get(const KeyT& key, ValueT& result) const -> StatusOr<LeafCase> {
     /*
         get value of given key in page
         1. find pos of key
@@ -196,7 +207,7 @@ auto LeafPage<KeyT, ValueT, KeyComparatorT>::Get(const KeyT& key, ValueT& result
 }
 
 LEAF_TEMPLATE_ARGUMENTS
-auto LeafPage<KeyT, ValueT, KeyComparatorT>::Remove(
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Remove(
     const KeyT& key, 
     std::shared_ptr<Page>& parent,
     KeyT& parent_merged_key,
@@ -240,64 +251,7 @@ auto LeafPage<KeyT, ValueT, KeyComparatorT>::Remove(
 
     // 4. if less than min_size, merge
     if (!is_root && GetSize() < GetMinSize()) {
-        auto& parent_inner = *reinterpret_cast<InternalT*>(parent->data());
-        auto my_pid_idx = parent_inner.GetIdxByPid(GetPageId());
-        assert(my_pid_idx != -1);
-        auto simbling_pid_idx = (my_pid_idx == parent_inner.GetSize() - 1)? my_pid_idx - 1 : my_pid_idx + 1;
-        auto replace_or_merge_pair_idx_in_parent = std::max(my_pid_idx, simbling_pid_idx);
-        auto replace_or_merge_pair = parent_inner.ElemAt(replace_or_merge_pair_idx_in_parent);
-        auto simbling_pid = parent_inner.PidAt(simbling_pid_idx);
-
-        auto simbling_raw_page = RawPageMgr::get_page(simbling_pid);
-        auto& simbling_leaf = *reinterpret_cast<SelfT*>(simbling_raw_page->data());
-
-        if (simbling_leaf.GetSize() > GetMinSize()){
-            // can borrow
-
-            // if simbling idx > my idx, move parent to last
-            // else move parent elem to first
-            PairT borrow_elem_simbling{};
-            if (my_pid_idx == simbling_pid_idx - 1) {
-                PushBack(replace_or_merge_pair);
-                borrow_elem_simbling = simbling_leaf.PopFront();
-                parent_inner.SetElemPairAt(replace_or_merge_pair_idx_in_parent, borrow_elem_simbling);
-            } else {
-                assert(my_pid_idx == simbling_pid_idx + 1);
-                PushFront(replace_or_merge_pair);
-                borrow_elem_simbling = simbling_leaf.PopBack();
-                parent_inner.SetElemPairAt(replace_or_merge_pair_idx_in_parent, borrow_elem_simbling);
-            }
-            return {LeafCase::DidBorrow};
-        } else {
-            // merge with simbling
-            auto merger_idx = std::min(my_pid_idx, simbling_pid_idx);
-            SelfT* merger_leaf_ptr, *mergee_leaf_ptr;
-            if (merger_idx == my_pid_idx) {
-                merger_leaf_ptr = this;
-                mergee_leaf_ptr = &simbling_leaf;
-            } else {
-                merger_leaf_ptr = &simbling_leaf;
-                mergee_leaf_ptr = this;
-            }
-            auto& merger_leaf = *reinterpret_cast<SelfT*>(merger_leaf_ptr);
-            auto& mergee_leaf = *reinterpret_cast<SelfT*>(mergee_leaf_ptr);
-            // copy parent borrow elem to merger
-            merger_leaf.PushBack(replace_or_merge_pair);
-            parent_inner.RemoveElemAndPidAt(replace_or_merge_pair_idx_in_parent);
-            // copy mergee to merger
-            std::copy(
-                std::begin(mergee_leaf.keys),
-                std::begin(mergee_leaf.keys) + mergee_leaf.GetSize(),
-                std::begin(merger_leaf.keys) + merger_leaf.GetSize()
-            );
-            std::copy(
-                std::begin(mergee_leaf.vals),
-                std::begin(mergee_leaf.vals) + mergee_leaf.GetSize(),
-                std::begin(merger_leaf.vals) + merger_leaf.GetSize()
-            );
-            ChangeSizeBy(mergee_leaf.GetSize());
-            return {LeafCase::DidMerge};
-        }
+        return CheckOrBorrowOrMerge(parent);
     }
 
     // 5. return old value
@@ -305,10 +259,106 @@ auto LeafPage<KeyT, ValueT, KeyComparatorT>::Remove(
 }
 
 LEAF_TEMPLATE_ARGUMENTS
-auto LeafPage<KeyT, ValueT, KeyComparatorT>::dump_struct() const -> std::string {
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::CheckOrBorrowOrMerge(
+    std::shared_ptr<Page>& parent
+) -> StatusOr<LeafCase> {
+    if (GetSize() >= GetMinSize()) {
+        return {LeafCase::OK};
+    }
+    auto& parent_inner = *reinterpret_cast<InternalT*>(parent->data());
+    auto my_pid_idx = parent_inner.GetIdxByPid(GetPageId());
+    assert(my_pid_idx != -1);
+    auto simbling_pid_idx = (my_pid_idx == parent_inner.GetSize() - 1)? my_pid_idx - 1 : my_pid_idx + 1;
+    auto replace_or_merge_pair_idx_in_parent = std::max(my_pid_idx, simbling_pid_idx);
+    auto replace_or_merge_pair = parent_inner.ElemAt(replace_or_merge_pair_idx_in_parent);
+    auto simbling_pid = parent_inner.PidAt(simbling_pid_idx);
+
+    auto simbling_raw_page = RawPageMgr::get_page(simbling_pid);
+    auto& simbling_leaf = *reinterpret_cast<SelfT*>(simbling_raw_page->data());
+
+    if (simbling_leaf.GetSize() > GetMinSize()){
+        // can borrow
+
+        // if simbling idx > my idx, move parent to last
+        // else move parent elem to first
+        PairT borrow_elem_simbling{};
+        if (my_pid_idx == simbling_pid_idx - 1) {
+            PushBack(replace_or_merge_pair);
+            borrow_elem_simbling = simbling_leaf.PopFront();
+            parent_inner.SetElemPairAt(replace_or_merge_pair_idx_in_parent, borrow_elem_simbling);
+        } else {
+            assert(my_pid_idx == simbling_pid_idx + 1);
+            PushFront(replace_or_merge_pair);
+            borrow_elem_simbling = simbling_leaf.PopBack();
+            parent_inner.SetElemPairAt(replace_or_merge_pair_idx_in_parent, borrow_elem_simbling);
+        }
+        parent_inner.ChangeCountAt(my_pid_idx, 1);
+        parent_inner.ChangeCountAt(simbling_pid_idx, -1);
+        return {LeafCase::DidBorrow};
+    } else {
+        // merge with simbling
+        auto merger_idx = std::min(my_pid_idx, simbling_pid_idx);
+        SelfT* merger_leaf_ptr, *mergee_leaf_ptr;
+        if (merger_idx == my_pid_idx) {
+            merger_leaf_ptr = this;
+            mergee_leaf_ptr = &simbling_leaf;
+        } else {
+            merger_leaf_ptr = &simbling_leaf;
+            mergee_leaf_ptr = this;
+        }
+        auto& merger_leaf = *reinterpret_cast<SelfT*>(merger_leaf_ptr);
+        auto& mergee_leaf = *reinterpret_cast<SelfT*>(mergee_leaf_ptr);
+        // copy parent borrow elem to merger
+        merger_leaf.PushBack(replace_or_merge_pair);
+        parent_inner.ChangeCountAt(merger_idx, 1 + mergee_leaf.GetSize());
+        parent_inner.RemoveElemAndPidAt(replace_or_merge_pair_idx_in_parent);
+        // copy mergee to merger
+        std::copy(
+            std::begin(mergee_leaf.keys),
+            std::begin(mergee_leaf.keys) + mergee_leaf.GetSize(),
+            std::begin(merger_leaf.keys) + merger_leaf.GetSize()
+        );
+        std::copy(
+            std::begin(mergee_leaf.vals),
+            std::begin(mergee_leaf.vals) + mergee_leaf.GetSize(),
+            std::begin(merger_leaf.vals) + merger_leaf.GetSize()
+        );
+        merger_leaf.ChangeSizeBy(mergee_leaf.GetSize());
+        // mergee is unreachable now, caller may still hold its page
+        RawPageMgr::remove(mergee_leaf.GetPageId());
+        return {LeafCase::DidMerge};
+    }
+}
+
+LEAF_TEMPLATE_ARGUMENTS
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::RemoveRange(const KeyT* lo, const KeyT* hi) -> int {
+    /*
+        remove keys in [lo, hi), nullptr bound is unbounded
+        1. find [first, last) by lower_bound
+        2. move the tail over the removed slots
+    */
+    auto const end_ite = std::begin(keys) + GetSize();
+    auto const start_ite = std::begin(keys);
+    auto first = (lo == nullptr)? start_ite : std::lower_bound(start_ite, end_ite, *lo, KeyLowerBoundCmpT{});
+    auto last = (hi == nullptr)? end_ite : std::lower_bound(first, end_ite, *hi, KeyLowerBoundCmpT{});
+    auto first_idx = std::distance(start_ite, first);
+    auto last_idx = std::distance(start_ite, last);
+
+    std::copy(last, end_ite, first);
+    std::copy(
+        std::begin(this->vals) + last_idx,
+        std::begin(this->vals) + GetSize(),
+        std::begin(this->vals) + first_idx
+    );
+    ChangeSizeBy(-(int)(last_idx - first_idx));
+    return (int)(last_idx - first_idx);
+}
+
+LEAF_TEMPLATE_ARGUMENTS
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::dump_struct() const -> std::string {
     auto ret = fmt::format("total size: {}\nslot cnt: {}\nkeyT size: {}\nvalT size: {}\nkeys size: {}\nvals size {}\n"
                             "header size: {}\n",
-                            sizeof(LeafPage<KeyT, ValueT, KeyComparatorT>), SLOT_CNT,
+                            sizeof(LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>), SLOT_CNT,
                             sizeof(KeyT), sizeof(ValueT),
                             sizeof(this->keys), sizeof(this->vals),
                             LEAF_PAGE_HEADER_SIZE
@@ -324,19 +374,56 @@ auto LeafPage<KeyT, ValueT, KeyComparatorT>::dump_struct() const -> std::string
 
 
 LEAF_TEMPLATE_ARGUMENTS
-auto LeafPage<KeyT, ValueT, KeyComparatorT>::GetFirstElem() const -> PairT {
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::GetFirstElem() const -> PairT {
     return std::make_pair(this->keys[0], this->vals[0]);
 }
 
 LEAF_TEMPLATE_ARGUMENTS
-void LeafPage<KeyT, ValueT, KeyComparatorT>::PushBack(PairT elem) {
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Rank(const KeyT& key) const -> int {
+    // number of keys < key in this page
+    auto const end_ite = std::begin(keys) + GetSize();
+    auto const start_ite = std::begin(keys);
+    auto const ge_ite = std::lower_bound(start_ite, end_ite, key, KeyLowerBoundCmpT{});
+    return std::distance(start_ite, ge_ite);
+}
+
+LEAF_TEMPLATE_ARGUMENTS
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::KeyAt(int idx) const -> KeyT {
+    return this->keys[idx];
+}
+
+LEAF_TEMPLATE_ARGUMENTS
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Summary() const -> typename AggregateT::SummaryT {
+    auto total = AggregateT::Identity();
+    for (int i = 0; i < GetSize(); i++) {
+        total = AggregateT::Combine(total, AggregateT::FromValue(this->vals[i]));
+    }
+    return total;
+}
+
+LEAF_TEMPLATE_ARGUMENTS
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::RangeSummary(const KeyT* lo, const KeyT* hi) const -> typename AggregateT::SummaryT {
+    // aggregate of vals whose key in [lo, hi), nullptr bound is unbounded
+    auto const end_ite = std::begin(keys) + GetSize();
+    auto const start_ite = std::begin(keys);
+    auto first = (lo == nullptr)? start_ite : std::lower_bound(start_ite, end_ite, *lo, KeyLowerBoundCmpT{});
+    auto last = (hi == nullptr)? end_ite : std::lower_bound(first, end_ite, *hi, KeyLowerBoundCmpT{});
+    auto total = AggregateT::Identity();
+    for (auto i = std::distance(start_ite, first); i < std::distance(start_ite, last); i++) {
+        total = AggregateT::Combine(total, AggregateT::FromValue(this->vals[i]));
+    }
+    return total;
+}
+
+LEAF_TEMPLATE_ARGUMENTS
+void LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::PushBack(PairT elem) {
     this->keys[GetSize()] = elem.first;
     this->vals[GetSize()] = elem.second;
     ChangeSizeBy(1);
 }
 
 LEAF_TEMPLATE_ARGUMENTS
-void LeafPage<KeyT, ValueT, KeyComparatorT>::PushFront(PairT elem) {
+void LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::PushFront(PairT elem) {
     std::copy_backward(
         std::begin(this->keys),
         std::begin(this->keys) + GetSize(),
@@ -353,7 +440,7 @@ void LeafPage<KeyT, ValueT, KeyComparatorT>::PushFront(PairT elem) {
 }
 
 LEAF_TEMPLATE_ARGUMENTS
-auto LeafPage<KeyT, ValueT, KeyComparatorT>::PopBack() -> PairT {
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::PopBack() -> PairT {
     ChangeSizeBy(-1);
     return std::make_pair(
         this->keys[GetSize()],
@@ -362,7 +449,7 @@ auto LeafPage<KeyT, ValueT, KeyComparatorT>::PopBack() -> PairT {
 }
 
 LEAF_TEMPLATE_ARGUMENTS
-auto LeafPage<KeyT, ValueT, KeyComparatorT>::PopFront() -> PairT {
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::PopFront() -> PairT {
     auto res = std::make_pair(
         this->keys[0],
         this->vals[0]
@@ -383,7 +470,7 @@ auto LeafPage<KeyT, ValueT, KeyComparatorT>::PopFront() -> PairT {
 
 
 LEAF_TEMPLATE_ARGUMENTS
-auto LeafPage<KeyT, ValueT, KeyComparatorT>::DumpNodeGraphviz() const -> std::string {
+auto LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::DumpNodeGraphviz() const -> std::string {
     std::stringstream out;
     out << "  node" << GetPageId() << " [label=\"";
     for (int i = 0; i < GetSize(); ++i) {
@@ -393,3 +480,14 @@ auto LeafPage<KeyT, ValueT, KeyComparatorT>::DumpNodeGraphviz() const -> std::st
     out << "\"];\n";
     return out.str();
 }
+
+LEAF_TEMPLATE_ARGUMENTS
+void LeafPage<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>::Prefetch(const std::shared_ptr<Page>& raw_page) {
+    // the header, and the keys the first probes of the binary search land on
+    // for a page filled between half and full
+    auto leaf = reinterpret_cast<const SelfT*>(raw_page->data());
+    __builtin_prefetch(leaf);
+    __builtin_prefetch(&leaf->keys[SLOT_CNT / 4]);
+    __builtin_prefetch(&leaf->keys[SLOT_CNT * 3 / 8]);
+    __builtin_prefetch(&leaf->keys[SLOT_CNT / 2]);
+}
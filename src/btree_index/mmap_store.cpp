@@ -0,0 +1,296 @@
+#include "mmap_store.h"
+#include "btree_page.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+uint32_t constexpr MMAP_MAGIC = 0x4D4D5442;    // "BTMM"
+
+auto AdviceFlag(MmapAdvice advice) -> int {
+    switch (advice) {
+        case MmapAdvice::Random:
+            return MADV_RANDOM;
+        case MmapAdvice::Sequential:
+            return MADV_SEQUENTIAL;
+        default:
+            return MADV_NORMAL;
+    }
+}
+
+}
+
+MmapStore::~MmapStore() {
+    if (this->base != nullptr) {
+        ::munmap(this->base, this->options.map_size);
+    }
+    if (this->fd >= 0) {
+        ::close(this->fd);
+    }
+}
+
+auto MmapStore::open(const MmapOptions& options, size_t page_size) -> StatusOr<std::shared_ptr<MmapStore>> {
+    /*
+        1. open file, a new file gets a clean header
+        2. reserve map_size of address space, map the file at its start
+        3. check the header, a dirty file was not flushed before a crash: its free
+           chain and next pid are stale, the index rebuilds them (FinishRepair)
+        4. load the free page chain, apply access advice
+    */
+    auto store = std::shared_ptr<MmapStore>(new MmapStore());
+    store->options = options;
+    store->page_size = page_size;
+    // 1. open
+    store->fd = ::open(options.path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (store->fd < 0) {
+        return {StatusCode::IOError};
+    }
+    struct stat st{};
+    if (::fstat(store->fd, &st) != 0) {
+        return {StatusCode::IOError};
+    }
+    store->file_page_cnt = st.st_size / page_size;
+    auto is_new = store->file_page_cnt == 0;
+    if (is_new) {
+        if (::ftruncate(store->fd, page_size) != 0) {
+            return {StatusCode::IOError};
+        }
+        store->file_page_cnt = 1;
+    }
+    // 2. map
+    auto addr = ::mmap(nullptr, options.map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, store->fd, 0);
+    if (addr == MAP_FAILED) {
+        return {StatusCode::IOError};
+    }
+    store->base = static_cast<char*>(addr);
+    // 3. header
+    auto& header = store->GetHeader();
+    if (is_new) {
+        header = Header{MMAP_MAGIC, (uint32_t)page_size, 1, -1, 0, -1};
+        auto sync_res = store->SyncHeader();
+        if (!sync_res.Ok()) {
+            return {sync_res.Code()};
+        }
+    }
+    if (header.magic != MMAP_MAGIC || header.page_size != page_size) {
+        return {StatusCode::IOError};
+    }
+    if (header.clean == 0) {
+        if (!options.repair) {
+            return {StatusCode::IOError};
+        }
+        // pages up to the file end may belong to the tree
+        store->needs_repair = true;
+        store->next_pid = (int)(store->file_page_cnt - 1);
+        store->views.resize(store->next_pid);
+    } else {
+        if ((size_t)header.next_pid + 1 > store->file_page_cnt) {
+            return {StatusCode::IOError};
+        }
+        store->next_pid = header.next_pid;
+        store->views.resize(store->next_pid);
+    }
+    // 4. free chain
+    for (auto pid = store->needs_repair ? -1 : header.free_head; pid >= 0; ) {
+        if (pid >= store->next_pid || store->free_pids.size() >= (size_t)store->next_pid) {
+            return {StatusCode::IOError};
+        }
+        store->free_pids.push_back(pid);
+        std::memcpy(&pid, store->PageAddr(pid), sizeof(pid));
+    }
+    ::madvise(store->base, options.map_size, AdviceFlag(options.advice));
+    if (options.prefetch) {
+        ::madvise(store->base, store->file_page_cnt * page_size, MADV_WILLNEED);
+    }
+    return {store};
+}
+
+auto MmapStore::GetHeader() -> Header& {
+    return *reinterpret_cast<Header*>(this->base);
+}
+
+auto MmapStore::PageAddr(int pid) -> char* {
+    return this->base + (size_t)(pid + 1) * this->page_size;
+}
+
+auto MmapStore::SyncHeader() -> Status {
+    if (::msync(this->base, this->page_size, MS_SYNC) != 0) {
+        return {StatusCode::IOError};
+    }
+    return {};
+}
+
+auto MmapStore::ReserveLocked(int pid) -> Status {
+    auto need = (size_t)pid + 2;
+    if (need <= this->file_page_cnt) {
+        return {};
+    }
+    if (need * this->page_size > this->options.map_size) {
+        return {StatusCode::OutOfSpace};
+    }
+    // grow by doubling, one ftruncate per many new pages
+    auto new_cnt = std::min(std::max(need, 2 * this->file_page_cnt), this->options.map_size / this->page_size);
+    if (::ftruncate(this->fd, new_cnt * this->page_size) != 0) {
+        return {StatusCode::IOError};
+    }
+    this->file_page_cnt = new_cnt;
+    return {};
+}
+
+auto MmapStore::Reserve(size_t page_cnt) -> Status {
+    std::unique_lock lk(this->mu);
+    if (page_cnt <= this->free_pids.size()) {
+        return {};
+    }
+    return ReserveLocked(this->next_pid + (int)(page_cnt - this->free_pids.size()) - 1);
+}
+
+auto MmapStore::create(int page_size) -> std::shared_ptr<Page> {
+    assert((size_t)page_size == this->page_size);
+    std::unique_lock lk(this->mu);
+    int page_id{};
+    if (!this->free_pids.empty()) {
+        page_id = this->free_pids.back();
+        this->free_pids.pop_back();
+    } else {
+        if (!ReserveLocked(this->next_pid).Ok()) {
+            // the writer did not Reserve before changing pages
+            std::cout << "should not reach here!\n";
+            exit(-1);
+        }
+        page_id = this->next_pid++;
+        this->views.resize(this->next_pid);
+    }
+    auto addr = PageAddr(page_id);
+    std::memset(addr, 0, this->page_size);
+    reinterpret_cast<BTreePage*>(addr)->SetPageId(page_id);
+    auto& view = this->views[page_id];
+    if (view == nullptr) {
+        view = std::make_shared<Page>(addr, this->page_size);
+    }
+    return view;
+}
+
+auto MmapStore::get_page(int pid, bool for_write) -> std::shared_ptr<Page> {
+    {
+        std::shared_lock lk(this->mu);
+        if (pid < 0 || pid >= this->next_pid) {
+            return {};
+        }
+        if (this->views[pid] != nullptr) {
+            return this->views[pid];
+        }
+    }
+    // first access of pid in this process
+    std::unique_lock lk(this->mu);
+    auto& view = this->views[pid];
+    if (view == nullptr) {
+        view = std::make_shared<Page>(PageAddr(pid), this->page_size);
+    }
+    return view;
+}
+
+void MmapStore::remove(int pid) {
+    std::unique_lock lk(this->mu);
+    // not reused before Flush: create never hands out (and zeroes) a page removed since,
+    // so its bytes stay as they were until the free chain overwrites its first bytes
+    this->pending_pids.push_back(pid);
+}
+
+auto MmapStore::LivePages() const -> size_t {
+    std::shared_lock lk(this->mu);
+    return (size_t)this->next_pid - this->free_pids.size() - this->pending_pids.size();
+}
+
+auto MmapStore::RootPid() -> int {
+    return GetHeader().root_pid;
+}
+
+void MmapStore::SetRootPid(int pid) {
+    GetHeader().root_pid = pid;
+}
+
+auto MmapStore::NeedsRepair() const -> bool {
+    return this->needs_repair;
+}
+
+auto MmapStore::FinishRepair(int root_pid, const std::vector<bool>& live) -> Status {
+    {
+        std::unique_lock lk(this->mu);
+        // the file may hold pages past the last live one, they are dropped with the rest
+        this->next_pid = 0;
+        for (int pid = (int)std::min(live.size(), this->views.size()) - 1; pid >= 0; pid--) {
+            if (live[pid]) {
+                this->next_pid = pid + 1;
+                break;
+            }
+        }
+        this->views.resize(this->next_pid);
+        this->free_pids.clear();
+        this->pending_pids.clear();
+        for (int pid = 0; pid < this->next_pid; pid++) {
+            if (!live[pid]) {
+                this->free_pids.push_back(pid);
+            }
+        }
+        this->needs_repair = false;
+    }
+    return Flush(root_pid);
+}
+
+auto MmapStore::BeginWrite() -> Status {
+    auto& header = GetHeader();
+    if (header.clean == 0) {
+        return {};
+    }
+    header.clean = 0;
+    return SyncHeader();
+}
+
+auto MmapStore::Flush(int root_pid) -> Status {
+    /*
+        1. link free pages, and pages removed since the last flush, into the chain
+        2. msync all pages
+        3. header: root, next pid, chain head, clean; msync it last
+        4. removed pages may be reused from now on
+    */
+    std::unique_lock lk(this->mu);
+    auto& header = GetHeader();
+    // no write since the last flush
+    if (header.clean != 0) {
+        return {};
+    }
+    // 1. free chain
+    auto next_free = int32_t{-1};
+    for (auto pids : {&this->free_pids, &this->pending_pids}) {
+        for (auto pid : *pids) {
+            std::memcpy(PageAddr(pid), &next_free, sizeof(next_free));
+            next_free = pid;
+        }
+    }
+    // 2. pages
+    if (::msync(this->base, this->file_page_cnt * this->page_size, MS_SYNC) != 0) {
+        return {StatusCode::IOError};
+    }
+    // 3. header
+    header.root_pid = root_pid;
+    header.next_pid = this->next_pid;
+    header.free_head = next_free;
+    header.clean = 1;
+    auto sync_res = SyncHeader();
+    if (!sync_res.Ok()) {
+        return sync_res;
+    }
+    // 4. reusable
+    this->free_pids.insert(this->free_pids.end(), this->pending_pids.begin(), this->pending_pids.end());
+    this->pending_pids.clear();
+    return {};
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "page_store.h"
+#include "../status/status.h"
+
+/*
+    pages of one index live in a single memory-mapped file.
+    get_page hands out views into the mapping: no copy, no buffer pool, the page
+    cache does the caching and the kernel writes dirty pages back on its own.
+    the whole map_size is reserved at open, so page addresses never move while
+    the file grows. Flush msyncs the mapping and marks the file clean; the first
+    write after it marks the file dirty (synced) before any page changes, so a
+    crash between flushes is detected on open instead of serving a torn tree.
+
+    a dirty file is repaired on open (MmapOptions::repair): the index walks the tree
+    from the root pid every op leaves in the header, checks each page and recounts
+    child metas, FinishRepair frees every page the walk did not reach. a process crash
+    keeps all pages in the page cache, so ops that returned before it survive; the op
+    in flight may be lost, with the keys a half done split moved. power loss between
+    flushes may persist any mix of pages: not durable, Checkpoint() bounds the loss.
+
+    file layout: page pid lives at (pid + 1) * page size, before it the header:
+        uint32_t magic | uint32_t page size | uint32_t clean | int32_t root pid
+        | int32_t next pid | int32_t head of the free page chain
+    a free page holds the pid of the next free page in its first bytes. a removed page
+    joins the chain at the next Flush, create reuses only pages freed before it.
+*/
+
+enum class MmapAdvice : uint8_t {
+    Normal,
+    // point lookups: no read-ahead around a faulted page
+    Random,
+    // scans: aggressive read-ahead, pages behind are dropped early
+    Sequential,
+};
+
+struct MmapOptions {
+    std::string path;
+    MmapAdvice advice{MmapAdvice::Random};
+    // fault the used part of the file in at open (MADV_WILLNEED)
+    bool prefetch{false};
+    // a file its last writer did not flush is repaired, false: rejected with IOError
+    bool repair{true};
+    // address space reserved for the file, a write needing pages past it fails with OutOfSpace
+    size_t map_size{size_t{1} << 36};
+    // period of background flushes, 0: only explicit Checkpoint() and close
+    int flush_interval_ms{1000};
+};
+
+class MmapStore : public PageBackend {
+public:
+    MmapStore(const MmapStore&) = delete;
+    ~MmapStore();
+    // map the file, a file made with another page size is rejected with IOError, so is
+    // a file not flushed by its last writer unless options.repair
+    static auto open(const MmapOptions& options, size_t page_size = BTREE_PAGE_SIZE) 
+        -> StatusOr<std::shared_ptr<MmapStore>>;
+
+    auto create(int page_size) -> std::shared_ptr<Page> override;
+    auto get_page(int pid, bool for_write) -> std::shared_ptr<Page> override;
+    void remove(int pid) override;
+    // grows the file, OutOfSpace past map_size, IOError if the file can not grow
+    auto Reserve(size_t page_cnt) -> Status override;
+    auto LivePages() const -> size_t override;
+
+    // -1 for a new file
+    auto RootPid() -> int;
+    // root after every op, read by a repair. no sync, Flush syncs it
+    void SetRootPid(int pid);
+    // opened dirty: every pid the file holds is readable, none reused until FinishRepair
+    auto NeedsRepair() const -> bool;
+    // the pages reached from root_pid stay (live[pid]), the others become free, then Flush
+    auto FinishRepair(int root_pid, const std::vector<bool>& live) -> Status;
+    // called before a writer changes any page
+    auto BeginWrite() -> Status;
+    // persist free chain and root, msync everything, mark clean. caller keeps writers out
+    auto Flush(int root_pid) -> Status;
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t page_size;
+        uint32_t clean;
+        int32_t root_pid;
+        int32_t next_pid;
+        int32_t free_head;
+    };
+    MmapStore() = default;
+    auto GetHeader() -> Header&;
+    auto PageAddr(int pid) -> char*;
+    auto SyncHeader() -> Status;
+    // grow the file to hold pid
+    auto ReserveLocked(int pid) -> Status;
+
+    MmapOptions options;
+    size_t page_size{BTREE_PAGE_SIZE};
+    int fd{-1};
+    char* base{nullptr};
+    // pages the file holds, header included
+    size_t file_page_cnt{0};
+    mutable std::shared_mutex mu;
+    std::vector<std::shared_ptr<Page>> views;
+    // reusable by create
+    std::vector<int> free_pids;
+    // removed since the last flush, reusable after the next one
+    std::vector<int> pending_pids;
+    int next_pid{0};
+    bool needs_repair{false};
+};
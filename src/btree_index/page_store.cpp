@@ -0,0 +1,505 @@
+#include "page_store.h"
+#include "btree_page.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+auto IsIoAligned(const void* buf) -> bool {
+    return reinterpret_cast<uintptr_t>(buf) % PAGE_IO_ALIGN == 0;
+}
+
+}
+
+Page::Page(size_t size): owned(AllocBytes(size)), bytes(owned.get()), len(size) {}
+
+Page::Page(char* data, size_t size): bytes(data), len(size) {}
+
+Page::Page(const Page& other): Page(other.len) {
+    std::memcpy(this->bytes, other.bytes, this->len);
+}
+
+auto Page::operator=(const Page& other) -> Page& {
+    if (this != &other) {
+        this->owned.reset(AllocBytes(other.len));
+        this->bytes = this->owned.get();
+        this->len = other.len;
+        std::memcpy(this->bytes, other.bytes, this->len);
+    }
+    return *this;
+}
+
+void Page::FreeBytes::operator()(char* bytes) const {
+    std::free(bytes);
+}
+
+auto Page::AllocBytes(size_t size) -> char* {
+    // aligned_alloc wants a multiple of the alignment
+    auto alloc_size = std::max((size + PAGE_IO_ALIGN - 1) / PAGE_IO_ALIGN * PAGE_IO_ALIGN, PAGE_IO_ALIGN);
+    auto bytes = static_cast<char*>(std::aligned_alloc(PAGE_IO_ALIGN, alloc_size));
+    if (bytes == nullptr) {
+        throw std::bad_alloc();
+    }
+    std::memset(bytes, 0, alloc_size);
+    return bytes;
+}
+
+auto Page::data() -> char* {
+    return this->bytes;
+}
+
+auto Page::data() const -> const char* {
+    return this->bytes;
+}
+
+auto Page::size() const -> size_t {
+    return this->len;
+}
+
+PageFile::~PageFile() {
+    if (this->fd >= 0) {
+        ::close(this->fd);
+    }
+}
+
+auto PageFile::open(const std::string& path, std::shared_ptr<IoEngine> io, bool direct, size_t page_size) 
+    -> StatusOr<std::shared_ptr<PageFile>> {
+    /*
+        direct mode: open with O_DIRECT and probe one aligned read, filesystems without
+        O_DIRECT support (some tmpfs / fuse / network mounts) fail either one with EINVAL.
+        a page size that is not a multiple of the alignment can not go direct either
+    */
+    auto page_file = std::shared_ptr<PageFile>(new PageFile());
+    page_file->io = std::move(io);
+    page_file->page_size = page_size;
+    if (direct && page_size % PAGE_IO_ALIGN == 0) {
+        page_file->fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_DIRECT, 0644);
+        auto probe = Page(PAGE_IO_ALIGN);
+        if (page_file->fd >= 0 && ::pread(page_file->fd, probe.data(), PAGE_IO_ALIGN, 0) < 0) {
+            ::close(page_file->fd);
+            page_file->fd = -1;
+        }
+        page_file->direct = page_file->fd >= 0;
+    }
+    if (page_file->fd < 0) {
+        page_file->fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    }
+    if (page_file->fd < 0) {
+        return {StatusCode::IOError};
+    }
+    return {page_file};
+}
+
+auto PageFile::Read(int pid, char* buf) -> Status {
+    if (this->direct && !IsIoAligned(buf)) {
+        auto bounce = Page(this->page_size);
+        auto read_res = Read(pid, bounce.data());
+        if (read_res.Ok()) {
+            std::memcpy(buf, bounce.data(), this->page_size);
+        }
+        return read_res;
+    }
+    size_t done = 0;
+    auto offset = (off_t)pid * (off_t)this->page_size;
+    while (done < this->page_size) {
+        auto n = ::pread(this->fd, buf + done, this->page_size - done, offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        // a read past the end of file is a failure too
+        if (n <= 0) {
+            return {StatusCode::IOError};
+        }
+        done += n;
+    }
+    return {};
+}
+
+auto PageFile::Write(int pid, const char* buf) -> Status {
+    if (this->direct && !IsIoAligned(buf)) {
+        auto bounce = Page(this->page_size);
+        std::memcpy(bounce.data(), buf, this->page_size);
+        return Write(pid, bounce.data());
+    }
+    size_t done = 0;
+    auto offset = (off_t)pid * (off_t)this->page_size;
+    while (done < this->page_size) {
+        auto n = ::pwrite(this->fd, buf + done, this->page_size - done, offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        // nothing written (full device) would retry forever
+        if (n <= 0) {
+            return {StatusCode::IOError};
+        }
+        done += n;
+    }
+    return {};
+}
+
+void PageFile::ReadAsync(const std::vector<std::pair<int, char*>>& reads, std::function<void(int pid, bool ok)> done) {
+    if (this->io == nullptr) {
+        for (auto [pid, buf] : reads) {
+            done(pid, Read(pid, buf).Ok());
+        }
+        return;
+    }
+    auto reqs = std::vector<IoRequest>{};
+    reqs.reserve(reads.size());
+    for (auto [pid, buf] : reads) {
+        assert(!this->direct || IsIoAligned(buf));
+        reqs.push_back(IoRequest{false, this->fd, buf, (uint32_t)this->page_size, (uint64_t)pid * this->page_size, 
+            [done, pid](bool ok) {
+                done(pid, ok);
+            }});
+    }
+    this->io->Submit(std::move(reqs));
+}
+
+auto PageFile::WriteBatch(const std::vector<std::pair<int, std::vector<char>>>& images) -> Status {
+    if (this->io == nullptr) {
+        for (auto& [pid, image] : images) {
+            auto write_res = Write(pid, image.data());
+            if (!write_res.Ok()) {
+                return write_res;
+            }
+        }
+        return {};
+    }
+    auto reqs = std::vector<IoRequest>{};
+    reqs.reserve(images.size());
+    // direct mode: aligned copies of unaligned images, alive until the batch is done
+    auto bounces = std::vector<Page>{};
+    bounces.reserve(images.size());
+    for (auto& [pid, image] : images) {
+        // the engine only reads from buf for a write
+        auto buf = const_cast<char*>(image.data());
+        if (this->direct && !IsIoAligned(buf)) {
+            auto& bounce = bounces.emplace_back(this->page_size);
+            std::memcpy(bounce.data(), buf, this->page_size);
+            buf = bounce.data();
+        }
+        reqs.push_back(IoRequest{true, this->fd, buf, (uint32_t)this->page_size, (uint64_t)pid * this->page_size, {}});
+    }
+    return this->io->RunBatch(std::move(reqs));
+}
+
+auto PageFile::Sync() -> Status {
+    if (::fdatasync(this->fd) != 0) {
+        return {StatusCode::IOError};
+    }
+    return {};
+}
+
+auto PageFile::PageCount() const -> StatusOr<int> {
+    struct stat st{};
+    if (::fstat(this->fd, &st) != 0) {
+        return {StatusCode::IOError};
+    }
+    return {(int)(st.st_size / (off_t)this->page_size)};
+}
+
+auto PageFile::PageSize() const -> size_t {
+    return this->page_size;
+}
+
+auto PageFile::IsDirect() const -> bool {
+    return this->direct;
+}
+
+PageStore::PageStore(const PoolOptions& pool_options): pool_options(pool_options) {
+    if (pool_options.capacity > 0) {
+        this->replacer = Replacer::create(pool_options);
+    }
+}
+
+auto PageStore::create(int page_size) -> std::shared_ptr<Page> {
+    std::unique_lock lk(this->mu);
+    int page_id = this->next_page_id++;
+    auto page = std::make_shared<Page>(page_size);
+
+    auto& btree_page = *reinterpret_cast<BTreePage*>(page->data());
+    btree_page.SetPageId(page_id);
+
+    this->dirty_pids.push_back(page_id);
+    InsertFrameLocked(page_id, page, true);
+    this->memory_pages++;
+    return page;
+}
+
+PageStore::~PageStore() {
+    std::unique_lock lk(this->mu);
+    this->loaded_cv.wait(lk, [this] {
+        return this->loading.empty();
+    });
+}
+
+auto PageStore::get_page(int pid, bool for_write) -> std::shared_ptr<Page> {
+    if (!for_write) {
+        std::shared_lock lk(this->mu);
+        auto res = this->frames.find(pid);
+        if (res != this->frames.end()) {
+            this->hits.fetch_add(1, std::memory_order_relaxed);
+            RecordAccess(pid, *res->second.page);
+            return res->second.page;
+        }
+    }
+    std::unique_lock lk(this->mu);
+    auto res = this->frames.find(pid);
+    if (res != this->frames.end()) {
+        this->hits.fetch_add(1, std::memory_order_relaxed);
+        RecordAccess(pid, *res->second.page);
+    } else {
+        // miss: start the read or join the one in flight, wait for it without the lock
+        this->misses.fetch_add(1, std::memory_order_relaxed);
+        auto load = StartLoadLocked(pid);
+        if (load != nullptr) {
+            lk.unlock();
+            SubmitLoads({{pid, load}});
+            lk.lock();
+        }
+        auto in_flight = this->loading.find(pid);
+        if (in_flight != this->loading.end()) {
+            auto waiting = in_flight->second;
+            this->loaded_cv.wait(lk, [&waiting] {
+                return waiting->finished;
+            });
+        }
+        res = this->frames.find(pid);
+        // not in file, or the read failed
+        if (res == this->frames.end()) {
+            return {};
+        }
+    }
+    if (for_write && !res->second.dirty) {
+        res->second.dirty = true;
+        this->dirty_pids.push_back(pid);
+    }
+    return res->second.page;
+}
+
+void PageStore::prefetch(const std::vector<int>& pids) {
+    auto loads = std::vector<std::pair<int, std::shared_ptr<Loading>>>{};
+    {
+        std::unique_lock lk(this->mu);
+        for (auto pid : pids) {
+            if (this->frames.contains(pid)) {
+                continue;
+            }
+            auto load = StartLoadLocked(pid);
+            if (load != nullptr) {
+                loads.emplace_back(pid, std::move(load));
+            }
+        }
+    }
+    if (!loads.empty()) {
+        SubmitLoads(loads);
+    }
+}
+
+auto PageStore::StartLoadLocked(int pid) -> std::shared_ptr<Loading> {
+    if (this->file == nullptr || pid < 0 || pid >= this->file_page_cnt || this->loading.contains(pid)) {
+        return {};
+    }
+    auto load = std::make_shared<Loading>();
+    load->page = std::make_shared<Page>(this->file->PageSize());
+    this->loading.insert({pid, load});
+    return load;
+}
+
+void PageStore::SubmitLoads(const std::vector<std::pair<int, std::shared_ptr<Loading>>>& loads) {
+    auto reads = std::vector<std::pair<int, char*>>{};
+    reads.reserve(loads.size());
+    for (auto& [pid, load] : loads) {
+        reads.emplace_back(pid, load->page->data());
+    }
+    // completions take mu, so never submit while holding it
+    this->file->ReadAsync(reads, [this](int pid, bool ok) {
+        FinishLoad(pid, ok);
+    });
+}
+
+void PageStore::FinishLoad(int pid, bool ok) {
+    std::unique_lock lk(this->mu);
+    auto res = this->loading.find(pid);
+    assert(res != this->loading.end());
+    auto load = std::move(res->second);
+    this->loading.erase(res);
+    if (ok) {
+        InsertFrameLocked(pid, load->page, false);
+    }
+    load->finished = true;
+    // notify under the lock, the destructor may free loaded_cv right after
+    this->loaded_cv.notify_all();
+}
+
+void PageStore::RecordAccess(int pid, const Page& page) {
+    if (this->replacer != nullptr) {
+        // inner pages are on the path of every descent
+        this->replacer->RecordAccess(pid, reinterpret_cast<const BTreePage*>(page.data())->IsInternalPage());
+    }
+}
+
+void PageStore::InsertFrameLocked(int pid, std::shared_ptr<Page> page, bool dirty) {
+    RecordAccess(pid, *page);
+    this->frames.insert({pid, Frame{std::move(page), dirty}});
+    EvictLocked();
+}
+
+void PageStore::EvictLocked() {
+    if (this->replacer == nullptr) {
+        return;
+    }
+    auto evictable = [this](int victim_pid) {
+        return EvictableLocked(victim_pid);
+    };
+    while (this->frames.size() > this->pool_options.capacity) {
+        auto victim = this->replacer->Victim(evictable);
+        // everything else is dirty or pinned
+        if (!victim.has_value()) {
+            break;
+        }
+        this->frames.erase(*victim);
+        this->evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+auto PageStore::EvictableLocked(int pid) const -> bool {
+    auto res = this->frames.find(pid);
+    if (res == this->frames.end()) {
+        return false;
+    }
+    auto& frame = res->second;
+    // use_count 1: only the table holds the page, no descent works on it
+    return !frame.dirty && !frame.in_writeback && frame.page.use_count() == 1 && pid < this->file_page_cnt;
+}
+
+void PageStore::remove(int pid) {
+    std::unique_lock lk(this->mu);
+    this->frames.erase(pid);
+    // a file slot stays, pids are not reused
+    if (pid >= this->file_page_cnt) {
+        this->memory_pages--;
+    }
+    if (this->replacer != nullptr) {
+        this->replacer->Remove(pid);
+    }
+}
+
+void PageStore::MarkDirty(int pid) {
+    std::unique_lock lk(this->mu);
+    auto res = this->frames.find(pid);
+    if (res != this->frames.end() && !res->second.dirty) {
+        res->second.dirty = true;
+        this->dirty_pids.push_back(pid);
+    }
+}
+
+auto PageStore::TakeDirtyImages() -> std::vector<std::pair<int, std::vector<char>>> {
+    std::unique_lock lk(this->mu);
+    auto images = std::vector<std::pair<int, std::vector<char>>>{};
+    images.reserve(this->dirty_pids.size());
+    // ascending pids: writeback runs front to back through the file
+    std::sort(this->dirty_pids.begin(), this->dirty_pids.end());
+    for (auto pid : this->dirty_pids) {
+        auto res = this->frames.find(pid);
+        // removed after it became dirty
+        if (res == this->frames.end()) {
+            continue;
+        }
+        res->second.dirty = false;
+        res->second.in_writeback = true;
+        auto& page = *res->second.page;
+        images.emplace_back(pid, std::vector<char>(page.data(), page.data() + page.size()));
+    }
+    this->dirty_pids.clear();
+    return images;
+}
+
+void PageStore::FinishWriteback(const std::vector<std::pair<int, std::vector<char>>>& images) {
+    std::unique_lock lk(this->mu);
+    for (auto& [pid, image] : images) {
+        // from now on the file holds pid, it can be read back after eviction
+        auto res = this->frames.find(pid);
+        if (pid >= this->file_page_cnt && res != this->frames.end()) {
+            this->memory_pages--;
+        }
+        this->file_page_cnt = std::max(this->file_page_cnt, pid + 1);
+        if (res != this->frames.end()) {
+            res->second.in_writeback = false;
+        }
+    }
+    // pages past capacity stayed only because they were dirty
+    EvictLocked();
+}
+
+auto PageStore::Stats() const -> PoolStats {
+    std::shared_lock lk(this->mu);
+    return PoolStats{
+        this->hits.load(std::memory_order_relaxed), 
+        this->misses.load(std::memory_order_relaxed), 
+        this->evictions.load(std::memory_order_relaxed), 
+        this->frames.size(),
+        this->dirty_pids.size()
+    };
+}
+
+auto PageStore::HotPages(size_t max_cnt) const -> std::vector<int> {
+    std::shared_lock lk(this->mu);
+    auto ranked = std::vector<int>{};
+    if (this->replacer != nullptr) {
+        ranked = this->replacer->HotPages();
+    } else {
+        ranked.reserve(this->frames.size());
+        for (auto& [pid, frame] : this->frames) {
+            ranked.push_back(pid);
+        }
+        std::stable_partition(ranked.begin(), ranked.end(), [this](int pid) {
+            return reinterpret_cast<const BTreePage*>(this->frames.at(pid).page->data())->IsInternalPage();
+        });
+    }
+    auto pids = std::vector<int>{};
+    for (auto pid : ranked) {
+        if (max_cnt > 0 && pids.size() >= max_cnt) {
+            break;
+        }
+        // pages never written can not be read back
+        if (pid < this->file_page_cnt && this->frames.contains(pid)) {
+            pids.push_back(pid);
+        }
+    }
+    return pids;
+}
+
+auto PageStore::DirtyRatio() const -> double {
+    std::shared_lock lk(this->mu);
+    auto frame_cnt = this->pool_options.capacity > 0 ? this->pool_options.capacity : this->frames.size();
+    return frame_cnt == 0 ? 0.0 : (double)this->dirty_pids.size() / (double)frame_cnt;
+}
+
+auto PageStore::NextPageId() const -> int {
+    std::shared_lock lk(this->mu);
+    return this->next_page_id;
+}
+
+void PageStore::AttachFile(std::shared_ptr<PageFile> page_file, int next_pid) {
+    std::unique_lock lk(this->mu);
+    this->file = std::move(page_file);
+    this->file_page_cnt = next_pid;
+    this->next_page_id = std::max(this->next_page_id, next_pid);
+}
+
+auto PageStore::LivePages() const -> size_t {
+    std::shared_lock lk(this->mu);
+    return (size_t)this->file_page_cnt + this->memory_pages;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+#include "io_engine.h"
+#include "replacer.h"
+#include "../status/status.h"
+
+/*
+    bytes of one page: an owned zeroed buffer aligned to PAGE_IO_ALIGN, or a view
+    of memory that outlives the page (a file mapping). a copy always owns its bytes.
+*/
+class Page {
+public:
+    explicit Page(size_t size);
+    Page(char* data, size_t size);
+    Page(const Page& other);
+    auto operator=(const Page& other) -> Page&;
+    auto data() -> char*;
+    auto data() const -> const char*;
+    auto size() const -> size_t;
+
+private:
+    struct FreeBytes {
+        void operator()(char* bytes) const;
+    };
+    static auto AllocBytes(size_t size) -> char*;
+
+    std::unique_ptr<char, FreeBytes> owned;
+    char* bytes;
+    size_t len;
+};
+
+/*
+    where RawPageMgr takes pages from, bound to a thread by RawPageMgr::Scope
+*/
+class PageBackend {
+public:
+    virtual ~PageBackend() = default;
+    virtual auto create(int page_size) -> std::shared_ptr<Page> = 0;
+    virtual auto get_page(int pid, bool for_write) -> std::shared_ptr<Page> = 0;
+    virtual void remove(int pid) = 0;
+    // room for page_cnt creates, asked before a writer changes any page: a create
+    // failing half way through a split would leave the tree half changed
+    virtual auto Reserve(size_t page_cnt) -> Status { return {}; }
+    // hint: pids are read soon, start loading them without waiting
+    virtual void prefetch(const std::vector<int>& pids) {}
+    // pages the backend holds storage for: created and not removed, or still owning a file slot
+    virtual auto LivePages() const -> size_t { return 0; }
+};
+
+/*
+    on-disk home of the pages of one index, page pid lives at pid * page_size
+*/
+class PageFile {
+public:
+    PageFile(const PageFile&) = delete;
+    ~PageFile();
+    // io: engine of ReadAsync / WriteBatch, nullptr: they run synchronously.
+    // direct: bypass the page cache (O_DIRECT), buffered io where the filesystem refuses it
+    static auto open(const std::string& path, std::shared_ptr<IoEngine> io = nullptr, bool direct = false, 
+        size_t page_size = BTREE_PAGE_SIZE) -> StatusOr<std::shared_ptr<PageFile>>;
+    auto Read(int pid, char* buf) -> Status;
+    auto Write(int pid, const char* buf) -> Status;
+    // one submission for all reads, done(pid, ok) runs once per read, maybe on an engine thread.
+    // in direct mode bufs must be PAGE_IO_ALIGN aligned, Page buffers are
+    void ReadAsync(const std::vector<std::pair<int, char*>>& reads, std::function<void(int pid, bool ok)> done);
+    // one submission for all images, returns when all are written
+    auto WriteBatch(const std::vector<std::pair<int, std::vector<char>>>& images) -> Status;
+    auto Sync() -> Status;
+    // number of whole pages in the file
+    auto PageCount() const -> StatusOr<int>;
+    auto PageSize() const -> size_t;
+    // O_DIRECT was accepted
+    auto IsDirect() const -> bool;
+
+private:
+    PageFile() = default;
+    int fd{-1};
+    bool direct{false};
+    size_t page_size{BTREE_PAGE_SIZE};
+    std::shared_ptr<IoEngine> io;
+};
+
+/*
+    page table of one index
+    pages created / fetched by a writer are marked dirty, a checkpoint takes
+    their images. with a PageFile attached, pages below its page count that
+    are not in the table yet are read from the file on first access.
+    a miss is read without holding the table lock; threads missing the same
+    page wait for one read, prefetch starts reads nobody waits for yet.
+    with a capacity the table is bounded: past it, the replacer picks clean
+    pages nobody holds (use_count 1) whose image is in the file, and drops them.
+    dirty and pinned pages stay, so the table may exceed capacity for a while.
+*/
+class PageStore : public PageBackend {
+public:
+    explicit PageStore(const PoolOptions& pool_options = {});
+    PageStore(const PageStore&) = delete;
+    // waits for reads in flight
+    ~PageStore();
+    auto create(int page_size) -> std::shared_ptr<Page> override;
+    auto get_page(int pid, bool for_write) -> std::shared_ptr<Page> override;
+    void remove(int pid) override;
+    void prefetch(const std::vector<int>& pids) override;
+    auto LivePages() const -> size_t override;
+    void MarkDirty(int pid);
+    // copies of dirty pages in page id order, clears dirty marks. caller keeps writers out
+    auto TakeDirtyImages() -> std::vector<std::pair<int, std::vector<char>>>;
+    // images are durable in the file, their pages may be evicted from now on
+    void FinishWriteback(const std::vector<std::pair<int, std::vector<char>>>& images);
+    auto Stats() const -> PoolStats;
+    // resident pids whose image is in the file, hottest first, at most max_cnt (0: all).
+    // unbounded: inner pages before leaves
+    auto HotPages(size_t max_cnt) const -> std::vector<int>;
+    // dirty pages per capacity, per resident page when unbounded
+    auto DirtyRatio() const -> double;
+    auto NextPageId() const -> int;
+    // recovery: pids below next_pid live in file, new pages start from next_pid
+    void AttachFile(std::shared_ptr<PageFile> page_file, int next_pid);
+
+private:
+    struct Frame {
+        std::shared_ptr<Page> page;
+        bool dirty;
+        // image taken by a checkpoint, not durable yet
+        bool in_writeback{false};
+    };
+    struct Loading {
+        std::shared_ptr<Page> page;
+        bool finished{false};
+    };
+    // read pid if it lives in file and nobody reads it yet, caller holds mu.
+    // returns the read to submit after mu is released, nullptr if there is none
+    auto StartLoadLocked(int pid) -> std::shared_ptr<Loading>;
+    void SubmitLoads(const std::vector<std::pair<int, std::shared_ptr<Loading>>>& loads);
+    void FinishLoad(int pid, bool ok);
+    void RecordAccess(int pid, const Page& page);
+    // add a frame, evict down to capacity
+    void InsertFrameLocked(int pid, std::shared_ptr<Page> page, bool dirty);
+    // drop evictable pages while over capacity
+    void EvictLocked();
+    auto EvictableLocked(int pid) const -> bool;
+
+    mutable std::shared_mutex mu;
+    std::unordered_map<int, Frame> frames;
+    // reads in flight, a finished read moves its page into frames
+    std::unordered_map<int, std::shared_ptr<Loading>> loading;
+    std::condition_variable_any loaded_cv;
+    std::vector<int> dirty_pids;
+    int next_page_id{0};
+    // live pages without a file slot yet
+    size_t memory_pages{0};
+    std::shared_ptr<PageFile> file;
+    int file_page_cnt{0};
+    PoolOptions pool_options;
+    // nullptr when unbounded
+    std::unique_ptr<Replacer> replacer;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+};
@@ -0,0 +1,440 @@
+#include "replacer.h"
+
+#include <algorithm>
+#include <iostream>
+
+auto PoolStats::HitRate() const -> double {
+    auto accesses = this->hits + this->misses;
+    return accesses == 0 ? 0.0 : (double)this->hits / (double)accesses;
+}
+
+auto Replacer::create(const PoolOptions& options) -> std::unique_ptr<Replacer> {
+    switch (options.replacer) {
+        case ReplacerKind::LruK:
+            return std::make_unique<LruKReplacer>(options.lru_k);
+        case ReplacerKind::TwoQ:
+            return std::make_unique<TwoQReplacer>(options.capacity);
+        case ReplacerKind::ClockPro:
+            return std::make_unique<ClockProReplacer>(options.capacity);
+    }
+    std::cout << "should not reach here!\n";
+    exit(-1);
+}
+
+LruKReplacer::LruKReplacer(int k): k((size_t)std::max(k, 1)) {}
+
+auto LruKReplacer::OrderKey(int pid, const History& history) const -> OrderKeyT {
+    // full history: the K-th most recent access decides, else the last one (plain LRU)
+    auto full = history.accesses.size() >= this->k;
+    auto decider = full ? history.accesses.front() : history.accesses.back();
+    return {history.priority, full, decider, pid};
+}
+
+void LruKReplacer::RecordAccess(int pid, bool priority) {
+    std::lock_guard lk(this->mu);
+    auto [res, inserted] = this->histories.try_emplace(pid);
+    auto& history = res->second;
+    if (!inserted) {
+        this->order.erase(OrderKey(pid, history));
+    }
+    history.priority = history.priority || priority;
+    history.accesses.push_back(++this->clock);
+    if (history.accesses.size() > this->k) {
+        history.accesses.erase(history.accesses.begin());
+    }
+    this->order.insert(OrderKey(pid, history));
+}
+
+void LruKReplacer::Remove(int pid) {
+    std::lock_guard lk(this->mu);
+    auto res = this->histories.find(pid);
+    if (res == this->histories.end()) {
+        return;
+    }
+    this->order.erase(OrderKey(pid, res->second));
+    this->histories.erase(res);
+}
+
+auto LruKReplacer::Victim(const std::function<bool(int)>& evictable) -> std::optional<int> {
+    std::lock_guard lk(this->mu);
+    for (auto key = this->order.begin(); key != this->order.end(); key++) {
+        auto pid = std::get<3>(*key);
+        if (evictable(pid)) {
+            this->order.erase(key);
+            this->histories.erase(pid);
+            return pid;
+        }
+    }
+    return {};
+}
+
+auto LruKReplacer::HotPages() -> std::vector<int> {
+    std::lock_guard lk(this->mu);
+    auto pids = std::vector<int>{};
+    pids.reserve(this->order.size());
+    for (auto key = this->order.rbegin(); key != this->order.rend(); key++) {
+        pids.push_back(std::get<3>(*key));
+    }
+    return pids;
+}
+
+TwoQReplacer::TwoQReplacer(size_t capacity):
+    in_capacity(std::max<size_t>(capacity / 4, 1)), out_capacity(std::max<size_t>(capacity / 2, 1)) {}
+
+auto TwoQReplacer::QueueOf(Queue queue) -> std::list<int>& {
+    switch (queue) {
+        case Queue::In:
+            return this->in_queue;
+        case Queue::Out:
+            return this->out_queue;
+        case Queue::Hot:
+            return this->hot_queue;
+    }
+    std::cout << "should not reach here!\n";
+    exit(-1);
+}
+
+void TwoQReplacer::MoveTo(int pid, Entry& entry, Queue queue) {
+    QueueOf(entry.queue).erase(entry.pos);
+    auto& to = QueueOf(queue);
+    to.push_front(pid);
+    entry.pos = to.begin();
+    entry.queue = queue;
+}
+
+void TwoQReplacer::RecordAccess(int pid, bool priority) {
+    /*
+        new page: FIFO in, priority pages skip it
+        in: no change, references close to the first one are correlated
+        out: re-referenced after eviction, hot now
+        hot: LRU
+    */
+    std::lock_guard lk(this->mu);
+    auto res = this->entries.find(pid);
+    if (res == this->entries.end()) {
+        auto queue = priority ? Queue::Hot : Queue::In;
+        auto& to = QueueOf(queue);
+        to.push_front(pid);
+        this->entries.insert({pid, Entry{queue, to.begin(), priority}});
+        return;
+    }
+    auto& entry = res->second;
+    entry.priority = entry.priority || priority;
+    if (entry.queue != Queue::In || entry.priority) {
+        MoveTo(pid, entry, Queue::Hot);
+    }
+}
+
+void TwoQReplacer::Remove(int pid) {
+    std::lock_guard lk(this->mu);
+    auto res = this->entries.find(pid);
+    if (res == this->entries.end()) {
+        return;
+    }
+    QueueOf(res->second.queue).erase(res->second.pos);
+    this->entries.erase(res);
+}
+
+auto TwoQReplacer::TakeFrom(Queue queue, const std::function<bool(int)>& evictable) -> std::optional<int> {
+    auto& from = QueueOf(queue);
+    for (auto take_priority : {false, true}) {
+        for (auto pos = from.rbegin(); pos != from.rend(); pos++) {
+            if (this->entries.at(*pos).priority == take_priority && evictable(*pos)) {
+                return *pos;
+            }
+        }
+    }
+    return {};
+}
+
+auto TwoQReplacer::Victim(const std::function<bool(int)>& evictable) -> std::optional<int> {
+    /*
+        1. in holds more than its share: its oldest page goes, remembered in out
+        2. else the least recently used hot page
+        3. else whatever in has
+    */
+    std::lock_guard lk(this->mu);
+    auto evict_in = [this, &evictable]() -> std::optional<int> {
+        auto pid = TakeFrom(Queue::In, evictable);
+        if (!pid.has_value()) {
+            return {};
+        }
+        MoveTo(*pid, this->entries.at(*pid), Queue::Out);
+        while (this->out_queue.size() > this->out_capacity) {
+            this->entries.erase(this->out_queue.back());
+            this->out_queue.pop_back();
+        }
+        return pid;
+    };
+    // 1. in over its share
+    if (this->in_queue.size() > this->in_capacity) {
+        auto pid = evict_in();
+        if (pid.has_value()) {
+            return pid;
+        }
+    }
+    // 2. hot
+    auto pid = TakeFrom(Queue::Hot, evictable);
+    if (pid.has_value()) {
+        auto res = this->entries.find(*pid);
+        this->hot_queue.erase(res->second.pos);
+        this->entries.erase(res);
+        return pid;
+    }
+    // 3. in below its share
+    return evict_in();
+}
+
+auto TwoQReplacer::HotPages() -> std::vector<int> {
+    // priority pages, then hot by recency, then new pages; out holds no resident page
+    std::lock_guard lk(this->mu);
+    auto pids = std::vector<int>{};
+    pids.reserve(this->hot_queue.size() + this->in_queue.size());
+    for (auto take_priority : {true, false}) {
+        for (auto queue : {&this->hot_queue, &this->in_queue}) {
+            for (auto pid : *queue) {
+                if (this->entries.at(pid).priority == take_priority) {
+                    pids.push_back(pid);
+                }
+            }
+        }
+    }
+    return pids;
+}
+
+ClockProReplacer::ClockProReplacer(size_t capacity):
+    capacity(std::max<size_t>(capacity, 2)), cold_target(std::max<size_t>(capacity / 4, 1)),
+    hand_hot(clock.end()), hand_cold(clock.end()), hand_test(clock.end()) {}
+
+auto ClockProReplacer::Next(PosT pos) -> PosT {
+    pos++;
+    return pos == this->clock.end() ? this->clock.begin() : pos;
+}
+
+void ClockProReplacer::Insert(const Entry& entry) {
+    if (this->clock.empty()) {
+        this->clock.push_back(entry);
+        this->hand_hot = this->hand_cold = this->hand_test = this->clock.begin();
+        this->entries[entry.pid] = this->clock.begin();
+        return;
+    }
+    this->entries[entry.pid] = this->clock.insert(this->hand_hot, entry);
+}
+
+void ClockProReplacer::Erase(PosT pos) {
+    this->entries.erase(pos->pid);
+    if (this->clock.size() == 1) {
+        this->clock.clear();
+        this->hand_hot = this->hand_cold = this->hand_test = this->clock.end();
+        return;
+    }
+    for (auto hand : {&this->hand_hot, &this->hand_cold, &this->hand_test}) {
+        if (*hand == pos) {
+            *hand = Next(pos);
+        }
+    }
+    this->clock.erase(pos);
+}
+
+void ClockProReplacer::RunHandHot(size_t hot_limit) {
+    /*
+        hot page: referenced ones lose the bit, the first unreferenced one turns cold.
+        cold page: its test period ends. non-resident page: forgotten, cold pages
+        were not re-referenced in time, so they get a smaller share.
+        priority hot pages are passed over until two rounds found no ordinary one to demote
+    */
+    for (auto take_priority : {false, true}) {
+        auto steps = 2 * this->clock.size();
+        while (this->hot_cnt > hot_limit && steps-- > 0) {
+            auto pos = this->hand_hot;
+            if (pos->state == State::NonResident) {
+                // moves hand_hot on
+                Erase(pos);
+                this->non_resident_cnt--;
+                this->cold_target = std::max<size_t>(this->cold_target - 1, 1);
+                continue;
+            }
+            this->hand_hot = Next(pos);
+            if (pos->state == State::Cold) {
+                pos->in_test = false;
+            } else if (pos->priority && !take_priority) {
+                continue;
+            } else if (pos->referenced) {
+                pos->referenced = false;
+            } else {
+                pos->state = State::Cold;
+                this->hot_cnt--;
+                this->cold_cnt++;
+            }
+        }
+    }
+}
+
+auto ClockProReplacer::HotLimit() const -> size_t {
+    return this->capacity - this->cold_target;
+}
+
+void ClockProReplacer::RunHandTest() {
+    // non-resident pages are remembered for at most capacity pages
+    auto steps = 2 * this->clock.size();
+    while (this->non_resident_cnt > this->capacity && steps-- > 0) {
+        auto pos = this->hand_test;
+        if (pos->state == State::NonResident) {
+            Erase(pos);
+            this->non_resident_cnt--;
+            this->cold_target = std::max<size_t>(this->cold_target - 1, 1);
+            continue;
+        }
+        this->hand_test = Next(pos);
+        if (pos->state == State::Cold) {
+            pos->in_test = false;
+        }
+    }
+}
+
+void ClockProReplacer::PromoteToHot(PosT pos) {
+    // re-referenced within its test period: cold pages deserve a larger share
+    this->cold_target = std::min(this->cold_target + 1, this->capacity - 1);
+    auto pid = pos->pid;
+    auto priority = pos->priority;
+    if (pos->state == State::Cold) {
+        this->cold_cnt--;
+    } else {
+        this->non_resident_cnt--;
+    }
+    Erase(pos);
+    Insert(Entry{pid, State::Hot, false, false, priority});
+    this->hot_cnt++;
+    RunHandHot(HotLimit());
+}
+
+void ClockProReplacer::RecordAccess(int pid, bool priority) {
+    /*
+        resident page: set its reference bit, the hands look at it later
+        non-resident page in test period: re-fault, comes back hot
+        new page: cold in test period, priority pages start hot
+        priority sticks to the page, also while it is non-resident
+    */
+    std::lock_guard lk(this->mu);
+    auto res = this->entries.find(pid);
+    if (res != this->entries.end()) {
+        auto pos = res->second;
+        pos->priority = pos->priority || priority;
+        if (pos->state == State::NonResident) {
+            PromoteToHot(pos);
+        } else {
+            pos->referenced = true;
+        }
+        return;
+    }
+    if (priority) {
+        Insert(Entry{pid, State::Hot, false, false, true});
+        this->hot_cnt++;
+        RunHandHot(HotLimit());
+    } else {
+        Insert(Entry{pid, State::Cold, false, true, false});
+        this->cold_cnt++;
+    }
+}
+
+void ClockProReplacer::Remove(int pid) {
+    std::lock_guard lk(this->mu);
+    auto res = this->entries.find(pid);
+    if (res == this->entries.end()) {
+        return;
+    }
+    switch (res->second->state) {
+        case State::Hot:
+            this->hot_cnt--;
+            break;
+        case State::Cold:
+            this->cold_cnt--;
+            break;
+        case State::NonResident:
+            this->non_resident_cnt--;
+            break;
+    }
+    Erase(res->second);
+}
+
+auto ClockProReplacer::Victim(const std::function<bool(int)>& evictable) -> std::optional<int> {
+    /*
+        cold hand over resident cold pages:
+        referenced in test period -> hot; referenced otherwise -> new test period at the head;
+        unreferenced -> evicted, stays as non-resident while in test period.
+        1. ordinary cold pages, then priority ones
+        2. no cold page at all: the hot hand demotes one first
+        3. a round over the cold pages that finds none evictable ends the search: dirty /
+           pinned pages stay until a checkpoint, demoting hot pages would not free one
+    */
+    std::lock_guard lk(this->mu);
+    // 1. ordinary first
+    for (auto take_priority : {false, true}) {
+        // referenced pages lose their bit on the first round and go on the second
+        auto steps = 2 * (this->clock.size() + 1);
+        size_t unevictable_cnt = 0;
+        while (this->hot_cnt + this->cold_cnt > 0 && steps-- > 0) {
+            // 2. demote
+            if (this->cold_cnt == 0) {
+                RunHandHot(this->hot_cnt - 1);
+                continue;
+            }
+            // 3. a round without a candidate
+            if (unevictable_cnt >= this->cold_cnt) {
+                break;
+            }
+            auto pos = this->hand_cold;
+            this->hand_cold = Next(pos);
+            if (pos->state != State::Cold) {
+                continue;
+            }
+            if (pos->priority != take_priority || !evictable(pos->pid)) {
+                unevictable_cnt++;
+                continue;
+            }
+            unevictable_cnt = 0;
+            if (pos->referenced) {
+                if (pos->in_test) {
+                    PromoteToHot(pos);
+                } else {
+                    auto pid = pos->pid;
+                    auto priority = pos->priority;
+                    Erase(pos);
+                    Insert(Entry{pid, State::Cold, false, true, priority});
+                }
+                continue;
+            }
+            auto pid = pos->pid;
+            this->cold_cnt--;
+            if (pos->in_test) {
+                pos->state = State::NonResident;
+                this->non_resident_cnt++;
+                RunHandTest();
+            } else {
+                Erase(pos);
+            }
+            return pid;
+        }
+    }
+    return {};
+}
+
+auto ClockProReplacer::HotPages() -> std::vector<int> {
+    // hot pages, then referenced cold ones, then the rest of the cold ones
+    std::lock_guard lk(this->mu);
+    auto pids = std::vector<int>{};
+    pids.reserve(this->hot_cnt + this->cold_cnt);
+    for (auto& entry : this->clock) {
+        if (entry.state == State::Hot) {
+            pids.push_back(entry.pid);
+        }
+    }
+    for (auto referenced : {true, false}) {
+        for (auto& entry : this->clock) {
+            if (entry.state == State::Cold && entry.referenced == referenced) {
+                pids.push_back(entry.pid);
+            }
+        }
+    }
+    return pids;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+/*
+    page replacement policies of a bounded page table.
+    a replacer only orders pages, the page table asks it for a victim and says
+    which pages may go (clean, unpinned). priority pages (inner pages, the upper
+    levels every descent walks through) leave after ordinary ones, and all three
+    policies resist scans: pages touched once by a long range read are evicted
+    before pages touched repeatedly.
+*/
+
+enum class ReplacerKind : uint8_t {
+    // evict by the K-th most recent access, pages seen fewer than K times first
+    LruK,
+    // new pages wait in a FIFO, only a re-reference (remembered after eviction) makes them hot
+    TwoQ,
+    // clock with hot / cold pages and an adaptive cold share
+    ClockPro,
+};
+
+struct PoolOptions {
+    // resident pages, 0: unbounded (no eviction)
+    size_t capacity{0};
+    ReplacerKind replacer{ReplacerKind::LruK};
+    // K of LruK
+    int lru_k{2};
+};
+
+struct PoolStats {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t evictions{0};
+    size_t resident{0};
+    // marked dirty since the last checkpoint took them
+    size_t dirty{0};
+
+    auto HitRate() const -> double;
+};
+
+class Replacer {
+public:
+    virtual ~Replacer() = default;
+    static auto create(const PoolOptions& options) -> std::unique_ptr<Replacer>;
+    // pid was created / fetched. priority: keep it over ordinary pages
+    virtual void RecordAccess(int pid, bool priority) = 0;
+    // pid left the page table without being a victim
+    virtual void Remove(int pid) = 0;
+    // next page to evict, forgotten as resident. pages with !evictable(pid) stay
+    virtual auto Victim(const std::function<bool(int)>& evictable) -> std::optional<int> = 0;
+    // resident pids, the ones evicted last (hottest) first
+    virtual auto HotPages() -> std::vector<int> = 0;
+};
+
+class LruKReplacer : public Replacer {
+public:
+    explicit LruKReplacer(int k);
+    void RecordAccess(int pid, bool priority) override;
+    void Remove(int pid) override;
+    auto Victim(const std::function<bool(int)>& evictable) -> std::optional<int> override;
+    auto HotPages() -> std::vector<int> override;
+
+private:
+    // eviction order: ordinary before priority, < K accesses (infinite distance) before K,
+    // then oldest deciding access first
+    using OrderKeyT = std::tuple<bool, bool, uint64_t, int>;
+    struct History {
+        // most recent last, at most K
+        std::vector<uint64_t> accesses;
+        bool priority;
+    };
+    auto OrderKey(int pid, const History& history) const -> OrderKeyT;
+
+    std::mutex mu;
+    size_t k;
+    uint64_t clock{0};
+    std::unordered_map<int, History> histories;
+    std::set<OrderKeyT> order;
+};
+
+class TwoQReplacer : public Replacer {
+public:
+    explicit TwoQReplacer(size_t capacity);
+    void RecordAccess(int pid, bool priority) override;
+    void Remove(int pid) override;
+    auto Victim(const std::function<bool(int)>& evictable) -> std::optional<int> override;
+    auto HotPages() -> std::vector<int> override;
+
+private:
+    enum class Queue : uint8_t { In, Out, Hot };
+    struct Entry {
+        Queue queue;
+        std::list<int>::iterator pos;
+        bool priority;
+    };
+    auto QueueOf(Queue queue) -> std::list<int>&;
+    void MoveTo(int pid, Entry& entry, Queue queue);
+    // oldest evictable page of queue, ordinary before priority
+    auto TakeFrom(Queue queue, const std::function<bool(int)>& evictable) -> std::optional<int>;
+
+    std::mutex mu;
+    // share of the pool new pages get, and how many evicted new pages are remembered
+    size_t in_capacity;
+    size_t out_capacity;
+    // front is newest. in: resident FIFO, out: ghost FIFO, hot: resident LRU
+    std::list<int> in_queue;
+    std::list<int> out_queue;
+    std::list<int> hot_queue;
+    std::unordered_map<int, Entry> entries;
+};
+
+class ClockProReplacer : public Replacer {
+public:
+    explicit ClockProReplacer(size_t capacity);
+    void RecordAccess(int pid, bool priority) override;
+    void Remove(int pid) override;
+    auto Victim(const std::function<bool(int)>& evictable) -> std::optional<int> override;
+    auto HotPages() -> std::vector<int> override;
+
+private:
+    enum class State : uint8_t { Hot, Cold, NonResident };
+    struct Entry {
+        int pid;
+        State state;
+        bool referenced;
+        // cold page in its test period: a re-reference before it ends makes it hot
+        bool in_test;
+        // demoted / evicted only when no ordinary page can go
+        bool priority;
+    };
+    using PosT = std::list<Entry>::iterator;
+    auto Next(PosT pos) -> PosT;
+    // new entry at the list head, just behind the hot hand
+    void Insert(const Entry& entry);
+    void Erase(PosT pos);
+    // share of resident pages hot pages may take
+    auto HotLimit() const -> size_t;
+    // demote unreferenced hot pages while there are more than hot_limit, ordinary ones first
+    void RunHandHot(size_t hot_limit);
+    // end the test period of one cold page, drop one non-resident page
+    void RunHandTest();
+    void PromoteToHot(PosT pos);
+
+    std::mutex mu;
+    size_t capacity;
+    // target of resident cold pages, grows on re-faults in test period, shrinks when tests expire
+    size_t cold_target;
+    size_t hot_cnt{0};
+    size_t cold_cnt{0};
+    size_t non_resident_cnt{0};
+    std::list<Entry> clock;
+    std::unordered_map<int, PosT> entries;
+    PosT hand_hot;
+    PosT hand_cold;
+    PosT hand_test;
+};
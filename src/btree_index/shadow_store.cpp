@@ -0,0 +1,400 @@
+#include "shadow_store.h"
+#include "btree_page.h"
+#include "../wal/crc32.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+uint32_t constexpr SHADOW_MAGIC = 0x48535442;    // "BTSH"
+size_t constexpr META_CRC_OFFSET = sizeof(uint32_t);
+size_t constexpr META_BODY_OFFSET = META_CRC_OFFSET + sizeof(uint32_t);
+size_t constexpr META_HEADER_SIZE = META_BODY_OFFSET + sizeof(uint64_t) + 4 * sizeof(uint32_t);
+// chunk slots a meta page holds, bounds the pid space
+auto MaxMetaChunks(size_t page_size) -> size_t {
+    return (page_size - META_HEADER_SIZE) / sizeof(uint32_t);
+}
+
+struct MetaHeader {
+    uint64_t txn_id;
+    int32_t root_pid;
+    int32_t next_pid;
+    uint32_t page_size;
+    uint32_t chunk_cnt;
+};
+
+void EncodeMeta(const ShadowSnapshot& snapshot, Page& buf) {
+    auto header = MetaHeader{snapshot.txn_id, snapshot.root_pid, snapshot.next_pid,
+        (uint32_t)buf.size(), (uint32_t)snapshot.chunk_slots.size()};
+    std::memcpy(buf.data(), &SHADOW_MAGIC, sizeof(SHADOW_MAGIC));
+    std::memcpy(buf.data() + META_BODY_OFFSET, &header, sizeof(header));
+    std::memcpy(buf.data() + META_HEADER_SIZE, snapshot.chunk_slots.data(), snapshot.chunk_slots.size() * sizeof(uint32_t));
+    auto crc = Crc32(0, buf.data() + META_BODY_OFFSET, buf.size() - META_BODY_OFFSET);
+    std::memcpy(buf.data() + META_CRC_OFFSET, &crc, sizeof(crc));
+}
+
+// page size a meta page was written with, 0 when it is not a meta page
+auto MetaPageSize(const Page& buf) -> uint32_t {
+    uint32_t magic{};
+    auto header = MetaHeader{};
+    std::memcpy(&magic, buf.data(), sizeof(magic));
+    std::memcpy(&header, buf.data() + META_BODY_OFFSET, sizeof(header));
+    return magic == SHADOW_MAGIC ? header.page_size : 0;
+}
+
+// false for a torn / never written meta page
+auto DecodeMeta(const Page& buf, MetaHeader& header, std::vector<uint32_t>& chunk_slots) -> bool {
+    uint32_t magic{};
+    uint32_t crc{};
+    std::memcpy(&magic, buf.data(), sizeof(magic));
+    std::memcpy(&crc, buf.data() + META_CRC_OFFSET, sizeof(crc));
+    if (magic != SHADOW_MAGIC || Crc32(0, buf.data() + META_BODY_OFFSET, buf.size() - META_BODY_OFFSET) != crc) {
+        return false;
+    }
+    std::memcpy(&header, buf.data() + META_BODY_OFFSET, sizeof(header));
+    if (header.chunk_cnt > MaxMetaChunks(buf.size())) {
+        return false;
+    }
+    chunk_slots.resize(header.chunk_cnt);
+    std::memcpy(chunk_slots.data(), buf.data() + META_HEADER_SIZE, header.chunk_cnt * sizeof(uint32_t));
+    return true;
+}
+
+}
+
+ShadowChunk::ShadowChunk(const ShadowChunk& other): slots(other.slots) {
+    for (int i = 0; i < SHADOW_CHUNK_SIZE; i++) {
+        if (other.loaded[i].load(std::memory_order_acquire)) {
+            this->pages[i] = other.pages[i];
+            this->loaded[i].store(true, std::memory_order_relaxed);
+        }
+    }
+}
+
+auto ShadowSnapshot::create(int page_size) -> std::shared_ptr<Page> {
+    std::cout << "should not reach here!\n";
+    exit(-1);
+}
+
+auto ShadowSnapshot::get_page(int pid, bool for_write) -> std::shared_ptr<Page> {
+    assert(!for_write);
+    if (pid < 0 || pid >= this->next_pid) {
+        return {};
+    }
+    auto& chunk = this->chunks[pid / SHADOW_CHUNK_SIZE];
+    if (chunk == nullptr) {
+        return {};
+    }
+    auto idx = pid % SHADOW_CHUNK_SIZE;
+    if (chunk->loaded[idx].load(std::memory_order_acquire)) {
+        return chunk->pages[idx];
+    }
+    if (chunk->slots[idx] == 0) {
+        return {};
+    }
+    // first access: read the slot, a reader racing for the same page may read it too,
+    // the first one to finish publishes its copy
+    auto page = std::make_shared<Page>(this->file->PageSize());
+    if (!this->file->Read(chunk->slots[idx], page->data()).Ok()) {
+        return {};
+    }
+    std::unique_lock lk(chunk->load_mu);
+    if (!chunk->loaded[idx].load(std::memory_order_relaxed)) {
+        chunk->pages[idx] = std::move(page);
+        chunk->loaded[idx].store(true, std::memory_order_release);
+    }
+    return chunk->pages[idx];
+}
+
+auto ShadowSnapshot::HasPage(int pid) const -> bool {
+    if (pid < 0 || pid >= this->next_pid) {
+        return false;
+    }
+    auto& chunk = this->chunks[pid / SHADOW_CHUNK_SIZE];
+    return chunk != nullptr && chunk->slots[pid % SHADOW_CHUNK_SIZE] != 0;
+}
+
+void ShadowSnapshot::remove(int pid) {
+    std::cout << "should not reach here!\n";
+    exit(-1);
+}
+
+auto ShadowSnapshot::LivePages() const -> size_t {
+    return this->live_pages;
+}
+
+ShadowTxn::ShadowTxn(ShadowStore* _store, std::shared_ptr<ShadowSnapshot> _base)
+    : store(_store), base(std::move(_base)), next_pid(this->base->next_pid) {}
+
+auto ShadowTxn::create(int page_size) -> std::shared_ptr<Page> {
+    // reuse pids freed by earlier commits, the versions readers hold keep their own table
+    auto& free_pids = this->store->free_pids;
+    int page_id{};
+    if (this->reused_pid_cnt < free_pids.size()) {
+        page_id = free_pids[free_pids.size() - 1 - this->reused_pid_cnt++];
+    } else {
+        page_id = this->next_pid++;
+    }
+    auto page = std::make_shared<Page>(page_size);
+    reinterpret_cast<BTreePage*>(page->data())->SetPageId(page_id);
+    this->changed[page_id] = page;
+    return page;
+}
+
+auto ShadowTxn::get_page(int pid, bool for_write) -> std::shared_ptr<Page> {
+    auto res = this->changed.find(pid);
+    if (res != this->changed.end()) {
+        return res->second;
+    }
+    auto page = this->base->get_page(pid, false);
+    if (page == nullptr || !for_write) {
+        return page;
+    }
+    // first write access: shadow the published page
+    auto copy = std::make_shared<Page>(*page);
+    this->changed.insert({pid, copy});
+    return copy;
+}
+
+void ShadowTxn::remove(int pid) {
+    this->changed[pid] = nullptr;
+}
+
+auto ShadowTxn::BaseRootPid() const -> int {
+    return this->base->root_pid;
+}
+
+auto ShadowStore::open(const ShadowOptions& options, size_t page_size) -> StatusOr<std::shared_ptr<ShadowStore>> {
+    /*
+        1. pick the valid meta page with the larger txn id
+        2. load its table chunks, pages are read on first access
+        3. slots and pids it does not use are free
+        no log to replay: the file holds exactly the last committed version
+    */
+    auto store = std::shared_ptr<ShadowStore>(new ShadowStore());
+    store->options = options;
+    store->page_size = page_size;
+    auto file_res = PageFile::open(options.path, nullptr, false, page_size);
+    if (!file_res.Ok()) {
+        return {file_res.Code()};
+    }
+    store->file = file_res.Unwrap();
+    auto cnt_res = store->file->PageCount();
+    if (!cnt_res.Ok()) {
+        return {cnt_res.Code()};
+    }
+    auto page_cnt = cnt_res.Unwrap();
+    auto snapshot = std::make_shared<ShadowSnapshot>();
+    snapshot->file = store->file;
+
+    // 1. meta
+    auto found = false;
+    auto header = MetaHeader{};
+    auto buf = Page(page_size);
+    for (int meta_slot = 0; meta_slot < 2 && meta_slot < page_cnt; meta_slot++) {
+        auto read_res = store->file->Read(meta_slot, buf.data());
+        if (!read_res.Ok()) {
+            return {read_res.Code()};
+        }
+        // written by an index of another page size
+        auto meta_page_size = MetaPageSize(buf);
+        if (meta_page_size != 0 && meta_page_size != page_size) {
+            return {StatusCode::IOError};
+        }
+        auto cur_header = MetaHeader{};
+        auto cur_chunk_slots = std::vector<uint32_t>{};
+        if (DecodeMeta(buf, cur_header, cur_chunk_slots) && (!found || cur_header.txn_id > header.txn_id)) {
+            found = true;
+            header = cur_header;
+            snapshot->chunk_slots = std::move(cur_chunk_slots);
+        }
+    }
+
+    // 2. table
+    auto used = std::vector<bool>(std::max(page_cnt, 2), false);
+    if (found) {
+        snapshot->txn_id = header.txn_id;
+        snapshot->root_pid = header.root_pid;
+        snapshot->next_pid = header.next_pid;
+        for (auto chunk_slot : snapshot->chunk_slots) {
+            // no pid of the chunk was ever written
+            if (chunk_slot == 0) {
+                snapshot->chunks.push_back(nullptr);
+                continue;
+            }
+            auto chunk = std::make_shared<ShadowChunk>();
+            if (chunk_slot >= (uint32_t)page_cnt) {
+                return {StatusCode::IOError};
+            }
+            used[chunk_slot] = true;
+            auto read_res = store->file->Read(chunk_slot, buf.data());
+            if (!read_res.Ok()) {
+                return {read_res.Code()};
+            }
+            std::memcpy(chunk->slots.data(), buf.data(), sizeof(chunk->slots));
+            for (int i = 0; i < SHADOW_CHUNK_SIZE; i++) {
+                auto slot = chunk->slots[i];
+                if (slot == 0) {
+                    continue;
+                }
+                if (slot >= (uint32_t)page_cnt) {
+                    return {StatusCode::IOError};
+                }
+                used[slot] = true;
+            }
+            snapshot->chunks.push_back(chunk);
+        }
+    }
+
+    // 3. free space
+    store->slot_cnt = used.size();
+    for (uint32_t slot = used.size() - 1; slot >= 2; slot--) {
+        if (!used[slot]) {
+            store->free_slots.push_back(slot);
+        }
+    }
+    for (int pid = snapshot->next_pid - 1; pid >= 0; pid--) {
+        if (!snapshot->HasPage(pid)) {
+            store->free_pids.push_back(pid);
+        }
+    }
+    snapshot->live_pages = (size_t)snapshot->next_pid - store->free_pids.size();
+    store->current = snapshot;
+    return {store};
+}
+
+auto ShadowStore::Acquire() const -> std::shared_ptr<ShadowSnapshot> {
+    std::unique_lock lk(this->current_mu);
+    return this->current;
+}
+
+auto ShadowStore::Begin() -> std::unique_ptr<ShadowTxn> {
+    return std::unique_ptr<ShadowTxn>(new ShadowTxn(this, Acquire()));
+}
+
+auto ShadowStore::AllocSlot() -> uint32_t {
+    if (this->free_slots.empty()) {
+        return this->slot_cnt++;
+    }
+    auto slot = this->free_slots.back();
+    this->free_slots.pop_back();
+    return slot;
+}
+
+auto ShadowStore::Commit(ShadowTxn& txn, int root_pid) -> Status {
+    /*
+        1. copy the table chunks holding changed pids, place changed pages in free slots
+        2. write pages and chunks, sync
+        3. write the meta page of the version before base, sync
+        4. publish, slots of the replaced pages / chunks become free
+        slots base uses are never written, so a crash at any step leaves base or txn on disk.
+        slots freed at 4 are only used by the version before txn, recovery never goes back
+        that far once txn's meta is synced. a failure from 3 on keeps the slots txn took:
+        its meta may be on disk (written, sync failed) and win recovery
+    */
+    auto& base = *txn.base;
+    auto snapshot = std::make_shared<ShadowSnapshot>();
+    snapshot->txn_id = base.txn_id + 1;
+    snapshot->root_pid = root_pid;
+    snapshot->next_pid = txn.next_pid;
+    snapshot->chunks = base.chunks;
+    snapshot->chunk_slots = base.chunk_slots;
+    snapshot->file = this->file;
+    size_t chunk_cnt = (txn.next_pid + SHADOW_CHUNK_SIZE - 1) / SHADOW_CHUNK_SIZE;
+    if (chunk_cnt > MaxMetaChunks(this->page_size)) {
+        return {StatusCode::OutOfSpace};
+    }
+    snapshot->chunks.resize(chunk_cnt);
+    snapshot->chunk_slots.resize(chunk_cnt, 0);
+    auto saved_free_slots = this->free_slots;
+    auto saved_slot_cnt = this->slot_cnt;
+    auto fail = [&](const Status& status) -> Status {
+        this->free_slots = std::move(saved_free_slots);
+        this->slot_cnt = saved_slot_cnt;
+        return status;
+    };
+
+    // 1. place, 2. write pages
+    auto replaced = std::vector<uint32_t>{};
+    auto new_chunks = std::unordered_map<int, std::shared_ptr<ShadowChunk>>{};
+    for (auto& [pid, page] : txn.changed) {
+        auto chunk_idx = pid / SHADOW_CHUNK_SIZE;
+        auto& chunk = new_chunks[chunk_idx];
+        if (chunk == nullptr) {
+            auto& base_chunk = snapshot->chunks[chunk_idx];
+            chunk = (base_chunk == nullptr)? std::make_shared<ShadowChunk>() : std::make_shared<ShadowChunk>(*base_chunk);
+        }
+        auto& slot = chunk->slots[pid % SHADOW_CHUNK_SIZE];
+        if (slot != 0) {
+            replaced.push_back(slot);
+        }
+        chunk->pages[pid % SHADOW_CHUNK_SIZE] = page;
+        chunk->loaded[pid % SHADOW_CHUNK_SIZE].store(page != nullptr, std::memory_order_relaxed);
+        slot = 0;
+        if (page == nullptr) {
+            continue;
+        }
+        slot = AllocSlot();
+        auto write_res = this->file->Write(slot, page->data());
+        if (!write_res.Ok()) {
+            return fail(write_res);
+        }
+    }
+    // a chunk fills the front of its slot
+    auto chunk_buf = Page(this->page_size);
+    for (auto& [chunk_idx, chunk] : new_chunks) {
+        auto& chunk_slot = snapshot->chunk_slots[chunk_idx];
+        if (chunk_slot != 0) {
+            replaced.push_back(chunk_slot);
+        }
+        chunk_slot = AllocSlot();
+        std::memcpy(chunk_buf.data(), chunk->slots.data(), sizeof(chunk->slots));
+        auto write_res = this->file->Write(chunk_slot, chunk_buf.data());
+        if (!write_res.Ok()) {
+            return fail(write_res);
+        }
+        snapshot->chunks[chunk_idx] = chunk;
+    }
+    if (this->options.sync) {
+        auto sync_res = this->file->Sync();
+        if (!sync_res.Ok()) {
+            return fail(sync_res);
+        }
+    }
+
+    // 3. meta, from here on a failed commit leaves its slots taken until the next open
+    saved_free_slots = this->free_slots;
+    saved_slot_cnt = this->slot_cnt;
+    auto meta = Page(this->page_size);
+    EncodeMeta(*snapshot, meta);
+    auto write_res = this->file->Write(snapshot->txn_id % 2, meta.data());
+    if (!write_res.Ok()) {
+        return fail(write_res);
+    }
+    if (this->options.sync) {
+        auto sync_res = this->file->Sync();
+        if (!sync_res.Ok()) {
+            return fail(sync_res);
+        }
+    }
+
+    // 4. publish, the replaced version is freed by its last reader
+    auto removed_cnt = (size_t)std::count_if(txn.changed.begin(), txn.changed.end(), [](auto& change) {
+        return change.second == nullptr;
+    });
+    snapshot->live_pages = (size_t)snapshot->next_pid - (this->free_pids.size() - txn.reused_pid_cnt + removed_cnt);
+    {
+        std::unique_lock lk(this->current_mu);
+        this->current.swap(snapshot);
+    }
+    this->free_slots.insert(this->free_slots.end(), replaced.begin(), replaced.end());
+    this->free_pids.resize(this->free_pids.size() - txn.reused_pid_cnt);
+    for (auto& [pid, page] : txn.changed) {
+        if (page == nullptr) {
+            this->free_pids.push_back(pid);
+        }
+    }
+    return {};
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+#include "page_store.h"
+#include "../status/status.h"
+
+/*
+    copy-on-write shadow paging.
+    a version of the tree is a page table (pid -> page) plus a root pid. a write
+    transaction never touches a published page: the first write access copies it,
+    so a mutation copies its root-to-leaf path (and the simblings it borrows from).
+    commit writes the copies and the changed parts of the page table to free slots
+    of the file, then flips one of two meta pages, then publishes the new version.
+    readers pin a version and never wait for a writer; the file always holds a complete version.
+    open reads the meta page and the table chunks only, a page is read from its slot
+    on its first get_page, so open time and memory do not grow with the data.
+
+    file layout, one slot is one page (page size of the index):
+        slot 0, 1: meta pages, the valid one with the larger txn id wins
+        other slots: pages, and table chunks (uint32_t slot of each pid in the chunk, at the slot front)
+    meta page:
+        uint32_t magic | uint32_t crc | uint64_t txn id | int32_t root pid | int32_t next pid
+        | uint32_t page size | uint32_t chunk cnt | uint32_t chunk slots[chunk cnt]
+*/
+
+struct ShadowOptions {
+    std::string path;
+    // false: commits are not synced (bulk loads, tests), a crash may leave no valid version
+    bool sync{true};
+};
+
+// pids of one table chunk, one chunk slot array fills the smallest page
+int constexpr SHADOW_CHUNK_SIZE = BTREE_PAGE_SIZE / sizeof(uint32_t);
+
+/*
+    pids of one table chunk. a page in the file is loaded on first access and stays
+    with the chunk; a chunk copied by a commit shares the pages loaded so far
+*/
+struct ShadowChunk {
+    ShadowChunk() = default;
+    ShadowChunk(const ShadowChunk& other);
+
+    // set once, when loaded[i] turns true, read without a lock after that
+    mutable std::array<std::shared_ptr<Page>, SHADOW_CHUNK_SIZE> pages;
+    mutable std::array<std::atomic<bool>, SHADOW_CHUNK_SIZE> loaded{};
+    // slot of each page in the file, 0 for no page
+    std::array<uint32_t, SHADOW_CHUNK_SIZE> slots{};
+    // publishes a loaded page, the read itself runs without it
+    mutable std::mutex load_mu;
+};
+
+/*
+    one published version, immutable. also the backend of a read scope
+*/
+class ShadowSnapshot : public PageBackend {
+public:
+    auto create(int page_size) -> std::shared_ptr<Page> override;
+    auto get_page(int pid, bool for_write) -> std::shared_ptr<Page> override;
+    void remove(int pid) override;
+    auto LivePages() const -> size_t override;
+
+    uint64_t txn_id{0};
+    // -1 before the first commit
+    int root_pid{-1};
+    int next_pid{0};
+    // pids in use: below next_pid and not free
+    size_t live_pages{0};
+    std::vector<std::shared_ptr<const ShadowChunk>> chunks;
+    std::vector<uint32_t> chunk_slots;
+    // where pages not loaded yet are read from
+    std::shared_ptr<PageFile> file;
+
+    // pid has a page in this version, loaded or not
+    auto HasPage(int pid) const -> bool;
+};
+
+class ShadowStore;
+
+/*
+    private version of a writer, built on top of the version it started from
+*/
+class ShadowTxn : public PageBackend {
+public:
+    auto create(int page_size) -> std::shared_ptr<Page> override;
+    auto get_page(int pid, bool for_write) -> std::shared_ptr<Page> override;
+    void remove(int pid) override;
+    auto BaseRootPid() const -> int;
+
+private:
+    friend class ShadowStore;
+    ShadowTxn(ShadowStore* store, std::shared_ptr<ShadowSnapshot> base);
+
+    ShadowStore* store;
+    std::shared_ptr<ShadowSnapshot> base;
+    // copied / created pages, nullptr for removed ones
+    std::unordered_map<int, std::shared_ptr<Page>> changed;
+    int next_pid;
+    // free pids of the store taken by create
+    size_t reused_pid_cnt{0};
+};
+
+class ShadowStore {
+public:
+    ShadowStore(const ShadowStore&) = delete;
+    // load the newest valid version of the file, an empty file has no root yet.
+    // a file made with another page size is rejected with IOError
+    static auto open(const ShadowOptions& options, size_t page_size = BTREE_PAGE_SIZE) 
+        -> StatusOr<std::shared_ptr<ShadowStore>>;
+    // current version, readers keep it as long as they need it.
+    // only copies a pointer, a running commit does not hold it up
+    auto Acquire() const -> std::shared_ptr<ShadowSnapshot>;
+    // one writer at a time, caller serializes Begin .. Commit
+    auto Begin() -> std::unique_ptr<ShadowTxn>;
+    // make txn durable with root_pid as its root, then publish it.
+    // on failure nothing is published, txn can not be committed again
+    auto Commit(ShadowTxn& txn, int root_pid) -> Status;
+
+private:
+    friend class ShadowTxn;
+    ShadowStore() = default;
+    auto AllocSlot() -> uint32_t;
+
+    ShadowOptions options;
+    size_t page_size{BTREE_PAGE_SIZE};
+    std::shared_ptr<PageFile> file;
+    // guards the pointer copy only. std::atomic<std::shared_ptr> of libstdc++ 12 is racy
+    // (load releases its spin bit relaxed)
+    mutable std::mutex current_mu;
+    std::shared_ptr<ShadowSnapshot> current;
+    // writer side state
+    std::vector<uint32_t> free_slots;
+    uint32_t slot_cnt{2};
+    std::vector<int> free_pids;
+};
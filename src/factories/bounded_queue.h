@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/*
+    bounded multi-producer multi-consumer queue on a ring of slots (Vyukov): a slot's
+    sequence number says whether it is free for the push at pos (== pos) or holds the
+    item for the pop at pos (== pos + 1). push and pop each claim a position with one
+    CAS and never wait for each other, a full or empty queue fails the call.
+*/
+template<typename T>
+class BoundedQueue {
+public:
+    // capacity is rounded up to a power of two
+    explicit BoundedQueue(size_t capacity) {
+        size_t slot_cnt = 2;
+        while (slot_cnt < capacity) {
+            slot_cnt *= 2;
+        }
+        this->mask = slot_cnt - 1;
+        this->slots = std::make_unique<Slot[]>(slot_cnt);
+        for (size_t i = 0; i < slot_cnt; i++) {
+            this->slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+    BoundedQueue(const BoundedQueue&) = delete;
+
+    // moves from item only when it was queued
+    auto TryPush(T& item) -> bool {
+        auto pos = this->push_pos.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &this->slots[pos & this->mask];
+            auto diff = (intptr_t)slot->seq.load(std::memory_order_acquire) - (intptr_t)pos;
+            if (diff == 0) {
+                if (this->push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // the slot still holds the item of the previous lap: full
+                return false;
+            } else {
+                pos = this->push_pos.load(std::memory_order_relaxed);
+            }
+        }
+        slot->item = std::move(item);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    auto TryPop(T& item) -> bool {
+        auto pos = this->pop_pos.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &this->slots[pos & this->mask];
+            auto diff = (intptr_t)slot->seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (this->pop_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // nothing pushed at pos yet: empty
+                return false;
+            } else {
+                pos = this->pop_pos.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(slot->item);
+        // free for the push one lap later
+        slot->seq.store(pos + this->mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    auto Capacity() const -> size_t {
+        return this->mask + 1;
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<size_t> seq;
+        T item;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    // producers and consumers do not share a cache line
+    alignas(64) std::atomic<size_t> push_pos{0};
+    alignas(64) std::atomic<size_t> pop_pos{0};
+};
@@ -0,0 +1,105 @@
+#include "op_executor.h"
+
+OpExecutor::OpExecutor(const ExecutorOptions& options) {
+    auto worker_cnt = std::max<size_t>(options.workers, 1);
+    for (size_t i = 0; i < worker_cnt; i++) {
+        this->workers.push_back(std::make_unique<Worker>(options.queue_capacity));
+    }
+    for (auto& worker : this->workers) {
+        worker->thread = std::thread([this, &worker = *worker] {
+            WorkerLoop(worker);
+        });
+    }
+}
+
+OpExecutor::~OpExecutor() {
+    this->stopping.store(true);
+    for (auto& worker : this->workers) {
+        worker->pushes.fetch_add(1);
+        worker->pushes.notify_all();
+    }
+    for (auto& worker : this->workers) {
+        worker->thread.join();
+    }
+}
+
+auto OpExecutor::WorkerCnt() const -> size_t {
+    return this->workers.size();
+}
+
+auto OpExecutor::Submit(OpT op) -> std::future<void> {
+    return Submit(this->next_worker.fetch_add(1, std::memory_order_relaxed), std::move(op));
+}
+
+auto OpExecutor::Submit(size_t shard, OpT op) -> std::future<void> {
+    auto task = ExecTask{std::move(op)};
+    auto future = task.promise.emplace().get_future();
+    Push(*this->workers[shard % this->workers.size()], task);
+    return future;
+}
+
+void OpExecutor::Submit(size_t shard, OpT op, CallbackT done) {
+    auto task = ExecTask{std::move(op), std::move(done)};
+    Push(*this->workers[shard % this->workers.size()], task);
+}
+
+auto OpExecutor::TrySubmit(size_t shard, OpT& op) -> std::optional<std::future<void>> {
+    auto& worker = *this->workers[shard % this->workers.size()];
+    auto task = ExecTask{std::move(op)};
+    auto future = task.promise.emplace().get_future();
+    if (!worker.queue.TryPush(task)) {
+        op = std::move(task.op);
+        return {};
+    }
+    worker.pushes.fetch_add(1);
+    worker.pushes.notify_one();
+    return future;
+}
+
+void OpExecutor::Push(Worker& worker, ExecTask& task) {
+    while (true) {
+        // read before trying: a pop in between changes it and the wait returns at once
+        auto seen_pops = worker.pops.load();
+        if (worker.queue.TryPush(task)) {
+            break;
+        }
+        worker.pops.wait(seen_pops);
+    }
+    worker.pushes.fetch_add(1);
+    worker.pushes.notify_one();
+}
+
+void OpExecutor::WorkerLoop(Worker& worker) {
+    auto task = ExecTask{};
+    while (true) {
+        auto seen_pushes = worker.pushes.load();
+        if (worker.queue.TryPop(task)) {
+            worker.pops.fetch_add(1);
+            worker.pops.notify_all();
+            Run(task);
+            task = ExecTask{};
+            continue;
+        }
+        // queue drained
+        if (this->stopping.load()) {
+            return;
+        }
+        worker.pushes.wait(seen_pushes);
+    }
+}
+
+void OpExecutor::Run(ExecTask& task) {
+    auto error = std::exception_ptr{};
+    try {
+        task.op();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    if (task.done) {
+        task.done(error);
+    } else if (error) {
+        task.promise->set_exception(error);
+    } else {
+        task.promise->set_value();
+    }
+}
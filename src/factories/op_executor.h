@@ -0,0 +1,73 @@
+#pragma once
+
+#include "bounded_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+struct ExecutorOptions {
+    size_t workers{std::max(1u, std::thread::hardware_concurrency())};
+    // ops queued per worker before Submit blocks (TrySubmit fails)
+    size_t queue_capacity{1024};
+};
+
+/*
+    runs factory ops on a pool of workers, so a front-end thread queues an op and moves
+    on instead of waiting for the index lock. every worker has its own bounded queue:
+    ops of one shard go to worker shard % workers and run there in submit order, ops
+    without a shard go round robin. a finished op fulfils its future, or calls its
+    callback on the worker with the exception the op threw (nullptr if none).
+    destruction runs the ops already queued, then joins the workers.
+*/
+class OpExecutor {
+public:
+    using OpT = std::function<void()>;
+    using CallbackT = std::function<void(std::exception_ptr)>;
+
+    explicit OpExecutor(const ExecutorOptions& options = {});
+    OpExecutor(const OpExecutor&) = delete;
+    ~OpExecutor();
+
+    auto WorkerCnt() const -> size_t;
+    // blocks only while the chosen worker's queue is full
+    auto Submit(OpT op) -> std::future<void>;
+    auto Submit(size_t shard, OpT op) -> std::future<void>;
+    void Submit(size_t shard, OpT op, CallbackT done);
+    // queue full: nothing queued, op left as it was
+    auto TrySubmit(size_t shard, OpT& op) -> std::optional<std::future<void>>;
+
+private:
+    struct ExecTask {
+        OpT op;
+        // one of them: the callback, or the promise behind the returned future.
+        // an empty task (a free queue slot) allocates no promise state
+        CallbackT done;
+        std::optional<std::promise<void>> promise;
+    };
+    struct Worker {
+        explicit Worker(size_t capacity): queue(capacity) {}
+
+        BoundedQueue<ExecTask> queue;
+        // bumped after every push / pop, what an idle worker / blocked producer waits on
+        std::atomic<uint64_t> pushes{0};
+        std::atomic<uint64_t> pops{0};
+        std::thread thread;
+    };
+
+    void Push(Worker& worker, ExecTask& task);
+    void WorkerLoop(Worker& worker);
+    static void Run(ExecTask& task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> next_worker{0};
+    std::atomic<bool> stopping{false};
+};
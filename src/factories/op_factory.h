@@ -2,8 +2,18 @@
 
 #include "common.h"
 #include "src/btree_index/index.h"
+#include "op_executor.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
+#include <future>
+#include <iostream>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
 
 
 enum class OPTYPE: int {
@@ -17,38 +27,226 @@ template<OPTYPE T>
 struct TT{};
 
 
+// executor shards by key range: shard i holds keys in [bounds[i - 1], bounds[i]), bounds sorted
+template<typename KeyT, typename KeyComparatorT>
+class KeyRangeShards {
+public:
+    explicit KeyRangeShards(std::vector<KeyT> bounds): bounds(std::move(bounds)) {}
+    auto ShardOf(const KeyT& key) const -> size_t {
+        auto ite = std::upper_bound(this->bounds.begin(), this->bounds.end(), key, [](const KeyT& a, const KeyT& b) {
+            return KeyComparatorT{}(a, b) < 0;
+        });
+        return (size_t)(ite - this->bounds.begin());
+    }
+    auto ShardCnt() const -> size_t {
+        return this->bounds.size() + 1;
+    }
+
+private:
+    std::vector<KeyT> bounds;
+};
+
+
+// ops by value, what an OpBatch holds instead of closures
+template<typename KeyT, typename ValueT>
+struct InsertOp {
+    KeyT key;
+    ValueT val;
+};
+
+template<typename KeyT, typename ValueT>
+struct UpdateOp {
+    KeyT key;
+    ValueT val;
+};
+
+template<typename KeyT, typename ValueT>
+struct RemoveOp {
+    KeyT key;
+};
+
+template<typename KeyT, typename ValueT>
+struct GetOp {
+    KeyT key;
+    // receives the value, must outlive the batch run
+    std::optional<ValueT>* result;
+};
+
+template<typename KeyT, typename ValueT>
+using IndexOp = std::variant<InsertOp<KeyT, ValueT>, UpdateOp<KeyT, ValueT>, RemoveOp<KeyT, ValueT>, GetOp<KeyT, ValueT>>;
+
+
+/*
+    ops collected by value in one vector and run against an index in key order:
+    ops on neighbouring keys descend to the same pages one after another, a run of
+    GETs goes through MultiGet. ops on one key keep the order they were added in.
+    no closure, no virtual call, nothing allocated per op once the vectors have grown.
+*/
+template<typename IndexT, typename KeyT, typename ValueT, typename KeyComparatorT>
+class OpBatch {
+    using InsertOpT = InsertOp<KeyT, ValueT>;
+    using UpdateOpT = UpdateOp<KeyT, ValueT>;
+    using RemoveOpT = RemoveOp<KeyT, ValueT>;
+    using GetOpT = GetOp<KeyT, ValueT>;
+public:
+    using OpT = IndexOp<KeyT, ValueT>;
+
+    explicit OpBatch(size_t capacity = 0) {
+        this->entries.reserve(capacity);
+        this->statuses.reserve(capacity);
+    }
+
+    // args as for IndexOpFactory::make_op: the value of INSERT / UPDATE (copied into
+    // the batch), the std::optional<ValueT>& of GET
+    template<OPTYPE OP, typename... Args>
+    void Add(const KeyT& k, Args&&... args) {
+        auto seq = (uint32_t)this->entries.size();
+        if constexpr (OP == OPTYPE::INSERT) {
+            this->entries.push_back(Entry{InsertOpT{k, std::forward<Args>(args)...}, seq});
+        } else if constexpr (OP == OPTYPE::UPDATE) {
+            this->entries.push_back(Entry{UpdateOpT{k, std::forward<Args>(args)...}, seq});
+        } else if constexpr (OP == OPTYPE::REMOVE) {
+            this->entries.push_back(Entry{RemoveOpT{k}, seq});
+        } else if constexpr (OP == OPTYPE::GET) {
+            this->entries.push_back(Entry{GetOpT{k, &args...}, seq});
+        }
+        this->statuses.emplace_back();
+    }
 
-INDEX_TEMPLATE_ARGUMENTS
+    auto Size() const -> size_t {
+        return this->entries.size();
+    }
+
+    // status of the i-th added op, after Run
+    auto StatusAt(size_t i) const -> Status {
+        return this->statuses[i];
+    }
+
+    // drops the ops, keeps the memory for the next ones
+    void Clear() {
+        this->entries.clear();
+        this->statuses.clear();
+    }
+
+    // returns the number of failed ops (e.g. duplicate INSERTs), see StatusAt
+    auto Run(IndexT& idx) -> size_t {
+        /*
+            1. sort by key, ops on one key by the order they were added in
+            2. run in that order, a run of GETs as one MultiGet
+        */
+        // 1. sort
+        std::sort(this->entries.begin(), this->entries.end(), [](const Entry& a, const Entry& b) {
+            auto cmp = KeyComparatorT{}(KeyOf(a.op), KeyOf(b.op));
+            return cmp != 0 ? cmp < 0 : a.seq < b.seq;
+        });
+        // 2. run
+        size_t failed = 0;
+        for (size_t i = 0; i < this->entries.size();) {
+            if (std::holds_alternative<GetOpT>(this->entries[i].op)) {
+                auto end = i;
+                this->get_keys.clear();
+                for (; end < this->entries.size() && std::holds_alternative<GetOpT>(this->entries[end].op); end++) {
+                    this->get_keys.push_back(std::get<GetOpT>(this->entries[end].op).key);
+                }
+                this->get_results.resize(this->get_keys.size());
+                auto status = idx.MultiGet(this->get_keys, this->get_results);
+                for (auto j = i; j < end; j++) {
+                    *std::get<GetOpT>(this->entries[j].op).result = this->get_results[j - i];
+                    this->statuses[this->entries[j].seq] = status;
+                    failed += !status.Ok();
+                }
+                i = end;
+                continue;
+            }
+            auto status = std::visit([&idx](auto& op) -> Status {
+                using VisitedT = std::decay_t<decltype(op)>;
+                if constexpr (std::is_same_v<VisitedT, InsertOpT>) {
+                    return idx.Insert(op.key, op.val);
+                } else if constexpr (std::is_same_v<VisitedT, UpdateOpT>) {
+                    return idx.Update(op.key, op.val);
+                } else if constexpr (std::is_same_v<VisitedT, RemoveOpT>) {
+                    return idx.Remove(op.key);
+                } else {
+                    // GETs run above
+                    std::cout << "should not reach here!\n";
+                    exit(-1);
+                }
+            }, this->entries[i].op);
+            this->statuses[this->entries[i].seq] = status;
+            failed += !status.Ok();
+            i++;
+        }
+        return failed;
+    }
+
+private:
+    struct Entry {
+        OpT op;
+        // position in the order of Add
+        uint32_t seq;
+    };
+
+    static auto KeyOf(const OpT& op) -> const KeyT& {
+        return std::visit([](const auto& visited) -> const KeyT& {
+            return visited.key;
+        }, op);
+    }
+
+    std::vector<Entry> entries;
+    // by seq
+    std::vector<Status> statuses;
+    // MultiGet buffers, reused by every run
+    std::vector<KeyT> get_keys;
+    std::vector<std::optional<ValueT>> get_results;
+};
+
+
+template<typename KeyT, typename ValueT, typename KeyComparatorT, typename AggregateT = NoAggregate,
+    size_t PageSize = BTREE_PAGE_SIZE>
 struct IndexOpFactory {
-    using IndexT = Index<KeyT, ValueT, KeyComparatorT>;
+    using IndexT = Index<KeyT, ValueT, KeyComparatorT, AggregateT, PageSize>;
+    using ShardsT = KeyRangeShards<KeyT, KeyComparatorT>;
+    using BatchT = OpBatch<IndexT, KeyT, ValueT, KeyComparatorT>;
 public:
+    // values of INSERT / UPDATE are copied into the op, it may run after they are gone.
+    // GET writes its std::optional<ValueT>& args, which must outlive the op
     template<OPTYPE  OP, typename ... Args>
     std::function<void()> make_op(std::shared_ptr<IndexT> idx, KeyT k, Args&&... args) {
         if constexpr (OP == OPTYPE::INSERT) {
-            return [idx, k, &args...]() {
+            return [idx, k, ...args = std::forward<Args>(args)]() {
                 idx->Insert(k, args...).Unwrap();
             };
         } else if constexpr (OP == OPTYPE::UPDATE) {
-            return [idx, k, &args...]() {
+            return [idx, k, ...args = std::forward<Args>(args)]() {
                 idx->Update(k, args...).Unwrap();
             };
         } else if constexpr (OP == OPTYPE::REMOVE) {
-            return [idx, k, &args...]() {
+            return [idx, k]() {
                 idx->Remove(k).Unwrap();
             };
+        } else if constexpr (OP == OPTYPE::GET) {
+            // args is the std::optional<ValueT>& receiving the result
+            return [idx, k, &args...]() {
+                auto v = idx->Get(k).Unwrap();
+                ((args = v), ...);
+            };
         }
         return [](){};
     }
 
-    template<>
-    std::function<void()> make_op<OPTYPE::GET>(std::shared_ptr<IndexT> idx, KeyT k, std::optional<ValueT>& res) {
-        return [idx, k, &res]() {
-            auto v = idx->Get(k).Unwrap();
-            res = v;
-        };
+    // make_op run by the worker of k's shard, ops of one shard run in submit order.
+    // a failed op (e.g. a duplicate INSERT) throws from the future's get()
+    template<OPTYPE  OP, typename ... Args>
+    auto submit_op(OpExecutor& executor, const ShardsT& shards, std::shared_ptr<IndexT> idx, KeyT k,
+        Args&&... args) -> std::future<void> {
+        auto shard = shards.ShardOf(k);
+        return executor.Submit(shard, make_op<OP>(std::move(idx), k, std::forward<Args>(args)...));
     }
 
-
-};
+    // ops by value instead of std::function closures, run in key order: see OpBatch
+    auto make_batch(size_t capacity = 0) -> BatchT {
+        return BatchT(capacity);
+    }
 
 
+};
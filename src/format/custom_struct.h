@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <string>
 #include "fmt/format.h"
 
 struct TestStructA {
@@ -15,6 +16,21 @@ struct TestStructA {
     }
 };
 
+struct TestStructB {
+    long score;
+    std::array<char, 120> payload;
+
+    auto dump_struct() const -> std::string {
+        return std::to_string(this->score);
+    }
+};
+
+struct TestStructBScore {
+    auto operator()(const TestStructB& b) const -> long {
+        return b.score;
+    }
+};
+
 struct IntThreeWayCmper {
     auto operator()(const int& a, const int& b) -> int{
         return (a > b) - (a < b);
@@ -1,10 +1,20 @@
 #include "graphviz.h"
 
+#include <cerrno>
+#include <filesystem>
 #include <fstream>
 #include <string>
 #include <iostream>
 
+#include <unistd.h>
+
 void GenerateDot(std::string filename, std::string content) {
+    // dots/ is output, not part of the tree
+    auto dir = std::filesystem::path(filename).parent_path();
+    if (!dir.empty()) {
+        auto ec = std::error_code{};
+        std::filesystem::create_directories(dir, ec);
+    }
     std::ofstream ofs(filename, std::ios::out);
     
     if (!ofs) {
@@ -17,4 +27,48 @@ void GenerateDot(std::string filename, std::string content) {
     ofs.close();
 
     return;
-}
\ No newline at end of file
+}
+FdOutBuf::FdOutBuf(int fd): fd(fd) {
+    setp(this->buf.data(), this->buf.data() + this->buf.size());
+}
+
+FdOutBuf::~FdOutBuf() {
+    Flush();
+}
+
+auto FdOutBuf::Failed() const -> bool {
+    return this->failed;
+}
+
+auto FdOutBuf::overflow(int_type ch) -> int_type {
+    if (!Flush()) {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+auto FdOutBuf::sync() -> int {
+    return Flush() ? 0 : -1;
+}
+
+auto FdOutBuf::Flush() -> bool {
+    auto pending = pptr() - pbase();
+    auto done = decltype(pending){0};
+    while (!this->failed && done < pending) {
+        auto n = ::write(this->fd, pbase() + done, pending - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            this->failed = true;
+            break;
+        }
+        done += n;
+    }
+    setp(this->buf.data(), this->buf.data() + this->buf.size());
+    return !this->failed;
+}
@@ -1,3 +1,31 @@
+#pragma once
+
+#include <array>
+#include <streambuf>
 #include <string>
 
-void GenerateDot(std::string name, std::string content);
\ No newline at end of file
+void GenerateDot(std::string name, std::string content);
+
+/*
+    streambuf writing to a file descriptor through a fixed buffer, so a dot document
+    goes out while it is produced instead of piling up in memory. the fd stays open
+*/
+class FdOutBuf : public std::streambuf {
+public:
+    explicit FdOutBuf(int fd);
+    FdOutBuf(const FdOutBuf&) = delete;
+    ~FdOutBuf() override;
+    // a write to fd failed, everything after it was dropped
+    auto Failed() const -> bool;
+
+protected:
+    auto overflow(int_type ch) -> int_type override;
+    auto sync() -> int override;
+
+private:
+    auto Flush() -> bool;
+
+    int fd;
+    bool failed{false};
+    std::array<char, 64 * 1024> buf;
+};
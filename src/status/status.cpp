@@ -1,5 +1,20 @@
+#include <stdexcept>
+#include <string>
+
+#include "fmt/core.h"
 #include "status.h"
 
-const char* OutofSpaceException::message = "OutOfSpace";
-const char* KeyNotFoundException::message = "KeyNotFound";
-const char* KeyDuplicateException::message = "KeyDuplicate";
+auto StatusCodeName(StatusCode code) -> const char* {
+    switch (code) {
+        case StatusCode::Ok: return "Ok";
+        case StatusCode::OutOfSpace: return "OutOfSpace";
+        case StatusCode::KeyNotFound: return "KeyNotFound";
+        case StatusCode::KeyDuplicate: return "KeyDuplicate";
+        case StatusCode::IOError: return "IOError";
+    }
+    return "Unknown";
+}
+
+void ThrowStatus(StatusCode code) {
+    throw std::runtime_error(std::string(fmt::format("Exception: {}", StatusCodeName(code))));
+}
@@ -1,115 +1,76 @@
 #pragma once
 
-#include <stdexcept>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
 #include <utility>
-#include <exception>
 #include <variant>
-#include <string>
-#include <memory>
 
-#include "fmt/core.h"
-
-namespace visitor{
-template<class... Ts>
-struct overload : Ts... {
-    using Ts::operator()...;
-};
-template<class... Ts> overload(Ts...) -> overload<Ts...>;
-
-
-struct StatusOrVisitor {
-    template<typename T>
-    static bool Ok(std::variant<T, std::unique_ptr<std::exception>>& var) {
-        auto ret = std::visit(visitor::overload{
-            [](const T& t) { return true; },
-            [](const std::unique_ptr<std::exception>& except) { return false; }
-        }, var);
-        return ret;
-    }
+/*
+    Error codes carried by StatusOr.
+    An error is a one byte code, so building / copying / checking a failed
+    StatusOr never allocates. Only Unwrap() on a failure turns the code into
+    an exception.
+*/
+enum class StatusCode : uint8_t {
+    Ok = 0,
+    OutOfSpace,
+    KeyNotFound,
+    KeyDuplicate,
+    IOError,
 };
 
-}
+auto StatusCodeName(StatusCode code) -> const char*;
 
-class OutofSpaceException : public std::exception {
-private:
-    static const char* message;
-public:
-    OutofSpaceException() {}
-
-    virtual const char* what() const noexcept override {
-        return message;
-    }
-};
-
-class KeyNotFoundException : public std::exception {
-private:
-    static const char* message;
-public:
-    KeyNotFoundException() {}
-
-    virtual const char* what() const noexcept override {
-        return message;
-    }
-};
-
-class KeyDuplicateException : public std::exception {
-private:
-    static const char* message;
-public:
-    KeyDuplicateException() {}
-
-    virtual const char* what() const noexcept override {
-        return message;
-    }
-};
-
-    
-template<typename T>
-class StatusBase{
-    virtual bool Ok() = 0;
-    virtual T Unwrap() = 0;
-};
+// out of line, keeps fmt / exception code away from the callers' hot paths
+[[noreturn]] void ThrowStatus(StatusCode code);
 
 template<typename T> 
-class StatusOr: StatusBase<T> {
+class StatusOr {
 public:
     StatusOr(const T& _res): result(_res) {}
-    StatusOr(std::unique_ptr<std::exception>&& _e): result(std::move(_e)) {}
-    bool Ok() override {
-        return visitor::StatusOrVisitor::Ok(this->result);
+    StatusOr(StatusCode _code): result(_code) {
+        assert(_code != StatusCode::Ok);
+    }
+    bool Ok() const {
+        return this->result.index() == 0;
     }
-    T Unwrap() override {
+    auto Code() const -> StatusCode {
+        return Ok() ? StatusCode::Ok : *std::get_if<StatusCode>(&this->result);
+    }
+    // opt-in: throws std::runtime_error when not Ok
+    T Unwrap() const {
         if (Ok()) {
-            return std::get<T>(this->result);
+            return *std::get_if<T>(&this->result);
         } else {
-            throw std::runtime_error(std::string(fmt::format("Exception: {}", std::get<std::unique_ptr<std::exception>>(this->result)->what())));
+            ThrowStatus(*std::get_if<StatusCode>(&this->result));
         }
     }
     
 private:
-    std::variant<T, std::unique_ptr<std::exception>> result;
+    std::variant<T, StatusCode> result;
 };
 
 template <>
-class StatusOr<void>: StatusBase<void> {
+class StatusOr<void> {
 public:
     StatusOr() {}
-    StatusOr(std::unique_ptr<std::exception>&& _e): result(std::move(_e)) {}
-    bool Ok() override {return result.get() == nullptr;}
-    void Unwrap() override {
+    StatusOr(StatusCode _code): code(_code) {}
+    bool Ok() const {return this->code == StatusCode::Ok;}
+    auto Code() const -> StatusCode {return this->code;}
+    // opt-in: throws std::runtime_error when not Ok
+    void Unwrap() const {
         if (Ok()) {
             return;
         } else {
-            throw std::runtime_error(std::string(fmt::format("Exception: {}", this->result->what())));
+            ThrowStatus(this->code);
         }
     }
 private:
-    std::unique_ptr<std::exception> result;
+    StatusCode code{StatusCode::Ok};
 };
 
-template<typename T>
-std::unique_ptr<std::exception> make_exception() {
-    return std::make_unique<T>(T{});
-}
-
 using Status = StatusOr<void>;
+
+static_assert(std::is_trivially_copyable_v<Status>);
+static_assert(std::is_trivially_copyable_v<StatusOr<int>>);
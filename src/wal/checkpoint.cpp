@@ -0,0 +1,147 @@
+#include "checkpoint.h"
+#include "crc32.h"
+#include "file_util.h"
+
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+uint32_t constexpr CHECKPOINT_MAGIC = 0x4B435442;    // "BTCK"
+uint32_t constexpr HOT_PAGES_MAGIC = 0x50485442;    // "BTHP"
+size_t constexpr CRC_OFFSET = sizeof(uint32_t);
+size_t constexpr BODY_OFFSET = CRC_OFFSET + sizeof(uint32_t);
+
+template<typename T>
+void PutField(std::string& buf, const T& field) {
+    buf.append(reinterpret_cast<const char*>(&field), sizeof(T));
+}
+
+template<typename T>
+auto GetField(const std::string& buf, size_t& pos, T& field) -> bool {
+    if (pos + sizeof(T) > buf.size()) {
+        return false;
+    }
+    std::memcpy(&field, buf.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+}
+
+auto SaveCheckpoint(const std::string& path, const CheckpointRecord& record) -> Status {
+    auto buf = std::string{};
+    buf.reserve(BODY_OFFSET + 32 + record.images.size() * (sizeof(int32_t) + record.page_size));
+    PutField(buf, CHECKPOINT_MAGIC);
+    PutField(buf, uint32_t{0});
+    PutField(buf, record.lsn);
+    PutField(buf, (int32_t)record.root_pid);
+    PutField(buf, (int32_t)record.next_pid);
+    PutField(buf, record.page_size);
+    PutField(buf, (uint32_t)record.images.size());
+    for (auto& [pid, image] : record.images) {
+        PutField(buf, (int32_t)pid);
+        buf.append(image.data(), record.page_size);
+    }
+    auto crc = Crc32(0, buf.data() + BODY_OFFSET, buf.size() - BODY_OFFSET);
+    std::memcpy(buf.data() + CRC_OFFSET, &crc, sizeof(crc));
+    if (!ReplaceFile(path, buf.data(), buf.size())) {
+        return {StatusCode::IOError};
+    }
+    return {};
+}
+
+auto LoadCheckpoint(const std::string& path) -> StatusOr<std::optional<CheckpointRecord>> {
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return {std::optional<CheckpointRecord>{}};
+        }
+        return {StatusCode::IOError};
+    }
+    std::string buf;
+    auto read_ok = ReadAll(fd, buf);
+    ::close(fd);
+    if (!read_ok) {
+        return {StatusCode::IOError};
+    }
+    uint32_t magic{};
+    uint32_t crc{};
+    size_t pos = 0;
+    if (!GetField(buf, pos, magic) || !GetField(buf, pos, crc) || magic != CHECKPOINT_MAGIC
+        || Crc32(0, buf.data() + BODY_OFFSET, buf.size() - BODY_OFFSET) != crc) {
+        return {std::optional<CheckpointRecord>{}};
+    }
+    auto record = CheckpointRecord{};
+    int32_t root_pid{};
+    int32_t next_pid{};
+    uint32_t image_cnt{};
+    GetField(buf, pos, record.lsn);
+    GetField(buf, pos, root_pid);
+    GetField(buf, pos, next_pid);
+    GetField(buf, pos, record.page_size);
+    GetField(buf, pos, image_cnt);
+    record.root_pid = root_pid;
+    record.next_pid = next_pid;
+    record.images.reserve(image_cnt);
+    for (uint32_t i = 0; i < image_cnt; i++) {
+        int32_t pid{};
+        if (!GetField(buf, pos, pid) || pos + record.page_size > buf.size()) {
+            return {std::optional<CheckpointRecord>{}};
+        }
+        record.images.emplace_back(pid, std::vector<char>(buf.data() + pos, buf.data() + pos + record.page_size));
+        pos += record.page_size;
+    }
+    return {std::make_optional(std::move(record))};
+}
+
+auto SaveHotPages(const std::string& path, const std::vector<int>& pids) -> Status {
+    auto buf = std::string{};
+    buf.reserve(BODY_OFFSET + sizeof(uint32_t) + pids.size() * sizeof(int32_t));
+    PutField(buf, HOT_PAGES_MAGIC);
+    PutField(buf, uint32_t{0});
+    PutField(buf, (uint32_t)pids.size());
+    for (auto pid : pids) {
+        PutField(buf, (int32_t)pid);
+    }
+    auto crc = Crc32(0, buf.data() + BODY_OFFSET, buf.size() - BODY_OFFSET);
+    std::memcpy(buf.data() + CRC_OFFSET, &crc, sizeof(crc));
+    if (!ReplaceFile(path, buf.data(), buf.size())) {
+        return {StatusCode::IOError};
+    }
+    return {};
+}
+
+auto LoadHotPages(const std::string& path) -> StatusOr<std::vector<int>> {
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return {std::vector<int>{}};
+        }
+        return {StatusCode::IOError};
+    }
+    std::string buf;
+    auto read_ok = ReadAll(fd, buf);
+    ::close(fd);
+    if (!read_ok) {
+        return {StatusCode::IOError};
+    }
+    uint32_t magic{};
+    uint32_t crc{};
+    uint32_t pid_cnt{};
+    size_t pos = 0;
+    if (!GetField(buf, pos, magic) || !GetField(buf, pos, crc) || magic != HOT_PAGES_MAGIC
+        || Crc32(0, buf.data() + BODY_OFFSET, buf.size() - BODY_OFFSET) != crc || !GetField(buf, pos, pid_cnt)) {
+        return {std::vector<int>{}};
+    }
+    auto pids = std::vector<int>{};
+    pids.reserve(pid_cnt);
+    for (uint32_t i = 0; i < pid_cnt; i++) {
+        int32_t pid{};
+        if (!GetField(buf, pos, pid)) {
+            return {std::vector<int>{}};
+        }
+        pids.push_back(pid);
+    }
+    return {std::move(pids)};
+}
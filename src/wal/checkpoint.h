@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../status/status.h"
+
+/*
+    checkpoint record: the index state as of log record lsn.
+    it carries the images of the pages dirtied since the previous checkpoint;
+    the page file plus these images is the tree at lsn. the record is made
+    durable (atomic rename) before the images are written into the page file,
+    so a crash in between is repaired by writing the images again on recovery.
+
+    file layout:
+        uint32_t magic | uint32_t crc32 of the rest | uint64_t lsn | int32_t root_pid
+        | int32_t next_pid | uint32_t page_size | uint32_t image count | (int32_t pid | page bytes)...
+*/
+struct CheckpointRecord {
+    uint64_t lsn{0};
+    int root_pid{0};
+    int next_pid{0};
+    uint32_t page_size{0};
+    std::vector<std::pair<int, std::vector<char>>> images;
+};
+
+auto SaveCheckpoint(const std::string& path, const CheckpointRecord& record) -> Status;
+// empty when path holds no complete checkpoint
+auto LoadCheckpoint(const std::string& path) -> StatusOr<std::optional<CheckpointRecord>>;
+
+/*
+    hot page list: resident page ids of an index, hottest first, read back on
+    open to warm up the page table.
+
+    file layout:
+        uint32_t magic | uint32_t crc32 of the rest | uint32_t pid count | int32_t pid...
+*/
+auto SaveHotPages(const std::string& path, const std::vector<int>& pids) -> Status;
+// empty when path holds no complete list
+auto LoadHotPages(const std::string& path) -> StatusOr<std::vector<int>>;
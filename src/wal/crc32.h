@@ -0,0 +1,26 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// crc32 (ieee), checksum of log records and checkpoint files
+inline auto constexpr CRC32_TABLE = [] {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+        auto c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+    }
+    return table;
+}();
+
+inline auto Crc32(uint32_t crc, const char* data, size_t size) -> uint32_t {
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = CRC32_TABLE[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cerrno>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// small posix helpers shared by the log and checkpoint files
+
+inline auto WriteAll(int fd, const char* data, size_t size) -> bool {
+    size_t done = 0;
+    while (done < size) {
+        auto n = ::write(fd, data + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+// size bytes from offset on
+inline auto ReadAt(int fd, off_t offset, size_t size, std::string& data) -> bool {
+    data.resize(size);
+    size_t done = 0;
+    while (done < data.size()) {
+        auto n = ::pread(fd, data.data() + done, data.size() - done, offset + done);
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+inline auto ReadAll(int fd, std::string& data) -> bool {
+    auto size = ::lseek(fd, 0, SEEK_END);
+    if (size < 0) {
+        return false;
+    }
+    return ReadAt(fd, 0, size, data);
+}
+
+// make a rename / create in the directory of path durable
+inline auto SyncParentDir(const std::string& path) -> bool {
+    auto slash = path.rfind('/');
+    auto dir = slash == std::string::npos ? std::string(".") : path.substr(0, slash + 1);
+    auto dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd < 0) {
+        return false;
+    }
+    auto ok = ::fsync(dir_fd) == 0;
+    ::close(dir_fd);
+    return ok;
+}
+
+// write data to path atomically: tmp file, sync, rename, sync dir
+inline auto ReplaceFile(const std::string& path, const char* data, size_t size) -> bool {
+    auto tmp_path = path + ".tmp";
+    auto fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    auto ok = WriteAll(fd, data, size) && ::fdatasync(fd) == 0;
+    ::close(fd);
+    return ok && ::rename(tmp_path.c_str(), path.c_str()) == 0 && SyncParentDir(path);
+}
@@ -0,0 +1,347 @@
+#include "wal.h"
+#include "crc32.h"
+#include "file_util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+size_t constexpr RECORD_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint8_t);
+
+// crc covers lsn, type and payload
+auto RecordCrc(uint64_t lsn, uint8_t type, const char* payload, uint32_t size) -> uint32_t {
+    auto crc = Crc32(0, reinterpret_cast<const char*>(&lsn), sizeof(lsn));
+    crc = Crc32(crc, reinterpret_cast<const char*>(&type), sizeof(type));
+    return Crc32(crc, payload, size);
+}
+
+/*
+    walk the valid prefix of data
+    returns the end offset of the last valid record
+*/
+template<typename FnT>
+auto ParseRecords(const std::string& data, FnT&& fn) -> size_t {
+    size_t pos = 0;
+    while (pos + RECORD_HEADER_SIZE <= data.size()) {
+        uint32_t size{};
+        uint32_t crc{};
+        uint64_t lsn{};
+        uint8_t type{};
+        auto ptr = data.data() + pos;
+        std::memcpy(&size, ptr, sizeof(size));
+        std::memcpy(&crc, ptr + 4, sizeof(crc));
+        std::memcpy(&lsn, ptr + 8, sizeof(lsn));
+        std::memcpy(&type, ptr + 16, sizeof(type));
+        if (pos + RECORD_HEADER_SIZE + size > data.size()) {
+            break;
+        }
+        auto payload = ptr + RECORD_HEADER_SIZE;
+        if (RecordCrc(lsn, type, payload, size) != crc) {
+            break;
+        }
+        fn(WalRecord{lsn, WalRecordType(type), payload, size});
+        pos += RECORD_HEADER_SIZE + size;
+    }
+    return pos;
+}
+
+}
+
+Wal::Wal(const WalOptions& _options): options(_options) {}
+
+Wal::~Wal() {
+    {
+        std::unique_lock lk(this->mu);
+        this->stopping = true;
+    }
+    this->stop_cv.notify_all();
+    if (this->sync_thread.joinable()) {
+        this->sync_thread.join();
+    }
+    {
+        std::unique_lock lk(this->mu);
+        FlushLocked(lk, this->options.sync_mode != WalSyncMode::None);
+    }
+    ::close(this->fd);
+}
+
+auto Wal::open(const WalOptions& options, uint64_t start_lsn) -> StatusOr<std::shared_ptr<Wal>> {
+    /*
+        1. open file
+        2. find the valid prefix and the last lsn
+        3. cut a torn tail
+        4. start periodic sync
+    */
+    auto wal = std::shared_ptr<Wal>(new Wal(options));
+    // 1. open
+    wal->fd = ::open(options.path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (wal->fd < 0) {
+        return {StatusCode::IOError};
+    }
+    // 2. scan
+    std::string data;
+    if (!ReadAll(wal->fd, data)) {
+        return {StatusCode::IOError};
+    }
+    uint64_t last_lsn = 0;
+    auto valid_end = ParseRecords(data, [&](const WalRecord& record) {
+        last_lsn = record.lsn;
+    });
+    // 3. cut torn tail
+    if (valid_end < data.size() && ::ftruncate(wal->fd, valid_end) != 0) {
+        return {StatusCode::IOError};
+    }
+    // a log truncated by a checkpoint may be empty, lsn keeps growing from the checkpoint
+    last_lsn = std::max(last_lsn, start_lsn);
+    wal->next_lsn = last_lsn + 1;
+    wal->written_lsn = last_lsn;
+    wal->durable_lsn = last_lsn;
+    // 4. periodic sync
+    if (options.sync_mode == WalSyncMode::Periodic) {
+        wal->sync_thread = std::thread([w = wal.get()] { w->PeriodicSyncLoop(); });
+    }
+    return {wal};
+}
+
+auto Wal::Append(WalRecordType type, const char* payload, uint32_t size) -> uint64_t {
+    std::unique_lock lk(this->mu);
+    auto lsn = this->next_lsn++;
+    if (this->failed) {
+        // never written, Commit reports the failure
+        return lsn;
+    }
+    auto raw_type = (uint8_t)type;
+    auto crc = RecordCrc(lsn, raw_type, payload, size);
+    auto old_size = this->buffer.size();
+    this->buffer.resize(old_size + RECORD_HEADER_SIZE + size);
+    auto ptr = this->buffer.data() + old_size;
+    std::memcpy(ptr, &size, sizeof(size));
+    std::memcpy(ptr + 4, &crc, sizeof(crc));
+    std::memcpy(ptr + 8, &lsn, sizeof(lsn));
+    std::memcpy(ptr + 16, &raw_type, sizeof(raw_type));
+    std::memcpy(ptr + RECORD_HEADER_SIZE, payload, size);
+    return lsn;
+}
+
+auto Wal::Commit(uint64_t lsn) -> Status {
+    std::unique_lock lk(this->mu);
+    if (this->failed) {
+        return {StatusCode::IOError};
+    }
+    if (this->options.sync_mode != WalSyncMode::PerOp) {
+        // bound the buffer, durability is up to the sync thread / OS
+        if (this->buffer.size() >= this->options.buffer_size) {
+            return FlushLocked(lk, false);
+        }
+        return {};
+    }
+    // group commit: whoever finds no flush running flushes for everyone buffered so far
+    while (this->durable_lsn < lsn) {
+        // the flush carrying lsn failed, or one before it did
+        if (this->failed) {
+            return {StatusCode::IOError};
+        }
+        if (this->flushing) {
+            this->flushed_cv.wait(lk);
+            continue;
+        }
+        auto flush_res = FlushLocked(lk, true);
+        if (!flush_res.Ok()) {
+            return flush_res;
+        }
+    }
+    return {};
+}
+
+auto Wal::Sync() -> Status {
+    std::unique_lock lk(this->mu);
+    return FlushLocked(lk, true);
+}
+
+auto Wal::FlushLocked(std::unique_lock<std::mutex>& lk, bool sync) -> Status {
+    /*
+        lk holds mu on entry and on return, released during io. a failure latches
+        1. wait for a running flush
+        2. take the buffer
+        3. write (and sync) outside the lock
+        4. publish progress, wake up waiters
+    */
+    // 1. wait
+    while (this->flushing) {
+        this->flushed_cv.wait(lk);
+    }
+    if (this->failed) {
+        return {StatusCode::IOError};
+    }
+    if (this->buffer.empty() && (!sync || this->durable_lsn == this->written_lsn)) {
+        return {};
+    }
+    // 2. take buffer
+    this->flushing = true;
+    auto batch = std::string{};
+    batch.swap(this->buffer);
+    auto upto = this->next_lsn - 1;
+    // Truncate swaps fd only while no flush runs
+    auto fd = this->fd;
+    // 3. io
+    lk.unlock();
+    auto ok = WriteAll(fd, batch.data(), batch.size()) && (!sync || ::fdatasync(fd) == 0);
+    lk.lock();
+    // 4. publish
+    this->flushing = false;
+    if (ok) {
+        this->written_lsn = upto;
+        if (sync) {
+            this->durable_lsn = upto;
+            this->sync_cnt++;
+        }
+    } else {
+        // part of batch may be on disk, a later batch after it would be cut off on replay
+        this->failed = true;
+    }
+    this->flushed_cv.notify_all();
+    if (!ok) {
+        return {StatusCode::IOError};
+    }
+    return {};
+}
+
+void Wal::PeriodicSyncLoop() {
+    std::unique_lock lk(this->mu);
+    while (!this->stopping) {
+        this->stop_cv.wait_for(lk, std::chrono::milliseconds(this->options.sync_interval_ms), [this] {
+            return this->stopping;
+        });
+        if (this->stopping) {
+            break;
+        }
+        // an io error shows up again on the next Sync / Commit
+        FlushLocked(lk, true);
+    }
+}
+
+auto Wal::Replay(uint64_t after_lsn, const std::function<void(const WalRecord&)>& fn) -> Status {
+    {
+        std::unique_lock lk(this->mu);
+        auto flush_res = FlushLocked(lk, false);
+        if (!flush_res.Ok()) {
+            return flush_res;
+        }
+    }
+    std::string data;
+    if (!ReadAll(this->fd, data)) {
+        return {StatusCode::IOError};
+    }
+    ParseRecords(data, [&](const WalRecord& record) {
+        if (record.lsn > after_lsn) {
+            fn(record);
+        }
+    });
+    return {};
+}
+
+auto Wal::Truncate(uint64_t upto_lsn) -> Status {
+    /*
+        drop records with lsn <= upto_lsn, a checkpoint covers them
+        1. write out the buffer, note where the file ends
+        2. without mu: copy the records to keep up to that end into a new file
+        3. hold flushes back: copy what they appended meanwhile, sync, rename the
+           new file over the log, swap the fd in
+        appends never wait for the copy, commits only for step 3. any failure
+        leaves the old file and fd in use
+    */
+    auto fd = -1;
+    off_t copied_end = 0;
+    {
+        std::unique_lock lk(this->mu);
+        // 1. write out
+        auto flush_res = FlushLocked(lk, false);
+        if (!flush_res.Ok()) {
+            return flush_res;
+        }
+        // only this Truncate replaces fd
+        fd = this->fd;
+        copied_end = ::lseek(fd, 0, SEEK_END);
+        if (copied_end < 0) {
+            return {StatusCode::IOError};
+        }
+    }
+    // 2. copy
+    std::string data;
+    if (!ReadAt(fd, 0, copied_end, data)) {
+        return {StatusCode::IOError};
+    }
+    size_t keep_from = 0;
+    ParseRecords(data, [&](const WalRecord& record) {
+        if (record.lsn <= upto_lsn) {
+            keep_from = record.payload + record.size - data.data();
+        }
+    });
+    if (keep_from == 0) {
+        return {};
+    }
+    auto tmp_path = this->options.path + ".tmp";
+    // opened before the rename, so no reopen can fail after it
+    auto new_fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (new_fd < 0) {
+        return {StatusCode::IOError};
+    }
+    auto ok = WriteAll(new_fd, data.data() + keep_from, data.size() - keep_from);
+    // 3. swap
+    std::unique_lock lk(this->mu);
+    while (this->flushing) {
+        this->flushed_cv.wait(lk);
+    }
+    this->flushing = true;
+    // a flush failed beside the copy, the log takes no more changes
+    ok = ok && !this->failed;
+    lk.unlock();
+    auto renamed = false;
+    if (ok) {
+        auto end = ::lseek(fd, 0, SEEK_END);
+        auto appended = std::string{};
+        renamed = end >= copied_end && ReadAt(fd, copied_end, end - copied_end, appended)
+            && WriteAll(new_fd, appended.data(), appended.size()) && ::fdatasync(new_fd) == 0
+            && ::rename(tmp_path.c_str(), this->options.path.c_str()) == 0;
+    }
+    lk.lock();
+    this->flushing = false;
+    if (renamed) {
+        ::close(this->fd);
+        this->fd = new_fd;
+        // every written record is in the synced new file
+        this->durable_lsn = this->written_lsn;
+    }
+    this->flushed_cv.notify_all();
+    lk.unlock();
+    if (!renamed) {
+        ::close(new_fd);
+        ::unlink(tmp_path.c_str());
+        return {StatusCode::IOError};
+    }
+    // a crash before the dir sync brings back the old log, it holds every record too
+    SyncParentDir(this->options.path);
+    return {};
+}
+
+auto Wal::LastLsn() const -> uint64_t {
+    std::unique_lock lk(this->mu);
+    return this->next_lsn - 1;
+}
+
+auto Wal::DurableLsn() const -> uint64_t {
+    std::unique_lock lk(this->mu);
+    return this->durable_lsn;
+}
+
+auto Wal::SyncCount() const -> uint64_t {
+    std::unique_lock lk(this->mu);
+    return this->sync_cnt;
+}
+
+auto Wal::Failed() const -> bool {
+    std::unique_lock lk(this->mu);
+    return this->failed;
+}
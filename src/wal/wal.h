@@ -0,0 +1,108 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../status/status.h"
+
+/*
+    Write-ahead log.
+    A record is appended to an in-memory buffer under the caller's ordering lock,
+    then Commit(lsn) waits (outside of that lock) until the record is durable.
+    Writers waiting at the same time share one write + fdatasync (group commit):
+    the first one flushes the whole buffer, the others wait for it.
+
+    record layout on disk (little endian, no padding):
+        uint32_t payload size | uint32_t crc32 | uint64_t lsn | uint8_t type | payload
+    a torn / corrupted tail is cut off when the log is opened.
+
+    a failed write or sync latches: the records of that batch may be partly on disk,
+    so nothing is written after them. every waiting and later Commit / Sync / Truncate
+    returns IOError and DurableLsn stops before the batch. reopen to go on from the
+    valid prefix of the file.
+*/
+
+enum class WalSyncMode : uint8_t {
+    // Commit waits for fdatasync, concurrent commits share one sync
+    PerOp,
+    // a background thread syncs every sync_interval_ms, Commit does not wait
+    Periodic,
+    // never sync, buffer is handed to the OS when it grows past buffer_size
+    None,
+};
+
+enum class WalRecordType : uint8_t {
+    Insert = 1,
+    Update,
+    Remove,
+    DeleteRange,
+};
+
+struct WalOptions {
+    std::string path;
+    WalSyncMode sync_mode{WalSyncMode::PerOp};
+    int sync_interval_ms{10};
+    size_t buffer_size{1 << 20};
+};
+
+struct WalRecord {
+    uint64_t lsn;
+    WalRecordType type;
+    const char* payload;
+    uint32_t size;
+};
+
+class Wal {
+public:
+    Wal(const Wal&) = delete;
+    ~Wal();
+    // open or create the log, valid records are kept and appending continues after them
+    // and after start_lsn (lsn of the checkpoint the log was truncated to)
+    static auto open(const WalOptions& options, uint64_t start_lsn = 0) -> StatusOr<std::shared_ptr<Wal>>;
+
+    // buffer one record, caller serializes Append calls in apply order
+    auto Append(WalRecordType type, const char* payload, uint32_t size) -> uint64_t;
+    // wait until record lsn is durable as required by sync mode
+    auto Commit(uint64_t lsn) -> Status;
+    // write and sync everything appended so far
+    auto Sync() -> Status;
+    // call fn on every valid record with lsn > after_lsn, in lsn order
+    auto Replay(uint64_t after_lsn, const std::function<void(const WalRecord&)>& fn) -> Status;
+    // drop records with lsn <= upto_lsn once a checkpoint made them redundant.
+    // one Truncate at a time, Append / Commit keep going while it copies the log
+    auto Truncate(uint64_t upto_lsn) -> Status;
+
+    auto LastLsn() const -> uint64_t;
+    auto DurableLsn() const -> uint64_t;
+    // number of fdatasync calls, a batch of concurrent commits costs one
+    auto SyncCount() const -> uint64_t;
+    // a write or sync failed, the log takes no more records
+    auto Failed() const -> bool;
+
+private:
+    explicit Wal(const WalOptions& options);
+    auto FlushLocked(std::unique_lock<std::mutex>& lk, bool sync) -> Status;
+    void PeriodicSyncLoop();
+
+    WalOptions options;
+    int fd{-1};
+    mutable std::mutex mu;
+    std::condition_variable flushed_cv;
+    std::string buffer;
+    uint64_t next_lsn{1};
+    uint64_t written_lsn{0};
+    uint64_t durable_lsn{0};
+    uint64_t sync_cnt{0};
+    bool flushing{false};
+    // sticky, see the class comment
+    bool failed{false};
+    bool stopping{false};
+    std::condition_variable stop_cv;
+    std::thread sync_thread;
+};
@@ -1,14 +1,34 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <set>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 #include <cstddef>
 #include <cassert>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "src/btree_index/index.h"
 #include "src/format/custom_struct.h"
 #include "src/graphviz/graphviz.h"
+#include "src/factories/op_factory.h"
 
 using namespace std;
 
 int constexpr TEST_NUM = 10;
+int constexpr ORDER_STAT_TEST_NUM = 500;
 
 int main() {
     cout << "\n\n============ START CHECKING BTREE INDEX ==================\n";
@@ -22,6 +42,26 @@ int main() {
     }
     cout << "\n\n\t\t [INSERT] Check Passed! \n";
 
+    cout << "\n\n-----Running [STATUS] Check On Btree Index...--------\n";
+    {
+        // a failure is a plain code, only Unwrap turns it into an exception
+        auto dup = idx->Insert(0, TestStructA{});
+        assert(!dup.Ok() && dup.Code() == StatusCode::KeyDuplicate);
+        [[maybe_unused]] auto copied = dup;
+        assert(copied.Code() == StatusCode::KeyDuplicate);
+        [[maybe_unused]] auto thrown = false;
+        try {
+            dup.Unwrap();
+        } catch (const std::runtime_error& e) {
+            thrown = std::string(e.what()) == "Exception: KeyDuplicate";
+        }
+        assert(thrown);
+        [[maybe_unused]] auto fresh = idx->Insert(TEST_NUM, TestStructA{});
+        assert(fresh.Code() == StatusCode::Ok);
+        idx->Remove(TEST_NUM).Unwrap();
+    }
+    cout << "\n\n\t\t [STATUS] Check Passed! \n";
+
     cout << "\n\n-----Running [UPDATE] Check On Btree Index...--------\n";
 
     for (int i = 0; i < TEST_NUM; i++) {
@@ -63,6 +103,1428 @@ int main() {
     }
     cout << "\n\n\t\t [DELETE] Check Passed! \n";
 
+    cout << "\n\n-----Running [RANK/SELECT/COUNT] Check On Btree Index...--------\n";
+    {
+        auto os_idx = Index<int, TestStructA, IntThreeWayCmper>::create();
+        auto keys = std::vector<int>{};
+        for (int i = 0; i < ORDER_STAT_TEST_NUM; i++) {
+            keys.push_back(i * 2);
+        }
+        auto rng = std::mt19937{42};
+        std::shuffle(keys.begin(), keys.end(), rng);
+        auto ref = std::set<int>{};
+        for (auto k : keys) {
+            [[maybe_unused]] auto ret = os_idx->Insert(k, TestStructA{});
+            assert(ret.Ok());
+            ref.insert(k);
+        }
+        // duplicate is rejected and does not change counts
+        [[maybe_unused]] auto dup = os_idx->Insert(keys[0], TestStructA{});
+        assert(!dup.Ok());
+        std::shuffle(keys.begin(), keys.end(), rng);
+        for (int i = 0; i < ORDER_STAT_TEST_NUM / 2; i++) {
+            os_idx->Remove(keys[i]).Unwrap();
+            ref.erase(keys[i]);
+        }
+        auto sorted = std::vector<int>(ref.begin(), ref.end());
+        for (int i = 0; i < (int)sorted.size(); i++) {
+            assert(os_idx->Select(i).Unwrap().value() == sorted[i]);
+            assert(os_idx->Rank(sorted[i]).Unwrap() == (size_t)i);
+            assert(os_idx->Rank(sorted[i] + 1).Unwrap() == (size_t)i + 1);
+            assert(os_idx->Get(sorted[i]).Unwrap().has_value());
+        }
+        assert(!os_idx->Select(sorted.size()).Unwrap().has_value());
+        for (int lo = -1; lo < ORDER_STAT_TEST_NUM * 2; lo += 37) {
+            auto hi = lo + 101;
+            [[maybe_unused]] auto expect = std::distance(ref.lower_bound(lo), ref.lower_bound(hi));
+            assert(os_idx->Count(lo, hi).Unwrap() == (size_t)expect);
+        }
+        assert(os_idx->Count(10, 10).Unwrap() == 0);
+    }
+    cout << "\n\n\t\t [RANK/SELECT/COUNT] Check Passed! \n";
+
+    cout << "\n\n-----Running [AGGREGATE] Check On Btree Index...--------\n";
+    {
+        using AggT = SumMinMaxAggregate<TestStructB, TestStructBScore>;
+        auto agg_idx = Index<int, TestStructB, IntThreeWayCmper, AggT>::create();
+        auto keys = std::vector<int>{};
+        for (int i = 0; i < ORDER_STAT_TEST_NUM; i++) {
+            keys.push_back(i);
+        }
+        auto rng = std::mt19937{7};
+        std::shuffle(keys.begin(), keys.end(), rng);
+        auto ref = std::map<int, long>{};
+        for (auto k : keys) {
+            auto v = TestStructB{};
+            v.score = (long)(rng() % 1000) - 500;
+            [[maybe_unused]] auto ret = agg_idx->Insert(k, v);
+            assert(ret.Ok());
+            ref[k] = v.score;
+        }
+        for (int i = 0; i < ORDER_STAT_TEST_NUM / 3; i++) {
+            auto v = TestStructB{};
+            v.score = (long)(rng() % 1000) - 500;
+            [[maybe_unused]] auto ret = agg_idx->Update(keys[i], v);
+            assert(ret.Ok());
+            ref[keys[i]] = v.score;
+        }
+        std::shuffle(keys.begin(), keys.end(), rng);
+        for (int i = 0; i < ORDER_STAT_TEST_NUM / 2; i++) {
+            agg_idx->Remove(keys[i]).Unwrap();
+            ref.erase(keys[i]);
+        }
+        for (int lo = -3; lo < ORDER_STAT_TEST_NUM; lo += 13) {
+            auto hi = lo + 1 + (lo * 7) % 97;
+            auto expect = AggT::Identity();
+            for (auto ite = ref.lower_bound(lo); ite != ref.end() && ite->first < hi; ++ite) {
+                expect = AggT::Combine(expect, AggT::SummaryT{ite->second, ite->second, ite->second});
+            }
+            [[maybe_unused]] auto got = agg_idx->Aggregate(lo, hi).Unwrap();
+            assert(got.sum == expect.sum && got.min == expect.min && got.max == expect.max);
+        }
+    }
+    cout << "\n\n\t\t [AGGREGATE] Check Passed! \n";
+
+    cout << "\n\n-----Running [DELETE RANGE] Check On Btree Index...--------\n";
+    {
+        using AggT = SumMinMaxAggregate<TestStructB, TestStructBScore>;
+        auto dr_idx = Index<int, TestStructB, IntThreeWayCmper, AggT>::create();
+        auto keys = std::vector<int>{};
+        for (int i = 0; i < ORDER_STAT_TEST_NUM; i++) {
+            keys.push_back(i);
+        }
+        auto rng = std::mt19937{11};
+        std::shuffle(keys.begin(), keys.end(), rng);
+        auto ref = std::map<int, long>{};
+        for (auto k : keys) {
+            auto v = TestStructB{};
+            v.score = k;
+            dr_idx->Insert(k, v).Unwrap();
+            ref[k] = k;
+        }
+        auto ranges = std::vector<std::pair<int, int>>{{10, 12}, {40, 41}, {100, 260}, {5, 50}, {300, 300}, {280, 520}};
+        for (auto [lo, hi] : ranges) {
+            auto first = ref.lower_bound(lo), last = ref.lower_bound(hi);
+            [[maybe_unused]] auto expect = (size_t)std::distance(first, last);
+            ref.erase(first, last);
+            [[maybe_unused]] auto deleted = dr_idx->DeleteRange(lo, hi).Unwrap();
+            assert(deleted == expect);
+            assert(dr_idx->Count(-1, ORDER_STAT_TEST_NUM).Unwrap() == ref.size());
+            for (int k = 0; k < ORDER_STAT_TEST_NUM; k++) {
+                assert(dr_idx->Get(k).Unwrap().has_value() == (ref.count(k) == 1));
+            }
+            auto sum = 0L;
+            for (auto [k, v] : ref) {
+                sum += v;
+            }
+            assert(dr_idx->Aggregate(-1, ORDER_STAT_TEST_NUM).Unwrap().sum == sum);
+        }
+        auto i = size_t{0};
+        for ([[maybe_unused]] auto [k, v] : ref) {
+            assert(dr_idx->Select(i).Unwrap() == k);
+            i++;
+        }
+        // tree stays usable after the range deletes
+        for (int k = 100; k < 260; k++) {
+            dr_idx->Insert(k, TestStructB{}).Unwrap();
+        }
+        assert(dr_idx->Count(100, 260).Unwrap() == 160);
+        [[maybe_unused]] auto deleted = dr_idx->DeleteRange(-1, ORDER_STAT_TEST_NUM).Unwrap();
+        assert(deleted == ref.size() + 160);
+        assert(dr_idx->Count(-1, ORDER_STAT_TEST_NUM).Unwrap() == 0);
+    }
+    cout << "\n\n\t\t [DELETE RANGE] Check Passed! \n";
+
+    cout << "\n\n-----Running [WAL] Check On Btree Index...--------\n";
+    {
+        using WalIndexT = Index<int, TestStructB, IntThreeWayCmper>;
+        auto wal_path = (std::filesystem::temp_directory_path() / "btree_unittest.wal").string();
+        std::filesystem::remove(wal_path);
+        auto ref = std::map<int, long>{};
+        for (auto mode : {WalSyncMode::PerOp, WalSyncMode::Periodic, WalSyncMode::None}) {
+            auto options = WalOptions{wal_path, mode};
+            {
+                auto wal_idx = WalIndexT::open(options).Unwrap();
+                auto base = (int)mode * ORDER_STAT_TEST_NUM;
+                for (int i = base; i < base + ORDER_STAT_TEST_NUM; i++) {
+                    auto v = TestStructB{};
+                    v.score = i;
+                    wal_idx->Insert(i, v).Unwrap();
+                    ref[i] = i;
+                }
+                [[maybe_unused]] auto dup = wal_idx->Insert(base, TestStructB{});
+                assert(!dup.Ok());
+                for (int i = base; i < base + ORDER_STAT_TEST_NUM; i += 3) {
+                    auto v = TestStructB{};
+                    v.score = -i;
+                    wal_idx->Update(i, v).Unwrap();
+                    ref[i] = -i;
+                }
+                for (int i = base + 1; i < base + ORDER_STAT_TEST_NUM; i += 5) {
+                    wal_idx->Remove(i).Unwrap();
+                    ref.erase(i);
+                }
+                wal_idx->DeleteRange(base + 100, base + 200).Unwrap();
+                ref.erase(ref.lower_bound(base + 100), ref.lower_bound(base + 200));
+            }
+            // restart: everything logged so far comes back
+            auto wal_idx = WalIndexT::open(options).Unwrap();
+            assert(wal_idx->Count(-1, 3 * ORDER_STAT_TEST_NUM).Unwrap() == ref.size());
+            for ([[maybe_unused]] auto [k, v] : ref) {
+                assert(wal_idx->Get(k).Unwrap().value().score == v);
+            }
+        }
+        // a torn tail record is dropped on open
+        {
+            auto file = std::ofstream(wal_path, std::ios::app | std::ios::binary);
+            file << "torn";
+        }
+        auto wal_idx = WalIndexT::open(WalOptions{wal_path}).Unwrap();
+        assert(wal_idx->Count(-1, 3 * ORDER_STAT_TEST_NUM).Unwrap() == ref.size());
+        wal_idx.reset();
+
+        // concurrent committers share fdatasync calls
+        std::filesystem::remove(wal_path);
+        auto wal = Wal::open(WalOptions{wal_path}).Unwrap();
+        auto committers = std::vector<std::thread>{};
+        for (int t = 0; t < 4; t++) {
+            committers.emplace_back([&wal, t] {
+                for (int i = 0; i < 50; i++) {
+                    auto lsn = wal->Append(WalRecordType::Remove, reinterpret_cast<const char*>(&t), sizeof(t));
+                    wal->Commit(lsn).Unwrap();
+                }
+            });
+        }
+        for (auto& th : committers) {
+            th.join();
+        }
+        assert(wal->DurableLsn() == 200 && wal->SyncCount() <= 200);
+
+        // truncate copies the log beside committers, every record after its lsn stays
+        committers.clear();
+        auto started = std::atomic<int>{0};
+        for (int t = 0; t < 4; t++) {
+            committers.emplace_back([&wal, &started, t] {
+                for (int i = 0; i < 200; i++) {
+                    auto lsn = wal->Append(WalRecordType::Remove, reinterpret_cast<const char*>(&t), sizeof(t));
+                    wal->Commit(lsn).Unwrap();
+                    started++;
+                }
+            });
+        }
+        while (started.load() < 100) {
+            std::this_thread::yield();
+        }
+        [[maybe_unused]] auto truncate_res = wal->Truncate(150);
+        assert(truncate_res.Ok());
+        for (auto& th : committers) {
+            th.join();
+        }
+        [[maybe_unused]] auto last_lsn = wal->LastLsn();
+        assert(last_lsn == 1000 && wal->DurableLsn() == last_lsn);
+        // a failed truncate keeps the old file in use
+        std::filesystem::create_directory(wal_path + ".tmp");
+        [[maybe_unused]] auto failed_res = wal->Truncate(500);
+        assert(failed_res.Code() == StatusCode::IOError);
+        auto lsn_after_fail = wal->Append(WalRecordType::Remove, "x", 1);
+        [[maybe_unused]] auto commit_res = wal->Commit(lsn_after_fail);
+        assert(commit_res.Ok());
+        std::filesystem::remove(wal_path + ".tmp");
+        wal.reset();
+        wal = Wal::open(WalOptions{wal_path}, 150).Unwrap();
+        auto replayed = std::vector<uint64_t>{};
+        [[maybe_unused]] auto replay_res = wal->Replay(0, [&replayed](const WalRecord& record) {
+            replayed.push_back(record.lsn);
+        });
+        assert(replay_res.Ok() && replayed.size() == lsn_after_fail - 150);
+        for (size_t i = 0; i < replayed.size(); i++) {
+            assert(replayed[i] == 151 + i);
+        }
+        wal.reset();
+        std::filesystem::remove(wal_path);
+
+        // a failed write latches: every committer gets IOError, none waits forever
+        auto full_wal = Wal::open(WalOptions{"/dev/full"}).Unwrap();
+        auto failures = std::atomic<int>{0};
+        committers.clear();
+        for (int t = 0; t < 4; t++) {
+            committers.emplace_back([&full_wal, &failures, t] {
+                for (int i = 0; i < 20; i++) {
+                    auto lsn = full_wal->Append(WalRecordType::Remove, reinterpret_cast<const char*>(&t), sizeof(t));
+                    failures += full_wal->Commit(lsn).Code() == StatusCode::IOError;
+                }
+            });
+        }
+        for (auto& th : committers) {
+            th.join();
+        }
+        assert(failures == 80 && full_wal->Failed() && full_wal->DurableLsn() == 0);
+        full_wal.reset();
+        // the op that hit the failure stays in memory, later writes and checkpoints are refused
+        auto full_ckpt_options = CheckpointOptions{(std::filesystem::temp_directory_path() / "btree_unittest_full.pages").string(), 0};
+        std::filesystem::remove(full_ckpt_options.path);
+        std::filesystem::remove(full_ckpt_options.path + ".ckpt");
+        auto full_idx = WalIndexT::open(WalOptions{"/dev/full"}, full_ckpt_options).Unwrap();
+        [[maybe_unused]] auto failed_insert = full_idx->Insert(1, TestStructB{});
+        assert(failed_insert.Code() == StatusCode::IOError && full_idx->Get(1).Unwrap().has_value());
+        [[maybe_unused]] auto refused_insert = full_idx->Insert(2, TestStructB{});
+        assert(refused_insert.Code() == StatusCode::IOError && !full_idx->Get(2).Unwrap().has_value());
+        [[maybe_unused]] auto refused_remove = full_idx->Remove(1);
+        assert(refused_remove.Code() == StatusCode::IOError && full_idx->Get(1).Unwrap().has_value());
+        [[maybe_unused]] auto refused_ckpt = full_idx->Checkpoint();
+        assert(refused_ckpt.Code() == StatusCode::IOError);
+        full_idx.reset();
+        assert(!std::filesystem::exists(full_ckpt_options.path + ".ckpt"));
+        std::filesystem::remove(full_ckpt_options.path);
+    }
+    cout << "\n\n\t\t [WAL] Check Passed! \n";
+
+    cout << "\n\n-----Running [CHECKPOINT] Check On Btree Index...--------\n";
+    {
+        using CkptIndexT = Index<int, TestStructB, IntThreeWayCmper>;
+        auto dir = std::filesystem::temp_directory_path();
+        auto wal_options = WalOptions{(dir / "btree_unittest_ckpt.wal").string()};
+        auto ckpt_options = CheckpointOptions{(dir / "btree_unittest_ckpt.pages").string(), 0};
+        for (auto path : {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt"}) {
+            std::filesystem::remove(path);
+        }
+        auto ref = std::map<int, long>{};
+        auto apply_ops = [&ref](CkptIndexT& ckpt_idx, int base) {
+            for (int i = base; i < base + ORDER_STAT_TEST_NUM; i++) {
+                auto v = TestStructB{};
+                v.score = i;
+                ckpt_idx.Insert(i, v).Unwrap();
+                ref[i] = i;
+            }
+            for (int i = base; i < base + ORDER_STAT_TEST_NUM; i += 4) {
+                ckpt_idx.Remove(i).Unwrap();
+                ref.erase(i);
+            }
+            ckpt_idx.DeleteRange(base + 50, base + 90).Unwrap();
+            ref.erase(ref.lower_bound(base + 50), ref.lower_bound(base + 90));
+        };
+        auto check_ref = [&ref](CkptIndexT& ckpt_idx) {
+            assert(ckpt_idx.Count(-1, 10 * ORDER_STAT_TEST_NUM).Unwrap() == ref.size());
+            for ([[maybe_unused]] auto [k, v] : ref) {
+                assert(ckpt_idx.Get(k).Unwrap().value().score == v);
+            }
+        };
+        // checkpoint drops the covered log, the child then crashes without a clean shutdown
+        auto pid = fork();
+        if (pid == 0) {
+            auto ckpt_idx = CkptIndexT::open(wal_options, ckpt_options).Unwrap();
+            apply_ops(*ckpt_idx, 0);
+            ckpt_idx->Checkpoint().Unwrap();
+            if (std::filesystem::file_size(wal_options.path) != 0) {
+                _exit(1);
+            }
+            apply_ops(*ckpt_idx, ORDER_STAT_TEST_NUM);
+            _exit(0);
+        }
+        auto child_status = 0;
+        waitpid(pid, &child_status, 0);
+        assert(WIFEXITED(child_status) && WEXITSTATUS(child_status) == 0);
+        apply_ops(*CkptIndexT::create(), 0);
+        apply_ops(*CkptIndexT::create(), ORDER_STAT_TEST_NUM);
+        {
+            // recovery: checkpoint + log tail
+            auto ckpt_idx = CkptIndexT::open(wal_options, ckpt_options).Unwrap();
+            check_ref(*ckpt_idx);
+            apply_ops(*ckpt_idx, 2 * ORDER_STAT_TEST_NUM);
+        }
+        // clean shutdown checkpointed everything
+        assert(std::filesystem::file_size(wal_options.path) == 0);
+        {
+            ckpt_options.interval_ms = 1;
+            auto ckpt_idx = CkptIndexT::open(wal_options, ckpt_options).Unwrap();
+            check_ref(*ckpt_idx);
+            apply_ops(*ckpt_idx, 3 * ORDER_STAT_TEST_NUM);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        auto ckpt_idx = CkptIndexT::open(wal_options, ckpt_options).Unwrap();
+        check_ref(*ckpt_idx);
+        ckpt_idx.reset();
+        for (auto path : {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt"}) {
+            std::filesystem::remove(path);
+        }
+    }
+    cout << "\n\n\t\t [CHECKPOINT] Check Passed! \n";
+
+    cout << "\n\n-----Running [SHADOW PAGING] Check On Btree Index...--------\n";
+    {
+        using CowIndexT = Index<int, TestStructB, IntThreeWayCmper>;
+        auto cow_options = ShadowOptions{(std::filesystem::temp_directory_path() / "btree_unittest_cow.pages").string()};
+        std::filesystem::remove(cow_options.path);
+        auto ref = std::map<int, long>{};
+        auto apply_ops = [&ref](CowIndexT& cow_idx, int base) {
+            for (int i = base; i < base + ORDER_STAT_TEST_NUM; i++) {
+                auto v = TestStructB{};
+                v.score = i;
+                cow_idx.Insert(i, v).Unwrap();
+                ref[i] = i;
+            }
+            for (int i = base; i < base + ORDER_STAT_TEST_NUM; i += 4) {
+                cow_idx.Remove(i).Unwrap();
+                ref.erase(i);
+            }
+            cow_idx.DeleteRange(base + 50, base + 90).Unwrap();
+            ref.erase(ref.lower_bound(base + 50), ref.lower_bound(base + 90));
+        };
+        auto check_ref = [&ref](CowIndexT& cow_idx) {
+            assert(cow_idx.Count(-1, 10 * ORDER_STAT_TEST_NUM).Unwrap() == ref.size());
+            for ([[maybe_unused]] auto [k, v] : ref) {
+                assert(cow_idx.Get(k).Unwrap().value().score == v);
+            }
+        };
+        // every returned mutation is in the file, the child crashes right after them
+        auto pid = fork();
+        if (pid == 0) {
+            auto cow_idx = CowIndexT::open(cow_options).Unwrap();
+            apply_ops(*cow_idx, 0);
+            _exit(0);
+        }
+        auto child_status = 0;
+        waitpid(pid, &child_status, 0);
+        assert(WIFEXITED(child_status) && WEXITSTATUS(child_status) == 0);
+        apply_ops(*CowIndexT::create(), 0);
+        auto cow_idx = CowIndexT::open(cow_options).Unwrap();
+        check_ref(*cow_idx);
+
+        // readers never block and always see a whole version: keys are added in order,
+        // a version with c keys >= base holds exactly base .. base + c - 1
+        auto base = 2 * ORDER_STAT_TEST_NUM;
+        auto done = std::atomic<bool>{false};
+        auto readers = std::vector<std::thread>{};
+        for (int t = 0; t < 3; t++) {
+            readers.emplace_back([&cow_idx, &done, base] {
+                [[maybe_unused]] size_t last_cnt = 0;
+                while (!done.load()) {
+                    auto cnt = cow_idx->Count(base, base + ORDER_STAT_TEST_NUM).Unwrap();
+                    assert(cnt >= last_cnt);
+                    if (cnt > 0) {
+                        assert(cow_idx->Get(base + (int)cnt - 1).Unwrap().has_value());
+                    }
+                    last_cnt = cnt;
+                }
+            });
+        }
+        for (int i = base; i < base + ORDER_STAT_TEST_NUM; i++) {
+            auto v = TestStructB{};
+            v.score = i;
+            cow_idx->Insert(i, v).Unwrap();
+            ref[i] = i;
+        }
+        done = true;
+        for (auto& th : readers) {
+            th.join();
+        }
+        // failed ops publish nothing
+        [[maybe_unused]] auto dup = cow_idx->Insert(base, TestStructB{});
+        assert(dup.Code() == StatusCode::KeyDuplicate);
+        cow_idx.reset();
+        // open reads no page, cold readers race to load the same ones
+        cow_idx = CowIndexT::open(cow_options).Unwrap();
+        auto cold_readers = std::vector<std::thread>{};
+        for (int t = 0; t < 4; t++) {
+            cold_readers.emplace_back([&cow_idx, &ref] {
+                for ([[maybe_unused]] auto [k, v] : ref) {
+                    assert(cow_idx->Get(k).Unwrap().value().score == v);
+                }
+            });
+        }
+        for (auto& th : cold_readers) {
+            th.join();
+        }
+        check_ref(*cow_idx);
+        cow_idx.reset();
+        std::filesystem::remove(cow_options.path);
+    }
+    cout << "\n\n\t\t [SHADOW PAGING] Check Passed! \n";
+
+    cout << "\n\n-----Running [MMAP] Check On Btree Index...--------\n";
+    {
+        using MmapIndexT = Index<int, TestStructB, IntThreeWayCmper>;
+        auto mmap_options = MmapOptions{(std::filesystem::temp_directory_path() / "btree_unittest_mmap.pages").string()};
+        mmap_options.flush_interval_ms = 0;
+        std::filesystem::remove(mmap_options.path);
+        auto ref = std::map<int, long>{};
+        auto apply_ops = [&ref](MmapIndexT& mmap_idx, int base) {
+            for (int i = base; i < base + ORDER_STAT_TEST_NUM; i++) {
+                auto v = TestStructB{};
+                v.score = i;
+                mmap_idx.Insert(i, v).Unwrap();
+                ref[i] = i;
+            }
+            for (int i = base; i < base + ORDER_STAT_TEST_NUM; i += 4) {
+                mmap_idx.Remove(i).Unwrap();
+                ref.erase(i);
+            }
+            mmap_idx.DeleteRange(base + 50, base + 90).Unwrap();
+            ref.erase(ref.lower_bound(base + 50), ref.lower_bound(base + 90));
+        };
+        auto check_ref = [&ref](MmapIndexT& mmap_idx) {
+            assert(mmap_idx.Count(-1, 10 * ORDER_STAT_TEST_NUM).Unwrap() == ref.size());
+            for ([[maybe_unused]] auto [k, v] : ref) {
+                assert(mmap_idx.Get(k).Unwrap().value().score == v);
+            }
+        };
+        {
+            auto mmap_idx = MmapIndexT::open(mmap_options).Unwrap();
+            apply_ops(*mmap_idx, 0);
+        }
+        {
+            // close flushed, pages are read in place from the mapping
+            mmap_options.advice = MmapAdvice::Sequential;
+            mmap_options.prefetch = true;
+            auto mmap_idx = MmapIndexT::open(mmap_options).Unwrap();
+            check_ref(*mmap_idx);
+            apply_ops(*mmap_idx, ORDER_STAT_TEST_NUM);
+            mmap_idx->Checkpoint().Unwrap();
+        }
+        auto mmap_idx = MmapIndexT::open(mmap_options).Unwrap();
+        check_ref(*mmap_idx);
+        mmap_idx.reset();
+        // a crash after unflushed writes is detected, the tree is repaired from the pages
+        auto pid = fork();
+        if (pid == 0) {
+            auto crash_idx = MmapIndexT::open(mmap_options).Unwrap();
+            apply_ops(*crash_idx, 2 * ORDER_STAT_TEST_NUM);
+            _exit(0);
+        }
+        auto child_status = 0;
+        waitpid(pid, &child_status, 0);
+        assert(WIFEXITED(child_status) && WEXITSTATUS(child_status) == 0);
+        auto no_repair_options = mmap_options;
+        no_repair_options.repair = false;
+        auto dirty_open = MmapIndexT::open(no_repair_options);
+        assert(dirty_open.Code() == StatusCode::IOError);
+        // the ops the child finished, on a reference index
+        auto crash_ref_idx = MmapIndexT::create();
+        apply_ops(*crash_ref_idx, 2 * ORDER_STAT_TEST_NUM);
+        mmap_idx = MmapIndexT::open(mmap_options).Unwrap();
+        check_ref(*mmap_idx);
+        auto repaired_stats = mmap_idx->GetTreeStats(true);
+        assert(repaired_stats.orphaned_pages == 0 && repaired_stats.keys == ref.size());
+        apply_ops(*mmap_idx, 3 * ORDER_STAT_TEST_NUM);
+        check_ref(*mmap_idx);
+        mmap_idx.reset();
+        // repaired and flushed: clean from now on
+        mmap_idx = MmapIndexT::open(no_repair_options).Unwrap();
+        check_ref(*mmap_idx);
+        mmap_idx.reset();
+        // pages that do not form a tree are rejected, not served
+        pid = fork();
+        if (pid == 0) {
+            auto crash_idx = MmapIndexT::open(mmap_options).Unwrap();
+            apply_ops(*crash_idx, 4 * ORDER_STAT_TEST_NUM);
+            _exit(0);
+        }
+        waitpid(pid, &child_status, 0);
+        assert(WIFEXITED(child_status) && WEXITSTATUS(child_status) == 0);
+        {
+            // header: magic | page size | clean | root pid
+            auto file = std::fstream(mmap_options.path, std::ios::in | std::ios::out | std::ios::binary);
+            auto root_pid = int32_t{};
+            file.seekg(3 * sizeof(uint32_t));
+            file.read(reinterpret_cast<char*>(&root_pid), sizeof(root_pid));
+            auto zeros = std::vector<char>(BTREE_PAGE_SIZE);
+            file.seekp((std::streamoff)(root_pid + 1) * BTREE_PAGE_SIZE);
+            file.write(zeros.data(), zeros.size());
+        }
+        auto corrupt_open = MmapIndexT::open(mmap_options);
+        assert(corrupt_open.Code() == StatusCode::IOError);
+        std::filesystem::remove(mmap_options.path);
+
+        // a full mapping fails the insert before any page changes, the tree stays whole
+        auto small_options = mmap_options;
+        small_options.map_size = 64 * BTREE_PAGE_SIZE;
+        auto small_idx = MmapIndexT::open(small_options).Unwrap();
+        auto inserted = 0;
+        auto insert_res = Status{};
+        while (true) {
+            auto v = TestStructB{};
+            v.score = inserted;
+            insert_res = small_idx->Insert(inserted, v);
+            if (!insert_res.Ok()) {
+                break;
+            }
+            inserted++;
+        }
+        assert(insert_res.Code() == StatusCode::OutOfSpace && inserted > 0);
+        assert(small_idx->Count(0, inserted + 1).Unwrap() == (size_t)inserted);
+        for (int i = 0; i < inserted; i++) {
+            assert(small_idx->Get(i).Unwrap().value().score == i);
+        }
+        [[maybe_unused]] auto del_res = small_idx->DeleteRange(0, inserted / 2);
+        assert(del_res.Ok());
+        small_idx.reset();
+        small_idx = MmapIndexT::open(small_options).Unwrap();
+        assert(small_idx->Count(0, inserted + 1).Unwrap() == (size_t)(inserted - inserted / 2));
+        small_idx.reset();
+        std::filesystem::remove(small_options.path);
+    }
+    cout << "\n\n\t\t [MMAP] Check Passed! \n";
+
+    cout << "\n\n-----Running [ASYNC IO] Check On Btree Index...--------\n";
+    {
+        using AsyncIndexT = Index<int, TestStructB, IntThreeWayCmper>;
+        auto dir = std::filesystem::temp_directory_path();
+        auto io_path = (dir / "btree_unittest_io.pages").string();
+        for (auto kind : {IoEngineKind::ThreadPool, IoEngineKind::IoUring}) {
+            // engine alone: one batch of writes, one batch of reads back
+            std::filesystem::remove(io_path);
+            auto engine = std::shared_ptr<IoEngine>(IoEngine::create(IoOptions{kind, 8, 2}));
+            assert(kind == IoEngineKind::IoUring || engine->Kind() == IoEngineKind::ThreadPool);
+            auto page_file = PageFile::open(io_path, engine).Unwrap();
+            auto images = std::vector<std::pair<int, std::vector<char>>>{};
+            for (int pid = 0; pid < 100; pid++) {
+                images.emplace_back(pid, std::vector<char>(BTREE_PAGE_SIZE, (char)pid));
+            }
+            page_file->WriteBatch(images).Unwrap();
+            auto bufs = std::vector<std::vector<char>>(101, std::vector<char>(BTREE_PAGE_SIZE));
+            auto reads = std::vector<std::pair<int, char*>>{};
+            for (int pid = 0; pid <= 100; pid++) {
+                reads.emplace_back(pid, bufs[pid].data());
+            }
+            auto read_ok = std::vector<int>(101, -1);
+            std::atomic<int> read_cnt{0};
+            page_file->ReadAsync(reads, [&read_ok, &read_cnt](int pid, bool ok) {
+                read_ok[pid] = ok;
+                read_cnt++;
+            });
+            while (read_cnt < 101) {
+                std::this_thread::yield();
+            }
+            for (int pid = 0; pid < 100; pid++) {
+                assert(read_ok[pid] == 1 && bufs[pid] == images[pid].second);
+            }
+            // past the end of file
+            assert(read_ok[100] == 0);
+            page_file.reset();
+            engine.reset();
+
+            // index: cold misses, read-ahead and batched checkpoint writes through the engine
+            auto wal_options = WalOptions{(dir / "btree_unittest_io.wal").string()};
+            auto ckpt_options = CheckpointOptions{io_path, 0, IoOptions{kind, 8, 2, 4}};
+            for (auto path : {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt"}) {
+                std::filesystem::remove(path);
+            }
+            {
+                auto async_idx = AsyncIndexT::open(wal_options, ckpt_options).Unwrap();
+                for (int i = 0; i < 4 * ORDER_STAT_TEST_NUM; i++) {
+                    auto v = TestStructB{};
+                    v.score = i;
+                    async_idx->Insert(i, v).Unwrap();
+                }
+            }
+            {
+                auto async_idx = AsyncIndexT::open(wal_options, ckpt_options).Unwrap();
+                auto readers = std::vector<std::thread>{};
+                for (int t = 0; t < 4; t++) {
+                    readers.emplace_back([&async_idx, t] {
+                        for (int i = t; i < 4 * ORDER_STAT_TEST_NUM; i += 4) {
+                            assert(async_idx->Get(i).Unwrap().value().score == i);
+                        }
+                    });
+                }
+                for (auto& th : readers) {
+                    th.join();
+                }
+                async_idx->DeleteRange(100, 3 * ORDER_STAT_TEST_NUM).Unwrap();
+            }
+            auto async_idx = AsyncIndexT::open(wal_options, ckpt_options).Unwrap();
+            // cold DeleteRange prefetches the subtrees it drops
+            [[maybe_unused]] auto deleted = async_idx->DeleteRange(-1, 10 * ORDER_STAT_TEST_NUM).Unwrap();
+            assert(deleted == 100 + ORDER_STAT_TEST_NUM);
+            assert(async_idx->Count(-1, 10 * ORDER_STAT_TEST_NUM).Unwrap() == 0);
+            async_idx.reset();
+            for (auto path : {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt"}) {
+                std::filesystem::remove(path);
+            }
+        }
+    }
+    cout << "\n\n\t\t [ASYNC IO] Check Passed! \n";
+
+    cout << "\n\n-----Running [DIRECT IO] Check On Btree Index...--------\n";
+    {
+        using DirectIndexT = Index<int, TestStructB, IntThreeWayCmper>;
+        auto dir = std::filesystem::temp_directory_path();
+        auto io_path = (dir / "btree_unittest_direct.pages").string();
+        // page buffers are aligned for O_DIRECT
+        assert(reinterpret_cast<uintptr_t>(Page(BTREE_PAGE_SIZE).data()) % PAGE_IO_ALIGN == 0);
+        assert(reinterpret_cast<uintptr_t>(Page(Page(100)).data()) % PAGE_IO_ALIGN == 0);
+        {
+            // unaligned caller buffers go through aligned copies, buffered fallback behaves the same
+            std::filesystem::remove(io_path);
+            auto page_file = PageFile::open(io_path, nullptr, true).Unwrap();
+            auto raw = std::vector<char>(2 * BTREE_PAGE_SIZE + 1);
+            auto unaligned = raw.data() + (reinterpret_cast<uintptr_t>(raw.data()) % PAGE_IO_ALIGN == 0 ? 1 : 0);
+            for (int pid = 0; pid < 8; pid++) {
+                std::fill(unaligned, unaligned + BTREE_PAGE_SIZE, (char)(pid + 1));
+                page_file->Write(pid, unaligned).Unwrap();
+            }
+            auto images = std::vector<std::pair<int, std::vector<char>>>{{8, std::vector<char>(BTREE_PAGE_SIZE, 9)}};
+            page_file->WriteBatch(images).Unwrap();
+            assert(page_file->PageCount().Unwrap() == 9);
+            for (int pid = 0; pid < 9; pid++) {
+                auto page = Page(BTREE_PAGE_SIZE);
+                page_file->Read(pid, page.data()).Unwrap();
+                page_file->Read(pid, unaligned).Unwrap();
+                assert(page.data()[0] == pid + 1 && page.data()[BTREE_PAGE_SIZE - 1] == pid + 1);
+                assert(std::equal(unaligned, unaligned + BTREE_PAGE_SIZE, page.data()));
+            }
+            assert(!page_file->Read(9, unaligned).Ok());
+        }
+        for (auto kind : {IoEngineKind::ThreadPool, IoEngineKind::IoUring}) {
+            auto wal_options = WalOptions{(dir / "btree_unittest_direct.wal").string()};
+            auto ckpt_options = CheckpointOptions{io_path, 0, IoOptions{kind, 8, 2, 2, true}};
+            for (auto path : {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt"}) {
+                std::filesystem::remove(path);
+            }
+            {
+                auto direct_idx = DirectIndexT::open(wal_options, ckpt_options).Unwrap();
+                for (int i = 0; i < 4 * ORDER_STAT_TEST_NUM; i++) {
+                    auto v = TestStructB{};
+                    v.score = i;
+                    direct_idx->Insert(i, v).Unwrap();
+                }
+                direct_idx->Checkpoint().Unwrap();
+                direct_idx->DeleteRange(0, ORDER_STAT_TEST_NUM).Unwrap();
+            }
+            auto direct_idx = DirectIndexT::open(wal_options, ckpt_options).Unwrap();
+            assert(direct_idx->Count(-1, 10 * ORDER_STAT_TEST_NUM).Unwrap() == 3 * ORDER_STAT_TEST_NUM);
+            for (int i = ORDER_STAT_TEST_NUM; i < 4 * ORDER_STAT_TEST_NUM; i++) {
+                assert(direct_idx->Get(i).Unwrap().value().score == i);
+            }
+            direct_idx.reset();
+            for (auto path : {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt"}) {
+                std::filesystem::remove(path);
+            }
+        }
+    }
+    cout << "\n\n\t\t [DIRECT IO] Check Passed! \n";
+
+    cout << "\n\n-----Running [BUFFER POOL] Check On Btree Index...--------\n";
+    {
+        for (auto kind : {ReplacerKind::LruK, ReplacerKind::TwoQ, ReplacerKind::ClockPro}) {
+            // replacer alone: pages re-referenced under pressure and priority pages survive a long scan
+            size_t capacity = 8;
+            auto replacer = Replacer::create(PoolOptions{capacity, kind, 2});
+            auto resident = std::set<int>{};
+            auto access = [&replacer, &resident, capacity](int pid, bool priority) {
+                replacer->RecordAccess(pid, priority);
+                resident.insert(pid);
+                while (resident.size() > capacity) {
+                    // pid 0 is pinned
+                    auto victim = replacer->Victim([&resident](int victim_pid) {
+                        return victim_pid != 0 && resident.contains(victim_pid);
+                    });
+                    assert(victim.has_value() && *victim != 0);
+                    resident.erase(*victim);
+                }
+            };
+            int next_pid = 1000;
+            for (int round = 0; round < 20; round++) {
+                for (int pid = 0; pid < 4; pid++) {
+                    access(pid, false);
+                }
+                for (int i = 0; i < 4; i++) {
+                    access(next_pid++, false);
+                }
+            }
+            for (int pid = 500; pid < 502; pid++) {
+                access(pid, true);
+            }
+            for (int i = 0; i < 200; i++) {
+                access(next_pid++, false);
+            }
+            for ([[maybe_unused]] auto pid : {0, 1, 2, 3, 500, 501}) {
+                assert(resident.contains(pid));
+            }
+            replacer->Remove(1);
+            resident.erase(1);
+            access(next_pid++, false);
+            assert(resident.size() == capacity);
+        }
+        {
+            // clock-pro: inner pages stay while ordinary pages turn hot around them
+            size_t capacity = 8;
+            auto replacer = Replacer::create(PoolOptions{capacity, ReplacerKind::ClockPro, 2});
+            auto resident = std::set<int>{};
+            auto access = [&replacer, &resident, capacity](int pid, bool priority) {
+                replacer->RecordAccess(pid, priority);
+                resident.insert(pid);
+                while (resident.size() > capacity) {
+                    auto victim = replacer->Victim([&resident](int victim_pid) { return resident.contains(victim_pid); });
+                    assert(victim.has_value());
+                    resident.erase(*victim);
+                }
+            };
+            for (int pid = 500; pid < 503; pid++) {
+                access(pid, true);
+            }
+            int next_pid = 1000;
+            for (int round = 0; round < 50; round++) {
+                for (int pid = round % 8; pid < round % 8 + 4; pid++) {
+                    access(pid, false);
+                    access(pid, false);
+                }
+                for (int i = 0; i < 8; i++) {
+                    access(next_pid++, false);
+                }
+            }
+            for ([[maybe_unused]] auto pid : {500, 501, 502}) {
+                assert(resident.contains(pid));
+            }
+            // nothing evictable: no victim, and the hot pages stay hot
+            auto hot_pages = replacer->HotPages();
+            [[maybe_unused]] auto victim = replacer->Victim([](int) { return false; });
+            assert(!victim.has_value());
+            assert(replacer->HotPages() == hot_pages);
+        }
+        for (auto kind : {ReplacerKind::LruK, ReplacerKind::TwoQ, ReplacerKind::ClockPro}) {
+            // bounded page table: clean pages leave, come back from the page file on the next miss
+            using PoolIndexT = Index<int, TestStructB, IntThreeWayCmper>;
+            auto dir = std::filesystem::temp_directory_path();
+            auto wal_options = WalOptions{(dir / "btree_unittest_pool.wal").string()};
+            auto ckpt_options = CheckpointOptions{(dir / "btree_unittest_pool.pages").string(), 0, IoOptions{},
+                PoolOptions{16, kind, 2}};
+            for (auto path : {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt"}) {
+                std::filesystem::remove(path);
+            }
+            auto pool_idx = PoolIndexT::open(wal_options, ckpt_options).Unwrap();
+            for (int i = 0; i < 20 * ORDER_STAT_TEST_NUM; i++) {
+                auto v = TestStructB{};
+                v.score = i;
+                pool_idx->Insert(i, v).Unwrap();
+            }
+            // dirty pages can not leave before a checkpoint wrote them
+            assert(pool_idx->GetPoolStats().evictions == 0);
+            pool_idx->Checkpoint().Unwrap();
+            for (int round = 0; round < 2; round++) {
+                for (int i = 0; i < 20 * ORDER_STAT_TEST_NUM; i += 7) {
+                    assert(pool_idx->Get(i).Unwrap().value().score == i);
+                }
+            }
+            [[maybe_unused]] auto stats = pool_idx->GetPoolStats();
+            assert(stats.evictions > 0 && stats.misses > 0 && stats.resident <= 16);
+            assert(stats.HitRate() > 0.0 && stats.HitRate() < 1.0);
+            // writes fetch evicted pages back and keep them until the next checkpoint
+            pool_idx->DeleteRange(ORDER_STAT_TEST_NUM, 19 * ORDER_STAT_TEST_NUM).Unwrap();
+            pool_idx->Checkpoint().Unwrap();
+            assert(pool_idx->Count(-1, 20 * ORDER_STAT_TEST_NUM).Unwrap() == 2 * ORDER_STAT_TEST_NUM);
+            pool_idx.reset();
+            pool_idx = PoolIndexT::open(wal_options, ckpt_options).Unwrap();
+            for (int i = 0; i < 20 * ORDER_STAT_TEST_NUM; i++) {
+                [[maybe_unused]] auto in_range = i >= ORDER_STAT_TEST_NUM && i < 19 * ORDER_STAT_TEST_NUM;
+                assert(pool_idx->Get(i).Unwrap().has_value() == !in_range);
+            }
+            pool_idx.reset();
+            for (auto path : {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt"}) {
+                std::filesystem::remove(path);
+            }
+        }
+    }
+    cout << "\n\n\t\t [BUFFER POOL] Check Passed! \n";
+
+    cout << "\n\n-----Running [WRITEBACK] Check On Btree Index...--------\n";
+    {
+        // no periodic checkpoint: only the dirty share drives writeback, writers wait past the limit
+        using WritebackIndexT = Index<int, TestStructB, IntThreeWayCmper>;
+        auto dir = std::filesystem::temp_directory_path();
+        auto wal_options = WalOptions{(dir / "btree_unittest_writeback.wal").string()};
+        auto ckpt_options = CheckpointOptions{(dir / "btree_unittest_writeback.pages").string(), 0, IoOptions{},
+            PoolOptions{64, ReplacerKind::LruK, 2}, WritebackOptions{0.25, 0.5, 1}};
+        for (auto path : {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt"}) {
+            std::filesystem::remove(path);
+        }
+        auto wb_idx = WritebackIndexT::open(wal_options, ckpt_options).Unwrap();
+        for (int i = 0; i < 20 * ORDER_STAT_TEST_NUM; i++) {
+            auto v = TestStructB{};
+            v.score = i;
+            wb_idx->Insert(i, v).Unwrap();
+        }
+        // pages were written back (and so could leave) without an explicit checkpoint
+        assert(wb_idx->GetPoolStats().evictions > 0);
+        wb_idx->Remove(0).Unwrap();
+        wb_idx.reset();
+        wb_idx = WritebackIndexT::open(wal_options, ckpt_options).Unwrap();
+        for (int i = 0; i < 20 * ORDER_STAT_TEST_NUM; i++) {
+            [[maybe_unused]] auto res = wb_idx->Get(i).Unwrap();
+            assert(res.has_value() == (i != 0));
+            assert(i == 0 || res.value().score == i);
+        }
+        wb_idx.reset();
+        for (auto path : {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt"}) {
+            std::filesystem::remove(path);
+        }
+    }
+    cout << "\n\n\t\t [WRITEBACK] Check Passed! \n";
+
+    cout << "\n\n-----Running [WARMUP] Check On Btree Index...--------\n";
+    {
+        for (auto kind : {ReplacerKind::LruK, ReplacerKind::TwoQ, ReplacerKind::ClockPro}) {
+            // pages hot before close are back in the page table soon after open, without misses
+            using WarmIndexT = Index<int, TestStructB, IntThreeWayCmper>;
+            auto dir = std::filesystem::temp_directory_path();
+            auto wal_options = WalOptions{(dir / "btree_unittest_warmup.wal").string()};
+            auto ckpt_options = CheckpointOptions{(dir / "btree_unittest_warmup.pages").string(), 0, IoOptions{},
+                PoolOptions{16, kind, 2}, WritebackOptions{}, WarmupOptions{true, 0}};
+            auto hot_path = ckpt_options.path + ".hot";
+            for (auto path : {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt", hot_path}) {
+                std::filesystem::remove(path);
+            }
+            auto warm_idx = WarmIndexT::open(wal_options, ckpt_options).Unwrap();
+            for (int i = 0; i < 20 * ORDER_STAT_TEST_NUM; i++) {
+                auto v = TestStructB{};
+                v.score = i;
+                warm_idx->Insert(i, v).Unwrap();
+            }
+            warm_idx->Checkpoint().Unwrap();
+            // a small hot set read again and again, read_hot_set counts the misses of one round
+            auto read_hot_set = [](auto& index) {
+                auto misses = index->GetPoolStats().misses;
+                for (int i = 0; i < 64; i++) {
+                    assert(index->Get(i).Unwrap().value().score == i);
+                }
+                return index->GetPoolStats().misses - misses;
+            };
+            for (int round = 0; round < 5; round++) {
+                read_hot_set(warm_idx);
+            }
+            warm_idx.reset();
+            auto hot_pids = LoadHotPages(hot_path).Unwrap();
+            assert(!hot_pids.empty() && hot_pids.size() <= 16);
+            // cold start: every page of the hot set is a miss
+            auto cold_options = ckpt_options;
+            cold_options.warmup.enabled = false;
+            warm_idx = WarmIndexT::open(wal_options, cold_options).Unwrap();
+            [[maybe_unused]] auto cold_misses = read_hot_set(warm_idx);
+            warm_idx.reset();
+            warm_idx = WarmIndexT::open(wal_options, ckpt_options).Unwrap();
+            for (int wait = 0; wait < 500 && warm_idx->GetPoolStats().resident < hot_pids.size(); wait++) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            assert(warm_idx->GetPoolStats().resident == hot_pids.size());
+            [[maybe_unused]] auto warm_misses = read_hot_set(warm_idx);
+            assert(warm_misses < cold_misses);
+            warm_idx.reset();
+            for (auto path : {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt", hot_path}) {
+                std::filesystem::remove(path);
+            }
+        }
+    }
+    cout << "\n\n\t\t [WARMUP] Check Passed! \n";
+
+    cout << "\n\n-----Running [PAGE SIZE] Check On Btree Index...--------\n";
+    {
+        // one process, two page sizes: 792 byte values get 4x the fanout on 16 KiB pages
+        struct WideValue {
+            long score;
+            std::array<char, 784> payload;
+        };
+        using SmallPageIndexT = Index<int, WideValue, IntThreeWayCmper, NoAggregate, 4096>;
+        using BigPageIndexT = Index<int, WideValue, IntThreeWayCmper, NoAggregate, 16384>;
+        using HugePageIndexT = Index<int, TestStructB, IntThreeWayCmper, NoAggregate, 65536>;
+        auto dir = std::filesystem::temp_directory_path();
+        auto wal_paths = std::array<std::string, 2>{(dir / "btree_unittest_small.wal").string(), 
+            (dir / "btree_unittest_big.wal").string()};
+        auto page_paths = std::array<std::string, 2>{(dir / "btree_unittest_small.pages").string(), 
+            (dir / "btree_unittest_big.pages").string()};
+        auto remove_files = [&wal_paths, &page_paths] {
+            for (int i = 0; i < 2; i++) {
+                for (auto path : {wal_paths[i], page_paths[i], page_paths[i] + ".ckpt"}) {
+                    std::filesystem::remove(path);
+                }
+            }
+        };
+        remove_files();
+        auto fill = [](auto& index) {
+            for (int i = 0; i < ORDER_STAT_TEST_NUM; i++) {
+                auto v = WideValue{};
+                v.score = i;
+                v.payload.back() = (char)i;
+                index->Insert(i, v).Unwrap();
+            }
+            index->Checkpoint().Unwrap();
+        };
+        auto check = [](auto& index) {
+            assert(index->Count(-1, ORDER_STAT_TEST_NUM).Unwrap() == (size_t)ORDER_STAT_TEST_NUM);
+            for (int i = 0; i < ORDER_STAT_TEST_NUM; i++) {
+                [[maybe_unused]] auto v = index->Get(i).Unwrap().value();
+                assert(v.score == i && v.payload.back() == (char)i);
+            }
+        };
+        {
+            auto small_idx = SmallPageIndexT::open(WalOptions{wal_paths[0]}, CheckpointOptions{page_paths[0]}).Unwrap();
+            auto big_idx = BigPageIndexT::open(WalOptions{wal_paths[1]}, CheckpointOptions{page_paths[1]}).Unwrap();
+            fill(small_idx);
+            fill(big_idx);
+            check(small_idx);
+            check(big_idx);
+        }
+        [[maybe_unused]] auto small_size = std::filesystem::file_size(page_paths[0]);
+        [[maybe_unused]] auto big_size = std::filesystem::file_size(page_paths[1]);
+        assert(small_size % 4096 == 0 && big_size % 16384 == 0);
+        assert(big_size / 16384 < small_size / 4096);
+        auto big_idx = BigPageIndexT::open(WalOptions{wal_paths[1]}, CheckpointOptions{page_paths[1]}).Unwrap();
+        check(big_idx);
+        big_idx.reset();
+        // a file is only opened with the page size it was made with
+        auto wrong_size_open = SmallPageIndexT::open(WalOptions{wal_paths[1]}, CheckpointOptions{page_paths[1]});
+        assert(wrong_size_open.Code() == StatusCode::IOError);
+        remove_files();
+
+        auto shadow_options = ShadowOptions{(dir / "btree_unittest_big.shadow").string(), false};
+        std::filesystem::remove(shadow_options.path);
+        {
+            auto shadow_idx = BigPageIndexT::open(shadow_options).Unwrap();
+            fill(shadow_idx);
+        }
+        auto shadow_idx = BigPageIndexT::open(shadow_options).Unwrap();
+        check(shadow_idx);
+        shadow_idx.reset();
+        auto wrong_shadow_open = SmallPageIndexT::open(shadow_options);
+        assert(wrong_shadow_open.Code() == StatusCode::IOError);
+        std::filesystem::remove(shadow_options.path);
+
+        auto mmap_options = MmapOptions{(dir / "btree_unittest_huge.mmap").string()};
+        mmap_options.flush_interval_ms = 0;
+        std::filesystem::remove(mmap_options.path);
+        {
+            auto mmap_idx = HugePageIndexT::open(mmap_options).Unwrap();
+            for (int i = 0; i < 10 * ORDER_STAT_TEST_NUM; i++) {
+                auto v = TestStructB{};
+                v.score = i;
+                mmap_idx->Insert(i, v).Unwrap();
+            }
+        }
+        auto mmap_idx = HugePageIndexT::open(mmap_options).Unwrap();
+        for (int i = 0; i < 10 * ORDER_STAT_TEST_NUM; i++) {
+            assert(mmap_idx->Get(i).Unwrap().value().score == i);
+        }
+        mmap_idx.reset();
+        using DefaultPageIndexT = Index<int, TestStructB, IntThreeWayCmper>;
+        auto wrong_mmap_open = DefaultPageIndexT::open(mmap_options);
+        assert(wrong_mmap_open.Code() == StatusCode::IOError);
+        std::filesystem::remove(mmap_options.path);
+    }
+    cout << "\n\n\t\t [PAGE SIZE] Check Passed! \n";
+
+    cout << "\n\n-----Running [LATENCY STATS] Check On Btree Index...--------\n";
+    {
+        // a bucket covers at most 1/16 of its latencies
+        for (uint64_t ns : {0ULL, 15ULL, 16ULL, 1000ULL, 123456789ULL, 1ULL << 45}) {
+            [[maybe_unused]] auto top = LatencySnapshot::BucketTop(LatencySnapshot::BucketOf(ns));
+            assert(top >= std::min<uint64_t>(ns, (1ULL << LatencySnapshot::MAX_BITS) - 1));
+            assert(ns >= (1ULL << LatencySnapshot::MAX_BITS) || top - ns <= ns / 16);
+        }
+        auto idx = Index<int, TestStructB, IntThreeWayCmper>::create();
+        int constexpr thread_cnt = 4;
+        int constexpr per_thread = ORDER_STAT_TEST_NUM;
+        auto workers = std::vector<std::thread>{};
+        for (int t = 0; t < thread_cnt; t++) {
+            workers.emplace_back([&idx, t] {
+                for (int i = t * per_thread; i < (t + 1) * per_thread; i++) {
+                    auto v = TestStructB{};
+                    v.score = i;
+                    idx->Insert(i, v).Unwrap();
+                    assert(idx->Get(i).Unwrap().value().score == i);
+                    idx->Update(i, v).Unwrap();
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (int i = 0; i < thread_cnt * per_thread; i++) {
+            idx->Remove(i).Unwrap();
+        }
+        [[maybe_unused]] auto total_ops = (uint64_t)(thread_cnt * per_thread);
+        auto stats = idx->Stats();
+        for (auto op : {&stats.insert, &stats.get, &stats.update, &stats.remove}) {
+            for ([[maybe_unused]] auto phase : {&op->total, &op->lock_wait, &op->descent}) {
+                assert(phase->count == total_ops);
+                assert(phase->p50_ns <= phase->p99_ns && phase->p99_ns <= phase->p999_ns);
+                assert(phase->p999_ns <= phase->max_ns);
+            }
+            assert(op->total.MeanNs() >= op->descent.MeanNs());
+        }
+        // splits / merges are rare, updates never rebalance
+        assert(stats.insert.split_merge.count > 0 && stats.insert.split_merge.count < total_ops);
+        assert(stats.remove.split_merge.count > 0 && stats.remove.split_merge.count < total_ops);
+        assert(stats.update.split_merge.count == 0 && stats.get.split_merge.count == 0);
+        assert(stats.insert.split_merge.Percentile(0.5) == stats.insert.split_merge.p50_ns);
+
+        // threads that come and go record into the shards of the threads before them
+        auto recorder = LatencyRecorder{};
+        for (int t = 0; t < 100; t++) {
+            auto worker = std::thread([&recorder] { auto timer = OpTimer(recorder, LatencyOp::Get); });
+            worker.join();
+        }
+        assert(recorder.ShardCnt() == 1);
+        assert(recorder.Collect().get.total.count == 100);
+    }
+    cout << "\n\n\t\t [LATENCY STATS] Check Passed! \n";
+
+    cout << "\n\n-----Running [TREE STATS] Check On Btree Index...--------\n";
+    {
+        // counters kept by the writers agree with a walk of every page
+        auto same_shape = [](const TreeStats& counted, const TreeStats& scanned) {
+            assert(!counted.scanned && scanned.scanned);
+            assert(counted.height == scanned.height && counted.keys == scanned.keys);
+            assert(counted.leaf_pages == scanned.leaf_pages && counted.inner_pages == scanned.inner_pages);
+            assert(counted.levels.size() == scanned.levels.size() && (int)scanned.levels.size() == scanned.height);
+            for (size_t level = 0; level < scanned.levels.size(); level++) {
+                [[maybe_unused]] auto& level_stats = scanned.levels[level];
+                assert(counted.levels[level].pages == level_stats.pages && counted.levels[level].slots == level_stats.slots);
+                assert(level_stats.min_fill <= level_stats.avg_fill && level_stats.avg_fill <= level_stats.max_fill);
+                assert(level_stats.max_fill < 1.0);
+            }
+            assert(counted.bytes_used == scanned.bytes_used && counted.bytes_used <= counted.bytes_allocated);
+        };
+        auto idx = Index<int, TestStructB, IntThreeWayCmper>::create();
+        auto empty_stats = idx->GetTreeStats();
+        assert(empty_stats.height == 1 && empty_stats.keys == 0 && empty_stats.leaf_pages == 1);
+        for (int i = 0; i < 20 * ORDER_STAT_TEST_NUM; i++) {
+            auto v = TestStructB{};
+            v.score = i;
+            idx->Insert(i, v).Unwrap();
+        }
+        auto full_stats = idx->GetTreeStats();
+        same_shape(full_stats, idx->GetTreeStats(true));
+        assert(full_stats.height > 2 && full_stats.keys == (size_t)(20 * ORDER_STAT_TEST_NUM));
+        assert(full_stats.orphaned_pages == 0);
+        for (int i = 0; i < 20 * ORDER_STAT_TEST_NUM; i += 3) {
+            idx->Remove(i).Unwrap();
+        }
+        idx->DeleteRange(ORDER_STAT_TEST_NUM, 10 * ORDER_STAT_TEST_NUM).Unwrap();
+        auto shrunk_stats = idx->GetTreeStats();
+        same_shape(shrunk_stats, idx->GetTreeStats(true));
+        assert(shrunk_stats.leaf_pages < full_stats.leaf_pages && shrunk_stats.orphaned_pages == 0);
+
+        // reopened: the first call walks the tree, later ones use the counters
+        auto dir = std::filesystem::temp_directory_path();
+        auto wal_options = WalOptions{(dir / "btree_unittest_tree_stats.wal").string()};
+        auto ckpt_options = CheckpointOptions{(dir / "btree_unittest_tree_stats.pages").string()};
+        for (auto path : {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt"}) {
+            std::filesystem::remove(path);
+        }
+        {
+            auto wal_idx = Index<int, TestStructB, IntThreeWayCmper>::open(wal_options, ckpt_options).Unwrap();
+            for (int i = 0; i < 4 * ORDER_STAT_TEST_NUM; i++) {
+                auto v = TestStructB{};
+                v.score = i;
+                wal_idx->Insert(i, v).Unwrap();
+            }
+            wal_idx->Checkpoint().Unwrap();
+        }
+        auto wal_idx = Index<int, TestStructB, IntThreeWayCmper>::open(wal_options, ckpt_options).Unwrap();
+        assert(wal_idx->GetTreeStats().scanned);
+        wal_idx->DeleteRange(0, 2 * ORDER_STAT_TEST_NUM).Unwrap();
+        auto wal_stats = wal_idx->GetTreeStats();
+        same_shape(wal_stats, wal_idx->GetTreeStats(true));
+        // pages removed since the checkpoint still hold their slots in the page file
+        assert(wal_stats.orphaned_pages > 0);
+        wal_idx.reset();
+        for (auto path : {wal_options.path, ckpt_options.path, ckpt_options.path + ".ckpt"}) {
+            std::filesystem::remove(path);
+        }
+
+        auto shadow_options = ShadowOptions{(dir / "btree_unittest_tree_stats.shadow").string(), false};
+        std::filesystem::remove(shadow_options.path);
+        auto shadow_idx = Index<int, TestStructB, IntThreeWayCmper>::open(shadow_options).Unwrap();
+        for (int i = 0; i < 4 * ORDER_STAT_TEST_NUM; i++) {
+            auto v = TestStructB{};
+            v.score = i;
+            shadow_idx->Insert(i, v).Unwrap();
+        }
+        shadow_idx->GetTreeStats();
+        for (int i = 0; i < 4 * ORDER_STAT_TEST_NUM; i += 2) {
+            shadow_idx->Remove(i).Unwrap();
+        }
+        auto shadow_stats = shadow_idx->GetTreeStats();
+        same_shape(shadow_stats, shadow_idx->GetTreeStats(true));
+        // freed pids go back to the store, nothing is held for them
+        assert(shadow_stats.orphaned_pages == 0);
+        shadow_idx.reset();
+        std::filesystem::remove(shadow_options.path);
+    }
+    cout << "\n\n\t\t [TREE STATS] Check Passed! \n";
+
+    cout << "\n\n-----Running [GRAPHVIZ STREAM] Check On Btree Index...--------\n";
+    {
+        auto gv_idx = Index<int, TestStructB, IntThreeWayCmper>::create();
+        for (int i = 0; i < 4 * ORDER_STAT_TEST_NUM; i++) {
+            auto v = TestStructB{};
+            v.score = i;
+            gv_idx->Insert(i, v).Unwrap();
+        }
+        [[maybe_unused]] auto node_cnt = [](const std::string& dot) {
+            size_t cnt = 0;
+            for (auto pos = dot.find("[label="); pos != std::string::npos; pos = dot.find("[label=", pos + 1)) {
+                cnt++;
+            }
+            return cnt;
+        };
+        auto stats = gv_idx->GetTreeStats();
+        assert(stats.height >= 3);
+        auto full = gv_idx->DumpGraphviz();
+        assert(full.starts_with("digraph BTree {\n") && full.ends_with("}\n"));
+        assert(node_cnt(full) == (size_t)(stats.leaf_pages + stats.inner_pages));
+        assert(full.find("removed") == std::string::npos);
+
+        // root and its children only, each child a box with its key count
+        auto shallow = std::stringstream{};
+        gv_idx->WriteGraphviz(shallow, GraphvizOptions{.max_depth = 1}).Unwrap();
+        [[maybe_unused]] auto root_fanout = stats.levels[stats.height - 1 - 1].pages;
+        assert(node_cnt(shallow.str()) == (size_t)(1 + root_fanout));
+        assert(shallow.str().find("subtree|") != std::string::npos);
+
+        auto sampled = std::stringstream{};
+        gv_idx->WriteGraphviz(sampled, GraphvizOptions{.sample_children = 2, .summarize_leaves = true}).Unwrap();
+        assert(node_cnt(sampled.str()) < node_cnt(full));
+        assert(sampled.str().find("more children") != std::string::npos);
+        assert(sampled.str().find("% full") != std::string::npos);
+
+        // through a file descriptor: the same document as in memory
+        auto path = (std::filesystem::temp_directory_path() / "btree_unittest.dot").string();
+        auto fd = ::open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        assert(fd >= 0);
+        gv_idx->WriteGraphviz(fd).Unwrap();
+        ::close(fd);
+        auto in = std::ifstream(path);
+        auto from_fd = std::string(std::istreambuf_iterator<char>(in), {});
+        assert(from_fd == full);
+        std::filesystem::remove(path);
+        [[maybe_unused]] auto bad_fd_res = gv_idx->WriteGraphviz(-1);
+        assert(!bad_fd_res.Ok());
+    }
+    cout << "\n\n\t\t [GRAPHVIZ STREAM] Check Passed! \n";
+
+    cout << "\n\n-----Running [MULTI GET] Check On Btree Index...--------\n";
+    {
+        using MultiGetIndexT = Index<int, TestStructB, IntThreeWayCmper>;
+        // even keys present, inner pages hold values too: hits end on every level
+        auto check_multi_get = [](MultiGetIndexT& mg_idx) {
+            auto keys = vector<int>{};
+            for (int i = -3; i < 8 * ORDER_STAT_TEST_NUM + 3; i++) {
+                keys.push_back(i);
+            }
+            shuffle(keys.begin(), keys.end(), mt19937(7));
+            for (size_t group_size : {1, 3, 8, 32, 100}) {
+                auto results = vector<optional<TestStructB>>(keys.size());
+                mg_idx.MultiGet(keys, results, group_size).Unwrap();
+                for (size_t i = 0; i < keys.size(); i++) {
+                    [[maybe_unused]] auto expected = mg_idx.Get(keys[i]).Unwrap();
+                    assert(results[i].has_value() == expected.has_value());
+                    assert(!results[i].has_value() || results[i]->score == expected->score);
+                    assert(results[i].has_value() == (keys[i] >= 0 && keys[i] < 8 * ORDER_STAT_TEST_NUM && keys[i] % 2 == 0));
+                }
+            }
+            auto empty = vector<optional<TestStructB>>{};
+            mg_idx.MultiGet(span<const int>{}, empty).Unwrap();
+            auto short_results = vector<optional<TestStructB>>(1);
+            assert(mg_idx.MultiGet(keys, short_results).Code() == StatusCode::OutOfSpace);
+        };
+        auto fill = [](MultiGetIndexT& mg_idx) {
+            for (int i = 0; i < 8 * ORDER_STAT_TEST_NUM; i += 2) {
+                auto v = TestStructB{};
+                v.score = i;
+                mg_idx.Insert(i, v).Unwrap();
+            }
+        };
+        auto mg_idx = MultiGetIndexT::create();
+        // single leaf root first
+        auto one = TestStructB{};
+        one.score = 0;
+        mg_idx->Insert(0, one).Unwrap();
+        auto root_results = vector<optional<TestStructB>>(2);
+        mg_idx->MultiGet(vector<int>{0, 1}, root_results).Unwrap();
+        assert(root_results[0].has_value() && !root_results[1].has_value());
+        mg_idx->Remove(0).Unwrap();
+        fill(*mg_idx);
+        assert(mg_idx->GetTreeStats().height >= 3);
+        check_multi_get(*mg_idx);
+
+        auto shadow_options = ShadowOptions{(std::filesystem::temp_directory_path() / "btree_unittest_multi_get.shadow").string(), false};
+        std::filesystem::remove(shadow_options.path);
+        auto shadow_idx = MultiGetIndexT::open(shadow_options).Unwrap();
+        fill(*shadow_idx);
+        check_multi_get(*shadow_idx);
+        shadow_idx.reset();
+        std::filesystem::remove(shadow_options.path);
+    }
+    cout << "\n\n\t\t [MULTI GET] Check Passed! \n";
+
+    cout << "\n\n-----Running [OP EXECUTOR] Check On Btree Index...--------\n";
+    {
+        using ExecIndexT = Index<int, TestStructB, IntThreeWayCmper>;
+        auto factory = IndexOpFactory<int, TestStructB, IntThreeWayCmper>{};
+        auto exec_idx = ExecIndexT::create();
+        auto shards = KeyRangeShards<int, IntThreeWayCmper>({1000, 2000, 3000});
+        assert(shards.ShardCnt() == 4 && shards.ShardOf(-5) == 0 && shards.ShardOf(1000) == 1 && shards.ShardOf(3999) == 3);
+        {
+            auto executor = OpExecutor(ExecutorOptions{4, 64});
+            // front-end threads queue and move on, the futures are collected afterwards
+            auto front_ends = vector<thread>{};
+            auto futures = vector<vector<future<void>>>(4);
+            for (int t = 0; t < 4; t++) {
+                front_ends.emplace_back([&, t] {
+                    for (int i = t; i < 4000; i += 4) {
+                        auto v = TestStructB{};
+                        v.score = i;
+                        futures[t].push_back(factory.submit_op<OPTYPE::INSERT>(executor, shards, exec_idx, i, v));
+                    }
+                });
+            }
+            for (auto& front_end : front_ends) {
+                front_end.join();
+            }
+            for (auto& thread_futures : futures) {
+                for (auto& f : thread_futures) {
+                    f.get();
+                }
+            }
+            assert(exec_idx->Count(0, 4000).Unwrap() == 4000);
+
+            // one shard runs on one worker, in submit order
+            auto shard_threads = vector<thread::id>(4);
+            auto affinity_ok = atomic<bool>{true};
+            auto shard_futures = vector<future<void>>{};
+            for (int i = 0; i < 4000; i += 37) {
+                auto shard = shards.ShardOf(i);
+                shard_futures.push_back(executor.Submit(shard, [&shard_threads, &affinity_ok, shard] {
+                    if (shard_threads[shard] == thread::id{}) {
+                        shard_threads[shard] = this_thread::get_id();
+                    } else if (shard_threads[shard] != this_thread::get_id()) {
+                        affinity_ok = false;
+                    }
+                }));
+            }
+            auto v = TestStructB{};
+            v.score = -1;
+            factory.submit_op<OPTYPE::UPDATE>(executor, shards, exec_idx, 1500, v);
+            factory.submit_op<OPTYPE::REMOVE>(executor, shards, exec_idx, 1500);
+            auto got = optional<TestStructB>{};
+            shard_futures.push_back(factory.submit_op<OPTYPE::GET>(executor, shards, exec_idx, 1500, got));
+            for (auto& f : shard_futures) {
+                f.get();
+            }
+            assert(affinity_ok && !got.has_value());
+
+            // a failed op throws from get(), or reaches the callback
+            auto dup = factory.submit_op<OPTYPE::INSERT>(executor, shards, exec_idx, 7, TestStructB{});
+            [[maybe_unused]] auto threw = false;
+            try {
+                dup.get();
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            assert(threw);
+            auto callback_error = promise<bool>{};
+            executor.Submit(0, factory.make_op<OPTYPE::INSERT>(exec_idx, 8, TestStructB{}), [&callback_error](exception_ptr error) {
+                callback_error.set_value(error != nullptr);
+            });
+            [[maybe_unused]] auto callback_failed = callback_error.get_future().get();
+            assert(callback_failed);
+        }
+        {
+            // bounded: a full queue blocks Submit, TrySubmit gives the op back
+            auto executor = OpExecutor(ExecutorOptions{1, 2});
+            auto release = promise<void>{};
+            auto blocker = executor.Submit([gate = release.get_future().share()] { gate.wait(); });
+            auto ran = atomic<int>{0};
+            auto queued = vector<future<void>>{};
+            auto op = OpExecutor::OpT([&ran] { ran++; });
+            while (true) {
+                auto res = executor.TrySubmit(0, op);
+                if (!res.has_value()) {
+                    break;
+                }
+                queued.push_back(std::move(*res));
+                op = [&ran] { ran++; };
+            }
+            assert(op != nullptr && queued.size() >= 1 && queued.size() <= 2);
+            release.set_value();
+            blocker.get();
+            for (auto& f : queued) {
+                f.get();
+            }
+            assert(ran == (int)queued.size());
+        }
+        // destruction runs what is still queued
+        auto drained = atomic<int>{0};
+        {
+            auto executor = OpExecutor(ExecutorOptions{2, 8});
+            for (int i = 0; i < 100; i++) {
+                executor.Submit(i, [&drained] { drained++; });
+            }
+        }
+        assert(drained == 100);
+    }
+    cout << "\n\n\t\t [OP EXECUTOR] Check Passed! \n";
+
+    cout << "\n\n-----Running [OP BATCH] Check On Btree Index...--------\n";
+    {
+        using BatchIndexT = Index<int, TestStructB, IntThreeWayCmper>;
+        auto factory = IndexOpFactory<int, TestStructB, IntThreeWayCmper>{};
+        auto batch_idx = BatchIndexT::create();
+        auto ref_idx = BatchIndexT::create();
+        auto rng = std::mt19937{50};
+        auto batch = factory.make_batch(2000);
+        auto got = vector<optional<TestStructB>>(2000);
+        auto expected = vector<optional<TestStructB>>(2000);
+        auto statuses = vector<Status>(2000);
+        for (int round = 0; round < 5; round++) {
+            // the same ops one by one on ref_idx, in add order
+            batch.Clear();
+            for (int i = 0; i < 2000; i++) {
+                auto k = (int)(rng() % 500);
+                auto v = TestStructB{};
+                v.score = round * 10000 + i;
+                switch (rng() % 4) {
+                case 0:
+                    batch.Add<OPTYPE::INSERT>(k, v);
+                    statuses[i] = ref_idx->Insert(k, v);
+                    break;
+                case 1:
+                    batch.Add<OPTYPE::UPDATE>(k, v);
+                    statuses[i] = ref_idx->Update(k, v);
+                    break;
+                case 2:
+                    batch.Add<OPTYPE::REMOVE>(k);
+                    statuses[i] = ref_idx->Remove(k);
+                    break;
+                default:
+                    batch.Add<OPTYPE::GET>(k, got[i]);
+                    expected[i] = ref_idx->Get(k).Unwrap();
+                    statuses[i] = Status{};
+                }
+            }
+            assert(batch.Size() == 2000);
+            [[maybe_unused]] auto failed = batch.Run(*batch_idx);
+            size_t ref_failed = 0;
+            for (int i = 0; i < 2000; i++) {
+                ref_failed += !statuses[i].Ok();
+                assert(batch.StatusAt(i).Code() == statuses[i].Code());
+            }
+            assert(failed == ref_failed && ref_failed > 0);
+            for (int i = 0; i < 2000; i++) {
+                assert(expected[i].has_value() == got[i].has_value());
+                assert(!expected[i] || expected[i]->score == got[i]->score);
+                expected[i].reset();
+                got[i].reset();
+            }
+            for (int k = 0; k < 500; k++) {
+                [[maybe_unused]] auto a = batch_idx->Get(k).Unwrap();
+                [[maybe_unused]] auto b = ref_idx->Get(k).Unwrap();
+                assert(a.has_value() == b.has_value() && (!a || a->score == b->score));
+            }
+        }
+    }
+    cout << "\n\n\t\t [OP BATCH] Check Passed! \n";
+
     cout << "\n\n =============CHECK RESULT: All Check Passed!==============\n\n" << endl;
 }
 